@@ -1,114 +1,84 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <stdbool.h>
 
+#include "sdt_types.h"
 #include "makedir.h"
-
-typedef enum SDTtype_e{
-    SDT_TYPE_1 = 0x0000,
-    SDT_TYPE_2 = 0x3039
-}SDTtype_t;
-
-/*********** SDT archive types ***********
-** There are 2 types of SDT archives identified by the SDT_type field in the SDT_header_t structure,
-** which differ as follows in their structure:
-**
-
-******** SDT_TYPE_1 ********
-- SDT_header_t
-- array of numFiles offsets to subfiles ("subFilesOffsets" in the code below); each subfile's data block is preceded by
-  a SDT_subfileHeader_t header, like this:
-    - subfile 1's subfileHeader_t
-    - subfile 1's data
-
-    - subfile 2's subfileHeader_t
-    - subfile 2's data
-    ....
-    - subfile N's subfileHeader_t
-    - subfile N's data
-
-******** SDT_TYPE_2 ********
-- SDT_header_t
-- array of numFiles offsets to subfiles' data("subFilesOffsets" in the code below); unlike SDT_TYPE_1, the offsets
-  point directly to subfiles' data this time, since the subfileHeader_t headers are organized sequentially
-  as an array and placed after the array of offsets.
-- array of numFiles subfileHeader_t headers.
-
-********************************************
-
-** In other words, in SDT_TYPE_1 archives each subfileHeader_t header precedes the subfile's data it's associated to,
-** and the offsets point to the headers which are then followed by the subfiles' data, while in SDT_TYPE_2 archives the
-** archive structure follows this scheme:
-
-    - SDT_header_t
-
-    - subfile 1's data offset
-    - subfile 2's data offset
-    ...
-    - subfile N's data offset
-
-    - subfile 1's subFileHeader_t header
-    - subfile 2's subFileHeader_t header
-    ...
-    - subfile N's subFileHeader_t header
-
-    - subfile 1's data
-    - subfile 2's data
-    ...
-    - subfile N's data
-
-** Confused yet? :)
-
-*****************************************/
-
-
-/* macros used for the values in the sndFormat field in the structure
-** SDT_subfileHeader_t.
-** It's obvious that this field is actually a bitfield containing
-** several flags indicating much more than the sound format
-** (notice how bit 15 is set for VAG ADPCM, and bit 13 is set for MP2),
-** but since the other fields aren't important for ripping purposes
-** I'll just keep it as it is, especially since I've only encountered the 3 values
-** listed below for all the entries I've examined.
-** A bitmask would have probably made this look a little more elegant, but whatever.
-*/
-#define SNDFORMAT_VAG   0x8010
-#define SNDFORMAT_MP2   0x2410
-#define SNDFORMAT_MP2_2 0x2510
-
-
-#define SWAP_ENDIAN16(x) (((x) >> 8) | ((x) << 8))
-#define SWAP_ENDIAN32(x) (((x)>>24) | (((x)>>8) & 0xFF00) | (((x)<<8) & 0x00FF0000) | ((x)<<24))
-
-typedef unsigned char   BYTE;
-typedef unsigned short  WORD;
-typedef unsigned int    DWORD;
-
-typedef struct SDT_header_s{
-    WORD numFiles;
-    WORD SDT_type;
-}SDT_header_t;
-
-typedef struct SDT_subfileHeader_s{
-    DWORD currHeaderSize;   // seems to be always 0x28
-    DWORD dataSize;
-    char fileName[16];
-    WORD sampleRate;
-    WORD sndFormat;   // 0x8010 for .VAG ADPCM, 0x2410/0x2510 for .MP2
-    DWORD unk1, unk2, unk3;
-}SDT_subfileHeader_t;
-
-typedef struct VAGhdr_s{            // All the values in this header must be big endian
-        char id[4];                 // VAGp
-        DWORD version;              // I guess it doesn't matter, so I'll place a 0 here and call it a day
-        DWORD reserved;             // I guess it doesn't matter either
-        DWORD dataSize;
-        DWORD samplingFrequency;
-        char  reserved2[12];
-        char  name[16];
-}VAGhdr_t;
+#include "dedup.h"
+#include "vag.h"
+#include "wav.h"
+#include "bank.h"
+#include "resample.h"
+#include "flac.h"
+#include "jobs.h"
+#include "threads.h"
+#include "analyze.h"
+
+#define DEFAULT_SAMPLES_PER_PEAK    256
+
+// output format for VAG subfiles (MP2 subfiles are always saved as they are)
+typedef enum outFormat_e{
+    OUT_VAG,    // ADPCM data with a VAG header
+    OUT_RAW,    // headerless ADPCM data, as stored in the archive
+    OUT_WAV,    // decoded 16-bit PCM
+    OUT_FLAC    // decoded and losslessly compressed
+}outFormat_t;
+
+// options specified on the command line
+typedef struct options_s{
+    outFormat_t outFormat;
+    const char *bankPath;   // if not NULL, all the subfiles are saved in a single sound bank
+    DWORD outRate;          // if not 0, decoded sounds are resampled to this rate
+    resampleQuality_t quality;
+    unsigned numThreads;    // worker threads used for encoding
+    bool dedup;
+    bool list;
+    bool check;
+    bool analyze;
+    DWORD samplesPerPeak;   // waveform peaks files' resolution, for -analyze
+}options_t;
+
+// an SDT archive's subfile headers, loaded without reading the subfiles' data
+typedef struct SDTindex_s{
+    SDTtype_t               SDTtype;
+    unsigned                numFiles;
+    long                    fileSize;
+
+    DWORD *                 offsets;        // the offsets array as stored in the archive
+    DWORD *                 dataOffsets;    // offsets to each subfile's data, for either archive type
+    SDT_subfileHeader_t *   headers;
+}SDTindex_t;
+
+// a subfile to be saved by the worker threads, encoding it first if needed
+typedef struct saveJob_s{
+    char *                  path;           // file path, or sound bank entry name
+    SDT_subfileHeader_t     SDT_subfileHeader;
+    bankFormat_t            bankFormat;
+    DWORD                   sampleRate;
+
+    short *                 pcm;            // if not NULL, samples to be encoded into data
+    DWORD                   numSamples;
+
+    BYTE *                  data;
+    DWORD                   dataSize;
+}saveJob_t;
+
+// a subfile to be analyzed by the worker threads
+typedef struct analyzeJob_s{
+    char *                  SDTname;        // archive the subfile comes from, for the report
+    char *                  peaksPath;
+    SDT_subfileHeader_t     SDT_subfileHeader;
+    BYTE *                  data;
+
+    bool                    decoded;        // false for MP2 subfiles, which can't be decoded
+    DWORD                   numSamples;
+    soundStats_t            stats;
+    short *                 peaks;
+}analyzeJob_t;
 
 
 // global variables(used only inside this module)
@@ -125,37 +95,141 @@ static VAGhdr_t VAGhdr = {
 static char path[FILENAME_MAX];
 static char *currDirPtr;
 
+static options_t options;
+
+static FILE *analysisReport_fp;
+static DWORD numAnalyzed;
+
+static const DWORD *sortIdxByOffset;    // used by cmpOffsets()
+
 // local functions declarations
+static void printUsage(void);
+static int parseOptions(int argc, char **argv);
+static void getReportPath(char *reportPath, const char *SDTpath, const char *reportName);
 static bool is_SDT(FILE *in_fp, SDTtype_t *SDTtype);
-static bool extract_SDT1(FILE *in_fp);
-static bool extract_SDT2(FILE *in_fp);
+static bool load_SDTindex(FILE *in_fp, SDTtype_t SDTtype, SDTindex_t *SDTindex);
+static void free_SDTindex(SDTindex_t *SDTindex);
+static void list_SDT(const char *SDTpath, SDTindex_t *SDTindex);
+static unsigned check_SDT(const char *SDTpath, SDTindex_t *SDTindex);
+static int cmpOffsets(const void *a, const void *b);
+static bool extract_SDT(FILE *in_fp, SDTindex_t *SDTindex);
 static bool save_subFile(BYTE *subFileData, SDT_subfileHeader_t *SDT_subfileHeader);
+static bool decode_subFile(const BYTE *subfileData, const SDT_subfileHeader_t *SDT_subfileHeader, short **pcm, DWORD *numSamples, DWORD *sampleRate);
+static bool submit_saveJob(const SDT_subfileHeader_t *SDT_subfileHeader, bankFormat_t bankFormat, DWORD sampleRate,
+                           short *pcm, DWORD numSamples, const BYTE *data, DWORD dataSize);
+static bool process_saveJob(void *arg);
+static bool commit_saveJob(void *arg);
+static bool write_outFile(const char *outPath, const SDT_subfileHeader_t *SDT_subfileHeader, const void *hdr, DWORD hdrSize, const BYTE *data, DWORD dataSize);
+static bool analyze_SDT(FILE *in_fp, const char *SDTpath, SDTindex_t *SDTindex);
+static bool process_analyzeJob(void *arg);
+static bool commit_analyzeJob(void *arg);
+static const char *formatDB(char *buf, double dB);
 
 
 int main(int argc, char **argv){
     FILE *in_fp;
 
-    unsigned i;
+    int i, firstFileIdx;
     bool success;
+    unsigned numProblems = 0;
 
     SDTtype_t SDTtype;
+    SDTindex_t SDTindex;
 
     puts("\t\tQuake 3 Revolution SDT extractor by Yagotzirck");
 
     if(argc == 1){
-        fputs("Usage: Q3R_SDT_Extractor.exe <file1.SDT> <file2.SDT> ... <fileN.SDT>", stderr);
+        printUsage();
         return 1;
     }
 
-    for(i = 1; i < argc; i++){
+    firstFileIdx = parseOptions(argc, argv);
+
+    if(firstFileIdx == argc){
+        fputs("You need to specify at least one file after the options!\n", stderr);
+        return 1;
+    }
+
+    if(options.dedup && !dedup_init())
+        return 1;
+
+    if(options.bankPath != NULL && !(options.list || options.check || options.analyze) && !bank_create(options.bankPath))
+        return 1;
+
+    if(options.outFormat == OUT_FLAC && !(options.list || options.check || options.analyze) && !jobs_init(options.numThreads, process_saveJob, commit_saveJob))
+        return 1;
+
+    /* the subfiles of all the archives are analyzed by the worker threads as a single batch,
+    ** with the results saved in the same order as the subfiles
+    */
+    if(options.analyze){
+        char reportPath[FILENAME_MAX];
+
+        getReportPath(reportPath, argv[firstFileIdx], "SDT_analysis_report.txt");
+
+        if((analysisReport_fp = fopen(reportPath, "w")) == NULL){
+            fprintf(stderr, "Couldn't create file %s: %s\n", reportPath, strerror(errno));
+            return 1;
+        }
+
+        if(!jobs_init(options.numThreads, process_analyzeJob, commit_analyzeJob))
+            return 1;
+
+        fputs("# archive\tsubfile\tformat\trate\tsamples\tpeak (dBFS)\tRMS (dBFS)\tloudness (LUFS)\tclipped samples\n", analysisReport_fp);
+    }
+
+    for(i = firstFileIdx; i < argc; i++){
         if((in_fp = fopen(argv[i], "rb")) == NULL){
             fprintf(stderr, "Couldn't open %s: %s\n", argv[i], strerror(errno));
             continue;
         }
 
+        /* listing and checking only need the offsets and headers arrays, a few KB at most;
+        ** disable stdio's buffering so that reading each SDT_TYPE_1 header doesn't
+        ** fill a whole buffer (setvbuf() must come before any other operation on the stream)
+        */
+        if(options.list || options.check)
+            setvbuf(in_fp, NULL, _IONBF, 0);
+
         // check if the opened file is a valid SDT file and get the SDT archive type while we're at it
         if(!is_SDT(in_fp, &SDTtype)){
             fprintf(stderr, "%s doesn't appear to be a valid SDT file\n", argv[i]);
+            fclose(in_fp);
+            ++numProblems;
+            continue;
+        }
+
+        if(options.list || options.check){
+            strcpy(path, argv[i]);
+
+            if(load_SDTindex(in_fp, SDTtype, &SDTindex)){
+                if(options.list)
+                    list_SDT(argv[i], &SDTindex);
+
+                if(options.check)
+                    numProblems += check_SDT(argv[i], &SDTindex);
+
+                free_SDTindex(&SDTindex);
+            }
+            else
+                ++numProblems;
+
+            fclose(in_fp);
+            continue;
+        }
+
+        if(options.analyze){
+            printf("Analyzing %s...\n", argv[i]);
+
+            if(load_SDTindex(in_fp, SDTtype, &SDTindex)){
+                if(!analyze_SDT(in_fp, argv[i], &SDTindex))
+                    ++numProblems;
+
+                free_SDTindex(&SDTindex);
+            }
+            else
+                ++numProblems;
+
             fclose(in_fp);
             continue;
         }
@@ -164,20 +238,53 @@ int main(int argc, char **argv){
         ** with the same name as the SDT file but without the .SDT file extension and
         ** with "_extracted" appended to it
         */
-        strcpy(path, argv[i]);
-        currDirPtr = path + strlen(path) - 4;
-        strcpy(currDirPtr, "_extracted/");
-        makeDir(path);
-        currDirPtr = currDirPtr + strlen(currDirPtr);
+        if(options.bankPath == NULL){
+            strcpy(path, argv[i]);
+            currDirPtr = path + strlen(path) - 4;
+            strcpy(currDirPtr, "_extracted/");
+            makeDir(path);
+            currDirPtr = currDirPtr + strlen(currDirPtr);
+        }
+
+        /* sound bank entries are named "<folder>/<SDT file name without extension>/<subfile name>" instead,
+        ** with the folder the SDT file is in, so that the same-named archives of SOUND, SOUND_FR and SOUND_IT
+        ** don't collide; the folder is left out if the path doesn't name it
+        */
+        else{
+            const char *fileNamePtr = argv[i] + strlen(argv[i]);
+            const char *folderPtr;
+
+            while(fileNamePtr != argv[i] && fileNamePtr[-1] != '/' && fileNamePtr[-1] != '\\')
+                --fileNamePtr;
+
+            folderPtr = fileNamePtr == argv[i] ? fileNamePtr : fileNamePtr - 1;
+            while(folderPtr != argv[i] && folderPtr[-1] != '/' && folderPtr[-1] != '\\')
+                --folderPtr;
+
+            path[0] = '\0';
+            if(fileNamePtr - folderPtr > 1 && strncmp(folderPtr, "./", 2) != 0 && strncmp(folderPtr, ".\\", 2) != 0
+            && strncmp(folderPtr, "../", 3) != 0 && strncmp(folderPtr, "..\\", 3) != 0)
+                sprintf(path, "%.*s/", (int)(fileNamePtr - folderPtr - 1), folderPtr);
+
+            strcat(path, fileNamePtr);
+            currDirPtr = path + strlen(path) - 4;
+            strcpy(currDirPtr, "/");
+            currDirPtr = currDirPtr + strlen(currDirPtr);
+        }
         currDirPtr[sizeof(((SDT_subfileHeader_t*)0)->fileName)] = '\0';
 
         // handle the SDT subfiles' extraction according to the archive type
         printf("Extracting %s...", argv[i]);
 
-        if(SDTtype == SDT_TYPE_1)
-            success = extract_SDT1(in_fp);
-        else
-            success = extract_SDT2(in_fp);
+        success = load_SDTindex(in_fp, SDTtype, &SDTindex);
+        if(success){
+            success = extract_SDT(in_fp, &SDTindex);
+            free_SDTindex(&SDTindex);
+        }
+
+        // wait for the worker threads to save this archive's subfiles
+        if(options.outFormat == OUT_FLAC)
+            success = jobs_wait() && success;
 
         fclose(in_fp);
         if(success)
@@ -185,11 +292,229 @@ int main(int argc, char **argv){
 
     }
 
-    return 0;
+    if(options.outFormat == OUT_FLAC && !(options.list || options.check || options.analyze))
+        jobs_free();
+
+    if(options.analyze){
+        jobs_wait();
+        jobs_free();
+
+        fprintf(analysisReport_fp, "# %u subfiles analyzed\n", numAnalyzed);
+        fclose(analysisReport_fp);
+
+        printf("Analysis of %u subfiles saved in SDT_analysis_report.txt, in the same folder as %s\n", numAnalyzed, argv[firstFileIdx]);
+    }
+
+    if(options.bankPath != NULL && !(options.list || options.check || options.analyze))
+        bank_close();
+
+    resample_free();
+
+    if(options.dedup){
+        char reportPath[FILENAME_MAX];
+
+        getReportPath(reportPath, argv[firstFileIdx], "SDT_dedup_report.txt");
+        dedup_writeReport(reportPath);
+        dedup_free();
+    }
+
+    // a nonzero exit code lets scripts know that -check found problems
+    return (options.check && numProblems) ? 1 : 0;
 }
 
 // local functions definitions
 
+static void printUsage(void){
+    fputs(
+        "Usage: Q3R_SDT_Extractor.exe [options] <file1.SDT> <file2.SDT> ... <fileN.SDT>\n"
+        "where [options] can be any of the following:\n\n"
+
+        "-out_vag\n\t"
+            "Save ADPCM subfiles as .vag files, with a VAG header (default.)\n\n"
+
+        "-out_raw\n\t"
+            "Save ADPCM subfiles as .raw files, containing the ADPCM data only.\n\n"
+
+        "-out_wav\n\t"
+            "Decode ADPCM subfiles and save them as 16-bit PCM .wav files.\n\n"
+
+        "-out_flac\n\t"
+            "Decode ADPCM subfiles and save them as lossless .flac files.\n\n"
+
+        "-j <threads>\n\t"
+            "Number of threads used for -out_flac encoding and -analyze\n\t"
+            "(default: number of logical processors.)\n\n"
+
+        "-rate <Hz>\n\t"
+            "Resample the decoded sounds to the given sample rate\n\t"
+            "(-out_wav and -out_flac only.)\n\n"
+
+        "-quality <fast|medium|best>\n\t"
+            "Resampling quality: the higher the quality, the longer the filters\n\t"
+            "and the narrower the transition band (default: medium.)\n\n"
+
+        "-bank <file>\n\t"
+            "Save all the subfiles of all the specified archives, in the format\n\t"
+            "chosen with the options above, in a single sound bank file with a\n\t"
+            "hash table index (PCM data is stored without the .wav header.)\n\t"
+            "Each sound is named <folder>/<archive>/<subfile>, e.g.\n\t"
+            "SOUND_FR/MUSIC/track01.mp2, after the folder the archive is in.\n\n"
+
+        "-dedup\n\t"
+            "Save only one copy of the subfiles which are byte-identical across\n\t"
+            "the specified archives (e.g. the same sound in SOUND, SOUND_FR and\n\t"
+            "SOUND_IT), hard linking the duplicates to it; the mapping is saved\n\t"
+            "in SDT_dedup_report.txt, in the same folder as the first archive.\n\n"
+
+        "-list\n\t"
+            "Don't extract anything; print name, format, sample rate, size\n\t"
+            "and offset of each subfile, reading only the archive's headers.\n\n"
+
+        "-check\n\t"
+            "Don't extract anything; check the subfiles' offsets and sizes against\n\t"
+            "the archive's size and each other, reading only the archive's headers.\n\t"
+            "The exit code is nonzero if any problem is found.\n\n"
+
+        "-analyze\n\t"
+            "Don't extract anything; decode the ADPCM subfiles in memory and save\n\t"
+            "their peak, RMS and integrated loudness (ITU-R BS.1770) levels and\n\t"
+            "the number of clipped samples in SDT_analysis_report.txt, in the same\n\t"
+            "folder as the first archive, along with a waveform peaks file for each\n\t"
+            "subfile in a folder named after the archive, with \"_peaks\" appended.\n\t"
+            "The subfiles are analyzed in parallel (see -j.)\n\n"
+
+        "-peaks <samples>\n\t"
+            "Number of samples for each min/max pair in the waveform peaks files\n\t"
+            "(default: 256.)\n\n"
+
+        "MP2 subfiles are always saved as .mp2 files, regardless of the options.\n"
+        "If no option is specified, each subfile is saved as a separate .vag/.mp2 file.\n",
+
+      stderr
+    );
+}
+
+/* parseOptions(): parse the options preceding the SDT files' list (case insensitive,
+** with either one or two leading hyphens), returning the index of the first file in argv
+*/
+static int parseOptions(int argc, char **argv){
+    char option_lowercase[FILENAME_MAX];
+    int i, j;
+
+    memset(&options, 0, sizeof(options));
+    options.quality = RESAMPLE_MEDIUM;
+    options.numThreads = getNumCPUs();
+    options.samplesPerPeak = DEFAULT_SAMPLES_PER_PEAK;
+
+    for(i = 1; i < argc && argv[i][0] == '-'; ++i){
+        const char *option = argv[i][1] == '-' ? argv[i] + 1 : argv[i];
+
+        // get rid of case sensitivity
+        for(j = 0; option[j] != '\0' && j < sizeof(option_lowercase) - 1; j++)
+            option_lowercase[j] = tolower(option[j]);
+        option_lowercase[j] = '\0';
+
+        if(strcmp(option_lowercase, "-dedup") == 0)
+            options.dedup = true;
+
+        else if(strcmp(option_lowercase, "-out_vag") == 0)
+            options.outFormat = OUT_VAG;
+
+        else if(strcmp(option_lowercase, "-out_raw") == 0)
+            options.outFormat = OUT_RAW;
+
+        else if(strcmp(option_lowercase, "-out_wav") == 0)
+            options.outFormat = OUT_WAV;
+
+        else if(strcmp(option_lowercase, "-out_flac") == 0)
+            options.outFormat = OUT_FLAC;
+
+        else if(strcmp(option_lowercase, "-j") == 0 && i + 1 < argc){
+            options.numThreads = strtoul(argv[++i], NULL, 10);
+
+            if(options.numThreads == 0){
+                fprintf(stderr, "Invalid number of threads: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if(strcmp(option_lowercase, "-bank") == 0 && i + 1 < argc)
+            options.bankPath = argv[++i];
+
+        else if(strcmp(option_lowercase, "-rate") == 0 && i + 1 < argc){
+            options.outRate = strtoul(argv[++i], NULL, 10);
+
+            if(options.outRate == 0 || options.outRate > 0xFFFF){
+                fprintf(stderr, "Invalid sample rate: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if(strcmp(option_lowercase, "-quality") == 0 && i + 1 < argc){
+            ++i;
+
+            if(strcmp(argv[i], "fast") == 0)
+                options.quality = RESAMPLE_FAST;
+            else if(strcmp(argv[i], "medium") == 0)
+                options.quality = RESAMPLE_MEDIUM;
+            else if(strcmp(argv[i], "best") == 0)
+                options.quality = RESAMPLE_BEST;
+            else{
+                fprintf(stderr, "Invalid resampling quality: %s (must be fast, medium or best)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if(strcmp(option_lowercase, "-analyze") == 0)
+            options.analyze = true;
+
+        else if(strcmp(option_lowercase, "-peaks") == 0 && i + 1 < argc){
+            options.samplesPerPeak = strtoul(argv[++i], NULL, 10);
+
+            if(options.samplesPerPeak == 0){
+                fprintf(stderr, "Invalid number of samples per peak: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        else if(strcmp(option_lowercase, "-list") == 0)
+            options.list = true;
+
+        else if(strcmp(option_lowercase, "-check") == 0)
+            options.check = true;
+
+        // no supported option has been found; abort the program
+        else{
+            fprintf(stderr, "The option %s is unsupported.\n"
+                            "Invoke this exe without any parameters to see a list of available options.\n", argv[i]);
+
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(options.dedup && options.bankPath != NULL){
+        fputs("-dedup can't be used along with -bank.\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.outRate != 0 && options.outFormat != OUT_WAV && options.outFormat != OUT_FLAC){
+        fputs("-rate only applies to decoded sounds; use it along with -out_wav or -out_flac.\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    return i;
+}
+
+// getReportPath(): build the path of a report file placed in the same folder as the SDT file
+static void getReportPath(char *reportPath, const char *SDTpath, const char *reportName){
+    const char *fileNamePtr = SDTpath + strlen(SDTpath);
+
+    while(fileNamePtr != SDTpath && fileNamePtr[-1] != '/' && fileNamePtr[-1] != '\\')
+        --fileNamePtr;
+
+    snprintf(reportPath, FILENAME_MAX, "%.*s%s", (int)(fileNamePtr - SDTpath), SDTpath, reportName);
+}
+
 static bool is_SDT(FILE *in_fp, SDTtype_t *SDTtype){
     SDT_header_t SDT_header;
     DWORD firstSubfileOffset = 0;
@@ -234,131 +559,315 @@ static bool is_SDT(FILE *in_fp, SDTtype_t *SDTtype){
     return true;
 }
 
-static bool extract_SDT1(FILE *in_fp){
-    SDT_header_t        SDT_header;
-    DWORD*              subFilesOffsets;
-    SDT_subfileHeader_t SDT_subfileHeader;
-    BYTE*               subfileData;
-
+/* load_SDTindex(): read the offsets array and the subfile headers of either archive type,
+** without touching the subfiles' data (in SDT_TYPE_1 archives, each header is read on its own
+** from its offset.)
+** Headers which can't be read (e.g. due to an offset past the end of the file) are zeroed,
+** so that they'll be reported by check_SDT().
+*/
+static bool load_SDTindex(FILE *in_fp, SDTtype_t SDTtype, SDTindex_t *SDTindex){
+    SDT_header_t SDT_header;
     unsigned i, numFiles;
 
+    fseek(in_fp, 0, SEEK_END);
+    SDTindex->fileSize = ftell(in_fp);
+    rewind(in_fp);
+
     // get the SDT header
     fread(&SDT_header, sizeof(SDT_header), 1, in_fp);
 
     numFiles = SDT_header.numFiles;
+    SDTindex->numFiles = numFiles;
+    SDTindex->SDTtype = SDTtype;
 
     // allocate and read the array of subfiles' offsets
-    if((subFilesOffsets = malloc(numFiles * sizeof(*subFilesOffsets))) == NULL){
-        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's offsets array\n", numFiles * sizeof(*subFilesOffsets), path);
+    if((SDTindex->offsets = malloc(numFiles * sizeof(*SDTindex->offsets))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's offsets array\n", (unsigned)(numFiles * sizeof(*SDTindex->offsets)), path);
         return false;
     }
-    fread(subFilesOffsets, sizeof(*subFilesOffsets), numFiles, in_fp);
 
-    // save the subfiles
-    for(i = 0; i < numFiles; i++){
-        fseek(in_fp, subFilesOffsets[i], SEEK_SET);
-        fread(&SDT_subfileHeader, sizeof(SDT_subfileHeader), 1, in_fp);
+    if((SDTindex->dataOffsets = malloc(numFiles * sizeof(*SDTindex->dataOffsets))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's offsets array\n", (unsigned)(numFiles * sizeof(*SDTindex->dataOffsets)), path);
+        free(SDTindex->offsets);
+        return false;
+    }
 
-        if((subfileData = malloc(SDT_subfileHeader.dataSize)) == NULL){
-            fprintf(stderr, "\n\tCouldn't allocate %u bytes for %.16s's sound data\n", SDT_subfileHeader.dataSize, SDT_subfileHeader.fileName);
-            free(subFilesOffsets);
-            return false;
-        }
+    // allocate the array of subfiles' headers
+    if((SDTindex->headers = calloc(numFiles, sizeof(*SDTindex->headers))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's subfiles headers' array\n", (unsigned)(numFiles * sizeof(*SDTindex->headers)), path);
+        free(SDTindex->offsets);
+        free(SDTindex->dataOffsets);
+        return false;
+    }
 
-        fread(subfileData, 1, SDT_subfileHeader.dataSize, in_fp);
+    if(fread(SDTindex->offsets, sizeof(*SDTindex->offsets), numFiles, in_fp) != numFiles)
+        memset(SDTindex->offsets, 0xFF, numFiles * sizeof(*SDTindex->offsets));
 
-        if(!save_subFile(subfileData, &SDT_subfileHeader)){
-            free(subfileData);
-            free(subFilesOffsets);
-            return false;
+    /* SDT_TYPE_1: the offsets point to the headers, which precede the subfiles' data;
+    ** SDT_TYPE_2: the headers follow the offsets array, and the offsets point directly to the subfiles' data.
+    */
+    if(SDTtype == SDT_TYPE_1)
+        for(i = 0; i < numFiles; ++i){
+            if( SDTindex->offsets[i] >= SDTindex->fileSize ||
+                fseek(in_fp, SDTindex->offsets[i], SEEK_SET) != 0 ||
+                !fread(&SDTindex->headers[i], sizeof(SDTindex->headers[i]), 1, in_fp)
+            )
+                memset(&SDTindex->headers[i], 0, sizeof(SDTindex->headers[i]));
+
+            SDTindex->dataOffsets[i] = SDTindex->offsets[i] + sizeof(SDTindex->headers[i]);
         }
-
-        free(subfileData);
+    else{
+        fread(SDTindex->headers, sizeof(*SDTindex->headers), numFiles, in_fp);
+        memcpy(SDTindex->dataOffsets, SDTindex->offsets, numFiles * sizeof(*SDTindex->offsets));
     }
 
-    free(subFilesOffsets);
     return true;
 }
 
+static void free_SDTindex(SDTindex_t *SDTindex){
+    free(SDTindex->offsets);
+    free(SDTindex->dataOffsets);
+    free(SDTindex->headers);
+}
 
-static bool extract_SDT2(FILE *in_fp){
-    SDT_header_t            SDT_header;
-    DWORD*                  subFilesOffsets;
-    SDT_subfileHeader_t*    SDT_subfileHeaderArr;
-    BYTE*                   subfileData;
+// list_SDT(): print the information about each subfile stored in its header
+static void list_SDT(const char *SDTpath, SDTindex_t *SDTindex){
+    SDT_subfileHeader_t *hdr;
+    const char *format;
+    unsigned i;
 
-    unsigned i, numFiles;
+    printf("%s: SDT_TYPE_%c, %u subfiles, %ld bytes\n",
+            SDTpath, SDTindex->SDTtype == SDT_TYPE_1 ? '1' : '2', SDTindex->numFiles, SDTindex->fileSize);
 
-    // get the SDT header
-    fread(&SDT_header, sizeof(SDT_header), 1, in_fp);
+    printf("  %5s  %-16s  %-6s  %6s  %10s  %10s\n", "#", "name", "format", "rate", "size", "offset");
 
-    numFiles = SDT_header.numFiles;
+    for(i = 0; i < SDTindex->numFiles; ++i){
+        hdr = &SDTindex->headers[i];
 
-    // allocate and read the array of subfiles' offsets
-    if((subFilesOffsets = malloc(numFiles * sizeof(*subFilesOffsets))) == NULL){
-        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's offsets array\n", numFiles * sizeof(*subFilesOffsets), path);
-        return false;
+        switch(hdr->sndFormat){
+            case SNDFORMAT_VAG:
+                format = "VAG";
+                break;
+
+            case SNDFORMAT_MP2:
+            case SNDFORMAT_MP2_2:
+                format = "MP2";
+                break;
+
+            default:
+                format = "?";
+        }
+
+        printf("  %5u  %-16.16s  %-6s  %6u  %10u  0x%08X\n",
+                i, hdr->fileName, format, hdr->sampleRate, hdr->dataSize, SDTindex->dataOffsets[i]);
     }
-    fread(subFilesOffsets, sizeof(*subFilesOffsets), numFiles, in_fp);
+}
 
-    // allocate and read the array of subfiles' headers
-    if((SDT_subfileHeaderArr = malloc(numFiles * sizeof(*SDT_subfileHeaderArr))) == NULL){
-        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's subfiles headers' array\n", numFiles * sizeof(*SDT_subfileHeaderArr), path);
-        free(subFilesOffsets);
-        return false;
+/* check_SDT(): validate the offsets and sizes against the file length and against each other,
+** returning the number of problems found
+*/
+static unsigned check_SDT(const char *SDTpath, SDTindex_t *SDTindex){
+    SDT_subfileHeader_t *hdr;
+    DWORD *sortedIdx;
+    DWORD dataStart, prevEnd;
+    unsigned i, numProblems = 0;
+
+    // the subfiles' data can't overlap the header/offsets/headers arrays
+    dataStart = sizeof(SDT_header_t) + SDTindex->numFiles * sizeof(*SDTindex->offsets);
+    if(SDTindex->SDTtype == SDT_TYPE_2)
+        dataStart += SDTindex->numFiles * sizeof(*SDTindex->headers);
+
+    if(dataStart > SDTindex->fileSize){
+        printf("%s: the offsets/headers arrays (%u bytes) exceed the file size (%ld bytes)\n", SDTpath, dataStart, SDTindex->fileSize);
+        return 1;
     }
-    fread(SDT_subfileHeaderArr, sizeof(*SDT_subfileHeaderArr), numFiles, in_fp);
 
+    for(i = 0; i < SDTindex->numFiles; ++i){
+        hdr = &SDTindex->headers[i];
+
+        if(SDTindex->offsets[i] < dataStart || SDTindex->dataOffsets[i] > SDTindex->fileSize){
+            printf("%s: subfile %u's offset (0x%08X) is out of bounds\n", SDTpath, i, SDTindex->offsets[i]);
+            ++numProblems;
+            continue;
+        }
+
+        // if the header size is wrong, the offset doesn't point to a header and the other fields are garbage
+        if(hdr->currHeaderSize != sizeof(*hdr)){
+            printf("%s: subfile %u has an invalid header size (0x%X)\n", SDTpath, i, hdr->currHeaderSize);
+            ++numProblems;
+            continue;
+        }
+
+        if(hdr->dataSize > SDTindex->fileSize - SDTindex->dataOffsets[i]){
+            printf("%s: subfile %u (%.16s) ends past the end of the file (offset 0x%08X, %u bytes)\n",
+                    SDTpath, i, hdr->fileName, SDTindex->dataOffsets[i], hdr->dataSize);
+            ++numProblems;
+        }
+
+        if(hdr->sndFormat != SNDFORMAT_VAG && hdr->sndFormat != SNDFORMAT_MP2 && hdr->sndFormat != SNDFORMAT_MP2_2){
+            printf("%s: subfile %u (%.16s) has an unknown sound format (0x%04X)\n", SDTpath, i, hdr->fileName, hdr->sndFormat);
+            ++numProblems;
+        }
+    }
+
+    // look for overlapping subfiles, by scanning them in offset order
+    if(numProblems == 0 && SDTindex->numFiles > 1){
+        if((sortedIdx = malloc(SDTindex->numFiles * sizeof(*sortedIdx))) == NULL){
+            fprintf(stderr, "Couldn't allocate %u bytes for %s's overlap check\n", (unsigned)(SDTindex->numFiles * sizeof(*sortedIdx)), SDTpath);
+            return 1;
+        }
+
+        for(i = 0; i < SDTindex->numFiles; ++i)
+            sortedIdx[i] = i;
+
+        sortIdxByOffset = SDTindex->offsets;
+        qsort(sortedIdx, SDTindex->numFiles, sizeof(*sortedIdx), cmpOffsets);
+
+        prevEnd = SDTindex->dataOffsets[sortedIdx[0]] + SDTindex->headers[sortedIdx[0]].dataSize;
+
+        for(i = 1; i < SDTindex->numFiles; ++i){
+            if(SDTindex->offsets[sortedIdx[i]] < prevEnd){
+                printf("%s: subfile %u (%.16s) overlaps subfile %u (%.16s)\n", SDTpath,
+                        sortedIdx[i], SDTindex->headers[sortedIdx[i]].fileName,
+                        sortedIdx[i-1], SDTindex->headers[sortedIdx[i-1]].fileName);
+                ++numProblems;
+            }
+
+            prevEnd = SDTindex->dataOffsets[sortedIdx[i]] + SDTindex->headers[sortedIdx[i]].dataSize;
+        }
+
+        free(sortedIdx);
+    }
+
+    printf("%s: %s (%u subfiles, %u problems)\n", SDTpath, numProblems ? "FAILED" : "OK", SDTindex->numFiles, numProblems);
+
+    return numProblems;
+}
+
+static int cmpOffsets(const void *a, const void *b){
+    DWORD offsetA = sortIdxByOffset[*(const DWORD *)a];
+    DWORD offsetB = sortIdxByOffset[*(const DWORD *)b];
+
+    return (offsetA > offsetB) - (offsetA < offsetB);
+}
+
+
+static bool extract_SDT(FILE *in_fp, SDTindex_t *SDTindex){
+    SDT_subfileHeader_t*    SDT_subfileHeader;
+    BYTE*                   subfileData;
+
+    unsigned i;
 
     // save the subfiles
-    for(i = 0; i < numFiles; i++){
+    for(i = 0; i < SDTindex->numFiles; i++){
+        SDT_subfileHeader = &SDTindex->headers[i];
 
-        if((subfileData = malloc(SDT_subfileHeaderArr[i].dataSize)) == NULL){
-            fprintf(stderr, "\n\tCouldn't allocate %u bytes for %.16s's sound data\n", SDT_subfileHeaderArr[i].dataSize, SDT_subfileHeaderArr[i].fileName);
-            free(subFilesOffsets);
-            free(SDT_subfileHeaderArr);
+        if((subfileData = malloc(SDT_subfileHeader->dataSize)) == NULL){
+            fprintf(stderr, "\n\tCouldn't allocate %u bytes for %.16s's sound data\n", SDT_subfileHeader->dataSize, SDT_subfileHeader->fileName);
             return false;
         }
-        fseek(in_fp, subFilesOffsets[i], SEEK_SET);
-        fread(subfileData, 1, SDT_subfileHeaderArr[i].dataSize, in_fp);
+        fseek(in_fp, SDTindex->dataOffsets[i], SEEK_SET);
+        fread(subfileData, 1, SDT_subfileHeader->dataSize, in_fp);
 
-        if(!save_subFile(subfileData, &SDT_subfileHeaderArr[i])){
+        if(!save_subFile(subfileData, SDT_subfileHeader)){
             free(subfileData);
-            free(subFilesOffsets);
-            free(SDT_subfileHeaderArr);
             return false;
         }
 
         free(subfileData);
     }
 
-    free(subFilesOffsets);
-    free(SDT_subfileHeaderArr);
     return true;
 }
 
 
 static bool save_subFile(BYTE *subfileData, SDT_subfileHeader_t *SDT_subfileHeader){
-    FILE *out_fp;
-
     enum fileExtension_e{
         EXT_VAG,
-        EXT_MP2
-    }fileExtension;
+        EXT_MP2,
+        EXT_RAW,
+        EXT_WAV,
+        EXT_FLAC
+    }fileExtension = EXT_VAG;
 
-    const char *strFileExtension[2] = {".vag", ".mp2"};
+    const char *strFileExtension[5] = {".vag", ".mp2", ".raw", ".wav", ".flac"};
 
     // not every filename terminates with ".mp2", ".vag", or a null-character, due to the 16 characters limit
     char *fileNameFixExt;
 
+    // header and sound data to be saved, according to the output format
+    const void *    hdr = NULL;
+    DWORD           hdrSize = 0;
+    const BYTE *    outData = subfileData;
+    DWORD           outDataSize = SDT_subfileHeader->dataSize;
+    bankFormat_t    bankFormat = BANK_FORMAT_VAG;
+
+    wavHdr_t        wavHdr;
+    short *         pcm = NULL;
+    DWORD           numSamples;
+    DWORD           sampleRate = SDT_subfileHeader->sampleRate;
+    bool            success;
+
     switch(SDT_subfileHeader->sndFormat){
         case SNDFORMAT_VAG:
-            fileExtension = EXT_VAG;
+            switch(options.outFormat){
+                // if the sound data is ADPCM we need to put a VAG header at the beginning of the file
+                case OUT_VAG:
+                    fileExtension = EXT_VAG;
+                    bankFormat = BANK_FORMAT_VAG;
+
+                    VAGhdr.dataSize = SWAP_ENDIAN32(SDT_subfileHeader->dataSize);
+                    VAGhdr.samplingFrequency = ((WORD)SWAP_ENDIAN16(SDT_subfileHeader->sampleRate)) << 16;
+                    strncpy(VAGhdr.name, SDT_subfileHeader->fileName, sizeof(VAGhdr.name));
+
+                    hdr = &VAGhdr;
+                    hdrSize = sizeof(VAGhdr);
+                    break;
+
+                case OUT_RAW:
+                    fileExtension = EXT_RAW;
+                    bankFormat = BANK_FORMAT_ADPCM;
+                    break;
+
+                case OUT_WAV:
+                    fileExtension = EXT_WAV;
+                    bankFormat = BANK_FORMAT_PCM16;
+
+                    if(!decode_subFile(subfileData, SDT_subfileHeader, &pcm, &numSamples, &sampleRate))
+                        return false;
+
+                    outData = (BYTE *)pcm;
+                    outDataSize = numSamples * sizeof(*pcm);
+
+                    // sound banks store the PCM samples as they are, along with their sample rate
+                    if(options.bankPath == NULL){
+                        wav_initHdr(&wavHdr, sampleRate, outDataSize);
+                        hdr = &wavHdr;
+                        hdrSize = sizeof(wavHdr);
+                    }
+                    break;
+
+                // the samples are decoded here and encoded by the worker threads
+                case OUT_FLAC:
+                    fileExtension = EXT_FLAC;
+                    bankFormat = BANK_FORMAT_FLAC;
+
+                    if(!decode_subFile(subfileData, SDT_subfileHeader, &pcm, &numSamples, &sampleRate))
+                        return false;
+
+                    outData = NULL;
+                    outDataSize = 0;
+                    break;
+            }
             break;
 
+        /* there's no MP2 decoder in here, so MP2 data is always saved as it is,
+        ** regardless of the output format
+        */
         case SNDFORMAT_MP2:
         case SNDFORMAT_MP2_2:
             fileExtension = EXT_MP2;
+            bankFormat = BANK_FORMAT_MP2;
             break;
 
         default:
@@ -376,21 +885,288 @@ static bool save_subFile(BYTE *subfileData, SDT_subfileHeader_t *SDT_subfileHead
 
     strcpy(fileNameFixExt, strFileExtension[fileExtension]);
 
-    if((out_fp = fopen(path, "wb")) == NULL){
-        fprintf(stderr, "\n\tCouldn't create file %s: %s\n", path, strerror(errno));
+    // when encoding, everything is saved by the worker threads, in the same order as the subfiles
+    if(options.outFormat == OUT_FLAC)
+        return submit_saveJob(SDT_subfileHeader, bankFormat, sampleRate, pcm, numSamples, outData, outDataSize);
+
+    if(options.bankPath != NULL)
+        success = bank_addSound(path, bankFormat, sampleRate, hdr, hdrSize, outData, outDataSize);
+    else
+        success = write_outFile(path, SDT_subfileHeader, hdr, hdrSize, outData, outDataSize);
+
+    free(pcm);
+    return success;
+}
+
+/* decode_subFile(): decode a VAG subfile's sound data to 16-bit PCM, resampling it if requested;
+** on success *pcm points to a buffer which must be freed by the caller
+*/
+static bool decode_subFile(const BYTE *subfileData, const SDT_subfileHeader_t *SDT_subfileHeader, short **pcm, DWORD *numSamples, DWORD *sampleRate){
+    short *resampled;
+    DWORD numResampled;
+
+    if((*pcm = malloc(vag_numSamples(SDT_subfileHeader->dataSize) * sizeof(**pcm) + 1)) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %.16s's decoded sound data\n",
+                (unsigned)(vag_numSamples(SDT_subfileHeader->dataSize) * sizeof(**pcm)), SDT_subfileHeader->fileName);
+        return false;
+    }
+
+    *numSamples = vag_decode(subfileData, SDT_subfileHeader->dataSize, *pcm);
+    *sampleRate = SDT_subfileHeader->sampleRate;
+
+    if(options.outRate == 0 || options.outRate == *sampleRate || *sampleRate == 0)
+        return true;
+
+    numResampled = resample_numSamples(*numSamples, *sampleRate, options.outRate);
+
+    if((resampled = malloc(numResampled * sizeof(*resampled) + 1)) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %.16s's resampled sound data\n",
+                (unsigned)(numResampled * sizeof(*resampled)), SDT_subfileHeader->fileName);
+        free(*pcm);
+        return false;
+    }
+
+    if(!resample(*pcm, *numSamples, *sampleRate, resampled, options.outRate, options.quality)){
+        free(resampled);
+        free(*pcm);
+        return false;
+    }
+
+    free(*pcm);
+    *pcm = resampled;
+    *numSamples = numResampled;
+    *sampleRate = options.outRate;
+    return true;
+}
+
+/* submit_saveJob(): queue a subfile to be saved (and encoded first, if pcm isn't NULL) by the worker threads;
+** the job takes ownership of pcm, and gets its own copy of data and of the current path
+*/
+static bool submit_saveJob(const SDT_subfileHeader_t *SDT_subfileHeader, bankFormat_t bankFormat, DWORD sampleRate,
+                           short *pcm, DWORD numSamples, const BYTE *data, DWORD dataSize){
+    saveJob_t *job;
+
+    if( (job = calloc(1, sizeof(*job))) == NULL ||
+        (job->path = malloc(strlen(path) + 1)) == NULL ||
+        (pcm == NULL && (job->data = malloc(dataSize + 1)) == NULL)
+    ){
+        fprintf(stderr, "\n\tCouldn't allocate memory to queue %.16s\n", SDT_subfileHeader->fileName);
+
+        if(job != NULL)
+            free(job->path);
+
+        free(job);
+        free(pcm);
         return false;
     }
 
-    // if the sound data is ADPCM we need to put a VAG header at the beginning of the file
-    if(fileExtension == EXT_VAG){
-        VAGhdr.dataSize = SWAP_ENDIAN32(SDT_subfileHeader->dataSize);
-        VAGhdr.samplingFrequency = ((WORD)SWAP_ENDIAN16(SDT_subfileHeader->sampleRate)) << 16;
-        strncpy(VAGhdr.name, SDT_subfileHeader->fileName, sizeof(VAGhdr.name));
+    strcpy(job->path, path);
+    job->SDT_subfileHeader = *SDT_subfileHeader;
+    job->bankFormat = bankFormat;
+    job->sampleRate = sampleRate;
+    job->pcm = pcm;
+    job->numSamples = numSamples;
 
-        fwrite(&VAGhdr, sizeof(VAGhdr), 1, out_fp);
+    if(pcm == NULL){
+        memcpy(job->data, data, dataSize);
+        job->dataSize = dataSize;
     }
 
-    fwrite(subfileData, 1, SDT_subfileHeader->dataSize, out_fp);
+    return jobs_submit(job);
+}
+
+// process_saveJob(): runs on the worker threads, in parallel
+static bool process_saveJob(void *arg){
+    saveJob_t *job = arg;
+    bool success;
+
+    if(job->pcm == NULL)
+        return true;
+
+    success = flac_encode(job->pcm, job->numSamples, job->sampleRate, &job->data, &job->dataSize);
+
+    free(job->pcm);
+    job->pcm = NULL;
+    return success;
+}
+
+// commit_saveJob(): runs on the worker threads, one job at a time and in submission order
+static bool commit_saveJob(void *arg){
+    saveJob_t *job = arg;
+    bool success = false;
+
+    if(job->data != NULL){
+        if(options.bankPath != NULL)
+            success = bank_addSound(job->path, job->bankFormat, job->sampleRate, NULL, 0, job->data, job->dataSize);
+        else
+            success = write_outFile(job->path, &job->SDT_subfileHeader, NULL, 0, job->data, job->dataSize);
+    }
+
+    free(job->path);
+    free(job->data);
+    free(job);
+    return success;
+}
+
+// write_outFile(): save a subfile's header (if any) and sound data to the file specified by outPath
+static bool write_outFile(const char *outPath, const SDT_subfileHeader_t *SDT_subfileHeader, const void *hdr, DWORD hdrSize, const BYTE *data, DWORD dataSize){
+    FILE *out_fp;
+
+    /* in dedup mode, subfiles identical to an already extracted one are linked to it instead of being saved again;
+    ** any file already present is removed first, since it might be a hard link to another subfile's copy
+    */
+    if(options.dedup){
+        if(dedup_linkDuplicate(data, dataSize, SDT_subfileHeader, hdrSize, outPath))
+            return true;
+
+        remove(outPath);
+    }
+
+    if((out_fp = fopen(outPath, "wb")) == NULL){
+        fprintf(stderr, "\n\tCouldn't create file %s: %s\n", outPath, strerror(errno));
+        return false;
+    }
+
+    if(hdrSize)
+        fwrite(hdr, 1, hdrSize, out_fp);
+
+    fwrite(data, 1, dataSize, out_fp);
     fclose(out_fp);
+
+    if(options.dedup)
+        dedup_register(data, dataSize, SDT_subfileHeader, hdrSize, outPath);
+
+    return true;
+}
+
+/* analyze_SDT(): queue the archive's subfiles to be analyzed by the worker threads;
+** the waveform peaks files are saved in a folder named after the archive, with "_peaks" appended
+*/
+static bool analyze_SDT(FILE *in_fp, const char *SDTpath, SDTindex_t *SDTindex){
+    SDT_subfileHeader_t *SDT_subfileHeader;
+    analyzeJob_t *job;
+    char *fileNameFixExt;
+    const char *SDTname = SDTpath + strlen(SDTpath);
+    unsigned i;
+
+    while(SDTname != SDTpath && SDTname[-1] != '/' && SDTname[-1] != '\\')
+        --SDTname;
+
+    strcpy(path, SDTpath);
+    currDirPtr = path + strlen(path) - 4;
+    strcpy(currDirPtr, "_peaks/");
+    makeDir(path);
+    currDirPtr = currDirPtr + strlen(currDirPtr);
+    currDirPtr[sizeof(((SDT_subfileHeader_t*)0)->fileName)] = '\0';
+
+    for(i = 0; i < SDTindex->numFiles; i++){
+        SDT_subfileHeader = &SDTindex->headers[i];
+
+        memcpy(currDirPtr, SDT_subfileHeader->fileName, sizeof(SDT_subfileHeader->fileName));
+
+        fileNameFixExt = currDirPtr;
+        while(*fileNameFixExt != '.' && *fileNameFixExt != '\0')
+            ++fileNameFixExt;
+
+        strcpy(fileNameFixExt, ".peaks");
+
+        if( (job = calloc(1, sizeof(*job))) == NULL ||
+            (job->SDTname = malloc(strlen(SDTname) + 1)) == NULL ||
+            (job->peaksPath = malloc(strlen(path) + 1)) == NULL ||
+            (job->data = malloc(SDT_subfileHeader->dataSize + 1)) == NULL
+        ){
+            fprintf(stderr, "\tCouldn't allocate %u bytes for %.16s's sound data\n", SDT_subfileHeader->dataSize, SDT_subfileHeader->fileName);
+
+            if(job != NULL){
+                free(job->SDTname);
+                free(job->peaksPath);
+            }
+
+            free(job);
+            return false;
+        }
+
+        strcpy(job->SDTname, SDTname);
+        strcpy(job->peaksPath, path);
+        job->SDT_subfileHeader = *SDT_subfileHeader;
+
+        fseek(in_fp, SDTindex->dataOffsets[i], SEEK_SET);
+        fread(job->data, 1, SDT_subfileHeader->dataSize, in_fp);
+
+        jobs_submit(job);
+    }
+
     return true;
 }
+
+// process_analyzeJob(): runs on the worker threads, in parallel
+static bool process_analyzeJob(void *arg){
+    analyzeJob_t *job = arg;
+    SDT_subfileHeader_t *hdr = &job->SDT_subfileHeader;
+    short *pcm;
+
+    // there's no MP2 decoder in here
+    if(hdr->sndFormat != SNDFORMAT_VAG)
+        return true;
+
+    if((pcm = malloc(vag_numSamples(hdr->dataSize) * sizeof(*pcm) + 1)) == NULL){
+        fprintf(stderr, "\tCouldn't allocate %u bytes for %.16s's decoded sound data\n", (unsigned)(vag_numSamples(hdr->dataSize) * sizeof(*pcm)), hdr->fileName);
+        return false;
+    }
+
+    job->numSamples = vag_decode(job->data, hdr->dataSize, pcm);
+    analyze_sound(pcm, job->numSamples, hdr->sampleRate, &job->stats);
+
+    // the stats are still reported if there's no memory for the peaks, only the peaks file is skipped
+    if((job->peaks = malloc(analyze_numPeaks(job->numSamples, options.samplesPerPeak) * 2 * sizeof(*job->peaks) + 1)) == NULL)
+        fprintf(stderr, "\tCouldn't allocate %u bytes for %.16s's waveform peaks\n",
+                (unsigned)(analyze_numPeaks(job->numSamples, options.samplesPerPeak) * 2 * sizeof(*job->peaks)), hdr->fileName);
+    else
+        analyze_peaks(pcm, job->numSamples, options.samplesPerPeak, job->peaks);
+
+    job->decoded = true;
+
+    free(pcm);
+    return job->peaks != NULL;
+}
+
+// commit_analyzeJob(): runs on the worker threads, one job at a time and in submission order
+static bool commit_analyzeJob(void *arg){
+    analyzeJob_t *job = arg;
+    SDT_subfileHeader_t *hdr = &job->SDT_subfileHeader;
+    char peak[16], rms[16], loudness[16];
+    bool success = true;
+
+    if(job->decoded){
+        if(job->peaks != NULL)
+            success = analyze_writePeaks(job->peaksPath, hdr->sampleRate, job->numSamples, options.samplesPerPeak, job->peaks);
+
+        fprintf(analysisReport_fp, "%s\t%.16s\tVAG\t%u\t%u\t%s\t%s\t%s\t%u\n",
+                job->SDTname, hdr->fileName, hdr->sampleRate, job->numSamples,
+                formatDB(peak, job->stats.peak), formatDB(rms, job->stats.rms), formatDB(loudness, job->stats.loudness),
+                job->stats.numClipped);
+    }
+    else
+        fprintf(analysisReport_fp, "%s\t%.16s\t%s\t%u\t-\t-\t-\t-\t-\n",
+                job->SDTname, hdr->fileName, hdr->sndFormat == SNDFORMAT_VAG ? "VAG" : hdr->sndFormat == SNDFORMAT_MP2 || hdr->sndFormat == SNDFORMAT_MP2_2 ? "MP2" : "?",
+                hdr->sampleRate);
+
+    ++numAnalyzed;
+
+    free(job->SDTname);
+    free(job->peaksPath);
+    free(job->data);
+    free(job->peaks);
+    free(job);
+    return success;
+}
+
+// formatDB(): print a dB value with 2 decimals, or "-inf" for silence
+static const char *formatDB(char *buf, double dB){
+    if(dB == -HUGE_VAL)
+        strcpy(buf, "-inf");
+    else
+        sprintf(buf, "%.2f", dB);
+
+    return buf;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "analyze.h"
+
+// BS.1770 gating: 400 ms blocks overlapping by 75%, -70 LUFS absolute gate, -10 LU relative gate
+#define GATE_SEGMENTS       4           // 100 ms segments per block
+#define ABSOLUTE_GATE       -70.0
+#define RELATIVE_GATE       -10.0
+
+// second order IIR filter, in direct form I
+typedef struct biquad_s{
+    double  b0, b1, b2, a1, a2;
+    double  x1, x2, y1, y2;
+}biquad_t;
+
+
+// local functions declarations
+static double integratedLoudness(const short *pcm, DWORD numSamples, DWORD sampleRate);
+static void initKweighting(biquad_t *shelf, biquad_t *highPass, DWORD sampleRate);
+static double biquad(biquad_t *f, double x);
+static double toDB(double x);
+
+
+void analyze_sound(const short *pcm, DWORD numSamples, DWORD sampleRate, soundStats_t *stats){
+    int minSample = 0, maxSample = 0;
+    double sumSquares = 0.0;
+    DWORD i;
+
+    stats->numClipped = 0;
+
+    for(i = 0; i < numSamples; ++i){
+        int s = pcm[i];
+
+        if(s < minSample)
+            minSample = s;
+        if(s > maxSample)
+            maxSample = s;
+
+        sumSquares += (double)s * s;
+
+        if(s == 32767 || s == -32768)
+            ++stats->numClipped;
+    }
+
+    stats->peak = toDB((maxSample > -minSample ? maxSample : -minSample) / 32768.0);
+    stats->rms = numSamples ? toDB(sqrt(sumSquares / numSamples) / 32768.0) : -HUGE_VAL;
+    stats->loudness = integratedLoudness(pcm, numSamples, sampleRate);
+}
+
+DWORD analyze_numPeaks(DWORD numSamples, DWORD samplesPerPeak){
+    return (numSamples + samplesPerPeak - 1) / samplesPerPeak;
+}
+
+void analyze_peaks(const short *pcm, DWORD numSamples, DWORD samplesPerPeak, short *peaks){
+    DWORD i, j, end;
+
+    for(i = 0; i < numSamples; i += samplesPerPeak){
+        short minSample = pcm[i], maxSample = pcm[i];
+
+        end = numSamples - i < samplesPerPeak ? numSamples : i + samplesPerPeak;
+
+        for(j = i + 1; j < end; ++j){
+            if(pcm[j] < minSample)
+                minSample = pcm[j];
+            if(pcm[j] > maxSample)
+                maxSample = pcm[j];
+        }
+
+        *peaks++ = minSample;
+        *peaks++ = maxSample;
+    }
+}
+
+bool analyze_writePeaks(const char *path, DWORD sampleRate, DWORD numSamples, DWORD samplesPerPeak, const short *peaks){
+    FILE *out_fp;
+    peaksHdr_t hdr;
+    bool success;
+
+    hdr.magic = PEAKS_MAGICID;
+    hdr.version = PEAKS_VERSION;
+    hdr.sampleRate = sampleRate;
+    hdr.numSamples = numSamples;
+    hdr.samplesPerPeak = samplesPerPeak;
+    hdr.numPeaks = analyze_numPeaks(numSamples, samplesPerPeak);
+
+    if((out_fp = fopen(path, "wb")) == NULL){
+        fprintf(stderr, "\n\tCouldn't create file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, out_fp);
+    fwrite(peaks, sizeof(*peaks) * 2, hdr.numPeaks, out_fp);
+
+    success = !ferror(out_fp);
+    if(fclose(out_fp) != 0)
+        success = false;
+
+    if(!success){
+        fprintf(stderr, "\n\tCouldn't write %s: %s\n", path, strerror(errno));
+        remove(path);
+    }
+
+    return success;
+}
+
+
+// local functions definitions
+
+static double integratedLoudness(const short *pcm, DWORD numSamples, DWORD sampleRate){
+    biquad_t shelf, highPass;
+    double *blocks, segments[GATE_SEGMENTS] = {0};
+    double gateSum, threshold;
+    DWORD segmentLen = (sampleRate + 5) / 10;
+    DWORD numSegments = segmentLen ? numSamples / segmentLen : 0;
+    DWORD numBlocks, numGated, i, j;
+
+    if(numSegments < GATE_SEGMENTS)
+        return -HUGE_VAL;
+
+    numBlocks = numSegments - GATE_SEGMENTS + 1;
+    if((blocks = malloc(numBlocks * sizeof(*blocks))) == NULL)
+        return -HUGE_VAL;
+
+    initKweighting(&shelf, &highPass, sampleRate);
+
+    /* mean square of each block, from the sums of squares of its 100 ms segments;
+    ** segments[] holds the last GATE_SEGMENTS segments' sums
+    */
+    for(i = 0; i < numSegments; ++i){
+        double sum = 0.0, y;
+
+        for(j = 0; j < segmentLen; ++j){
+            y = biquad(&highPass, biquad(&shelf, pcm[i * segmentLen + j] / 32768.0));
+            sum += y * y;
+        }
+
+        segments[i % GATE_SEGMENTS] = sum;
+
+        if(i >= GATE_SEGMENTS - 1)
+            blocks[i - (GATE_SEGMENTS - 1)] = (segments[0] + segments[1] + segments[2] + segments[3]) / (GATE_SEGMENTS * segmentLen);
+    }
+
+    // absolute gate, then relative gate on the blocks which passed the first one
+    threshold = pow(10.0, (ABSOLUTE_GATE + 0.691) / 10.0);
+    gateSum = 0.0;
+    numGated = 0;
+
+    for(i = 0; i < numBlocks; ++i){
+        if(blocks[i] > threshold){
+            gateSum += blocks[i];
+            ++numGated;
+        }
+    }
+
+    if(numGated == 0){
+        free(blocks);
+        return -HUGE_VAL;
+    }
+
+    threshold = gateSum / numGated * pow(10.0, RELATIVE_GATE / 10.0);
+    if(threshold < pow(10.0, (ABSOLUTE_GATE + 0.691) / 10.0))
+        threshold = pow(10.0, (ABSOLUTE_GATE + 0.691) / 10.0);
+
+    gateSum = 0.0;
+    numGated = 0;
+
+    for(i = 0; i < numBlocks; ++i){
+        if(blocks[i] > threshold){
+            gateSum += blocks[i];
+            ++numGated;
+        }
+    }
+
+    free(blocks);
+    return numGated ? -0.691 + 10.0 * log10(gateSum / numGated) : -HUGE_VAL;
+}
+
+/* initKweighting(): BS.1770's K-weighting filters (a high shelf followed by a high pass),
+** designed for the actual sample rate from their analog prototypes rather than using the 48 kHz coefficients
+*/
+static void initKweighting(biquad_t *shelf, biquad_t *highPass, DWORD sampleRate){
+    const double shelfFreq = 1681.974450955533, shelfGain = 3.999843853973347, shelfQ = 0.7071752369554196;
+    const double highPassFreq = 38.13547087602444, highPassQ = 0.5003270373238773;
+    double K, Vh, Vb, a0;
+
+    K = tan(M_PI * shelfFreq / sampleRate);
+    Vh = pow(10.0, shelfGain / 20.0);
+    Vb = pow(Vh, 0.4996667741545416);
+    a0 = 1.0 + K / shelfQ + K * K;
+
+    memset(shelf, 0, sizeof(*shelf));
+    shelf->b0 = (Vh + Vb * K / shelfQ + K * K) / a0;
+    shelf->b1 = 2.0 * (K * K - Vh) / a0;
+    shelf->b2 = (Vh - Vb * K / shelfQ + K * K) / a0;
+    shelf->a1 = 2.0 * (K * K - 1.0) / a0;
+    shelf->a2 = (1.0 - K / shelfQ + K * K) / a0;
+
+    K = tan(M_PI * highPassFreq / sampleRate);
+    a0 = 1.0 + K / highPassQ + K * K;
+
+    memset(highPass, 0, sizeof(*highPass));
+    highPass->b0 = 1.0;
+    highPass->b1 = -2.0;
+    highPass->b2 = 1.0;
+    highPass->a1 = 2.0 * (K * K - 1.0) / a0;
+    highPass->a2 = (1.0 - K / highPassQ + K * K) / a0;
+}
+
+static double biquad(biquad_t *f, double x){
+    double y = f->b0 * x + f->b1 * f->x1 + f->b2 * f->x2 - f->a1 * f->y1 - f->a2 * f->y2;
+
+    f->x2 = f->x1;
+    f->x1 = x;
+    f->y2 = f->y1;
+    f->y1 = y;
+
+    return y;
+}
+
+static double toDB(double x){
+    return x > 0.0 ? 20.0 * log10(x) : -HUGE_VAL;
+}
@@ -0,0 +1,49 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/*********** Waveform peaks file format ***********
+** Downsampled waveform for editor previews; all the values are little endian.
+**
+    - peaksHdr_t
+
+    - numPeaks pairs of shorts: minimum and maximum sample value
+      of each group of samplesPerPeak samples (the last group may be shorter)
+**************************************************/
+
+#define PEAKS_MAGICID       0x4B503351  // "Q3PK" (little endian)
+#define PEAKS_VERSION       1
+
+typedef struct peaksHdr_s{
+    DWORD   magic;
+    DWORD   version;
+    DWORD   sampleRate;
+    DWORD   numSamples;
+    DWORD   samplesPerPeak;
+    DWORD   numPeaks;
+}peaksHdr_t;
+
+// a decoded sound's levels; dB values are -HUGE_VAL for silence (or, for loudness, sounds shorter than 400 ms)
+typedef struct soundStats_s{
+    double  peak;           // dBFS
+    double  rms;            // dBFS
+    double  loudness;       // integrated loudness as defined by ITU-R BS.1770, in LUFS
+    DWORD   numClipped;     // samples at either end of the 16-bit range
+}soundStats_t;
+
+// analyze_sound(): compute the levels of numSamples samples at sampleRate Hz
+void analyze_sound(const short *pcm, DWORD numSamples, DWORD sampleRate, soundStats_t *stats);
+
+// analyze_numPeaks(): number of min/max pairs computed by analyze_peaks()
+DWORD analyze_numPeaks(DWORD numSamples, DWORD samplesPerPeak);
+
+// analyze_peaks(): compute the minimum and maximum of each group of samplesPerPeak samples
+void analyze_peaks(const short *pcm, DWORD numSamples, DWORD samplesPerPeak, short *peaks);
+
+// analyze_writePeaks(): save the peaks computed by analyze_peaks() to a waveform peaks file
+bool analyze_writePeaks(const char *path, DWORD sampleRate, DWORD numSamples, DWORD samplesPerPeak, const short *peaks);
+
+#endif /* ANALYZE_H */
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include "bank.h"
+
+#define INITIAL_NUM_ENTRIES 256
+
+// global variables(used only inside this module)
+static FILE *           bank_fp;
+static const char *     bankPath;
+
+static bankHdr_t        bankHdr;
+static bankEntry_t *    entries;
+static DWORD            entriesCapacity;
+static DWORD *          slots;      // the hash table is built while adding the sounds
+static DWORD            currDataOffset;
+
+static const BYTE       zeroPadding[BANK_PAGE_SIZE];
+
+// local functions declarations
+static DWORD alignOffset(DWORD offset, DWORD alignment);
+static DWORD probeSlots(const DWORD *hashSlots, DWORD numSlots, const bankEntry_t *bankEntries, const char *name, DWORD nameHash);
+static bool growSlots(void);
+
+
+DWORD bank_hashName(const char *name){
+    DWORD hash = 0x811C9DC5;
+
+    while(*name != '\0'){
+        hash ^= (BYTE)*name++;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+const bankEntry_t *bank_find(const BYTE *bank, const char *name){
+    const bankHdr_t *hdr = (const bankHdr_t *)bank;
+    const DWORD *hashSlots = (const DWORD *)(bank + hdr->slotsOffset);
+    const bankEntry_t *bankEntries = (const bankEntry_t *)(bank + hdr->entriesOffset);
+
+    DWORD i = probeSlots(hashSlots, hdr->numSlots, bankEntries, name, bank_hashName(name));
+
+    return hashSlots[i] ? &bankEntries[hashSlots[i] - 1] : NULL;
+}
+
+
+bool bank_create(const char *path){
+    if((bank_fp = fopen(path, "wb")) == NULL){
+        fprintf(stderr, "Couldn't create file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    entriesCapacity = INITIAL_NUM_ENTRIES;
+    if((entries = malloc(entriesCapacity * sizeof(*entries))) == NULL){
+        fprintf(stderr, "Couldn't allocate %u bytes for %s's entries\n", (unsigned)(entriesCapacity * sizeof(*entries)), path);
+        fclose(bank_fp);
+        return false;
+    }
+
+    bankHdr.numSlots = INITIAL_NUM_ENTRIES * 2;
+    if((slots = calloc(bankHdr.numSlots, sizeof(*slots))) == NULL){
+        fprintf(stderr, "Couldn't allocate %u bytes for %s's hash table\n", (unsigned)(bankHdr.numSlots * sizeof(*slots)), path);
+        free(entries);
+        fclose(bank_fp);
+        return false;
+    }
+
+    bankPath = path;
+
+    bankHdr.numEntries = 0;
+    bankHdr.magic = BANK_MAGICID;
+    bankHdr.version = BANK_VERSION;
+    bankHdr.dataOffset = BANK_PAGE_SIZE;
+
+    /* the header is written for real by bank_close(), once the index is complete;
+    ** for now, reserve the first page for it
+    */
+    fwrite(zeroPadding, 1, BANK_PAGE_SIZE, bank_fp);
+    currDataOffset = BANK_PAGE_SIZE;
+
+    return true;
+}
+
+bool bank_addSound(const char *name, bankFormat_t format, DWORD sampleRate,
+                   const void *hdr, DWORD hdrSize, const void *data, DWORD dataSize){
+    bankEntry_t *entry;
+    DWORD nameHash = bank_hashName(name);
+    DWORD slotIdx;
+
+    if(strlen(name) >= BANK_NAME_SIZE){
+        fprintf(stderr, "\n\tThe name %s is too long for a sound bank entry\n", name);
+        return false;
+    }
+
+    // keep the hash table at most half full
+    if((bankHdr.numEntries + 1) * 2 > bankHdr.numSlots && !growSlots())
+        return false;
+
+    /* the names include the archive's folder, so the same name only comes up again if an archive is given twice
+    ** (or two archives' paths don't name their folders); the sound can't be saved without shadowing the other one
+    */
+    slotIdx = probeSlots(slots, bankHdr.numSlots, entries, name, nameHash);
+    if(slots[slotIdx] != 0){
+        fprintf(stderr, "\n\tCan't add %s: a sound with the same name is already in the bank\n", name);
+        return false;
+    }
+
+    if(bankHdr.numEntries == entriesCapacity){
+        bankEntry_t *newEntries = realloc(entries, entriesCapacity * 2 * sizeof(*entries));
+
+        if(newEntries == NULL){
+            fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's entries\n", (unsigned)(entriesCapacity * 2 * sizeof(*entries)), bankPath);
+            return false;
+        }
+
+        entries = newEntries;
+        entriesCapacity *= 2;
+    }
+
+    entry = &entries[bankHdr.numEntries++];
+    slots[slotIdx] = bankHdr.numEntries;
+
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->name, name);
+    entry->nameHash = nameHash;
+    entry->offset = currDataOffset;
+    entry->size = hdrSize + dataSize;
+    entry->sampleRate = sampleRate;
+    entry->format = format;
+
+    // the data is streamed to the file right away; only the index is kept in memory
+    if(hdrSize)
+        fwrite(hdr, 1, hdrSize, bank_fp);
+    fwrite(data, 1, dataSize, bank_fp);
+
+    currDataOffset += entry->size;
+    fwrite(zeroPadding, 1, alignOffset(currDataOffset, BANK_DATA_ALIGN) - currDataOffset, bank_fp);
+    currDataOffset = alignOffset(currDataOffset, BANK_DATA_ALIGN);
+
+    if(ferror(bank_fp)){
+        fprintf(stderr, "\n\tCouldn't write to %s: %s\n", bankPath, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool bank_close(void){
+    bool success;
+
+    bankHdr.dataSize = currDataOffset - BANK_PAGE_SIZE;
+    bankHdr.slotsOffset = currDataOffset;
+    bankHdr.entriesOffset = bankHdr.slotsOffset + bankHdr.numSlots * sizeof(*slots);
+
+    fwrite(slots, sizeof(*slots), bankHdr.numSlots, bank_fp);
+    fwrite(entries, sizeof(*entries), bankHdr.numEntries, bank_fp);
+
+    rewind(bank_fp);
+    fwrite(&bankHdr, sizeof(bankHdr), 1, bank_fp);
+
+    success = !ferror(bank_fp);
+    if(fclose(bank_fp) != 0)
+        success = false;
+
+    if(success)
+        printf("Sound bank %s: %u sounds, %u bytes of sound data\n", bankPath, bankHdr.numEntries, bankHdr.dataSize);
+    else
+        fprintf(stderr, "Couldn't write to %s: %s\n", bankPath, strerror(errno));
+
+    free(slots);
+    free(entries);
+    return success;
+}
+
+
+// local functions definitions
+
+static DWORD alignOffset(DWORD offset, DWORD alignment){
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/* probeSlots(): return the index of the slot referring to the entry called name,
+** or of the empty slot where such an entry would be placed
+*/
+static DWORD probeSlots(const DWORD *hashSlots, DWORD numSlots, const bankEntry_t *bankEntries, const char *name, DWORD nameHash){
+    DWORD mask = numSlots - 1;
+    DWORD i;
+
+    for(i = nameHash & mask; hashSlots[i] != 0; i = (i + 1) & mask){
+        const bankEntry_t *entry = &bankEntries[hashSlots[i] - 1];
+
+        if(entry->nameHash == nameHash && strcmp(entry->name, name) == 0)
+            break;
+    }
+
+    return i;
+}
+
+static bool growSlots(void){
+    DWORD *newSlots;
+    DWORD i, j, mask;
+
+    if((newSlots = calloc(bankHdr.numSlots * 2, sizeof(*newSlots))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for %s's hash table\n", (unsigned)(bankHdr.numSlots * 2 * sizeof(*newSlots)), bankPath);
+        return false;
+    }
+
+    bankHdr.numSlots *= 2;
+    mask = bankHdr.numSlots - 1;
+
+    for(i = 0; i < bankHdr.numEntries; ++i){
+        for(j = entries[i].nameHash & mask; newSlots[j] != 0; j = (j + 1) & mask)
+            ;
+
+        newSlots[j] = i + 1;
+    }
+
+    free(slots);
+    slots = newSlots;
+    return true;
+}
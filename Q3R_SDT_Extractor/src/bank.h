@@ -0,0 +1,84 @@
+#ifndef BANK_H
+#define BANK_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/*********** Sound bank format ***********
+** A sound bank packs any number of sounds (extracted from one or more SDT archives)
+** into a single file which can be mapped in memory as a whole, with an open-addressing
+** hash table allowing to look up each sound by name in O(1); all the values are little endian.
+**
+    - bankHdr_t, at offset 0
+
+    - the sounds' data blob, starting at offset BANK_PAGE_SIZE;
+      each sound's data starts at a multiple of BANK_DATA_ALIGN
+
+    - array of numSlots DWORDs (the hash table) at slotsOffset;
+      each slot holds either 0 (empty slot) or the index + 1 of a bankEntry_t
+
+    - array of numEntries bankEntry_t at entriesOffset
+**
+** A sound is looked up by hashing its name with bank_hashName(), then probing the slots
+** linearly starting from (hash & (numSlots - 1)) until either an empty slot or an entry with
+** the same hash and name is found; numSlots is a power of 2 at least twice as big as numEntries,
+** so the probe sequences are short.
+**
+** Each sound's name is "<folder>/<SDT archive name>/<subfile name>", e.g. "SOUND_FR/MUSIC/track01.mp2",
+** with the folder being the one the archive is in (left out, along with its slash, if the archive's path
+** doesn't name it) and the subfile name being the same as the file name used when extracting the subfiles
+** as separate files.
+*****************************************/
+
+#define BANK_MAGICID        0x42533351  // "Q3SB" (little endian)
+#define BANK_VERSION        1
+#define BANK_PAGE_SIZE      4096
+#define BANK_DATA_ALIGN     16
+#define BANK_NAME_SIZE      48
+
+typedef enum bankFormat_e{
+    BANK_FORMAT_VAG     = 0,    // PS-ADPCM data preceded by a VAG header
+    BANK_FORMAT_ADPCM   = 1,    // headerless PS-ADPCM data
+    BANK_FORMAT_MP2     = 2,    // MPEG audio layer II stream
+    BANK_FORMAT_PCM16   = 3,    // 16-bit signed mono PCM samples
+    BANK_FORMAT_FLAC    = 4     // FLAC stream of 16-bit mono PCM samples
+}bankFormat_t;
+
+typedef struct bankHdr_s{
+    DWORD   magic;
+    DWORD   version;
+    DWORD   numEntries;
+    DWORD   numSlots;
+    DWORD   slotsOffset;
+    DWORD   entriesOffset;
+    DWORD   dataOffset;         // always BANK_PAGE_SIZE
+    DWORD   dataSize;
+}bankHdr_t;
+
+typedef struct bankEntry_s{
+    DWORD   nameHash;
+    DWORD   offset;             // relative to the beginning of the bank
+    DWORD   size;
+    WORD    sampleRate;
+    WORD    format;             // a bankFormat_t value
+    char    name[BANK_NAME_SIZE];   // null-terminated
+}bankEntry_t;
+
+
+// bank_hashName(): 32-bit FNV-1a hash of a sound's name
+DWORD bank_hashName(const char *name);
+
+/* bank_find(): look up a sound in a bank loaded/mapped in memory,
+** returning its entry or NULL if it isn't present
+*/
+const bankEntry_t *bank_find(const BYTE *bank, const char *name);
+
+
+// functions used to create a bank
+bool bank_create(const char *bankPath);
+bool bank_addSound(const char *name, bankFormat_t format, DWORD sampleRate,
+                   const void *hdr, DWORD hdrSize, const void *data, DWORD dataSize);
+bool bank_close(void);
+
+#endif /* BANK_H */
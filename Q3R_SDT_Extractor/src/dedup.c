@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include "dedup.h"
+#include "hardlink.h"
+
+#define INITIAL_TABLE_SIZE  1024    // must be a power of 2
+
+typedef unsigned long long QWORD;
+
+// an extracted subfile's canonical copy
+typedef struct dedupEntry_s{
+    QWORD   hash;
+    DWORD   dataSize;
+    WORD    sampleRate;
+    WORD    sndFormat;
+    DWORD   hdrSize;
+    char *  path;       // NULL if the slot is unused
+}dedupEntry_t;
+
+// a duplicate subfile, kept for the mapping report
+typedef struct dedupLink_s{
+    char *  path;
+    const char *canonicalPath;
+    DWORD   dataSize;
+    bool    isHardLink;
+}dedupLink_t;
+
+
+// global variables(used only inside this module)
+static dedupEntry_t *   table;
+static DWORD            tableSize, numEntries;
+
+static dedupLink_t *    links;
+static DWORD            linksCapacity, numLinks;
+
+static BYTE             cmpBuf[64 * 1024];
+
+// hash computed by the last dedup_linkDuplicate() call, reused by dedup_register()
+static const BYTE *     lastData;
+static QWORD            lastHash;
+
+
+// local functions declarations
+static QWORD hashData(const BYTE *data, DWORD size);
+static dedupEntry_t *findSlot(QWORD hash, DWORD dataSize, const SDT_subfileHeader_t *SDT_subfileHeader, const BYTE *data);
+static bool growTable(void);
+static bool sameFileData(const char *path, DWORD hdrSize, const BYTE *data, DWORD size);
+static char *dupString(const char *str);
+
+
+bool dedup_init(void){
+    tableSize = INITIAL_TABLE_SIZE;
+    numEntries = 0;
+
+    if((table = calloc(tableSize, sizeof(*table))) == NULL){
+        fprintf(stderr, "Couldn't allocate %u bytes for the deduplication table\n", (unsigned)(tableSize * sizeof(*table)));
+        return false;
+    }
+
+    links = NULL;
+    linksCapacity = numLinks = 0;
+    lastData = NULL;
+    return true;
+}
+
+void dedup_free(void){
+    DWORD i;
+
+    for(i = 0; i < tableSize; ++i)
+        free(table[i].path);
+
+    for(i = 0; i < numLinks; ++i)
+        free(links[i].path);
+
+    free(table);
+    free(links);
+}
+
+bool dedup_linkDuplicate(const BYTE *data, DWORD dataSize, const SDT_subfileHeader_t *SDT_subfileHeader, DWORD hdrSize, const char *outPath){
+    QWORD hash = hashData(data, dataSize);
+    dedupEntry_t *entry = findSlot(hash, dataSize, SDT_subfileHeader, data);
+
+    lastData = data;
+    lastHash = hash;
+
+    if(entry->path == NULL)
+        return false;
+
+    // record the link
+    if(numLinks == linksCapacity){
+        DWORD newCapacity = linksCapacity ? linksCapacity * 2 : 256;
+        dedupLink_t *newLinks = realloc(links, newCapacity * sizeof(*links));
+
+        // not being able to dedup isn't fatal; the subfile will be saved as usual
+        if(newLinks == NULL)
+            return false;
+
+        links = newLinks;
+        linksCapacity = newCapacity;
+    }
+
+    if((links[numLinks].path = dupString(outPath)) == NULL)
+        return false;
+
+    links[numLinks].canonicalPath = entry->path;
+    links[numLinks].dataSize = hdrSize + dataSize;
+    links[numLinks].isHardLink = makeHardLink(entry->path, outPath);
+    ++numLinks;
+
+    return true;
+}
+
+bool dedup_register(const BYTE *data, DWORD dataSize, const SDT_subfileHeader_t *SDT_subfileHeader, DWORD hdrSize, const char *outPath){
+    dedupEntry_t *entry;
+    QWORD hash = data == lastData ? lastHash : hashData(data, dataSize);
+
+    // keep the load factor below 50%
+    if((numEntries + 1) * 2 > tableSize && !growTable())
+        return false;
+
+    entry = findSlot(hash, dataSize, SDT_subfileHeader, NULL);
+    lastData = NULL;
+
+    if((entry->path = dupString(outPath)) == NULL)
+        return false;
+
+    entry->dataSize = dataSize;
+    entry->sampleRate = SDT_subfileHeader->sampleRate;
+    entry->sndFormat = SDT_subfileHeader->sndFormat;
+    entry->hdrSize = hdrSize;
+    ++numEntries;
+
+    return true;
+}
+
+bool dedup_writeReport(const char *reportPath){
+    FILE *out_fp;
+    DWORD i, numHardLinks = 0;
+    QWORD bytesSaved = 0;
+
+    if((out_fp = fopen(reportPath, "w")) == NULL){
+        fprintf(stderr, "Couldn't create file %s: %s\n", reportPath, strerror(errno));
+        return false;
+    }
+
+    fputs("# duplicate\tcanonical copy\ttype\n", out_fp);
+
+    for(i = 0; i < numLinks; ++i){
+        fprintf(out_fp, "%s\t%s\t%s\n", links[i].path, links[i].canonicalPath, links[i].isHardLink ? "hardlink" : "reference");
+
+        bytesSaved += links[i].dataSize;
+        numHardLinks += links[i].isHardLink;
+    }
+
+    fprintf(out_fp, "# %u unique subfiles, %u duplicates (%u hard linked, %u referenced only), %llu bytes saved\n",
+            numEntries, numLinks, numHardLinks, numLinks - numHardLinks, bytesSaved);
+
+    fclose(out_fp);
+
+    printf("Deduplication: %u unique subfiles, %u duplicates, %llu bytes saved (mapping saved in %s)\n",
+            numEntries, numLinks, bytesSaved, reportPath);
+
+    return true;
+}
+
+
+// local functions definitions
+
+/* hashData(): 64-bit hash processing 8 bytes at a time, finalized with
+** MurmurHash3's fmix64 mixer; collisions are ruled out anyway by comparing
+** the data with the canonical copy before linking it.
+*/
+static QWORD hashData(const BYTE *data, DWORD size){
+    QWORD h = 0x9E3779B97F4A7C15ULL ^ size;
+    QWORD k;
+    DWORD i;
+
+    for(i = 0; i + 8 <= size; i += 8){
+        memcpy(&k, data + i, sizeof(k));
+        k *= 0x87C37B91114253D5ULL;
+        k = (k << 31) | (k >> 33);
+        h ^= k * 0x4CF5AD432745937FULL;
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+    }
+
+    for(k = 0; i < size; ++i)
+        k = (k << 8) | data[i];
+    h ^= k * 0x87C37B91114253D5ULL;
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* findSlot(): return the slot holding the canonical copy of the given data, or the empty slot
+** where it should be inserted if there's none; if data is NULL, the first empty slot
+** for the given hash is returned.
+*/
+static dedupEntry_t *findSlot(QWORD hash, DWORD dataSize, const SDT_subfileHeader_t *SDT_subfileHeader, const BYTE *data){
+    DWORD mask = tableSize - 1;
+    DWORD i = (DWORD)hash & mask;
+
+    while(table[i].path != NULL){
+        if( data != NULL &&
+            table[i].hash == hash &&
+            table[i].dataSize == dataSize &&
+            table[i].sampleRate == SDT_subfileHeader->sampleRate &&
+            table[i].sndFormat == SDT_subfileHeader->sndFormat &&
+            sameFileData(table[i].path, table[i].hdrSize, data, dataSize)
+        )
+            return &table[i];
+
+        i = (i + 1) & mask;
+    }
+
+    table[i].hash = hash;
+    return &table[i];
+}
+
+static bool growTable(void){
+    dedupEntry_t *oldTable = table;
+    DWORD oldTableSize = tableSize;
+    DWORD i, j, mask;
+
+    if((table = calloc(tableSize * 2, sizeof(*table))) == NULL){
+        table = oldTable;
+        return false;
+    }
+
+    tableSize *= 2;
+    mask = tableSize - 1;
+
+    for(i = 0; i < oldTableSize; ++i){
+        if(oldTable[i].path == NULL)
+            continue;
+
+        j = (DWORD)oldTable[i].hash & mask;
+        while(table[j].path != NULL)
+            j = (j + 1) & mask;
+
+        table[j] = oldTable[i];
+    }
+
+    free(oldTable);
+    return true;
+}
+
+// sameFileData(): compare data with the sound data saved in the file at path (past its header, if any)
+static bool sameFileData(const char *path, DWORD hdrSize, const BYTE *data, DWORD size){
+    FILE *in_fp;
+    size_t chunkSize;
+    bool isSame = true;
+
+    if((in_fp = fopen(path, "rb")) == NULL)
+        return false;
+
+    fseek(in_fp, hdrSize, SEEK_SET);
+
+    while(size && isSame){
+        chunkSize = size < sizeof(cmpBuf) ? size : sizeof(cmpBuf);
+
+        isSame =    fread(cmpBuf, 1, chunkSize, in_fp) == chunkSize &&
+                    memcmp(cmpBuf, data, chunkSize) == 0;
+
+        data += chunkSize;
+        size -= chunkSize;
+    }
+
+    fclose(in_fp);
+    return isSame;
+}
+
+static char *dupString(const char *str){
+    char *copy = malloc(strlen(str) + 1);
+
+    if(copy != NULL)
+        strcpy(copy, str);
+
+    return copy;
+}
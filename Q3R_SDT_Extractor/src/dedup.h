@@ -0,0 +1,31 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/* Cross-archive deduplication of the extracted subfiles.
+**
+** Many subfiles are byte-identical across the SOUND, SOUND_FR and SOUND_IT archives,
+** so when dedup mode is enabled each subfile's sound data is hashed while it's being
+** extracted: the first copy of each sound is saved as usual and becomes the canonical
+** copy, while the following ones are hard linked to it (or, if the file system doesn't
+** support hard links, just referenced in the mapping report without being written.)
+*/
+
+bool dedup_init(void);
+void dedup_free(void);
+
+/* dedup_linkDuplicate(): if the sound data (as saved, i.e. possibly decoded) matches the data of an
+** already extracted subfile, make outPath refer to that subfile's copy and return true; otherwise return
+** false, in which case the caller must save the subfile to outPath and then call dedup_register().
+** hdrSize is the size of the header preceding the sound data in the extracted files (if any.)
+*/
+bool dedup_linkDuplicate(const BYTE *data, DWORD dataSize, const SDT_subfileHeader_t *SDT_subfileHeader, DWORD hdrSize, const char *outPath);
+bool dedup_register(const BYTE *data, DWORD dataSize, const SDT_subfileHeader_t *SDT_subfileHeader, DWORD hdrSize, const char *outPath);
+
+// dedup_writeReport(): save the duplicate -> canonical copy mapping in a text file
+bool dedup_writeReport(const char *reportPath);
+
+#endif /* DEDUP_H */
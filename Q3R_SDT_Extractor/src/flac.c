@@ -0,0 +1,888 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "flac.h"
+
+/* the SIMD kernels need GCC/Clang's target attributes and cpu detection builtins;
+** any other compiler (e.g. tcc) gets the plain C versions
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && \
+    (defined(__i386__) || defined(__x86_64__))
+    #define FLAC_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+#define MAX_PARTITION_ORDER     8
+#define MAX_RICE_PARAM          14      // 15 is the escape code, which is never used here
+#define FRAME_OVERHEAD          32      // upper bound of a frame's size besides the samples' data
+
+// subframe types, as stored in the subframe header (FIXED and LPC types get the order added to them)
+#define SUBFRAME_CONSTANT       0x00
+#define SUBFRAME_VERBATIM       0x01
+#define SUBFRAME_FIXED          0x08
+#define SUBFRAME_LPC            0x1F    // + order, with order starting from 1
+
+typedef unsigned long long QWORD;
+
+typedef void (*autocorr_t)(const double *data, DWORD len, unsigned maxLag, double *autoc);
+typedef void (*lpcResidual_t)(const int *samples, DWORD len, const int *qlpCoefs, unsigned order, int shift, int *residual);
+
+typedef struct bitWriter_s{
+    BYTE *      buf;
+    DWORD       pos;        // bytes written so far
+    QWORD       acc;        // bits not written yet, right aligned
+    unsigned    numBits;    // always less than 8 between putBits() calls
+}bitWriter_t;
+
+// a block's encoding, along with its residual's Rice coding parameters
+typedef struct subframe_s{
+    unsigned    type;
+    unsigned    order;
+    int         qlpCoefs[FLAC_MAX_LPC_ORDER];
+    unsigned    precision;
+    int         shift;
+
+    QWORD       numBits;    // subframe size, header included
+    int *       residual;
+    unsigned    partitionOrder;
+    unsigned    riceParams[1 << MAX_PARTITION_ORDER];
+}subframe_t;
+
+// per-stream encoder state
+typedef struct encoder_s{
+    bitWriter_t bw;
+
+    int         samples[FLAC_BLOCK_SIZE];
+    int         residuals[2][FLAC_BLOCK_SIZE];  // the candidate's and the best subframe's
+    double      windowed[FLAC_BLOCK_SIZE];
+    double      window[FLAC_BLOCK_SIZE];
+    DWORD       windowSize;                     // block size the window has been computed for
+
+    subframe_t  best, candidate;
+
+    autocorr_t      autocorr;
+    lpcResidual_t   lpcResidual;
+}encoder_t;
+
+typedef struct md5_s{
+    DWORD       state[4];
+    QWORD       numBytes;
+    BYTE        block[64];
+}md5_t;
+
+// CRC-8 (polynomial 0x07) and CRC-16 (polynomial 0x8005) lookup tables, for the frames' checksums
+static const BYTE crc8Table[256] = {
+    0x00,0x07,0x0E,0x09,0x1C,0x1B,0x12,0x15,0x38,0x3F,0x36,0x31,0x24,0x23,0x2A,0x2D,
+    0x70,0x77,0x7E,0x79,0x6C,0x6B,0x62,0x65,0x48,0x4F,0x46,0x41,0x54,0x53,0x5A,0x5D,
+    0xE0,0xE7,0xEE,0xE9,0xFC,0xFB,0xF2,0xF5,0xD8,0xDF,0xD6,0xD1,0xC4,0xC3,0xCA,0xCD,
+    0x90,0x97,0x9E,0x99,0x8C,0x8B,0x82,0x85,0xA8,0xAF,0xA6,0xA1,0xB4,0xB3,0xBA,0xBD,
+    0xC7,0xC0,0xC9,0xCE,0xDB,0xDC,0xD5,0xD2,0xFF,0xF8,0xF1,0xF6,0xE3,0xE4,0xED,0xEA,
+    0xB7,0xB0,0xB9,0xBE,0xAB,0xAC,0xA5,0xA2,0x8F,0x88,0x81,0x86,0x93,0x94,0x9D,0x9A,
+    0x27,0x20,0x29,0x2E,0x3B,0x3C,0x35,0x32,0x1F,0x18,0x11,0x16,0x03,0x04,0x0D,0x0A,
+    0x57,0x50,0x59,0x5E,0x4B,0x4C,0x45,0x42,0x6F,0x68,0x61,0x66,0x73,0x74,0x7D,0x7A,
+    0x89,0x8E,0x87,0x80,0x95,0x92,0x9B,0x9C,0xB1,0xB6,0xBF,0xB8,0xAD,0xAA,0xA3,0xA4,
+    0xF9,0xFE,0xF7,0xF0,0xE5,0xE2,0xEB,0xEC,0xC1,0xC6,0xCF,0xC8,0xDD,0xDA,0xD3,0xD4,
+    0x69,0x6E,0x67,0x60,0x75,0x72,0x7B,0x7C,0x51,0x56,0x5F,0x58,0x4D,0x4A,0x43,0x44,
+    0x19,0x1E,0x17,0x10,0x05,0x02,0x0B,0x0C,0x21,0x26,0x2F,0x28,0x3D,0x3A,0x33,0x34,
+    0x4E,0x49,0x40,0x47,0x52,0x55,0x5C,0x5B,0x76,0x71,0x78,0x7F,0x6A,0x6D,0x64,0x63,
+    0x3E,0x39,0x30,0x37,0x22,0x25,0x2C,0x2B,0x06,0x01,0x08,0x0F,0x1A,0x1D,0x14,0x13,
+    0xAE,0xA9,0xA0,0xA7,0xB2,0xB5,0xBC,0xBB,0x96,0x91,0x98,0x9F,0x8A,0x8D,0x84,0x83,
+    0xDE,0xD9,0xD0,0xD7,0xC2,0xC5,0xCC,0xCB,0xE6,0xE1,0xE8,0xEF,0xFA,0xFD,0xF4,0xF3
+};
+
+static const WORD crc16Table[256] = {
+    0x0000,0x8005,0x800F,0x000A,0x801B,0x001E,0x0014,0x8011,
+    0x8033,0x0036,0x003C,0x8039,0x0028,0x802D,0x8027,0x0022,
+    0x8063,0x0066,0x006C,0x8069,0x0078,0x807D,0x8077,0x0072,
+    0x0050,0x8055,0x805F,0x005A,0x804B,0x004E,0x0044,0x8041,
+    0x80C3,0x00C6,0x00CC,0x80C9,0x00D8,0x80DD,0x80D7,0x00D2,
+    0x00F0,0x80F5,0x80FF,0x00FA,0x80EB,0x00EE,0x00E4,0x80E1,
+    0x00A0,0x80A5,0x80AF,0x00AA,0x80BB,0x00BE,0x00B4,0x80B1,
+    0x8093,0x0096,0x009C,0x8099,0x0088,0x808D,0x8087,0x0082,
+    0x8183,0x0186,0x018C,0x8189,0x0198,0x819D,0x8197,0x0192,
+    0x01B0,0x81B5,0x81BF,0x01BA,0x81AB,0x01AE,0x01A4,0x81A1,
+    0x01E0,0x81E5,0x81EF,0x01EA,0x81FB,0x01FE,0x01F4,0x81F1,
+    0x81D3,0x01D6,0x01DC,0x81D9,0x01C8,0x81CD,0x81C7,0x01C2,
+    0x0140,0x8145,0x814F,0x014A,0x815B,0x015E,0x0154,0x8151,
+    0x8173,0x0176,0x017C,0x8179,0x0168,0x816D,0x8167,0x0162,
+    0x8123,0x0126,0x012C,0x8129,0x0138,0x813D,0x8137,0x0132,
+    0x0110,0x8115,0x811F,0x011A,0x810B,0x010E,0x0104,0x8101,
+    0x8303,0x0306,0x030C,0x8309,0x0318,0x831D,0x8317,0x0312,
+    0x0330,0x8335,0x833F,0x033A,0x832B,0x032E,0x0324,0x8321,
+    0x0360,0x8365,0x836F,0x036A,0x837B,0x037E,0x0374,0x8371,
+    0x8353,0x0356,0x035C,0x8359,0x0348,0x834D,0x8347,0x0342,
+    0x03C0,0x83C5,0x83CF,0x03CA,0x83DB,0x03DE,0x03D4,0x83D1,
+    0x83F3,0x03F6,0x03FC,0x83F9,0x03E8,0x83ED,0x83E7,0x03E2,
+    0x83A3,0x03A6,0x03AC,0x83A9,0x03B8,0x83BD,0x83B7,0x03B2,
+    0x0390,0x8395,0x839F,0x039A,0x838B,0x038E,0x0384,0x8381,
+    0x0280,0x8285,0x828F,0x028A,0x829B,0x029E,0x0294,0x8291,
+    0x82B3,0x02B6,0x02BC,0x82B9,0x02A8,0x82AD,0x82A7,0x02A2,
+    0x82E3,0x02E6,0x02EC,0x82E9,0x02F8,0x82FD,0x82F7,0x02F2,
+    0x02D0,0x82D5,0x82DF,0x02DA,0x82CB,0x02CE,0x02C4,0x82C1,
+    0x8243,0x0246,0x024C,0x8249,0x0258,0x825D,0x8257,0x0252,
+    0x0270,0x8275,0x827F,0x027A,0x826B,0x026E,0x0264,0x8261,
+    0x0220,0x8225,0x822F,0x022A,0x823B,0x023E,0x0234,0x8231,
+    0x8213,0x0216,0x021C,0x8219,0x0208,0x820D,0x8207,0x0202
+};
+
+
+// local functions declarations
+static bool encodeBlock(encoder_t *enc, const short *pcm, DWORD blockSize, DWORD frameNum, DWORD sampleRate);
+static void chooseFixed(encoder_t *enc, DWORD blockSize);
+static void chooseLPC(encoder_t *enc, DWORD blockSize);
+static unsigned computeLPC(const double *autoc, unsigned maxOrder, double lpc[][FLAC_MAX_LPC_ORDER]);
+static bool quantizeLPC(const double *lpc, unsigned order, unsigned precision, int *qlpCoefs, int *shift);
+static void keepIfBetter(encoder_t *enc);
+static QWORD riceBits(const int *residual, DWORD blockSize, unsigned predOrder, unsigned *partitionOrder, unsigned *riceParams);
+static void writeSubframe(bitWriter_t *bw, const subframe_t *subframe, const int *samples, DWORD blockSize);
+static void writeResidual(bitWriter_t *bw, const subframe_t *subframe, DWORD blockSize);
+static void writeStreamInfo(bitWriter_t *bw, DWORD numSamples, DWORD sampleRate, DWORD minFrameSize, DWORD maxFrameSize, const BYTE *md5);
+static unsigned sampleRateCode(DWORD sampleRate);
+
+static void putBits(bitWriter_t *bw, DWORD value, unsigned numBits);
+static void putUTF8(bitWriter_t *bw, DWORD value);
+
+static BYTE crc8(const BYTE *data, DWORD len);
+static WORD crc16(const BYTE *data, DWORD len);
+
+static void md5_init(md5_t *md5);
+static void md5_update(md5_t *md5, const BYTE *data, DWORD len);
+static void md5_final(md5_t *md5, BYTE *digest);
+static void md5_block(DWORD *state, const BYTE *block);
+
+static void autocorr_C(const double *data, DWORD len, unsigned maxLag, double *autoc);
+static void lpcResidual_C(const int *samples, DWORD len, const int *qlpCoefs, unsigned order, int shift, int *residual);
+#ifdef FLAC_X86_SIMD
+static void autocorr_SSE2(const double *data, DWORD len, unsigned maxLag, double *autoc);
+static void autocorr_AVX2(const double *data, DWORD len, unsigned maxLag, double *autoc);
+static void lpcResidual_AVX2(const int *samples, DWORD len, const int *qlpCoefs, unsigned order, int shift, int *residual);
+#endif
+
+
+bool flac_encode(const short *pcm, DWORD numSamples, DWORD sampleRate, BYTE **out, DWORD *outSize){
+    encoder_t *enc;
+    md5_t md5;
+    BYTE md5Digest[16], sampleBytes[2 * 256];
+    DWORD numFrames = (numSamples + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE;
+    DWORD bufSize = 4 + 38 + numFrames * FRAME_OVERHEAD + numSamples * 2;
+    DWORD minFrameSize = 0xFFFFFF, maxFrameSize = 0;
+    DWORD i, j, frameStart;
+
+    if((enc = malloc(sizeof(*enc))) == NULL || (enc->bw.buf = malloc(bufSize)) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for the FLAC encoder\n", (unsigned)(sizeof(*enc) + bufSize));
+        free(enc);
+        return false;
+    }
+
+    enc->bw.pos = 0;
+    enc->bw.acc = 0;
+    enc->bw.numBits = 0;
+    enc->windowSize = 0;
+
+    enc->autocorr = autocorr_C;
+    enc->lpcResidual = lpcResidual_C;
+#ifdef FLAC_X86_SIMD
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        enc->autocorr = autocorr_AVX2;
+        enc->lpcResidual = lpcResidual_AVX2;
+    }
+    else if(__builtin_cpu_supports("sse2"))
+        enc->autocorr = autocorr_SSE2;
+#endif
+
+    // the MD5 signature is computed on the samples as little endian bytes, regardless of the host
+    md5_init(&md5);
+    for(i = 0; i < numSamples; i += j){
+        for(j = 0; j < 256 && i + j < numSamples; ++j){
+            sampleBytes[j*2]     = (WORD)pcm[i + j] & 0xFF;
+            sampleBytes[j*2 + 1] = (WORD)pcm[i + j] >> 8;
+        }
+
+        md5_update(&md5, sampleBytes, j * 2);
+    }
+    md5_final(&md5, md5Digest);
+
+    // the frame sizes aren't known yet; STREAMINFO is rewritten at the end
+    putBits(&enc->bw, 0x664C6143, 32);     // "fLaC"
+    writeStreamInfo(&enc->bw, numSamples, sampleRate, 0, 0, md5Digest);
+
+    for(i = 0; i < numFrames; ++i){
+        DWORD blockSize = numSamples - i * FLAC_BLOCK_SIZE < FLAC_BLOCK_SIZE ? numSamples - i * FLAC_BLOCK_SIZE : FLAC_BLOCK_SIZE;
+
+        frameStart = enc->bw.pos;
+        encodeBlock(enc, pcm + i * FLAC_BLOCK_SIZE, blockSize, i, sampleRate);
+
+        if(enc->bw.pos - frameStart < minFrameSize)
+            minFrameSize = enc->bw.pos - frameStart;
+        if(enc->bw.pos - frameStart > maxFrameSize)
+            maxFrameSize = enc->bw.pos - frameStart;
+    }
+
+    *outSize = enc->bw.pos;
+
+    enc->bw.pos = 4;
+    writeStreamInfo(&enc->bw, numSamples, sampleRate, numFrames ? minFrameSize : 0, maxFrameSize, md5Digest);
+
+    *out = enc->bw.buf;
+    free(enc);
+    return true;
+}
+
+
+// local functions definitions
+
+// encodeBlock(): encode a frame holding blockSize samples
+static bool encodeBlock(encoder_t *enc, const short *pcm, DWORD blockSize, DWORD frameNum, DWORD sampleRate){
+    bitWriter_t *bw = &enc->bw;
+    DWORD frameStart = bw->pos;
+    DWORD i;
+    unsigned rateCode = sampleRateCode(sampleRate);
+    bool isConstant = true;
+
+    for(i = 0; i < blockSize; ++i){
+        enc->samples[i] = pcm[i];
+
+        if(pcm[i] != pcm[0])
+            isConstant = false;
+    }
+
+    // frame header: sync code and fixed block size strategy, block size, sample rate, mono, 16 bits per sample
+    putBits(bw, 0xFFF8, 16);
+
+    if(blockSize == FLAC_BLOCK_SIZE)
+        putBits(bw, 12, 4);         // 256 * 2^(12-8)
+    else if(blockSize <= 256)
+        putBits(bw, 6, 4);          // 8 bits block size - 1 at the end of the header
+    else
+        putBits(bw, 7, 4);          // 16 bits block size - 1 at the end of the header
+
+    putBits(bw, rateCode, 4);
+    putBits(bw, 0, 4);
+    putBits(bw, 4, 3);
+    putBits(bw, 0, 1);
+    putUTF8(bw, frameNum);
+
+    if(blockSize != FLAC_BLOCK_SIZE)
+        putBits(bw, blockSize - 1, blockSize <= 256 ? 8 : 16);
+
+    if(rateCode == 12)
+        putBits(bw, sampleRate / 1000, 8);
+    else if(rateCode == 13)
+        putBits(bw, sampleRate, 16);
+
+    putBits(bw, crc8(bw->buf + frameStart, bw->pos - frameStart), 8);
+
+    // pick the smallest subframe type, starting from VERBATIM
+    enc->best.type = isConstant ? SUBFRAME_CONSTANT : SUBFRAME_VERBATIM;
+    enc->best.order = 0;
+    enc->best.numBits = 8 + (isConstant ? 16 : blockSize * 16);
+    enc->best.residual = enc->residuals[0];
+    enc->candidate.residual = enc->residuals[1];
+
+    // the predictors need some warm-up samples; tiny blocks are stored as they are
+    if(!isConstant && blockSize > FLAC_MAX_LPC_ORDER){
+        chooseFixed(enc, blockSize);
+        chooseLPC(enc, blockSize);
+    }
+
+    writeSubframe(bw, &enc->best, enc->samples, blockSize);
+
+    // pad to a byte boundary, then the frame's CRC-16
+    if(bw->numBits)
+        putBits(bw, 0, 8 - bw->numBits);
+
+    putBits(bw, crc16(bw->buf + frameStart, bw->pos - frameStart), 16);
+    return true;
+}
+
+// chooseFixed(): pick the fixed predictor order with the smallest sum of the absolute residuals
+static void chooseFixed(encoder_t *enc, DWORD blockSize){
+    const int *s = enc->samples;
+    subframe_t *sf = &enc->candidate;
+    QWORD errSum[5] = {0, 0, 0, 0, 0};
+    unsigned order, bestOrder = 0;
+    DWORD i;
+
+    for(i = 4; i < blockSize; ++i){
+        int e0 = s[i];
+        int e1 = e0 - s[i-1];
+        int e2 = e1 - (s[i-1] - s[i-2]);
+        int e3 = e2 - (s[i-1] - 2*s[i-2] + s[i-3]);
+        int e4 = e3 - (s[i-1] - 3*s[i-2] + 3*s[i-3] - s[i-4]);
+
+        errSum[0] += abs(e0);
+        errSum[1] += abs(e1);
+        errSum[2] += abs(e2);
+        errSum[3] += abs(e3);
+        errSum[4] += abs(e4);
+    }
+
+    for(order = 1; order < 5; ++order)
+        if(errSum[order] < errSum[bestOrder])
+            bestOrder = order;
+
+    for(i = bestOrder; i < blockSize; ++i){
+        switch(bestOrder){
+            case 0: sf->residual[i] = s[i];                                             break;
+            case 1: sf->residual[i] = s[i] - s[i-1];                                    break;
+            case 2: sf->residual[i] = s[i] - 2*s[i-1] + s[i-2];                         break;
+            case 3: sf->residual[i] = s[i] - 3*s[i-1] + 3*s[i-2] - s[i-3];              break;
+            case 4: sf->residual[i] = s[i] - 4*s[i-1] + 6*s[i-2] - 4*s[i-3] + s[i-4];   break;
+        }
+    }
+
+    sf->type = SUBFRAME_FIXED + bestOrder;
+    sf->order = bestOrder;
+    sf->numBits = 8 + bestOrder * 16 + riceBits(sf->residual, blockSize, bestOrder, &sf->partitionOrder, sf->riceParams);
+
+    keepIfBetter(enc);
+}
+
+// chooseLPC(): try every LPC order on the block, keeping the best one if it beats the current best subframe
+static void chooseLPC(encoder_t *enc, DWORD blockSize){
+    subframe_t *sf = &enc->candidate;
+    double autoc[FLAC_MAX_LPC_ORDER + 1];
+    double lpc[FLAC_MAX_LPC_ORDER][FLAC_MAX_LPC_ORDER];
+    unsigned order, maxOrder, precision;
+    DWORD i;
+
+    // Tukey(0.5) window, computed again only when the block size changes (i.e. for the last block)
+    if(enc->windowSize != blockSize){
+        DWORD taper = blockSize / 4;
+
+        for(i = 0; i < blockSize; ++i)
+            enc->window[i] = 1.0;
+
+        for(i = 0; i < taper; ++i){
+            enc->window[i] = 0.5 - 0.5 * cos(M_PI * i / taper);
+            enc->window[blockSize - 1 - i] = enc->window[i];
+        }
+
+        enc->windowSize = blockSize;
+    }
+
+    for(i = 0; i < blockSize; ++i)
+        enc->windowed[i] = enc->samples[i] * enc->window[i];
+
+    enc->autocorr(enc->windowed, blockSize, FLAC_MAX_LPC_ORDER, autoc);
+
+    if(autoc[0] == 0.0)
+        return;
+
+    maxOrder = computeLPC(autoc, FLAC_MAX_LPC_ORDER, lpc);
+
+    // same precisions as the reference encoder; 16 bits samples, 12 bits coefficients and 12 taps fit in 32 bits
+    precision = blockSize <= 192 ? 7 : blockSize <= 384 ? 8 : blockSize <= 576 ? 9 :
+                blockSize <= 1152 ? 10 : blockSize <= 2304 ? 11 : 12;
+
+    for(order = 1; order <= maxOrder; ++order){
+        if(!quantizeLPC(lpc[order - 1], order, precision, sf->qlpCoefs, &sf->shift))
+            continue;
+
+        enc->lpcResidual(enc->samples, blockSize, sf->qlpCoefs, order, sf->shift, sf->residual);
+
+        sf->type = SUBFRAME_LPC + order;
+        sf->order = order;
+        sf->precision = precision;
+        sf->numBits = 8 + order * 16 + 4 + 5 + order * precision +
+                      riceBits(sf->residual, blockSize, order, &sf->partitionOrder, sf->riceParams);
+
+        keepIfBetter(enc);
+    }
+}
+
+/* computeLPC(): Levinson-Durbin recursion, computing the predictor coefficients for
+** each order up to maxOrder; returns the highest order computed
+*/
+static unsigned computeLPC(const double *autoc, unsigned maxOrder, double lpc[][FLAC_MAX_LPC_ORDER]){
+    double refl[FLAC_MAX_LPC_ORDER];
+    double err = autoc[0], r, tmp;
+    unsigned i, j;
+
+    for(i = 0; i < maxOrder; ++i){
+        r = -autoc[i + 1];
+        for(j = 0; j < i; ++j)
+            r -= refl[j] * autoc[i - j];
+        r /= err;
+
+        refl[i] = r;
+        for(j = 0; j < i / 2; ++j){
+            tmp = refl[j];
+            refl[j] += r * refl[i - 1 - j];
+            refl[i - 1 - j] += r * tmp;
+        }
+        if(i & 1)
+            refl[j] += refl[j] * r;
+
+        err *= 1.0 - r * r;
+
+        // the filter's coefficients are the negated predictor coefficients
+        for(j = 0; j <= i; ++j)
+            lpc[i][j] = -refl[j];
+
+        if(err <= 0.0)
+            return i + 1;
+    }
+
+    return maxOrder;
+}
+
+// quantizeLPC(): quantize the coefficients to precision bits (sign included); returns false if they can't be
+static bool quantizeLPC(const double *lpc, unsigned order, unsigned precision, int *qlpCoefs, int *shift){
+    int qmax = (1 << (precision - 1)) - 1, qmin = -(1 << (precision - 1));
+    int log2cmax, q;
+    double cmax = 0.0, error = 0.0;
+    unsigned i;
+
+    for(i = 0; i < order; ++i)
+        if(fabs(lpc[i]) > cmax)
+            cmax = fabs(lpc[i]);
+
+    if(cmax <= 0.0)
+        return false;
+
+    frexp(cmax, &log2cmax);
+    *shift = (int)precision - log2cmax - 1;
+
+    // negative shifts aren't allowed by the format
+    if(*shift < 0)
+        return false;
+    if(*shift > 15)
+        *shift = 15;
+
+    // the rounding error is carried over to the next coefficient
+    for(i = 0; i < order; ++i){
+        error += lpc[i] * (1 << *shift);
+        q = (int)floor(error + 0.5);
+
+        if(q > qmax)
+            q = qmax;
+        else if(q < qmin)
+            q = qmin;
+
+        error -= q;
+        qlpCoefs[i] = q;
+    }
+
+    return true;
+}
+
+// keepIfBetter(): make the candidate subframe the best one if it's smaller
+static void keepIfBetter(encoder_t *enc){
+    int *residual;
+
+    if(enc->candidate.numBits >= enc->best.numBits)
+        return;
+
+    residual = enc->best.residual;
+    enc->best = enc->candidate;
+    enc->candidate.residual = residual;
+}
+
+/* riceBits(): pick the partition order and Rice parameters giving the smallest residual, and return
+** its size in bits; since sum(u >> k) <= (sum(u) >> k), the result is an upper bound of the actual size
+*/
+static QWORD riceBits(const int *residual, DWORD blockSize, unsigned predOrder, unsigned *partitionOrder, unsigned *riceParams){
+    QWORD sums[1 << MAX_PARTITION_ORDER];
+    QWORD bestBits = ~0ULL;
+    unsigned maxOrder = 0, order, k, p;
+    DWORD i;
+
+    while(maxOrder < MAX_PARTITION_ORDER && blockSize % (2u << maxOrder) == 0 && (blockSize >> (maxOrder + 1)) > predOrder)
+        ++maxOrder;
+
+    for(p = 0; p < (1u << maxOrder); ++p){
+        DWORD start = p == 0 ? predOrder : p * (blockSize >> maxOrder);
+        DWORD end = (p + 1) * (blockSize >> maxOrder);
+
+        sums[p] = 0;
+        for(i = start; i < end; ++i)
+            sums[p] += ((DWORD)residual[i] << 1) ^ (DWORD)(residual[i] >> 31);
+    }
+
+    for(order = maxOrder + 1; order-- > 0;){
+        unsigned params[1 << MAX_PARTITION_ORDER];
+        QWORD bits = 2 + 4;
+
+        for(p = 0; p < (1u << order); ++p){
+            DWORD n = (blockSize >> order) - (p == 0 ? predOrder : 0);
+            QWORD partBits, bestPartBits = ~0ULL;
+
+            for(k = 0; k <= MAX_RICE_PARAM; ++k){
+                partBits = (QWORD)n * (k + 1) + (sums[p] >> k);
+
+                if(partBits < bestPartBits){
+                    bestPartBits = partBits;
+                    params[p] = k;
+                }
+            }
+
+            bits += 4 + bestPartBits;
+        }
+
+        if(bits < bestBits){
+            bestBits = bits;
+            *partitionOrder = order;
+            memcpy(riceParams, params, (1u << order) * sizeof(*params));
+        }
+
+        // merge the partitions' sums for the next lower order
+        for(p = 0; p < (1u << order) / 2; ++p)
+            sums[p] = sums[2*p] + sums[2*p + 1];
+    }
+
+    return bestBits;
+}
+
+static void writeSubframe(bitWriter_t *bw, const subframe_t *subframe, const int *samples, DWORD blockSize){
+    DWORD i;
+
+    // zero padding bit, type, no wasted bits
+    putBits(bw, subframe->type << 1, 8);
+
+    switch(subframe->type){
+        case SUBFRAME_CONSTANT:
+            putBits(bw, samples[0] & 0xFFFF, 16);
+            return;
+
+        case SUBFRAME_VERBATIM:
+            for(i = 0; i < blockSize; ++i)
+                putBits(bw, samples[i] & 0xFFFF, 16);
+            return;
+    }
+
+    // warm-up samples
+    for(i = 0; i < subframe->order; ++i)
+        putBits(bw, samples[i] & 0xFFFF, 16);
+
+    if(subframe->type > SUBFRAME_LPC){
+        putBits(bw, subframe->precision - 1, 4);
+        putBits(bw, subframe->shift & 0x1F, 5);
+
+        for(i = 0; i < subframe->order; ++i)
+            putBits(bw, subframe->qlpCoefs[i] & ((1u << subframe->precision) - 1), subframe->precision);
+    }
+
+    writeResidual(bw, subframe, blockSize);
+}
+
+static void writeResidual(bitWriter_t *bw, const subframe_t *subframe, DWORD blockSize){
+    unsigned numPartitions = 1u << subframe->partitionOrder;
+    DWORD partSize = blockSize >> subframe->partitionOrder;
+    unsigned p, k;
+    DWORD i, u, q;
+
+    putBits(bw, 0, 2);      // Rice coding with 4 bits parameters
+    putBits(bw, subframe->partitionOrder, 4);
+
+    for(p = 0; p < numPartitions; ++p){
+        k = subframe->riceParams[p];
+        putBits(bw, k, 4);
+
+        for(i = p == 0 ? subframe->order : p * partSize; i < (p + 1) * partSize; ++i){
+            u = ((DWORD)subframe->residual[i] << 1) ^ (DWORD)(subframe->residual[i] >> 31);
+
+            // unary coded quotient (zeroes ended by a one), then the k low bits
+            for(q = u >> k; q >= 16; q -= 16)
+                putBits(bw, 0, 16);
+
+            putBits(bw, 1, q + 1);
+            putBits(bw, u & ((1u << k) - 1), k);
+        }
+    }
+}
+
+static void writeStreamInfo(bitWriter_t *bw, DWORD numSamples, DWORD sampleRate, DWORD minFrameSize, DWORD maxFrameSize, const BYTE *md5){
+    unsigned i;
+
+    putBits(bw, 0x80, 8);           // last metadata block, STREAMINFO
+    putBits(bw, 34, 24);
+
+    putBits(bw, FLAC_BLOCK_SIZE, 16);
+    putBits(bw, FLAC_BLOCK_SIZE, 16);
+    putBits(bw, minFrameSize, 24);
+    putBits(bw, maxFrameSize, 24);
+    putBits(bw, sampleRate, 20);
+    putBits(bw, 0, 3);              // channels - 1
+    putBits(bw, 15, 5);             // bits per sample - 1
+    putBits(bw, 0, 4);              // upper 4 bits of the 36 bits samples count
+    putBits(bw, numSamples, 32);
+
+    for(i = 0; i < 16; ++i)
+        putBits(bw, md5[i], 8);
+}
+
+// sampleRateCode(): frame header's sample rate code; 12 and 13 are followed by the rate in kHz/Hz
+static unsigned sampleRateCode(DWORD sampleRate){
+    switch(sampleRate){
+        case 88200:     return 1;
+        case 176400:    return 2;
+        case 192000:    return 3;
+        case 8000:      return 4;
+        case 16000:     return 5;
+        case 22050:     return 6;
+        case 24000:     return 7;
+        case 32000:     return 8;
+        case 44100:     return 9;
+        case 48000:     return 10;
+        case 96000:     return 11;
+    }
+
+    if(sampleRate % 1000 == 0 && sampleRate / 1000 < 256)
+        return 12;
+
+    if(sampleRate < 65536)
+        return 13;
+
+    return 0;   // read it from STREAMINFO
+}
+
+static void putBits(bitWriter_t *bw, DWORD value, unsigned numBits){
+    if(numBits == 0)
+        return;
+
+    bw->acc = (bw->acc << numBits) | (value & (0xFFFFFFFFu >> (32 - numBits)));
+    bw->numBits += numBits;
+
+    while(bw->numBits >= 8){
+        bw->numBits -= 8;
+        bw->buf[bw->pos++] = (BYTE)(bw->acc >> bw->numBits);
+    }
+}
+
+// putUTF8(): frame numbers are stored with the same variable length coding as UTF-8 characters
+static void putUTF8(bitWriter_t *bw, DWORD value){
+    unsigned numBytes, i;
+
+    if(value < 0x80){
+        putBits(bw, value, 8);
+        return;
+    }
+
+    numBytes = value < 0x800 ? 2 : value < 0x10000 ? 3 : value < 0x200000 ? 4 : value < 0x4000000 ? 5 : 6;
+
+    // first byte: as many ones as the number of bytes, a zero, then the value's top bits
+    putBits(bw, ((0xFF00 >> numBytes) & 0xFF) | (value >> (6 * (numBytes - 1))), 8);
+
+    for(i = numBytes - 1; i-- > 0;)
+        putBits(bw, 0x80 | ((value >> (6 * i)) & 0x3F), 8);
+}
+
+static BYTE crc8(const BYTE *data, DWORD len){
+    BYTE crc = 0;
+
+    while(len--)
+        crc = crc8Table[crc ^ *data++];
+
+    return crc;
+}
+
+static WORD crc16(const BYTE *data, DWORD len){
+    WORD crc = 0;
+
+    while(len--)
+        crc = (crc << 8) ^ crc16Table[(crc >> 8) ^ *data++];
+
+    return crc;
+}
+
+// MD5 (RFC 1321), for STREAMINFO's signature of the unencoded audio data
+static void md5_init(md5_t *md5){
+    md5->state[0] = 0x67452301;
+    md5->state[1] = 0xEFCDAB89;
+    md5->state[2] = 0x98BADCFE;
+    md5->state[3] = 0x10325476;
+    md5->numBytes = 0;
+}
+
+static void md5_update(md5_t *md5, const BYTE *data, DWORD len){
+    DWORD used = md5->numBytes % 64;
+    DWORD n;
+
+    md5->numBytes += len;
+
+    while(len > 0){
+        n = 64 - used < len ? 64 - used : len;
+        memcpy(md5->block + used, data, n);
+        used += n;
+        data += n;
+        len -= n;
+
+        if(used == 64){
+            md5_block(md5->state, md5->block);
+            used = 0;
+        }
+    }
+}
+
+static void md5_final(md5_t *md5, BYTE *digest){
+    static const BYTE padding[64] = {0x80};
+    QWORD numBits = md5->numBytes * 8;
+    BYTE lenBytes[8];
+    DWORD used = md5->numBytes % 64;
+    unsigned i;
+
+    for(i = 0; i < 8; ++i)
+        lenBytes[i] = (BYTE)(numBits >> (i * 8));
+
+    md5_update(md5, padding, used < 56 ? 56 - used : 120 - used);
+    md5_update(md5, lenBytes, 8);
+
+    for(i = 0; i < 16; ++i)
+        digest[i] = (BYTE)(md5->state[i / 4] >> ((i % 4) * 8));
+}
+
+static void md5_block(DWORD *state, const BYTE *block){
+    static const DWORD K[64] = {
+        0xD76AA478,0xE8C7B756,0x242070DB,0xC1BDCEEE,0xF57C0FAF,0x4787C62A,0xA8304613,0xFD469501,
+        0x698098D8,0x8B44F7AF,0xFFFF5BB1,0x895CD7BE,0x6B901122,0xFD987193,0xA679438E,0x49B40821,
+        0xF61E2562,0xC040B340,0x265E5A51,0xE9B6C7AA,0xD62F105D,0x02441453,0xD8A1E681,0xE7D3FBC8,
+        0x21E1CDE6,0xC33707D6,0xF4D50D87,0x455A14ED,0xA9E3E905,0xFCEFA3F8,0x676F02D9,0x8D2A4C8A,
+        0xFFFA3942,0x8771F681,0x6D9D6122,0xFDE5380C,0xA4BEEA44,0x4BDECFA9,0xF6BB4B60,0xBEBFBC70,
+        0x289B7EC6,0xEAA127FA,0xD4EF3085,0x04881D05,0xD9D4D039,0xE6DB99E5,0x1FA27CF8,0xC4AC5665,
+        0xF4292244,0x432AFF97,0xAB9423A7,0xFC93A039,0x655B59C3,0x8F0CCC92,0xFFEFF47D,0x85845DD1,
+        0x6FA87E4F,0xFE2CE6E0,0xA3014314,0x4E0811A1,0xF7537E82,0xBD3AF235,0x2AD7D2BB,0xEB86D391
+    };
+    static const BYTE R[64] = {
+        7,12,17,22,7,12,17,22,7,12,17,22,7,12,17,22,
+        5, 9,14,20,5, 9,14,20,5, 9,14,20,5, 9,14,20,
+        4,11,16,23,4,11,16,23,4,11,16,23,4,11,16,23,
+        6,10,15,21,6,10,15,21,6,10,15,21,6,10,15,21
+    };
+    DWORD M[16], a = state[0], b = state[1], c = state[2], d = state[3], f, tmp;
+    unsigned i, g;
+
+    for(i = 0; i < 16; ++i)
+        M[i] = block[i*4] | (block[i*4 + 1] << 8) | (block[i*4 + 2] << 16) | ((DWORD)block[i*4 + 3] << 24);
+
+    for(i = 0; i < 64; ++i){
+        if(i < 16){
+            f = (b & c) | (~b & d);
+            g = i;
+        }
+        else if(i < 32){
+            f = (d & b) | (~d & c);
+            g = (5*i + 1) % 16;
+        }
+        else if(i < 48){
+            f = b ^ c ^ d;
+            g = (3*i + 5) % 16;
+        }
+        else{
+            f = c ^ (b | ~d);
+            g = (7*i) % 16;
+        }
+
+        tmp = d;
+        d = c;
+        c = b;
+        f += a + K[i] + M[g];
+        b += (f << R[i]) | (f >> (32 - R[i]));
+        a = tmp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+static void autocorr_C(const double *data, DWORD len, unsigned maxLag, double *autoc){
+    unsigned lag;
+    DWORD i;
+
+    for(lag = 0; lag <= maxLag; ++lag){
+        double sum = 0.0;
+
+        for(i = lag; i < len; ++i)
+            sum += data[i] * data[i - lag];
+
+        autoc[lag] = sum;
+    }
+}
+
+static void lpcResidual_C(const int *samples, DWORD len, const int *qlpCoefs, unsigned order, int shift, int *residual){
+    unsigned j;
+    DWORD i;
+
+    for(i = order; i < len; ++i){
+        int pred = 0;
+
+        for(j = 0; j < order; ++j)
+            pred += qlpCoefs[j] * samples[i - 1 - j];
+
+        residual[i] = samples[i] - (pred >> shift);
+    }
+}
+
+#ifdef FLAC_X86_SIMD
+__attribute__((target("sse2")))
+static void autocorr_SSE2(const double *data, DWORD len, unsigned maxLag, double *autoc){
+    unsigned lag;
+    DWORD i;
+
+    for(lag = 0; lag <= maxLag; ++lag){
+        __m128d sum = _mm_setzero_pd();
+        double sums[2];
+
+        for(i = lag; i + 2 <= len; i += 2)
+            sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(data + i), _mm_loadu_pd(data + i - lag)));
+
+        _mm_storeu_pd(sums, sum);
+        autoc[lag] = sums[0] + sums[1];
+
+        for(; i < len; ++i)
+            autoc[lag] += data[i] * data[i - lag];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void autocorr_AVX2(const double *data, DWORD len, unsigned maxLag, double *autoc){
+    unsigned lag;
+    DWORD i;
+
+    for(lag = 0; lag <= maxLag; ++lag){
+        __m256d sum = _mm256_setzero_pd();
+        double sums[4];
+
+        for(i = lag; i + 4 <= len; i += 4)
+            sum = _mm256_fmadd_pd(_mm256_loadu_pd(data + i), _mm256_loadu_pd(data + i - lag), sum);
+
+        _mm256_storeu_pd(sums, sum);
+        autoc[lag] = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+
+        for(; i < len; ++i)
+            autoc[lag] += data[i] * data[i - lag];
+    }
+}
+
+// computes 8 residuals at once; each coefficient multiplies 8 consecutive samples
+__attribute__((target("avx2")))
+static void lpcResidual_AVX2(const int *samples, DWORD len, const int *qlpCoefs, unsigned order, int shift, int *residual){
+    __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    unsigned j;
+    DWORD i;
+
+    for(i = order; i + 8 <= len; i += 8){
+        __m256i pred = _mm256_setzero_si256();
+
+        for(j = 0; j < order; ++j)
+            pred = _mm256_add_epi32(pred, _mm256_mullo_epi32(_mm256_set1_epi32(qlpCoefs[j]),
+                                                             _mm256_loadu_si256((const __m256i *)(samples + i - 1 - j))));
+
+        pred = _mm256_sra_epi32(pred, shiftCount);
+        _mm256_storeu_si256((__m256i *)(residual + i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(samples + i)), pred));
+    }
+
+    for(; i < len; ++i){
+        int pred = 0;
+
+        for(j = 0; j < order; ++j)
+            pred += qlpCoefs[j] * samples[i - 1 - j];
+
+        residual[i] = samples[i] - (pred >> shift);
+    }
+}
+#endif
@@ -0,0 +1,31 @@
+#ifndef FLAC_H
+#define FLAC_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/* Lossless encoder for 16-bit mono PCM, producing standard FLAC streams
+** (a STREAMINFO metadata block followed by fixed-size frames).
+**
+** Each block is encoded with the smallest of:
+** - a CONSTANT subframe, if all the samples are the same;
+** - the best FIXED predictor (orders 0-4);
+** - the best LPC predictor (orders 1 to FLAC_MAX_LPC_ORDER), computed from the autocorrelation
+**   of the Tukey-windowed block through the Levinson-Durbin recursion;
+** - a VERBATIM subframe, if the data doesn't compress at all;
+** with the residuals Rice-coded using the best partition order.
+**
+** The autocorrelation and LPC residuals are computed with AVX2/FMA or SSE2 when the CPU
+** (and the compiler) supports them. flac_encode() has no global state, so several streams
+** can be encoded at once by different threads.
+*/
+#define FLAC_BLOCK_SIZE     4096
+#define FLAC_MAX_LPC_ORDER  12
+
+/* flac_encode(): encode numSamples samples at sampleRate Hz; on success *out points to
+** a malloc'ed buffer holding the whole FLAC stream, which is *outSize bytes long
+*/
+bool flac_encode(const short *pcm, DWORD numSamples, DWORD sampleRate, BYTE **out, DWORD *outSize);
+
+#endif /* FLAC_H */
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "hardlink.h"
+
+#define TMP_LINK_SUFFIX ".tmplink"
+
+
+// local functions declarations
+static bool isSameFile(const char *path1, const char *path2);
+
+
+// functions definitions
+bool makeHardLink(const char *existingPath, const char *newPath){
+    char tmpPath[FILENAME_MAX];
+
+    // replacing the file with a link to itself would remove it
+    if(strcmp(existingPath, newPath) == 0 || isSameFile(existingPath, newPath))
+        return true;
+
+    /* the link is made under a temporary name, then renamed over newPath,
+    ** so that newPath is left as it is if the link can't be made
+    */
+    if((size_t)snprintf(tmpPath, sizeof(tmpPath), "%s" TMP_LINK_SUFFIX, newPath) >= sizeof(tmpPath))
+        return false;
+
+    remove(tmpPath);
+
+#ifdef _WIN32
+    if(!CreateHardLinkA(tmpPath, existingPath, NULL))
+        return false;
+
+    if(!MoveFileExA(tmpPath, newPath, MOVEFILE_REPLACE_EXISTING)){
+#else
+    if(link(existingPath, tmpPath) != 0)
+        return false;
+
+    if(rename(tmpPath, newPath) != 0){
+#endif
+        remove(tmpPath);
+        return false;
+    }
+
+    return true;
+}
+
+
+// local functions definitions
+
+// isSameFile(): whether both paths exist and refer to the same file (e.g. through a different but equivalent path)
+static bool isSameFile(const char *path1, const char *path2){
+#ifdef _WIN32
+    BY_HANDLE_FILE_INFORMATION info1, info2;
+    HANDLE file1, file2;
+    bool same = false;
+
+    file1 = CreateFileA(path1, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    file2 = CreateFileA(path2, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+
+    if(file1 != INVALID_HANDLE_VALUE && file2 != INVALID_HANDLE_VALUE
+    && GetFileInformationByHandle(file1, &info1) && GetFileInformationByHandle(file2, &info2))
+        same = info1.dwVolumeSerialNumber == info2.dwVolumeSerialNumber
+            && info1.nFileIndexHigh == info2.nFileIndexHigh
+            && info1.nFileIndexLow == info2.nFileIndexLow;
+
+    if(file1 != INVALID_HANDLE_VALUE)
+        CloseHandle(file1);
+    if(file2 != INVALID_HANDLE_VALUE)
+        CloseHandle(file2);
+
+    return same;
+#else
+    struct stat stat1, stat2;
+
+    return stat(path1, &stat1) == 0 && stat(path2, &stat2) == 0
+        && stat1.st_dev == stat2.st_dev && stat1.st_ino == stat2.st_ino;
+#endif
+}
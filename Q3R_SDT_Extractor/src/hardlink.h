@@ -0,0 +1,15 @@
+#ifndef HARDLINK_H
+#define HARDLINK_H
+
+#include <stdbool.h>
+
+/* makeHardLink(): create newPath as a hard link to the existing file existingPath,
+** replacing newPath if it already exists; if the link can't be made, newPath is left untouched,
+** and if newPath already is existingPath (or a link to it) there's nothing to do.
+** Returns false if the file system doesn't support hard links (or on any other failure);
+** no error message is printed, since the caller is expected to fall back to something else.
+** As for makeDir(), this keeps windows.h away from the rest of the code.
+*/
+bool makeHardLink(const char *existingPath, const char *newPath);
+
+#endif /* HARDLINK_H */
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jobs.h"
+#include "threads.h"
+
+#define JOBS_PER_THREAD     2   // queue slots for each worker thread
+
+
+// global variables(used only inside this module)
+static thread_t **  threads;
+static unsigned     numThreads;
+
+static mutex_t *    mutex;
+static cond_t *     cond;       // signaled whenever any of the counters below changes
+
+static jobFunc_t    processJob, commitJob;
+
+static void **      queue;
+static unsigned     queueSize;
+
+// sequence numbers of the next job to be submitted, taken by a worker thread and committed
+static unsigned long submitSeq, takeSeq, commitSeq;
+
+static bool         failed, quit;
+
+
+// local functions declarations
+static void worker(void *arg);
+
+
+bool jobs_init(unsigned numWorkers, jobFunc_t process, jobFunc_t commit){
+    unsigned i;
+
+    if(numWorkers == 0)
+        numWorkers = 1;
+
+    processJob = process;
+    commitJob = commit;
+    submitSeq = takeSeq = commitSeq = 0;
+    failed = quit = false;
+    numThreads = 0;
+
+    queueSize = numWorkers * JOBS_PER_THREAD;
+
+    if( (queue = malloc(queueSize * sizeof(*queue))) == NULL ||
+        (threads = malloc(numWorkers * sizeof(*threads))) == NULL ||
+        (mutex = mutex_create()) == NULL ||
+        (cond = cond_create()) == NULL
+    ){
+        fputs("Couldn't allocate the worker threads' data\n", stderr);
+        jobs_free();
+        return false;
+    }
+
+    for(i = 0; i < numWorkers; ++i){
+        if((threads[i] = thread_create(worker, NULL)) == NULL){
+            fputs("Couldn't create the worker threads\n", stderr);
+            jobs_free();
+            return false;
+        }
+
+        ++numThreads;
+    }
+
+    return true;
+}
+
+bool jobs_submit(void *job){
+    mutex_lock(mutex);
+
+    // a slot can be reused only after its job has been committed
+    while(submitSeq - commitSeq >= queueSize)
+        cond_wait(cond, mutex);
+
+    queue[submitSeq % queueSize] = job;
+    ++submitSeq;
+
+    cond_broadcast(cond);
+    mutex_unlock(mutex);
+
+    return true;
+}
+
+bool jobs_wait(void){
+    bool success;
+
+    mutex_lock(mutex);
+
+    while(commitSeq != submitSeq)
+        cond_wait(cond, mutex);
+
+    success = !failed;
+    failed = false;
+
+    mutex_unlock(mutex);
+    return success;
+}
+
+void jobs_free(void){
+    unsigned i;
+
+    if(mutex != NULL && cond != NULL){
+        mutex_lock(mutex);
+        quit = true;
+        cond_broadcast(cond);
+        mutex_unlock(mutex);
+    }
+
+    for(i = 0; i < numThreads; ++i)
+        thread_join(threads[i]);
+
+    cond_free(cond);
+    mutex_free(mutex);
+    free(threads);
+    free(queue);
+
+    cond = NULL;
+    mutex = NULL;
+    threads = NULL;
+    queue = NULL;
+    numThreads = 0;
+}
+
+
+// local functions definitions
+
+static void worker(void *arg){
+    unsigned long seq;
+    void *job;
+    bool success;
+
+    for(;;){
+        mutex_lock(mutex);
+
+        while(takeSeq == submitSeq && !quit)
+            cond_wait(cond, mutex);
+
+        if(takeSeq == submitSeq){
+            mutex_unlock(mutex);
+            return;
+        }
+
+        seq = takeSeq++;
+        job = queue[seq % queueSize];
+        mutex_unlock(mutex);
+
+        success = processJob(job);
+
+        // wait for the previous jobs to be committed
+        mutex_lock(mutex);
+        while(commitSeq != seq)
+            cond_wait(cond, mutex);
+        mutex_unlock(mutex);
+
+        // the other workers can't commit anything until commitSeq is incremented, so there's no need to lock here
+        success = commitJob(job) && success;
+
+        mutex_lock(mutex);
+        if(!success)
+            failed = true;
+
+        ++commitSeq;
+        cond_broadcast(cond);
+        mutex_unlock(mutex);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+/* Worker threads pool with ordered commits: each submitted job is first processed by any of the
+** worker threads (in parallel with the other jobs), then committed in the same order the jobs were
+** submitted, one at a time; this way the expensive part of the work (e.g. encoding) runs in parallel,
+** while the output (e.g. files written, bank entries and console messages) is the same as a serial run.
+**
+** Both functions return false on failure; a job is committed even if its processing failed,
+** so that the commit function can free it.
+*/
+typedef bool (*jobFunc_t)(void *job);
+
+bool jobs_init(unsigned numThreads, jobFunc_t process, jobFunc_t commit);
+
+// jobs_submit(): queue a job, waiting for a free slot if the queue is full
+bool jobs_submit(void *job);
+
+// jobs_wait(): wait for all the submitted jobs to be committed; returns false if any of them failed
+bool jobs_wait(void);
+
+void jobs_free(void);
+
+#endif /* JOBS_H */
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resample.h"
+
+/* the SIMD inner products need GCC/Clang's target attributes and cpu detection builtins;
+** any other compiler (e.g. tcc) gets the plain C version
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && \
+    (defined(__i386__) || defined(__x86_64__))
+    #define RESAMPLE_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+#define TAPS_ALIGN  8       // filters' lengths are a multiple of this, so SIMD loops have no tails
+
+typedef unsigned long long QWORD;
+
+typedef float (*dotProduct_t)(const float *a, const float *b, DWORD len);
+
+// a filter bank for a given rates ratio and quality
+typedef struct filterBank_s{
+    DWORD   inRate;
+    DWORD   outRate;
+    resampleQuality_t quality;
+
+    DWORD   numPhases;
+    DWORD   numTaps;        // for each phase
+    DWORD   halfTaps;       // number of taps on each side of the interpolated position
+    float * coefs;          // numPhases * numTaps coefficients
+}filterBank_t;
+
+// quality presets
+static const struct{
+    DWORD   zeroCrossings;  // per side, at the cutoff frequency
+    double  rolloff;        // cutoff frequency relative to the lowest Nyquist frequency
+    double  kaiserBeta;
+}presets[3] = {
+    { 8, 0.85,  6.0},
+    {16, 0.90,  8.0},
+    {32, 0.95, 10.0}
+};
+
+
+// global variables(used only inside this module)
+static filterBank_t *   banks;
+static DWORD            numBanks;
+
+static dotProduct_t     dotProduct;
+
+
+// local functions declarations
+static filterBank_t *getFilterBank(DWORD inRate, DWORD outRate, resampleQuality_t quality);
+static bool computeFilterBank(filterBank_t *bank);
+static double besselI0(double x);
+static DWORD gcd(DWORD a, DWORD b);
+static dotProduct_t selectDotProduct(void);
+static float dotProduct_C(const float *a, const float *b, DWORD len);
+#ifdef RESAMPLE_X86_SIMD
+static float dotProduct_SSE2(const float *a, const float *b, DWORD len);
+static float dotProduct_AVX2(const float *a, const float *b, DWORD len);
+#endif
+
+
+DWORD resample_numSamples(DWORD numSamples, DWORD inRate, DWORD outRate){
+    return ((QWORD)numSamples * outRate + inRate - 1) / inRate;
+}
+
+bool resample(const short *in, DWORD numIn, DWORD inRate, short *out, DWORD outRate, resampleQuality_t quality){
+    filterBank_t *bank;
+    float *buf;
+    DWORD numOut = resample_numSamples(numIn, inRate, outRate);
+    DWORD i;
+
+    if((bank = getFilterBank(inRate, outRate, quality)) == NULL)
+        return false;
+
+    /* convert the input samples to float, with enough zeroes on both sides
+    ** for the filters to never read outside of the buffer
+    */
+    if((buf = calloc(numIn + 2 * bank->numTaps, sizeof(*buf))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for the resampler's work buffer\n", (unsigned)((numIn + 2 * bank->numTaps) * sizeof(*buf)));
+        return false;
+    }
+
+    for(i = 0; i < numIn; ++i)
+        buf[bank->halfTaps + i] = in[i];
+
+    for(i = 0; i < numOut; ++i){
+        /* position of the output sample in the input, in 1/numPhases units; it's exact unless the phases
+        ** were capped to RESAMPLE_MAX_PHASES, in which case it's rounded to the nearest phase
+        */
+        QWORD pos = ((QWORD)i * inRate * bank->numPhases * 2 + outRate) / ((QWORD)outRate * 2);
+        DWORD inIdx = pos / bank->numPhases;
+        DWORD phase = pos % bank->numPhases;
+
+        /* phase's filter is centered between input samples inIdx and inIdx + 1, and its first tap
+        ** applies to input sample (inIdx + 1 - halfTaps), which is buf[inIdx + 1]
+        */
+        float sample = dotProduct(bank->coefs + phase * bank->numTaps, buf + inIdx + 1, bank->numTaps);
+
+        if(sample >= 32767.0f)
+            out[i] = 32767;
+        else if(sample <= -32768.0f)
+            out[i] = -32768;
+        else
+            out[i] = (short)(sample < 0.0f ? sample - 0.5f : sample + 0.5f);
+    }
+
+    free(buf);
+    return true;
+}
+
+void resample_free(void){
+    DWORD i;
+
+    for(i = 0; i < numBanks; ++i)
+        free(banks[i].coefs);
+
+    free(banks);
+    banks = NULL;
+    numBanks = 0;
+}
+
+
+// local functions definitions
+
+// getFilterBank(): return the filter bank for the given parameters, computing it if it's not cached yet
+static filterBank_t *getFilterBank(DWORD inRate, DWORD outRate, resampleQuality_t quality){
+    filterBank_t *newBanks;
+    DWORD i;
+
+    for(i = 0; i < numBanks; ++i)
+        if(banks[i].inRate == inRate && banks[i].outRate == outRate && banks[i].quality == quality)
+            return &banks[i];
+
+    if(dotProduct == NULL)
+        dotProduct = selectDotProduct();
+
+    if((newBanks = realloc(banks, (numBanks + 1) * sizeof(*banks))) == NULL){
+        fputs("\n\tCouldn't allocate memory for a new filter bank\n", stderr);
+        return NULL;
+    }
+    banks = newBanks;
+
+    banks[numBanks].inRate = inRate;
+    banks[numBanks].outRate = outRate;
+    banks[numBanks].quality = quality;
+
+    if(!computeFilterBank(&banks[numBanks]))
+        return NULL;
+
+    return &banks[numBanks++];
+}
+
+static bool computeFilterBank(filterBank_t *bank){
+    DWORD div = gcd(bank->inRate, bank->outRate);
+    DWORD phase, tap;
+
+    // when downsampling the cutoff frequency goes down, and the filters get longer by the same amount
+    double cutoff = bank->outRate < bank->inRate ? (double)bank->outRate / bank->inRate : 1.0;
+    double halfWidth;
+
+    cutoff *= presets[bank->quality].rolloff;
+
+    bank->numPhases = bank->outRate / div;
+    if(bank->numPhases > RESAMPLE_MAX_PHASES)
+        bank->numPhases = RESAMPLE_MAX_PHASES;
+
+    bank->halfTaps = (DWORD)ceil(presets[bank->quality].zeroCrossings / cutoff);
+    bank->numTaps = (2 * bank->halfTaps + TAPS_ALIGN - 1) & ~(TAPS_ALIGN - 1);
+    halfWidth = bank->halfTaps;
+
+    if((bank->coefs = calloc(bank->numPhases * bank->numTaps, sizeof(*bank->coefs))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for a filter bank\n", (unsigned)(bank->numPhases * bank->numTaps * sizeof(*bank->coefs)));
+        return false;
+    }
+
+    for(phase = 0; phase < bank->numPhases; ++phase){
+        float *coefs = bank->coefs + phase * bank->numTaps;
+        double frac = (double)phase / bank->numPhases;
+        double sum = 0.0;
+
+        for(tap = 0; tap < 2 * bank->halfTaps; ++tap){
+            // distance of the tap's input sample from the interpolated position
+            double x = (double)tap - bank->halfTaps + 1 - frac;
+            double r = x / halfWidth;
+            double sinc = x == 0.0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = r <= -1.0 || r >= 1.0 ? 0.0 :
+                            besselI0(presets[bank->quality].kaiserBeta * sqrt(1.0 - r*r)) / besselI0(presets[bank->quality].kaiserBeta);
+
+            coefs[tap] = sinc * window;
+            sum += coefs[tap];
+        }
+
+        // normalize each phase to unity gain, so that a constant signal stays constant
+        for(tap = 0; tap < 2 * bank->halfTaps; ++tap)
+            coefs[tap] /= sum;
+    }
+
+    return true;
+}
+
+// besselI0(): zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x){
+    double sum = 1.0, term = 1.0;
+    int k;
+
+    for(k = 1; k < 64 && term > sum * 1e-12; ++k){
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+static DWORD gcd(DWORD a, DWORD b){
+    while(b != 0){
+        DWORD t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+static dotProduct_t selectDotProduct(void){
+#ifdef RESAMPLE_X86_SIMD
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return dotProduct_AVX2;
+
+    if(__builtin_cpu_supports("sse2"))
+        return dotProduct_SSE2;
+#endif
+
+    return dotProduct_C;
+}
+
+static float dotProduct_C(const float *a, const float *b, DWORD len){
+    float sum = 0.0f;
+    DWORD i;
+
+    for(i = 0; i < len; ++i)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+#ifdef RESAMPLE_X86_SIMD
+__attribute__((target("sse2")))
+static float dotProduct_SSE2(const float *a, const float *b, DWORD len){
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    DWORD i;
+
+    for(i = 0; i < len; i += 8){
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    // horizontal sum of the 4 lanes
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+    sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+
+    return _mm_cvtss_f32(sum0);
+}
+
+__attribute__((target("avx2,fma")))
+static float dotProduct_AVX2(const float *a, const float *b, DWORD len){
+    __m256 sum = _mm256_setzero_ps();
+    __m128 sum128;
+    DWORD i;
+
+    for(i = 0; i < len; i += 8)
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+
+    // horizontal sum of the 8 lanes
+    sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_add_ps(sum128, _mm_movehl_ps(sum128, sum128));
+    sum128 = _mm_add_ss(sum128, _mm_shuffle_ps(sum128, sum128, 1));
+
+    return _mm_cvtss_f32(sum128);
+}
+#endif
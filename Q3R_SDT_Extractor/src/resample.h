@@ -0,0 +1,39 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/* Polyphase windowed-sinc resampler for 16-bit mono PCM.
+**
+** For each (input rate, output rate, quality) combination a filter bank is computed once
+** and kept around for the following calls: the output/input rates ratio is reduced to
+** L/M, and the bank holds L phases (one for each fractional position an output sample can
+** fall on between two input samples), each one being a Kaiser-windowed sinc low-pass filter
+** with its cutoff at the lowest of the two Nyquist frequencies.
+** Ratios which would need more than RESAMPLE_MAX_PHASES phases use the nearest phase instead.
+**
+** The filters' inner products use AVX2/FMA or SSE2 when the CPU (and the compiler) supports them.
+*/
+#define RESAMPLE_MAX_PHASES     1024
+
+typedef enum resampleQuality_e{
+    RESAMPLE_FAST,      //  8 zero crossings per side, 85% of the bandwidth preserved
+    RESAMPLE_MEDIUM,    // 16 zero crossings per side, 90% of the bandwidth preserved
+    RESAMPLE_BEST       // 32 zero crossings per side, 95% of the bandwidth preserved
+}resampleQuality_t;
+
+// resample_numSamples(): number of samples produced by resampling numSamples samples from inRate to outRate
+DWORD resample_numSamples(DWORD numSamples, DWORD inRate, DWORD outRate);
+
+/* resample(): resample numIn samples from inRate to outRate; out must have room for
+** resample_numSamples(numIn, inRate, outRate) samples.
+** Returns false if the filter bank or the work buffer couldn't be allocated.
+*/
+bool resample(const short *in, DWORD numIn, DWORD inRate, short *out, DWORD outRate, resampleQuality_t quality);
+
+// resample_free(): free the cached filter banks
+void resample_free(void);
+
+#endif /* RESAMPLE_H */
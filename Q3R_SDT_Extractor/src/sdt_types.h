@@ -0,0 +1,108 @@
+#ifndef SDT_TYPES_H
+#define SDT_TYPES_H
+
+typedef enum SDTtype_e{
+    SDT_TYPE_1 = 0x0000,
+    SDT_TYPE_2 = 0x3039
+}SDTtype_t;
+
+/*********** SDT archive types ***********
+** There are 2 types of SDT archives identified by the SDT_type field in the SDT_header_t structure,
+** which differ as follows in their structure:
+**
+
+******** SDT_TYPE_1 ********
+- SDT_header_t
+- array of numFiles offsets to subfiles ("subFilesOffsets" in the code below); each subfile's data block is preceded by
+  a SDT_subfileHeader_t header, like this:
+    - subfile 1's subfileHeader_t
+    - subfile 1's data
+
+    - subfile 2's subfileHeader_t
+    - subfile 2's data
+    ....
+    - subfile N's subfileHeader_t
+    - subfile N's data
+
+******** SDT_TYPE_2 ********
+- SDT_header_t
+- array of numFiles offsets to subfiles' data("subFilesOffsets" in the code below); unlike SDT_TYPE_1, the offsets
+  point directly to subfiles' data this time, since the subfileHeader_t headers are organized sequentially
+  as an array and placed after the array of offsets.
+- array of numFiles subfileHeader_t headers.
+
+********************************************
+
+** In other words, in SDT_TYPE_1 archives each subfileHeader_t header precedes the subfile's data it's associated to,
+** and the offsets point to the headers which are then followed by the subfiles' data, while in SDT_TYPE_2 archives the
+** archive structure follows this scheme:
+
+    - SDT_header_t
+
+    - subfile 1's data offset
+    - subfile 2's data offset
+    ...
+    - subfile N's data offset
+
+    - subfile 1's subFileHeader_t header
+    - subfile 2's subFileHeader_t header
+    ...
+    - subfile N's subFileHeader_t header
+
+    - subfile 1's data
+    - subfile 2's data
+    ...
+    - subfile N's data
+
+** Confused yet? :)
+
+*****************************************/
+
+
+/* macros used for the values in the sndFormat field in the structure
+** SDT_subfileHeader_t.
+** It's obvious that this field is actually a bitfield containing
+** several flags indicating much more than the sound format
+** (notice how bit 15 is set for VAG ADPCM, and bit 13 is set for MP2),
+** but since the other fields aren't important for ripping purposes
+** I'll just keep it as it is, especially since I've only encountered the 3 values
+** listed below for all the entries I've examined.
+** A bitmask would have probably made this look a little more elegant, but whatever.
+*/
+#define SNDFORMAT_VAG   0x8010
+#define SNDFORMAT_MP2   0x2410
+#define SNDFORMAT_MP2_2 0x2510
+
+
+#define SWAP_ENDIAN16(x) (((x) >> 8) | ((x) << 8))
+#define SWAP_ENDIAN32(x) (((x)>>24) | (((x)>>8) & 0xFF00) | (((x)<<8) & 0x00FF0000) | ((x)<<24))
+
+typedef unsigned char   BYTE;
+typedef unsigned short  WORD;
+typedef unsigned int    DWORD;
+
+typedef struct SDT_header_s{
+    WORD numFiles;
+    WORD SDT_type;
+}SDT_header_t;
+
+typedef struct SDT_subfileHeader_s{
+    DWORD currHeaderSize;   // seems to be always 0x28
+    DWORD dataSize;
+    char fileName[16];
+    WORD sampleRate;
+    WORD sndFormat;   // 0x8010 for .VAG ADPCM, 0x2410/0x2510 for .MP2
+    DWORD unk1, unk2, unk3;
+}SDT_subfileHeader_t;
+
+typedef struct VAGhdr_s{            // All the values in this header must be big endian
+        char id[4];                 // VAGp
+        DWORD version;              // I guess it doesn't matter, so I'll place a 0 here and call it a day
+        DWORD reserved;             // I guess it doesn't matter either
+        DWORD dataSize;
+        DWORD samplingFrequency;
+        char  reserved2[12];
+        char  name[16];
+}VAGhdr_t;
+
+#endif /* SDT_TYPES_H */
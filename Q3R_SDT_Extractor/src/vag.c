@@ -0,0 +1,59 @@
+#include "vag.h"
+
+#define VAG_FLAG_END    7
+
+// predictor filters' coefficients, in 1/64 units
+static const int vagCoefs[5][2] = {
+    {  0,   0},
+    { 60,   0},
+    {115, -52},
+    { 98, -55},
+    {122, -60}
+};
+
+DWORD vag_numSamples(DWORD dataSize){
+    return (dataSize / VAG_BLOCK_SIZE) * VAG_SAMPLES_PER_BLOCK;
+}
+
+DWORD vag_decode(const BYTE *adpcm, DWORD dataSize, short *pcm){
+    const BYTE *blockEnd = adpcm + (dataSize / VAG_BLOCK_SIZE) * VAG_BLOCK_SIZE;
+    short *pcmStart = pcm;
+
+    int hist1 = 0, hist2 = 0;   // the previous 2 decoded samples
+    int coef1, coef2, shift, sample, i;
+
+    for(; adpcm < blockEnd; adpcm += VAG_BLOCK_SIZE){
+        unsigned filter = adpcm[0] >> 4;
+
+        if(adpcm[1] == VAG_FLAG_END)
+            break;
+
+        // there are only 5 filters; clamp any garbage value to the last one
+        if(filter > 4)
+            filter = 4;
+
+        coef1 = vagCoefs[filter][0];
+        coef2 = vagCoefs[filter][1];
+        shift = adpcm[0] & 0xF;
+
+        for(i = 0; i < VAG_SAMPLES_PER_BLOCK; ++i){
+            int nibble = (adpcm[2 + i/2] >> ((i & 1) * 4)) & 0xF;
+
+            // sign-extend the nibble to 16 bits, then scale it down by the shift value
+            sample = ((short)(nibble << 12)) >> shift;
+            sample += (hist1 * coef1 + hist2 * coef2) >> 6;
+
+            if(sample > 32767)
+                sample = 32767;
+            else if(sample < -32768)
+                sample = -32768;
+
+            *pcm++ = sample;
+
+            hist2 = hist1;
+            hist1 = sample;
+        }
+    }
+
+    return pcm - pcmStart;
+}
@@ -0,0 +1,27 @@
+#ifndef VAG_H
+#define VAG_H
+
+#include "sdt_types.h"
+
+/* PS-ADPCM (the sound data format of .VAG files) is organized in 16 byte blocks,
+** each one encoding 28 samples:
+** - byte 0: predictor filter index (high nibble) and shift value (low nibble);
+** - byte 1: flags (loop start/end markers; 7 marks the end of the stream);
+** - bytes 2-15: 28 4-bit signed samples, low nibble first.
+**
+** Each sample is decoded as (nibble << 12) >> shift, plus a prediction computed
+** from the previous 2 decoded samples with the block's filter coefficients.
+*/
+#define VAG_BLOCK_SIZE          16
+#define VAG_SAMPLES_PER_BLOCK   28
+
+// vag_numSamples(): upper bound of the number of samples decoded from dataSize bytes of ADPCM data
+DWORD vag_numSamples(DWORD dataSize);
+
+/* vag_decode(): decode dataSize bytes of ADPCM data into 16-bit PCM samples;
+** pcm must have room for vag_numSamples(dataSize) samples.
+** Returns the number of decoded samples.
+*/
+DWORD vag_decode(const BYTE *adpcm, DWORD dataSize, short *pcm);
+
+#endif /* VAG_H */
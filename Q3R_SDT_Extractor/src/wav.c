@@ -0,0 +1,21 @@
+#include <string.h>
+
+#include "wav.h"
+
+void wav_initHdr(wavHdr_t *wavHdr, DWORD sampleRate, DWORD dataSize){
+    memcpy(wavHdr->riffId, "RIFF", 4);
+    wavHdr->riffSize = sizeof(*wavHdr) - 8 + dataSize;
+    memcpy(wavHdr->waveId, "WAVE", 4);
+
+    memcpy(wavHdr->fmtId, "fmt ", 4);
+    wavHdr->fmtSize = 16;
+    wavHdr->audioFormat = 1;
+    wavHdr->numChannels = 1;
+    wavHdr->sampleRate = sampleRate;
+    wavHdr->byteRate = sampleRate * sizeof(short);
+    wavHdr->blockAlign = sizeof(short);
+    wavHdr->bitsPerSample = 16;
+
+    memcpy(wavHdr->dataId, "data", 4);
+    wavHdr->dataSize = dataSize;
+}
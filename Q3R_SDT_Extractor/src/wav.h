@@ -0,0 +1,28 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include "sdt_types.h"
+
+// canonical 44-byte RIFF/WAVE header for uncompressed PCM data
+typedef struct wavHdr_s{
+    char    riffId[4];      // "RIFF"
+    DWORD   riffSize;       // file size - 8
+    char    waveId[4];      // "WAVE"
+
+    char    fmtId[4];       // "fmt "
+    DWORD   fmtSize;        // 16
+    WORD    audioFormat;    // 1 = PCM
+    WORD    numChannels;
+    DWORD   sampleRate;
+    DWORD   byteRate;
+    WORD    blockAlign;
+    WORD    bitsPerSample;
+
+    char    dataId[4];      // "data"
+    DWORD   dataSize;
+}wavHdr_t;
+
+// wav_initHdr(): fill a header for dataSize bytes of 16-bit mono PCM data
+void wav_initHdr(wavHdr_t *wavHdr, DWORD sampleRate, DWORD dataSize);
+
+#endif /* WAV_H */
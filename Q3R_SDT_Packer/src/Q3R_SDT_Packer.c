@@ -0,0 +1,584 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include "sdt_types.h"
+#include "dirlist.h"
+#include "vagenc.h"
+#include "wav.h"
+#include "threads.h"
+
+/* Q3R_SDT_Packer rebuilds an SDT archive out of a folder of .vag/.mp2 files
+** (e.g. a folder previously created by Q3R_SDT_Extractor.)
+**
+** The layout is computed in advance from the input files' sizes, so the headers and
+** offset tables can be written first and the sound data can then be streamed
+** straight from each input file to the output archive through a small buffer,
+** without ever loading a whole subfile in memory.
+**
+** .wav files are encoded to VAG while gathering the layout instead, and their encoded
+** data is kept in memory until it's written.
+*/
+
+#define COPYBUF_SIZE    (64 * 1024)
+
+// information gathered for each input file during the first pass
+typedef struct packEntry_s{
+    char                *fileName;
+    DWORD               payloadOffset;  // where the sound data starts inside the input file (past the VAG header, if any)
+    BYTE                *encodedData;   // if not NULL, the sound data encoded from a .wav file
+    SDT_subfileHeader_t subfileHeader;
+}packEntry_t;
+
+// options specified on the command line
+typedef struct options_s{
+    SDTtype_t   SDTtype;
+    unsigned    numThreads;     // worker threads used for encoding
+    bool        encodeVAG;      // encode a single .wav file to .vag instead of packing a folder
+}options_t;
+
+
+// global variables(used only inside this module)
+static char path[FILENAME_MAX];
+static char *currFilePtr;
+
+static options_t options;
+
+static BYTE copyBuf[COPYBUF_SIZE];
+
+// local functions declarations
+static void printUsage(void);
+static int parseOptions(int argc, char **argv);
+static bool hasExtension(const char *fileName, const char *ext);
+static bool encode_VAGfile(const char *inPath, const char *outPath);
+static bool init_packEntry(packEntry_t *packEntry, char *fileName);
+static bool read_VAGinfo(FILE *in_fp, long fileSize, packEntry_t *packEntry);
+static bool read_MP2info(FILE *in_fp, long fileSize, packEntry_t *packEntry);
+static bool encode_WAV(packEntry_t *packEntry);
+static void free_packEntries(packEntry_t *packEntries, unsigned numFiles);
+static unsigned long long get_SDTsize(const packEntry_t *packEntries, unsigned numFiles);
+static bool write_SDT(FILE *out_fp, SDTtype_t SDTtype, packEntry_t *packEntries, unsigned numFiles);
+static bool copy_payload(FILE *out_fp, packEntry_t *packEntry);
+
+
+int main(int argc, char **argv){
+    FILE *out_fp;
+
+    char **dirList;
+    unsigned numDirEntries, numFiles, i;
+
+    packEntry_t *packEntries;
+
+    int firstArgIdx;
+    bool success;
+
+    puts("\t\tQuake 3 Revolution SDT packer by Yagotzirck");
+
+    if(argc == 1){
+        printUsage();
+        return 1;
+    }
+
+    firstArgIdx = parseOptions(argc, argv);
+
+    if(argc - firstArgIdx != 2){
+        printUsage();
+        return 1;
+    }
+
+    if(options.encodeVAG)
+        return encode_VAGfile(argv[firstArgIdx], argv[firstArgIdx + 1]) ? 0 : 1;
+
+    if((dirList = listDir(argv[firstArgIdx], &numDirEntries)) == NULL)
+        return 1;
+
+    if(numDirEntries == 0){
+        fprintf(stderr, "%s contains no files\n", argv[firstArgIdx]);
+        freeDirList(dirList, numDirEntries);
+        return 1;
+    }
+
+    if((packEntries = malloc(numDirEntries * sizeof(*packEntries))) == NULL){
+        fprintf(stderr, "Couldn't allocate %u bytes for the subfiles' list\n", (unsigned)(numDirEntries * sizeof(*packEntries)));
+        freeDirList(dirList, numDirEntries);
+        return 1;
+    }
+
+    // the input files' paths are built on this buffer
+    snprintf(path, sizeof(path), "%s/", argv[firstArgIdx]);
+    currFilePtr = path + strlen(path);
+
+    // first pass: gather each subfile's header data and size
+    for(i = 0, numFiles = 0; i < numDirEntries; ++i)
+        if(init_packEntry(&packEntries[numFiles], dirList[i]))
+            ++numFiles;
+
+    if(numFiles == 0 || numFiles > 0xFFFF){
+        fprintf(stderr, "%s contains %u packable files (it must be between 1 and 65535)\n", argv[firstArgIdx], numFiles);
+        free_packEntries(packEntries, numFiles);
+        freeDirList(dirList, numDirEntries);
+        return 1;
+    }
+
+    // the subfiles' offsets are 32 bit values
+    if(get_SDTsize(packEntries, numFiles) > 0xFFFFFFFF){
+        fprintf(stderr, "%s's files add up to more than the 4 GB an SDT archive can hold\n", argv[firstArgIdx]);
+        free_packEntries(packEntries, numFiles);
+        freeDirList(dirList, numDirEntries);
+        return 1;
+    }
+
+    if((out_fp = fopen(argv[firstArgIdx + 1], "wb")) == NULL){
+        fprintf(stderr, "Couldn't create file %s: %s\n", argv[firstArgIdx + 1], strerror(errno));
+        free_packEntries(packEntries, numFiles);
+        freeDirList(dirList, numDirEntries);
+        return 1;
+    }
+
+    // second pass: write the archive
+    printf("Packing %u files into %s...", numFiles, argv[firstArgIdx + 1]);
+
+    success = write_SDT(out_fp, options.SDTtype, packEntries, numFiles);
+
+    if(fclose(out_fp) != 0)
+        success = false;
+
+    if(success)
+        puts("done");
+    else
+        remove(argv[firstArgIdx + 1]);
+
+    free_packEntries(packEntries, numFiles);
+    freeDirList(dirList, numDirEntries);
+
+    return success ? 0 : 1;
+}
+
+// local functions definitions
+
+static void printUsage(void){
+    fputs(
+        "Usage: Q3R_SDT_Packer.exe [options] <input folder> <output.SDT>\n"
+        "       Q3R_SDT_Packer.exe -vag [-j <threads>] <input.wav> <output.vag>\n"
+        "where [options] are one or more of the following:\n\n"
+
+        "-type1\n\t"
+            "Place each subfile header right before its sound data,\n\t"
+            "with the offsets array pointing to the headers.\n\n"
+
+        "-type2\n\t"
+            "Place all the subfile headers in an array following the offsets\n\t"
+            "array, with the offsets pointing directly to the sound data.\n\n"
+
+        "-j <threads>\n\t"
+            "Encode .wav files using up to <threads> threads\n\t"
+            "(by default, as many as the available CPUs.)\n\n"
+
+        "-vag\n\t"
+            "Encode a single 16-bit PCM .wav file to a .vag file\n\t"
+            "instead of packing a folder.\n\n"
+
+        "If neither -type1 nor -type2 is specified, -type1 will be used by default.\n"
+        "All the .vag, .mp2 and .wav files in <input folder> are packed in alphabetical order;\n"
+        ".wav files (16-bit PCM, mono or stereo) are encoded to VAG first.\n",
+
+      stderr
+    );
+}
+
+/* parseOptions(): parse the options preceding the input/output paths (case insensitive,
+** with either one or two leading hyphens), returning the index of the first path in argv
+*/
+static int parseOptions(int argc, char **argv){
+    char option_lowercase[FILENAME_MAX];
+    int i, j;
+
+    options.SDTtype = SDT_TYPE_1;
+    options.numThreads = getNumCPUs();
+    options.encodeVAG = false;
+
+    for(i = 1; i < argc && argv[i][0] == '-'; ++i){
+        const char *option = argv[i][1] == '-' ? argv[i] + 1 : argv[i];
+
+        // get rid of case sensitivity
+        for(j = 0; option[j] != '\0' && j < sizeof(option_lowercase) - 1; j++)
+            option_lowercase[j] = tolower(option[j]);
+        option_lowercase[j] = '\0';
+
+        if(strcmp(option_lowercase, "-type1") == 0)
+            options.SDTtype = SDT_TYPE_1;
+
+        else if(strcmp(option_lowercase, "-type2") == 0)
+            options.SDTtype = SDT_TYPE_2;
+
+        else if(strcmp(option_lowercase, "-vag") == 0)
+            options.encodeVAG = true;
+
+        else if(strcmp(option_lowercase, "-j") == 0 && i + 1 < argc){
+            options.numThreads = strtoul(argv[++i], NULL, 10);
+
+            if(options.numThreads == 0){
+                fprintf(stderr, "Invalid number of threads: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // no supported option has been found; abort the program
+        else{
+            fprintf(stderr, "The option %s is unsupported.\n"
+                            "Invoke this exe without any parameters to see a list of available options.\n", argv[i]);
+
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return i;
+}
+
+
+// hasExtension(): case-insensitive check of fileName's extension
+static bool hasExtension(const char *fileName, const char *ext){
+    const char *fileExt = strrchr(fileName, '.');
+
+    if(fileExt == NULL)
+        return false;
+
+    while(*fileExt != '\0' && tolower(*fileExt) == *ext){
+        ++fileExt;
+        ++ext;
+    }
+
+    return *fileExt == '\0' && *ext == '\0';
+}
+
+// encode_VAGfile(): encode a .wav file to a .vag file, with the same VAG header the extractor writes
+static bool encode_VAGfile(const char *inPath, const char *outPath){
+    FILE *out_fp;
+    VAGhdr_t VAGhdr;
+    const char *fileName;
+    short *pcm;
+    DWORD numSamples, sampleRate, dataSize;
+    BYTE *data;
+    bool success;
+
+    if(!wav_read(inPath, &pcm, &numSamples, &sampleRate))
+        return false;
+
+    printf("Encoding %s...", inPath);
+
+    success = vag_encode(pcm, numSamples, options.numThreads, &data, &dataSize);
+    free(pcm);
+
+    if(!success)
+        return false;
+
+    if((out_fp = fopen(outPath, "wb")) == NULL){
+        fprintf(stderr, "\n\tCouldn't create file %s: %s\n", outPath, strerror(errno));
+        free(data);
+        return false;
+    }
+
+    // the name field holds the output file's name, without the folders
+    fileName = outPath + strlen(outPath);
+    while(fileName != outPath && fileName[-1] != '/' && fileName[-1] != '\\')
+        --fileName;
+
+    memset(&VAGhdr, 0, sizeof(VAGhdr));
+    memcpy(VAGhdr.id, "VAGp", sizeof(VAGhdr.id));
+    VAGhdr.dataSize = SWAP_ENDIAN32(dataSize);
+    VAGhdr.samplingFrequency = SWAP_ENDIAN32(sampleRate);
+    strncpy(VAGhdr.reserved2, "Yagotzirck", sizeof(VAGhdr.reserved2));
+    strncpy(VAGhdr.name, fileName, sizeof(VAGhdr.name));
+
+    fwrite(&VAGhdr, sizeof(VAGhdr), 1, out_fp);
+    fwrite(data, 1, dataSize, out_fp);
+    free(data);
+
+    success = !ferror(out_fp);
+    if(fclose(out_fp) != 0)
+        success = false;
+
+    if(success)
+        puts("done");
+    else{
+        fprintf(stderr, "\n\tCouldn't write %s: %s\n", outPath, strerror(errno));
+        remove(outPath);
+    }
+
+    return success;
+}
+
+/* init_packEntry(): fill packEntry with the data needed to write fileName's subfile header,
+** returning false if the file isn't a .vag/.mp2/.wav file or can't be read.
+*/
+static bool init_packEntry(packEntry_t *packEntry, char *fileName){
+    FILE *in_fp;
+    long fileSize;
+
+    bool isVAG, success;
+
+    packEntry->fileName = fileName;
+    packEntry->encodedData = NULL;
+
+    if(hasExtension(fileName, ".vag"))
+        isVAG = true;
+    else if(hasExtension(fileName, ".mp2"))
+        isVAG = false;
+    else if(hasExtension(fileName, ".wav"))
+        return encode_WAV(packEntry);
+    else{
+        fprintf(stderr, "Skipping %s (not a .vag/.mp2/.wav file)\n", fileName);
+        return false;
+    }
+
+    strcpy(currFilePtr, fileName);
+    if((in_fp = fopen(path, "rb")) == NULL){
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fseek(in_fp, 0, SEEK_END);
+    fileSize = ftell(in_fp);
+    rewind(in_fp);
+
+    // the subfile header's data size is a 32 bit value
+    if(fileSize < 0 || (unsigned long long)fileSize > 0xFFFFFFFF){
+        fprintf(stderr, "%s is too big to be packed\n", path);
+        fclose(in_fp);
+        return false;
+    }
+
+    memset(&packEntry->subfileHeader, 0, sizeof(packEntry->subfileHeader));
+    packEntry->subfileHeader.currHeaderSize = sizeof(packEntry->subfileHeader);
+
+    /* the extractor names the files after the 16 characters in the subfile header, with everything
+    ** from the first '.' on (or the end of the name) replaced by the sound format's extension;
+    ** so the name comes back as it is as long as it has no other dots and it fits in 16 characters
+    ** without its extension.
+    */
+    strncpy(packEntry->subfileHeader.fileName, fileName, sizeof(packEntry->subfileHeader.fileName));
+
+    if(isVAG)
+        success = read_VAGinfo(in_fp, fileSize, packEntry);
+    else
+        success = read_MP2info(in_fp, fileSize, packEntry);
+
+    fclose(in_fp);
+    return success;
+}
+
+/* read_VAGinfo(): the VAG header is removed, since the SDT subfile header
+** holds the same information (the data size and the sampling frequency.)
+*/
+static bool read_VAGinfo(FILE *in_fp, long fileSize, packEntry_t *packEntry){
+    VAGhdr_t VAGhdr;
+    DWORD dataSize;
+
+    if(fileSize < sizeof(VAGhdr) || !fread(&VAGhdr, sizeof(VAGhdr), 1, in_fp) || memcmp(VAGhdr.id, "VAGp", 4) != 0){
+        fprintf(stderr, "%s doesn't appear to be a valid VAG file\n", path);
+        return false;
+    }
+
+    // some tools include the header in the dataSize field, so we don't trust it blindly
+    dataSize = SWAP_ENDIAN32(VAGhdr.dataSize);
+    if(dataSize > fileSize - sizeof(VAGhdr))
+        dataSize = fileSize - sizeof(VAGhdr);
+
+    packEntry->payloadOffset = sizeof(VAGhdr);
+    packEntry->subfileHeader.dataSize = dataSize;
+    packEntry->subfileHeader.sampleRate = SWAP_ENDIAN32(VAGhdr.samplingFrequency);
+    packEntry->subfileHeader.sndFormat = SNDFORMAT_VAG;
+
+    return true;
+}
+
+/* read_MP2info(): the sample rate is taken from the first MPEG audio frame header;
+** the file is stored as-is.
+*/
+static bool read_MP2info(FILE *in_fp, long fileSize, packEntry_t *packEntry){
+    static const WORD sampleRates[4][3] = {
+        {11025, 12000,  8000},  // MPEG 2.5
+        {    0,     0,     0},  // reserved
+        {22050, 24000, 16000},  // MPEG 2
+        {44100, 48000, 32000}   // MPEG 1
+    };
+
+    BYTE frameHdr[4];
+    unsigned version, rateIdx;
+
+    if(!fread(frameHdr, sizeof(frameHdr), 1, in_fp) || frameHdr[0] != 0xFF || (frameHdr[1] & 0xE0) != 0xE0){
+        fprintf(stderr, "%s doesn't appear to be a valid MP2 file\n", path);
+        return false;
+    }
+
+    version = (frameHdr[1] >> 3) & 3;
+    rateIdx = (frameHdr[2] >> 2) & 3;
+
+    if(rateIdx == 3 || sampleRates[version][rateIdx] == 0){
+        fprintf(stderr, "%s has an invalid sample rate in its first frame header\n", path);
+        return false;
+    }
+
+    packEntry->payloadOffset = 0;
+    packEntry->subfileHeader.dataSize = fileSize;
+    packEntry->subfileHeader.sampleRate = sampleRates[version][rateIdx];
+    packEntry->subfileHeader.sndFormat = SNDFORMAT_MP2;
+
+    return true;
+}
+
+/* encode_WAV(): encode a .wav file's samples to VAG, keeping the encoded data until the archive is written;
+** the subfile gets the .wav file's name with a .vag extension.
+*/
+static bool encode_WAV(packEntry_t *packEntry){
+    SDT_subfileHeader_t *hdr = &packEntry->subfileHeader;
+    char *fileExt;
+    short *pcm;
+    DWORD numSamples, sampleRate, dataSize;
+    bool success;
+
+    strcpy(currFilePtr, packEntry->fileName);
+    if(!wav_read(path, &pcm, &numSamples, &sampleRate))
+        return false;
+
+    success = vag_encode(pcm, numSamples, options.numThreads, &packEntry->encodedData, &dataSize);
+    free(pcm);
+
+    if(!success)
+        return false;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->currHeaderSize = sizeof(*hdr);
+    hdr->dataSize = dataSize;
+    hdr->sampleRate = sampleRate;
+    hdr->sndFormat = SNDFORMAT_VAG;
+
+    // same naming rules as init_packEntry(), but the extension (when it fits) must be the extractor's one
+    strncpy(hdr->fileName, packEntry->fileName, sizeof(hdr->fileName));
+
+    fileExt = memchr(hdr->fileName, '.', sizeof(hdr->fileName));
+    if(fileExt != NULL && fileExt + 4 <= hdr->fileName + sizeof(hdr->fileName))
+        memcpy(fileExt, ".vag", 4);
+
+    packEntry->payloadOffset = 0;
+    return true;
+}
+
+static void free_packEntries(packEntry_t *packEntries, unsigned numFiles){
+    unsigned i;
+
+    for(i = 0; i < numFiles; ++i)
+        free(packEntries[i].encodedData);
+
+    free(packEntries);
+}
+
+
+// get_SDTsize(): the archive's size, which is the same for both types (only the headers' placement differs)
+static unsigned long long get_SDTsize(const packEntry_t *packEntries, unsigned numFiles){
+    unsigned long long size = sizeof(SDT_header_t) + (unsigned long long)numFiles * (sizeof(DWORD) + sizeof(SDT_subfileHeader_t));
+    unsigned i;
+
+    for(i = 0; i < numFiles; ++i)
+        size += packEntries[i].subfileHeader.dataSize;
+
+    return size;
+}
+
+static bool write_SDT(FILE *out_fp, SDTtype_t SDTtype, packEntry_t *packEntries, unsigned numFiles){
+    SDT_header_t    SDT_header;
+    DWORD*          subFilesOffsets;
+    DWORD           currOffset;
+
+    unsigned i;
+
+    SDT_header.numFiles = numFiles;
+    SDT_header.SDT_type = SDTtype;
+
+    if((subFilesOffsets = malloc(numFiles * sizeof(*subFilesOffsets))) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for the offsets array\n", (unsigned)(numFiles * sizeof(*subFilesOffsets)));
+        return false;
+    }
+
+    /* compute the offsets array:
+    ** - SDT_TYPE_1's offsets point to each subfile's header, which precedes the subfile's data;
+    ** - SDT_TYPE_2's offsets point to each subfile's data, which follows the array of headers.
+    */
+    currOffset = sizeof(SDT_header) + numFiles * sizeof(*subFilesOffsets);
+
+    if(SDTtype == SDT_TYPE_1)
+        for(i = 0; i < numFiles; ++i){
+            subFilesOffsets[i] = currOffset;
+            currOffset += sizeof(packEntries[i].subfileHeader) + packEntries[i].subfileHeader.dataSize;
+        }
+    else{
+        currOffset += numFiles * sizeof(packEntries[0].subfileHeader);
+
+        for(i = 0; i < numFiles; ++i){
+            subFilesOffsets[i] = currOffset;
+            currOffset += packEntries[i].subfileHeader.dataSize;
+        }
+    }
+
+    fwrite(&SDT_header, sizeof(SDT_header), 1, out_fp);
+    fwrite(subFilesOffsets, sizeof(*subFilesOffsets), numFiles, out_fp);
+    free(subFilesOffsets);
+
+    if(SDTtype == SDT_TYPE_2)
+        for(i = 0; i < numFiles; ++i)
+            fwrite(&packEntries[i].subfileHeader, sizeof(packEntries[i].subfileHeader), 1, out_fp);
+
+    for(i = 0; i < numFiles; ++i){
+        if(SDTtype == SDT_TYPE_1)
+            fwrite(&packEntries[i].subfileHeader, sizeof(packEntries[i].subfileHeader), 1, out_fp);
+
+        if(!copy_payload(out_fp, &packEntries[i]))
+            return false;
+    }
+
+    if(ferror(out_fp)){
+        fprintf(stderr, "\n\tCouldn't write the archive: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// copy_payload(): stream a subfile's sound data from its input file (or its encoded data) to the archive
+static bool copy_payload(FILE *out_fp, packEntry_t *packEntry){
+    FILE *in_fp;
+    DWORD bytesLeft = packEntry->subfileHeader.dataSize;
+    size_t chunkSize;
+
+    if(packEntry->encodedData != NULL){
+        fwrite(packEntry->encodedData, 1, bytesLeft, out_fp);
+        return true;
+    }
+
+    strcpy(currFilePtr, packEntry->fileName);
+    if((in_fp = fopen(path, "rb")) == NULL){
+        fprintf(stderr, "\n\tCouldn't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fseek(in_fp, packEntry->payloadOffset, SEEK_SET);
+
+    while(bytesLeft){
+        chunkSize = bytesLeft < sizeof(copyBuf) ? bytesLeft : sizeof(copyBuf);
+
+        if(fread(copyBuf, 1, chunkSize, in_fp) != chunkSize){
+            fprintf(stderr, "\n\tCouldn't read %s's sound data\n", path);
+            fclose(in_fp);
+            return false;
+        }
+
+        fwrite(copyBuf, 1, chunkSize, out_fp);
+        bytesLeft -= chunkSize;
+    }
+
+    fclose(in_fp);
+    return true;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "dirlist.h"
+
+static int cmpNames(const void *a, const void *b);
+static char **appendName(char **dirList, unsigned *numEntries, unsigned *capacity, const char *name);
+
+char **listDir(const char *path, unsigned *numEntries){
+    char        **dirList;
+    unsigned    capacity = 64;
+    char        searchPath[FILENAME_MAX];
+
+    if((dirList = malloc(capacity * sizeof(*dirList))) == NULL){
+        fprintf(stderr, "Couldn't allocate the directory listing\n");
+        return NULL;
+    }
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE hFind;
+
+    snprintf(searchPath, sizeof(searchPath), "%s\\*", path);
+
+    if((hFind = FindFirstFileA(searchPath, &findData)) == INVALID_HANDLE_VALUE){
+        fprintf(stderr, "Couldn't open directory %s\n", path);
+        free(dirList);
+        return NULL;
+    }
+
+    *numEntries = 0;
+    do{
+        if(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+
+        if((dirList = appendName(dirList, numEntries, &capacity, findData.cFileName)) == NULL)
+            break;
+    }while(FindNextFileA(hFind, &findData));
+
+    FindClose(hFind);
+#else
+    DIR *dir;
+    struct dirent *entry;
+    struct stat st;
+
+    if((dir = opendir(path)) == NULL){
+        fprintf(stderr, "Couldn't open directory %s\n", path);
+        free(dirList);
+        return NULL;
+    }
+
+    *numEntries = 0;
+    while((entry = readdir(dir)) != NULL){
+        snprintf(searchPath, sizeof(searchPath), "%s/%s", path, entry->d_name);
+        if(stat(searchPath, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if((dirList = appendName(dirList, numEntries, &capacity, entry->d_name)) == NULL)
+            break;
+    }
+
+    closedir(dir);
+#endif
+
+    if(dirList != NULL)
+        qsort(dirList, *numEntries, sizeof(*dirList), cmpNames);
+
+    return dirList;
+}
+
+void freeDirList(char **dirList, unsigned numEntries){
+    unsigned i;
+
+    if(dirList == NULL)
+        return;
+
+    for(i = 0; i < numEntries; ++i)
+        free(dirList[i]);
+
+    free(dirList);
+}
+
+
+static int cmpNames(const void *a, const void *b){
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static char **appendName(char **dirList, unsigned *numEntries, unsigned *capacity, const char *name){
+    if(*numEntries == *capacity){
+        char **newList = realloc(dirList, *capacity * 2 * sizeof(*dirList));
+
+        if(newList == NULL){
+            fprintf(stderr, "Couldn't allocate the directory listing\n");
+            freeDirList(dirList, *numEntries);
+            return NULL;
+        }
+
+        dirList = newList;
+        *capacity *= 2;
+    }
+
+    if((dirList[*numEntries] = malloc(strlen(name) + 1)) == NULL){
+        fprintf(stderr, "Couldn't allocate the directory listing\n");
+        freeDirList(dirList, *numEntries);
+        return NULL;
+    }
+
+    strcpy(dirList[(*numEntries)++], name);
+    return dirList;
+}
@@ -0,0 +1,14 @@
+#ifndef DIRLIST_H
+#define DIRLIST_H
+
+/* listDir(): returns a malloc'd array of the names of the regular files
+** contained in the directory specified by path (subdirectories excluded),
+** sorted in ascending order; the number of entries is stored in *numEntries.
+** Returns NULL on failure.
+** As for makeDir() in the extractors, this keeps windows.h (and its WORD/DWORD
+** definitions) away from the rest of the code.
+*/
+char **listDir(const char *path, unsigned *numEntries);
+void freeDirList(char **dirList, unsigned numEntries);
+
+#endif /* DIRLIST_H */
@@ -0,0 +1,50 @@
+#ifndef SDT_TYPES_H
+#define SDT_TYPES_H
+
+/* SDT archive structures, shared with Q3R_SDT_Extractor;
+** refer to Q3R_SDT_Extractor's sdt_types.h for a detailed description of the
+** SDT_TYPE_1 and SDT_TYPE_2 archive layouts.
+*/
+
+typedef unsigned char   BYTE;
+typedef unsigned short  WORD;
+typedef unsigned int    DWORD;
+
+typedef enum SDTtype_e{
+    SDT_TYPE_1 = 0x0000,
+    SDT_TYPE_2 = 0x3039
+}SDTtype_t;
+
+// values used for the sndFormat field in SDT_subfileHeader_t (see Q3R_SDT_Extractor's sdt_types.h)
+#define SNDFORMAT_VAG   0x8010
+#define SNDFORMAT_MP2   0x2410
+#define SNDFORMAT_MP2_2 0x2510
+
+#define SWAP_ENDIAN16(x) (((x) >> 8) | ((x) << 8))
+#define SWAP_ENDIAN32(x) (((x)>>24) | (((x)>>8) & 0xFF00) | (((x)<<8) & 0x00FF0000) | ((x)<<24))
+
+typedef struct SDT_header_s{
+    WORD numFiles;
+    WORD SDT_type;
+}SDT_header_t;
+
+typedef struct SDT_subfileHeader_s{
+    DWORD currHeaderSize;   // seems to be always 0x28
+    DWORD dataSize;
+    char fileName[16];
+    WORD sampleRate;
+    WORD sndFormat;   // 0x8010 for .VAG ADPCM, 0x2410/0x2510 for .MP2
+    DWORD unk1, unk2, unk3;
+}SDT_subfileHeader_t;
+
+typedef struct VAGhdr_s{            // All the values in this header are big endian
+        char id[4];                 // VAGp
+        DWORD version;
+        DWORD reserved;
+        DWORD dataSize;
+        DWORD samplingFrequency;
+        char  reserved2[12];
+        char  name[16];
+}VAGhdr_t;
+
+#endif /* SDT_TYPES_H */
@@ -0,0 +1,32 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stdbool.h>
+
+/* Minimal threads, mutexes and condition variables wrapper: Windows API on Windows,
+** pthreads anywhere else; as for makeDir(), this keeps windows.h away from the rest of the code.
+** The types are opaque, so they're allocated by the create functions.
+*/
+typedef struct thread_s thread_t;
+typedef struct mutex_s mutex_t;
+typedef struct cond_s cond_t;
+
+typedef void (*threadFunc_t)(void *arg);
+
+thread_t *thread_create(threadFunc_t func, void *arg);
+void thread_join(thread_t *thread);     // also frees the thread
+
+mutex_t *mutex_create(void);
+void mutex_free(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+cond_t *cond_create(void);
+void cond_free(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_broadcast(cond_t *cond);
+
+// getNumCPUs(): number of logical processors, at least 1
+unsigned getNumCPUs(void);
+
+#endif /* THREADS_H */
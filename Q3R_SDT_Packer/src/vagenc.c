@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vagenc.h"
+#include "threads.h"
+
+/* the SIMD search needs GCC/Clang's target attributes and cpu detection builtins;
+** any other compiler (e.g. tcc) gets the plain C version
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && \
+    (defined(__i386__) || defined(__x86_64__))
+    #define VAGENC_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+#define NUM_FILTERS     5
+#define NUM_SHIFTS      13      // shifts above 12 leave nothing of the nibbles
+#define NUM_CANDIDATES  (NUM_FILTERS * NUM_SHIFTS)
+
+#define VAG_FLAG_LAST   1       // last block of a non-looping sound
+#define VAG_FLAG_END    7
+
+typedef unsigned long long QWORD;
+
+// search function: returns the best candidate (filter * NUM_SHIFTS + shift) for a block
+typedef unsigned (*searchFunc_t)(const short *samples, int hist1, int hist2);
+
+// shared by the threads encoding a stream's segments
+typedef struct encodeCtx_s{
+    const short *   pcm;
+    DWORD           numSamples;
+    DWORD           numBlocks;      // audio blocks, excluding the leading silent block and the end marker
+    BYTE *          blocks;         // where the first audio block goes
+    searchFunc_t    search;
+
+    unsigned        numSegments;
+    unsigned        nextSegment;
+    mutex_t *       mutex;
+}encodeCtx_t;
+
+// predictor filters' coefficients, in 1/64 units
+static const int vagCoefs[NUM_FILTERS][2] = {
+    {  0,   0},
+    { 60,   0},
+    {115, -52},
+    { 98, -55},
+    {122, -60}
+};
+
+
+// local functions declarations
+static void encodeSegment(encodeCtx_t *ctx, unsigned segment);
+static void segmentWorker(void *arg);
+static void getBlockSamples(const encodeCtx_t *ctx, DWORD block, short *samples);
+static QWORD encodeCandidate(const short *samples, int *hist1, int *hist2, unsigned filter, unsigned shift, BYTE *nibbles);
+static unsigned search_C(const short *samples, int hist1, int hist2);
+#ifdef VAGENC_X86_SIMD
+static unsigned search_AVX2(const short *samples, int hist1, int hist2);
+#endif
+
+
+bool vag_encode(const short *pcm, DWORD numSamples, unsigned numThreads, BYTE **out, DWORD *outSize){
+    encodeCtx_t ctx;
+    thread_t **threads = NULL;
+    unsigned numWorkers, i;
+
+    ctx.pcm = pcm;
+    ctx.numSamples = numSamples;
+    ctx.numBlocks = (numSamples + VAG_SAMPLES_PER_BLOCK - 1) / VAG_SAMPLES_PER_BLOCK;
+    ctx.numSegments = (ctx.numBlocks + VAG_SEGMENT_BLOCKS - 1) / VAG_SEGMENT_BLOCKS;
+    ctx.nextSegment = 0;
+    ctx.mutex = NULL;
+
+    ctx.search = search_C;
+#ifdef VAGENC_X86_SIMD
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        ctx.search = search_AVX2;
+#endif
+
+    *outSize = (ctx.numBlocks + 2) * VAG_BLOCK_SIZE;
+
+    if((*out = malloc(*outSize)) == NULL){
+        fprintf(stderr, "\n\tCouldn't allocate %u bytes for the encoded sound data\n", *outSize);
+        return false;
+    }
+
+    // a silent block first, then the sound data and the end marker block
+    memset(*out, 0, VAG_BLOCK_SIZE);
+    ctx.blocks = *out + VAG_BLOCK_SIZE;
+
+    memset(ctx.blocks + ctx.numBlocks * VAG_BLOCK_SIZE, 0x77, VAG_BLOCK_SIZE);
+    ctx.blocks[ctx.numBlocks * VAG_BLOCK_SIZE] = 0;
+    ctx.blocks[ctx.numBlocks * VAG_BLOCK_SIZE + 1] = VAG_FLAG_END;
+
+    numWorkers = numThreads < ctx.numSegments ? numThreads : ctx.numSegments;
+
+    if( numWorkers > 1 &&
+        (ctx.mutex = mutex_create()) != NULL &&
+        (threads = malloc(numWorkers * sizeof(*threads))) != NULL
+    ){
+        // the current thread works too; if a thread can't be created, the others pick up its segments
+        for(i = 0; i < numWorkers - 1; ++i)
+            threads[i] = thread_create(segmentWorker, &ctx);
+
+        segmentWorker(&ctx);
+
+        for(i = 0; i < numWorkers - 1; ++i)
+            if(threads[i] != NULL)
+                thread_join(threads[i]);
+    }
+    else
+        for(i = 0; i < ctx.numSegments; ++i)
+            encodeSegment(&ctx, i);
+
+    free(threads);
+    mutex_free(ctx.mutex);
+
+    if(ctx.numBlocks)
+        ctx.blocks[(ctx.numBlocks - 1) * VAG_BLOCK_SIZE + 1] = VAG_FLAG_LAST;
+
+    return true;
+}
+
+
+// local functions definitions
+
+static void segmentWorker(void *arg){
+    encodeCtx_t *ctx = arg;
+    unsigned segment;
+
+    for(;;){
+        mutex_lock(ctx->mutex);
+        segment = ctx->nextSegment++;
+        mutex_unlock(ctx->mutex);
+
+        if(segment >= ctx->numSegments)
+            return;
+
+        encodeSegment(ctx, segment);
+    }
+}
+
+static void encodeSegment(encodeCtx_t *ctx, unsigned segment){
+    short samples[VAG_SAMPLES_PER_BLOCK];
+    BYTE nibbles[VAG_SAMPLES_PER_BLOCK];
+    int hist1 = 0, hist2 = 0;
+    DWORD first = segment * VAG_SEGMENT_BLOCKS;
+    DWORD end = first + VAG_SEGMENT_BLOCKS < ctx->numBlocks ? first + VAG_SEGMENT_BLOCKS : ctx->numBlocks;
+    DWORD block = first > VAG_PRIME_BLOCKS ? first - VAG_PRIME_BLOCKS : 0;
+    unsigned best, i;
+    BYTE *out;
+
+    // the priming blocks (if any) only serve to get the predictor history; their output is thrown away
+    for(; block < end; ++block){
+        getBlockSamples(ctx, block, samples);
+
+        best = ctx->search(samples, hist1, hist2);
+        encodeCandidate(samples, &hist1, &hist2, best / NUM_SHIFTS, best % NUM_SHIFTS, nibbles);
+
+        if(block < first)
+            continue;
+
+        out = ctx->blocks + block * VAG_BLOCK_SIZE;
+        out[0] = ((best / NUM_SHIFTS) << 4) | (best % NUM_SHIFTS);
+        out[1] = 0;
+
+        for(i = 0; i < VAG_SAMPLES_PER_BLOCK; i += 2)
+            out[2 + i/2] = nibbles[i] | (nibbles[i + 1] << 4);
+    }
+}
+
+// getBlockSamples(): the last block is padded with silence
+static void getBlockSamples(const encodeCtx_t *ctx, DWORD block, short *samples){
+    DWORD start = block * VAG_SAMPLES_PER_BLOCK;
+    DWORD count = ctx->numSamples - start < VAG_SAMPLES_PER_BLOCK ? ctx->numSamples - start : VAG_SAMPLES_PER_BLOCK;
+
+    memcpy(samples, ctx->pcm + start, count * sizeof(*samples));
+    memset(samples + count, 0, (VAG_SAMPLES_PER_BLOCK - count) * sizeof(*samples));
+}
+
+/* encodeCandidate(): encode a block with the given filter and shift, exactly as the decoder will
+** decode it, updating the predictor history; returns the squared error.
+** nibbles can be NULL when only the error is needed.
+*/
+static QWORD encodeCandidate(const short *samples, int *hist1, int *hist2, unsigned filter, unsigned shift, BYTE *nibbles){
+    int coef1 = vagCoefs[filter][0], coef2 = vagCoefs[filter][1];
+    int step = 12 - shift;                      // decoded residual = nibble * 2^step
+    int round = step ? 1 << (step - 1) : 0;
+    int h1 = *hist1, h2 = *hist2;
+    int pred, n, d, diff;
+    QWORD err = 0;
+    unsigned i;
+
+    for(i = 0; i < VAG_SAMPLES_PER_BLOCK; ++i){
+        pred = (h1 * coef1 + h2 * coef2) >> 6;
+
+        n = (samples[i] - pred + round) >> step;
+        if(n > 7)
+            n = 7;
+        else if(n < -8)
+            n = -8;
+
+        d = n * (1 << step) + pred;
+        if(d > 32767)
+            d = 32767;
+        else if(d < -32768)
+            d = -32768;
+
+        diff = samples[i] - d;
+        err += (QWORD)((long long)diff * diff);
+
+        if(nibbles != NULL)
+            nibbles[i] = n & 0xF;
+
+        h2 = h1;
+        h1 = d;
+    }
+
+    *hist1 = h1;
+    *hist2 = h2;
+    return err;
+}
+
+static unsigned search_C(const short *samples, int hist1, int hist2){
+    QWORD err, bestErr = ~0ULL;
+    unsigned c, best = 0;
+    int h1, h2;
+
+    for(c = 0; c < NUM_CANDIDATES; ++c){
+        h1 = hist1;
+        h2 = hist2;
+        err = encodeCandidate(samples, &h1, &h2, c / NUM_SHIFTS, c % NUM_SHIFTS, NULL);
+
+        if(err < bestErr){
+            bestErr = err;
+            best = c;
+        }
+    }
+
+    return best;
+}
+
+#ifdef VAGENC_X86_SIMD
+/* search_AVX2(): same as search_C(), with each lane evaluating a different candidate;
+** the squared errors are summed as doubles, which hold them exactly, so the result is the same
+*/
+__attribute__((target("avx2,fma")))
+static unsigned search_AVX2(const short *samples, int hist1, int hist2){
+    const __m256i min16 = _mm256_set1_epi32(-32768), max16 = _mm256_set1_epi32(32767);
+    const __m256i minNibble = _mm256_set1_epi32(-8), maxNibble = _mm256_set1_epi32(7);
+    double errs[8], bestErr = 1e300;
+    unsigned c, best = 0, lane, i;
+
+    for(c = 0; c < NUM_CANDIDATES; c += 8){
+        int coef1[8], coef2[8], step[8], round[8];
+        __m256i vCoef1, vCoef2, vStep, vRound, h1, h2, x, pred, n, d, diff;
+        __m256d err0 = _mm256_setzero_pd(), err1 = _mm256_setzero_pd(), lo, hi;
+
+        // the lanes past the last candidate repeat it, which can't change the result
+        for(lane = 0; lane < 8; ++lane){
+            unsigned cand = c + lane < NUM_CANDIDATES ? c + lane : NUM_CANDIDATES - 1;
+
+            coef1[lane] = vagCoefs[cand / NUM_SHIFTS][0];
+            coef2[lane] = vagCoefs[cand / NUM_SHIFTS][1];
+            step[lane] = 12 - cand % NUM_SHIFTS;
+            round[lane] = step[lane] ? 1 << (step[lane] - 1) : 0;
+        }
+
+        vCoef1 = _mm256_loadu_si256((const __m256i *)coef1);
+        vCoef2 = _mm256_loadu_si256((const __m256i *)coef2);
+        vStep = _mm256_loadu_si256((const __m256i *)step);
+        vRound = _mm256_loadu_si256((const __m256i *)round);
+        h1 = _mm256_set1_epi32(hist1);
+        h2 = _mm256_set1_epi32(hist2);
+
+        for(i = 0; i < VAG_SAMPLES_PER_BLOCK; ++i){
+            x = _mm256_set1_epi32(samples[i]);
+
+            pred = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h1, vCoef1), _mm256_mullo_epi32(h2, vCoef2)), 6);
+
+            n = _mm256_srav_epi32(_mm256_add_epi32(_mm256_sub_epi32(x, pred), vRound), vStep);
+            n = _mm256_max_epi32(_mm256_min_epi32(n, maxNibble), minNibble);
+
+            d = _mm256_add_epi32(_mm256_sllv_epi32(n, vStep), pred);
+            d = _mm256_max_epi32(_mm256_min_epi32(d, max16), min16);
+
+            diff = _mm256_sub_epi32(x, d);
+            lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(diff));
+            hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(diff, 1));
+            err0 = _mm256_fmadd_pd(lo, lo, err0);
+            err1 = _mm256_fmadd_pd(hi, hi, err1);
+
+            h2 = h1;
+            h1 = d;
+        }
+
+        _mm256_storeu_pd(errs, err0);
+        _mm256_storeu_pd(errs + 4, err1);
+
+        for(lane = 0; lane < 8 && c + lane < NUM_CANDIDATES; ++lane){
+            if(errs[lane] < bestErr){
+                bestErr = errs[lane];
+                best = c + lane;
+            }
+        }
+    }
+
+    return best;
+}
+#endif
@@ -0,0 +1,36 @@
+#ifndef VAGENC_H
+#define VAGENC_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/* PS-ADPCM (VAG) encoder.
+**
+** Each 16 byte block encodes 28 samples: byte 0 holds the predictor filter index (high nibble)
+** and the shift value (low nibble), byte 1 the flags and bytes 2-15 the 4-bit residuals, low nibble first.
+** The decoder computes each sample as ((nibble << 12) >> shift) plus a prediction made from the
+** previous 2 decoded samples with the filter's coefficients, so the encoder has to track the
+** decoder's output exactly (integer math and 16-bit clamping included) to choose the nibbles.
+**
+** For each block all the 5 filters and shifts 0-12 are tried, keeping the combination with the
+** smallest squared error; the candidates are evaluated 8 at a time with AVX2 when available.
+**
+** Long streams are split in segments of VAG_SEGMENT_BLOCKS blocks encoded on worker threads;
+** each segment's predictor history is primed by encoding the last VAG_PRIME_BLOCKS blocks of
+** the previous segment first (and throwing them away), so that it starts from nearly the same
+** history the decoder will have. The segments don't depend on the number of threads, so the
+** output doesn't either.
+*/
+#define VAG_BLOCK_SIZE          16
+#define VAG_SAMPLES_PER_BLOCK   28
+#define VAG_SEGMENT_BLOCKS      2048
+#define VAG_PRIME_BLOCKS        8
+
+/* vag_encode(): encode numSamples samples into *out, a malloc'ed buffer *outSize bytes long,
+** using up to numThreads threads; the stream starts with a silent block and ends with an end marker block
+** as usual for VAG files.
+*/
+bool vag_encode(const short *pcm, DWORD numSamples, unsigned numThreads, BYTE **out, DWORD *outSize);
+
+#endif /* VAGENC_H */
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wav.h"
+
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+// "fmt " chunk contents (the extensible format's additional fields are ignored)
+typedef struct wavFmt_s{
+    WORD    audioFormat;
+    WORD    numChannels;
+    DWORD   sampleRate;
+    DWORD   byteRate;
+    WORD    blockAlign;
+    WORD    bitsPerSample;
+}wavFmt_t;
+
+
+// local functions declarations
+static bool findChunk(FILE *in_fp, const char *id, DWORD *chunkSize);
+
+
+bool wav_read(const char *path, short **pcm, DWORD *numSamples, DWORD *sampleRate){
+    FILE *in_fp;
+    char riffHdr[12];
+    wavFmt_t fmt;
+    DWORD chunkSize, i;
+    short *samples;
+
+    if((in_fp = fopen(path, "rb")) == NULL){
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if(!fread(riffHdr, sizeof(riffHdr), 1, in_fp) || memcmp(riffHdr, "RIFF", 4) != 0 || memcmp(riffHdr + 8, "WAVE", 4) != 0){
+        fprintf(stderr, "%s doesn't appear to be a valid WAV file\n", path);
+        fclose(in_fp);
+        return false;
+    }
+
+    if(!findChunk(in_fp, "fmt ", &chunkSize) || chunkSize < sizeof(fmt) || !fread(&fmt, sizeof(fmt), 1, in_fp)){
+        fprintf(stderr, "%s has no valid format chunk\n", path);
+        fclose(in_fp);
+        return false;
+    }
+
+    if( (fmt.audioFormat != WAVE_FORMAT_PCM && fmt.audioFormat != WAVE_FORMAT_EXTENSIBLE) || fmt.bitsPerSample != 16 ||
+        (fmt.numChannels != 1 && fmt.numChannels != 2) || fmt.sampleRate == 0 || fmt.sampleRate > 0xFFFF
+    ){
+        fprintf(stderr, "%s must be 16-bit mono or stereo PCM at 65535 Hz at most\n", path);
+        fclose(in_fp);
+        return false;
+    }
+
+    // findChunk() expects to be at a chunk boundary (chunks are word aligned)
+    fseek(in_fp, (chunkSize + 1) / 2 * 2 - sizeof(fmt), SEEK_CUR);
+
+    if(!findChunk(in_fp, "data", &chunkSize)){
+        fprintf(stderr, "%s has no data chunk\n", path);
+        fclose(in_fp);
+        return false;
+    }
+
+    *numSamples = chunkSize / (fmt.numChannels * sizeof(short));
+
+    if((samples = malloc(*numSamples * fmt.numChannels * sizeof(short) + 1)) == NULL){
+        fprintf(stderr, "Couldn't allocate %u bytes for %s's samples\n", chunkSize, path);
+        fclose(in_fp);
+        return false;
+    }
+
+    // some tools write a wrong size for the last chunk, so a short read isn't an error
+    *numSamples = fread(samples, fmt.numChannels * sizeof(short), *numSamples, in_fp);
+    fclose(in_fp);
+
+    if(fmt.numChannels == 2)
+        for(i = 0; i < *numSamples; ++i)
+            samples[i] = (samples[i*2] + samples[i*2 + 1]) >> 1;
+
+    *pcm = samples;
+    *sampleRate = fmt.sampleRate;
+    return true;
+}
+
+
+// local functions definitions
+
+// findChunk(): skip chunks until the one with the given id, leaving the file pointer at its data
+static bool findChunk(FILE *in_fp, const char *id, DWORD *chunkSize){
+    char chunkId[4];
+
+    for(;;){
+        if(!fread(chunkId, sizeof(chunkId), 1, in_fp) || !fread(chunkSize, sizeof(*chunkSize), 1, in_fp))
+            return false;
+
+        if(memcmp(chunkId, id, sizeof(chunkId)) == 0)
+            return true;
+
+        if(fseek(in_fp, (*chunkSize + 1) / 2 * 2, SEEK_CUR) != 0)
+            return false;
+    }
+}
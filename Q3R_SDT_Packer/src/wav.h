@@ -0,0 +1,13 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdbool.h>
+
+#include "sdt_types.h"
+
+/* wav_read(): load a 16-bit PCM RIFF/WAVE file into *pcm, a malloc'ed buffer holding *numSamples samples;
+** stereo files are downmixed to mono, since the SDT sounds are mono.
+*/
+bool wav_read(const char *path, short **pcm, DWORD *numSamples, DWORD *sampleRate);
+
+#endif /* WAV_H */
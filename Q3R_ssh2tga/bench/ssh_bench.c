@@ -0,0 +1,747 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "tga_utils.h"
+#include "ssh_utils.h"
+#include "pixconv.h"
+#include "rle.h"
+#include "threads.h"
+#include "jobs.h"
+#include "sshgen.h"
+#include "tgaread.h"
+
+/* Benchmarks of the conversion kernels and of whole conversions, on synthetic ssh files (see sshgen.h),
+** to tell whether a SIMD or threading change actually pays off.
+**
+** The kernels run on BENCH_KERNEL_SIZE x BENCH_KERNEL_SIZE images of each pattern, repeated for at least
+** options.minSeconds, and report the time per megapixel and the bytes each run writes.
+** The conversions turn all of the generated files (each type, size and pattern) into each output format
+** with a pool of worker threads, as the converter does, and report the images (and megapixels) per second;
+** the palette fix, the alpha check and the RLE packing, which only exist as part of -out_shrink,
+** are measured by its conversions.
+** Since those conversions reorder palettes, drop alpha channels and pack runs, -run verify checks that
+** each generated file's -out_shrink conversion decodes to the same pixels as the ssh file itself;
+** that includes a file with mipmaps for each type and pattern, only ever converted by -run verify,
+** whose mipmaps must all be found and skipped to get to the palette.
+*/
+
+#define BENCH_KERNEL_SIZE   1024
+#define BENCH_MIN_SECONDS   0.5
+#define BENCH_MIPMAPS_SIZE  1   // imgSizes[]' index of the files with mipmaps, whose odd sizes get rounded down
+#define BENCH_MIPMAPS       6   // down to 1x1
+
+// what's run
+typedef enum benchRun_e{
+    RUN_ALL,
+    RUN_KERNELS,
+    RUN_CONVERT,
+    RUN_GENERATE,   // just write the generated files
+    RUN_VERIFY      // check the -out_shrink conversions of the generated files rather than timing anything
+}benchRun_t;
+
+// options specified on the command line
+typedef struct options_s{
+    benchRun_t      run;
+    unsigned        numThreads;
+    double          minSeconds;     // how long each kernel is repeated for, at least
+    const char *    folder;         // where the generated files (and their conversions) go
+}options_t;
+
+// a kernel's input and output buffers
+typedef struct kernelData_s{
+    const BYTE *    src;        // the image's data, as stored in the ssh file
+    BYTE *          dst;        // room for twice the image's pixels as 32 bit ones
+    BYTE *          work;       // as above; starts as a copy of src, for the kernels working in place
+    tgaPixel32_t    palette[SSH_MAX_PALETTE_ENTRIES];
+    DWORD           width;
+    DWORD           height;
+    unsigned        pixelSize;  // for the RLE encoders: 1 byte for palette indexes, 3 or 4 for truecolor pixels
+}kernelData_t;
+
+// kernelFunc_t: run a kernel once over the whole image, returning the bytes it wrote
+typedef DWORD (*kernelFunc_t)(kernelData_t *data);
+
+typedef struct kernel_s{
+    const char *    name;
+    sshImgType_t    imgType;    // the kind of image it works on
+    kernelFunc_t    func;
+}kernel_t;
+
+// an output format the conversions are timed with
+typedef struct benchFormat_s{
+    const char *    name;
+    outFormat_t     outFormat;
+    bool            rleOptimal;
+}benchFormat_t;
+
+// a file to be converted by the worker threads
+typedef struct convJob_s{
+    char            sshPath[FILENAME_MAX];
+    bool            converted;
+    DWORD           numPixels;
+    DWORD           bytesOut;
+}convJob_t;
+
+
+/* local functions declarations */
+static void printUsage(void);
+static int parseOptions(int argc, char **argv);
+static const char *getTypeName(sshImgType_t imgType);
+static void getSshPath(sshImgType_t imgType, DWORD size, DWORD numMipMaps, sshgenPattern_t pattern, char *name, char *sshPath);
+
+static bool benchKernels(void);
+static void benchKernel(const kernel_t *kernel, sshgenPattern_t pattern, kernelData_t *data);
+static DWORD kernel_swizzle24(kernelData_t *data);
+static DWORD kernel_swizzle32(kernelData_t *data);
+static DWORD kernel_swizzle32to24(kernelData_t *data);
+static DWORD kernel_unpack4bpp(kernelData_t *data);
+static DWORD kernel_expand4bpp(kernelData_t *data);
+static DWORD kernel_expand8bpp(kernelData_t *data);
+static DWORD kernel_scanAlpha(kernelData_t *data);
+static DWORD kernel_ps2Alpha(kernelData_t *data);
+static DWORD kernel_rleGreedy(kernelData_t *data);
+static DWORD kernel_rleOptimal(kernelData_t *data);
+static unsigned getPixelSize(sshImgType_t imgType);
+
+static bool generateFiles(void);
+static bool benchConversions(void);
+static bool verifyConversions(void);
+static bool verifyConversion(const char *sshPath, DWORD numMipMaps, sshScratch_t *scratch);
+static bool init_scratchBufs(unsigned numBufs);
+static void free_scratchBufs(unsigned numBufs);
+static bool process_convJob(void *job);
+static bool commit_convJob(void *job);
+
+
+/* global variables(used only inside this module) */
+static options_t options;
+
+static const sshImgType_t imgTypes[] = {SSH_PALETTED_4BPP, SSH_PALETTED_8BPP, SSH_TRUECOLOR_24BPP, SSH_TRUECOLOR_32BPP};
+#define NUM_IMG_TYPES   (sizeof(imgTypes) / sizeof(imgTypes[0]))
+
+static const DWORD imgSizes[][2] = {
+    {64, 64},
+    {100, 75},      // rows which aren't a multiple of the SIMD kernels' blocks
+    {256, 256},
+    {1024, 1024}
+};
+#define NUM_IMG_SIZES   (sizeof(imgSizes) / sizeof(imgSizes[0]))
+
+static const kernel_t kernels[] = {
+    {"swizzle 24->24",  SSH_TRUECOLOR_24BPP,    kernel_swizzle24},
+    {"swizzle 32->32",  SSH_TRUECOLOR_32BPP,    kernel_swizzle32},
+    {"swizzle 32->24",  SSH_TRUECOLOR_32BPP,    kernel_swizzle32to24},
+    {"unpack 4bpp",     SSH_PALETTED_4BPP,      kernel_unpack4bpp},
+    {"expand 4bpp",     SSH_PALETTED_4BPP,      kernel_expand4bpp},
+    {"expand 8bpp",     SSH_PALETTED_8BPP,      kernel_expand8bpp},
+    {"scan alpha",      SSH_TRUECOLOR_32BPP,    kernel_scanAlpha},
+    {"ps2 alpha",       SSH_TRUECOLOR_32BPP,    kernel_ps2Alpha},
+    {"rle greedy 8",    SSH_PALETTED_8BPP,      kernel_rleGreedy},
+    {"rle greedy 24",   SSH_TRUECOLOR_24BPP,    kernel_rleGreedy},
+    {"rle greedy 32",   SSH_TRUECOLOR_32BPP,    kernel_rleGreedy},
+    {"rle optimal 8",   SSH_PALETTED_8BPP,      kernel_rleOptimal},
+    {"rle optimal 24",  SSH_TRUECOLOR_24BPP,    kernel_rleOptimal},
+    {"rle optimal 32",  SSH_TRUECOLOR_32BPP,    kernel_rleOptimal}
+};
+#define NUM_KERNELS     (sizeof(kernels) / sizeof(kernels[0]))
+
+static const benchFormat_t formats[] = {
+    {"shrink",          OUT_SHRINK,                 false},
+    {"shrink optimal",  OUT_SHRINK,                 true},
+    {"asIs",            OUT_AS_IS,                  false},
+    {"upsideDown",      OUT_TRUECOLOR_UPSIDEDOWN,   false},
+    {"dds",             OUT_DDS,                    false},
+    {"ktx2",            OUT_KTX2,                   false},
+    {"dds_bc",          OUT_DDS_BC,                 false}
+};
+#define NUM_FORMATS     (sizeof(formats) / sizeof(formats[0]))
+
+// the conversions' options, and their totals so far, summed up by the commits
+static convOptions_t        convOptions;
+static unsigned             numConverted;
+static unsigned long long   totalPixels;
+static unsigned long long   totalBytesOut;
+
+// scratch buffers for the worker threads, as in the converter
+static sshScratch_t *   scratchBufs;
+static sshScratch_t **  freeScratchBufs;
+static unsigned         numFreeScratchBufs;
+static mutex_t *        scratchMutex;
+
+
+int main(int argc, char **argv){
+    int folderIdx;
+    bool success = true;
+
+    puts("\tQuake 3 Revolution SSH to TGA image converter benchmarks\n");
+
+    folderIdx = parseOptions(argc, argv);
+
+    if(folderIdx < argc)
+        options.folder = argv[folderIdx];
+    else if(options.run != RUN_KERNELS){
+        printUsage();
+        return 1;
+    }
+
+    if(options.run == RUN_ALL || options.run == RUN_KERNELS)
+        success = benchKernels();
+
+    if(success && options.run != RUN_KERNELS)
+        success = generateFiles();
+
+    if(success && (options.run == RUN_ALL || options.run == RUN_CONVERT))
+        success = benchConversions();
+
+    if(success && options.run == RUN_VERIFY)
+        success = verifyConversions();
+
+    return success ? 0 : 1;
+}
+
+// local functions definitions
+
+static void printUsage(void){
+    fputs(
+        "Usage: ssh_bench.exe [options] <folder>\n"
+        "where <folder> (which must exist) is where the synthetic ssh files\n"
+        "and their conversions are written, and [options] are one or more\n"
+        "of the following:\n\n"
+
+        "-run <all|kernels|convert|generate|verify>\n\t"
+            "What to run: the kernels' benchmarks (which don't need\n\t"
+            "the folder), the conversions' ones, both (the default),\n\t"
+            "or neither, just writing the ssh files; verify writes them\n\t"
+            "and checks that their -out_shrink conversions decode to\n\t"
+            "the same pixels.\n\n"
+
+        "-time <seconds>\n\t"
+            "How long each kernel is repeated for, at least\n\t"
+            "(0.5 seconds by default.)\n\n"
+
+        "-j <threads>\n\t"
+            "Convert up to <threads> images at once\n\t"
+            "(by default, as many as the available CPUs.)\n\n",
+
+      stderr
+    );
+}
+
+/* parseOptions(): parse the options preceding the folder (case insensitive,
+** with either one or two leading hyphens), returning the index of the folder in argv
+*/
+static int parseOptions(int argc, char **argv){
+    char option_lowercase[FILENAME_MAX];
+
+    const char *runStrList[] = {
+        "all",
+        "kernels",
+        "convert",
+        "generate",
+        "verify"
+    };
+
+    int i, j;
+    const int numRuns = sizeof(runStrList) / sizeof(runStrList[0]);
+
+    options.run = RUN_ALL;
+    options.numThreads = getNumCPUs();
+    options.minSeconds = BENCH_MIN_SECONDS;
+    options.folder = NULL;
+
+    for(i = 1; i < argc && argv[i][0] == '-'; ++i){
+        const char *option = argv[i][1] == '-' ? argv[i] + 1 : argv[i];
+
+        // get rid of case sensitivity
+        for(j = 0; option[j] != '\0' && j < sizeof(option_lowercase) - 1; j++)
+            option_lowercase[j] = tolower(option[j]);
+        option_lowercase[j] = '\0';
+
+        if(strcmp(option_lowercase, "-j") == 0 && i + 1 < argc){
+            options.numThreads = strtoul(argv[++i], NULL, 10);
+
+            if(options.numThreads == 0){
+                fprintf(stderr, "Invalid number of threads: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-time") == 0 && i + 1 < argc){
+            options.minSeconds = strtod(argv[++i], NULL);
+
+            if(options.minSeconds <= 0){
+                fprintf(stderr, "Invalid time: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-run") == 0 && i + 1 < argc){
+            ++i;
+
+            for(j = 0; j < numRuns; j++)
+                if(strcmp(runStrList[j], argv[i]) == 0)
+                    break;
+
+            if(j == numRuns){
+                fprintf(stderr, "Invalid benchmark: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            options.run = j;
+            continue;
+        }
+
+        // no supported option has been found; abort the program
+        fprintf(stderr, "The option %s is unsupported.\n"
+                        "Invoke this exe without any parameters to see a list of available options.\n", argv[i]);
+
+        exit(EXIT_FAILURE);
+    }
+
+    return i;
+}
+
+static const char *getTypeName(sshImgType_t imgType){
+    switch(imgType){
+        case SSH_PALETTED_4BPP:     return "pal4";
+        case SSH_PALETTED_8BPP:     return "pal8";
+        case SSH_TRUECOLOR_24BPP:   return "rgb24";
+        default:                    return "rgba32";
+    }
+}
+
+// getSshPath(): the name (without the extension) and the path of a generated file, in name and sshPath (FILENAME_MAX bytes each)
+static void getSshPath(sshImgType_t imgType, DWORD size, DWORD numMipMaps, sshgenPattern_t pattern, char *name, char *sshPath){
+    snprintf(name, FILENAME_MAX, "%s_%ux%u_%s%s", getTypeName(imgType), imgSizes[size][0], imgSizes[size][1], sshgen_patternNames[pattern],
+             numMipMaps ? "_mips" : "");
+    snprintf(sshPath, FILENAME_MAX, "%s/%s.ssh", options.folder, name);
+}
+
+
+// kernels' benchmarks
+
+static bool benchKernels(void){
+    DWORD numPixels = BENCH_KERNEL_SIZE * BENCH_KERNEL_SIZE;
+    sshPixel32_t palette[SSH_MAX_PALETTE_ENTRIES];
+    BYTE *src = NULL;
+    kernelData_t data;
+    sshgenPattern_t pattern;
+    DWORD i;
+
+    data.width = data.height = BENCH_KERNEL_SIZE;
+
+    // big enough for any of the image types
+    if((src = malloc(numPixels * sizeof(sshPixel32_t))) == NULL
+    || (data.dst = malloc(numPixels * sizeof(tgaPixel32_t) * 2)) == NULL
+    || (data.work = malloc(numPixels * sizeof(tgaPixel32_t) * 2)) == NULL){
+        fputs("Couldn't allocate the kernels' buffers\n", stderr);
+        free(src);
+        free(data.dst);
+        return false;
+    }
+
+    data.src = src;
+
+    printf("Kernels (%ux%u pixels):\n", BENCH_KERNEL_SIZE, BENCH_KERNEL_SIZE);
+
+    // each kernel runs on all of the patterns in a row, so that they're easily compared
+    for(i = 0; i < NUM_KERNELS; ++i){
+        for(pattern = 0; pattern < NUM_PATTERNS; ++pattern){
+            sshgen_fillImage(kernels[i].imgType, data.width, data.height, pattern, src);
+            memcpy(data.work, src, sshgen_imgDataSize(kernels[i].imgType, data.width, data.height));
+
+            sshgen_fillPalette(pattern, SSH_MAX_PALETTE_ENTRIES, palette);
+            pixconv_convert(PIXCONV_32_TO_32, palette, data.palette, SSH_MAX_PALETTE_ENTRIES);
+
+            data.pixelSize = getPixelSize(kernels[i].imgType);
+
+            benchKernel(&kernels[i], pattern, &data);
+        }
+
+        putchar('\n');
+    }
+
+    free(src);
+    free(data.dst);
+    free(data.work);
+    return true;
+}
+
+// benchKernel(): run a kernel over and over for at least options.minSeconds, then print its timing
+static void benchKernel(const kernel_t *kernel, sshgenPattern_t pattern, kernelData_t *data){
+    double megaPixels = (double)data->width * data->height / 1e6;
+    double start, elapsed;
+    unsigned numRuns = 0;
+    DWORD bytesOut;
+
+    start = getSeconds();
+
+    do{
+        bytesOut = kernel->func(data);
+        ++numRuns;
+        elapsed = getSeconds() - start;
+    }while(elapsed < options.minSeconds);
+
+    printf("  %-16s %-9s %9.3f ms/MP %10u bytes out\n", kernel->name, sshgen_patternNames[pattern],
+           elapsed * 1000 / numRuns / megaPixels, bytesOut);
+}
+
+static DWORD kernel_swizzle24(kernelData_t *data){
+    DWORD numPixels = data->width * data->height;
+
+    pixconv_convert(PIXCONV_24_TO_24, data->src, data->dst, numPixels);
+    return numPixels * sizeof(tgaPixel24_t);
+}
+
+static DWORD kernel_swizzle32(kernelData_t *data){
+    DWORD numPixels = data->width * data->height;
+
+    pixconv_convert(PIXCONV_32_TO_32, data->src, data->dst, numPixels);
+    return numPixels * sizeof(tgaPixel32_t);
+}
+
+static DWORD kernel_swizzle32to24(kernelData_t *data){
+    DWORD numPixels = data->width * data->height;
+
+    pixconv_convert(PIXCONV_32_TO_24, data->src, data->dst, numPixels);
+    return numPixels * sizeof(tgaPixel24_t);
+}
+
+static DWORD kernel_unpack4bpp(kernelData_t *data){
+    DWORD numPixels = data->width * data->height;
+
+    pixconv_unpack4bpp(data->src, data->dst, numPixels / 2);
+    return numPixels;
+}
+
+static DWORD kernel_expand4bpp(kernelData_t *data){
+    pixconv_expand4bppImage(data->src, data->palette, (tgaPixel32_t*)data->dst, data->width, data->height, false);
+    return data->width * data->height * sizeof(tgaPixel32_t);
+}
+
+static DWORD kernel_expand8bpp(kernelData_t *data){
+    pixconv_expandImage(data->src, data->palette, (tgaPixel32_t*)data->dst, data->width, data->height, false);
+    return data->width * data->height * sizeof(tgaPixel32_t);
+}
+
+// kernel_scanAlpha(): the check of whether the alpha channel is fully opaque, as -out_shrink does; nothing is written
+static DWORD kernel_scanAlpha(kernelData_t *data){
+    pixconv_scanAlpha(data->src, data->width * data->height, 0xFF, 0xFF);
+    return 0;
+}
+
+// kernel_ps2Alpha(): in place, so after the first run the values are already rescaled, which doesn't change its speed
+static DWORD kernel_ps2Alpha(kernelData_t *data){
+    DWORD numPixels = data->width * data->height;
+
+    pixconv_normalizePs2Alpha(data->work, numPixels);
+    return numPixels * sizeof(sshPixel32_t);
+}
+
+static DWORD kernel_rleGreedy(kernelData_t *data){
+    rleStream_t stream;
+    DWORD encodedSize;
+
+    rle_initStream(&stream, data->pixelSize, NULL);
+    rle_encodeStream(&stream, data->dst, &encodedSize, data->src, data->width * data->height, true);
+    return encodedSize;
+}
+
+// kernel_rleOptimal(): both passes, with the packets' plan in the work buffer
+static DWORD kernel_rleOptimal(kernelData_t *data){
+    DWORD numPixels = data->width * data->height;
+    rleOptimal_t plan;
+
+    rle_initOptimal(&plan, data->pixelSize, NULL, data->work);
+    rle_planOptimal(&plan, data->src, numPixels);
+    rle_finishPlan(&plan);
+    return rle_encodeOptimal(&plan, data->dst, data->src, numPixels);
+}
+
+// getPixelSize(): the size of an image type's pixels for the RLE encoders
+static unsigned getPixelSize(sshImgType_t imgType){
+    switch(imgType){
+        case SSH_TRUECOLOR_24BPP:   return sizeof(sshPixel24_t);
+        case SSH_TRUECOLOR_32BPP:   return sizeof(sshPixel32_t);
+        default:                    return 1;
+    }
+}
+
+
+// conversions' benchmarks
+
+static bool generateFiles(void){
+    char name[FILENAME_MAX], sshPath[FILENAME_MAX];
+    DWORD t, s, numFiles = 0;
+    sshgenPattern_t pattern;
+
+    for(t = 0; t < NUM_IMG_TYPES; ++t)
+        for(s = 0; s < NUM_IMG_SIZES; ++s)
+            for(pattern = 0; pattern < NUM_PATTERNS; ++pattern){
+                getSshPath(imgTypes[t], s, 0, pattern, name, sshPath);
+
+                if(!sshgen_save(imgTypes[t], imgSizes[s][0], imgSizes[s][1], 0, pattern, name, sshPath))
+                    return false;
+
+                ++numFiles;
+            }
+
+    for(t = 0; t < NUM_IMG_TYPES; ++t)
+        for(pattern = 0; pattern < NUM_PATTERNS; ++pattern){
+            getSshPath(imgTypes[t], BENCH_MIPMAPS_SIZE, BENCH_MIPMAPS, pattern, name, sshPath);
+
+            if(!sshgen_save(imgTypes[t], imgSizes[BENCH_MIPMAPS_SIZE][0], imgSizes[BENCH_MIPMAPS_SIZE][1], BENCH_MIPMAPS, pattern, name, sshPath))
+                return false;
+
+            ++numFiles;
+        }
+
+    printf("Generated %u ssh files in %s\n\n", numFiles, options.folder);
+    return true;
+}
+
+static bool benchConversions(void){
+    char name[FILENAME_MAX];
+    convJob_t *job;
+    DWORD t, s, f;
+    sshgenPattern_t pattern;
+    double start, elapsed;
+    bool success = true;
+
+    convOptions.bcQuality = BC_QUALITY_RANGE_FIT;
+    convOptions.bcThreads = 1;
+
+    if(!init_scratchBufs(options.numThreads))
+        return false;
+
+    if(!jobs_init(options.numThreads, process_convJob, commit_convJob)){
+        free_scratchBufs(options.numThreads);
+        return false;
+    }
+
+    printf("Conversions (%u threads):\n", options.numThreads);
+
+    for(f = 0; f < NUM_FORMATS && success; ++f){
+        convOptions.outFormat = formats[f].outFormat;
+        convOptions.rleOptimal = formats[f].rleOptimal;
+        numConverted = 0;
+        totalPixels = totalBytesOut = 0;
+
+        start = getSeconds();
+
+        for(t = 0; t < NUM_IMG_TYPES && success; ++t)
+            for(s = 0; s < NUM_IMG_SIZES && success; ++s)
+                for(pattern = 0; pattern < NUM_PATTERNS && success; ++pattern){
+                    if((job = malloc(sizeof(*job))) == NULL){
+                        fputs("Couldn't allocate a conversion job\n", stderr);
+                        success = false;
+                        break;
+                    }
+
+                    getSshPath(imgTypes[t], s, 0, pattern, name, job->sshPath);
+                    job->converted = false;
+                    job->numPixels = imgSizes[s][0] * imgSizes[s][1];
+                    job->bytesOut = 0;
+
+                    success = jobs_submit(job);
+                }
+
+        // a failed conversion has printed why already
+        success &= jobs_wait();
+        elapsed = getSeconds() - start;
+
+        printf("  %-16s %4u images in %7.3f seconds: %9.1f images/s %8.1f MP/s %10llu bytes out\n",
+               formats[f].name, numConverted, elapsed, numConverted / elapsed, totalPixels / 1e6 / elapsed, totalBytesOut);
+    }
+
+    jobs_free();
+    free_scratchBufs(options.numThreads);
+    return success;
+}
+
+/* verifyConversions(): convert each generated file with the formats decoding to the same pixels as the ssh file
+** (-out_shrink, with the palette and alpha channel they end up with), and compare them
+*/
+static bool verifyConversions(void){
+    char name[FILENAME_MAX], sshPath[FILENAME_MAX];
+    const benchFormat_t *format;
+    sshScratch_t scratch;
+    DWORD t, s, f;
+    sshgenPattern_t pattern;
+    unsigned numChecked = 0, numFailed = 0;
+
+    init_sshScratch(&scratch);
+    convOptions.bcQuality = BC_QUALITY_RANGE_FIT;
+    convOptions.bcThreads = 1;
+
+    for(f = 0; f < NUM_FORMATS; ++f){
+        format = &formats[f];
+
+        if(format->outFormat != OUT_SHRINK)
+            continue;
+
+        convOptions.outFormat = format->outFormat;
+        convOptions.rleOptimal = format->rleOptimal;
+
+        for(t = 0; t < NUM_IMG_TYPES; ++t)
+            for(s = 0; s < NUM_IMG_SIZES; ++s)
+                for(pattern = 0; pattern < NUM_PATTERNS; ++pattern){
+                    getSshPath(imgTypes[t], s, 0, pattern, name, sshPath);
+
+                    if(!verifyConversion(sshPath, 0, &scratch)){
+                        fprintf(stderr, "%s: the %s conversion doesn't match\n", sshPath, format->name);
+                        ++numFailed;
+                    }
+
+                    ++numChecked;
+                }
+
+        for(t = 0; t < NUM_IMG_TYPES; ++t)
+            for(pattern = 0; pattern < NUM_PATTERNS; ++pattern){
+                getSshPath(imgTypes[t], BENCH_MIPMAPS_SIZE, BENCH_MIPMAPS, pattern, name, sshPath);
+
+                if(!verifyConversion(sshPath, BENCH_MIPMAPS, &scratch)){
+                    fprintf(stderr, "%s: the %s conversion doesn't match\n", sshPath, format->name);
+                    ++numFailed;
+                }
+
+                ++numChecked;
+            }
+    }
+
+    free_sshScratch(&scratch);
+
+    printf("Verified %u conversions: %u matching, %u not matching\n", numChecked, numChecked - numFailed, numFailed);
+    return numFailed == 0;
+}
+
+/* verifyConversion(): convert a file with convOptions, then compare the decoded output with the ssh file's image;
+** the file must have all of its numMipMaps mipmaps found, too
+*/
+static bool verifyConversion(const char *sshPath, DWORD numMipMaps, sshScratch_t *scratch){
+    sshHandle_t sshHandle;
+    char outPath[FILENAME_MAX];
+    BYTE *expected, *converted;
+    DWORD width, height, outWidth, outHeight;
+    bool success;
+
+    // the conversion may fix the palette in place, so the file is read again for it
+    if(!init_sshHandle(&sshHandle, sshPath, 0, NULL, NULL, scratch))
+        return false;
+
+    if(sshHandle.numMipMaps != numMipMaps){
+        free_sshHandleBuffers(&sshHandle);
+        return false;
+    }
+
+    expected = ssh_decodeRgba(&sshHandle);
+    width = sshHandle.resHdr.width;
+    height = sshHandle.resHdr.height;
+    free_sshHandleBuffers(&sshHandle);
+
+    if(expected == NULL || !init_sshHandle(&sshHandle, sshPath, 0, NULL, NULL, scratch)){
+        free(expected);
+        return false;
+    }
+
+    ssh_getOutPath(&sshHandle, convOptions.outFormat, outPath);
+    success = ssh_convertAndSave(&sshHandle, &convOptions, scratch);
+    free_sshHandleBuffers(&sshHandle);
+
+    if(!success || (converted = tgaread_decodeRgba(outPath, &outWidth, &outHeight)) == NULL){
+        free(expected);
+        return false;
+    }
+
+    success = outWidth == width && outHeight == height
+           && memcmp(expected, converted, width * height * sizeof(sshPixel32_t)) == 0;
+
+    free(expected);
+    free(converted);
+    return success;
+}
+
+static bool init_scratchBufs(unsigned numBufs){
+    unsigned i;
+
+    scratchBufs = malloc(numBufs * sizeof(*scratchBufs));
+    freeScratchBufs = malloc(numBufs * sizeof(*freeScratchBufs));
+
+    if(scratchBufs == NULL || freeScratchBufs == NULL || (scratchMutex = mutex_create()) == NULL){
+        fputs("Couldn't allocate the worker threads' data\n", stderr);
+        free(scratchBufs);
+        free(freeScratchBufs);
+        return false;
+    }
+
+    for(i = 0; i < numBufs; ++i){
+        init_sshScratch(&scratchBufs[i]);
+        freeScratchBufs[i] = &scratchBufs[i];
+    }
+
+    numFreeScratchBufs = numBufs;
+    return true;
+}
+
+static void free_scratchBufs(unsigned numBufs){
+    unsigned i;
+
+    for(i = 0; i < numBufs; ++i)
+        free_sshScratch(&scratchBufs[i]);
+
+    mutex_free(scratchMutex);
+    free(scratchBufs);
+    free(freeScratchBufs);
+}
+
+// process_convJob(): convert a file on a worker thread; its errors are printed right away
+static bool process_convJob(void *job){
+    convJob_t *convJob = job;
+    sshHandle_t sshHandle;
+    sshScratch_t *scratch;
+    char outPath[FILENAME_MAX];
+    struct stat outStat;
+
+    mutex_lock(scratchMutex);
+    scratch = freeScratchBufs[--numFreeScratchBufs];
+    mutex_unlock(scratchMutex);
+
+    if(init_sshHandle(&sshHandle, convJob->sshPath, 0, NULL, NULL, scratch)){
+        ssh_getOutPath(&sshHandle, convOptions.outFormat, outPath);
+        convJob->converted = ssh_convertAndSave(&sshHandle, &convOptions, scratch);
+        free_sshHandleBuffers(&sshHandle);
+
+        if(convJob->converted && stat(outPath, &outStat) == 0)
+            convJob->bytesOut = outStat.st_size;
+    }
+
+    mutex_lock(scratchMutex);
+    freeScratchBufs[numFreeScratchBufs++] = scratch;
+    mutex_unlock(scratchMutex);
+
+    return convJob->converted;
+}
+
+// commit_convJob(): add a conversion to the totals
+static bool commit_convJob(void *job){
+    convJob_t *convJob = job;
+    bool success = convJob->converted;
+
+    if(success){
+        ++numConverted;
+        totalPixels += convJob->numPixels;
+        totalBytesOut += convJob->bytesOut;
+    }
+
+    free(convJob);
+    return success;
+}
@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sshgen.h"
+
+#define SSHGEN_STRIPE_WIDTH     8
+#define SSHGEN_SPARSE_COLORS    4
+#define SSHGEN_RES_OFFSET       (sizeof(sshMainHdr_t) + sizeof(sshResEntry_t) + 8)  // 8 for "Buy ERTS"
+#define SSHGEN_FOOTER_SPACES    12
+#define SSHGEN_MAX_HDR_OFFSET   0xFFFFFF    // nextHdrOffset is a 24 bit field
+#define SSHGEN_MAX_MIPMAPS      15          // numMipMaps is a 4 bit field
+
+
+const char * const sshgen_patternNames[NUM_PATTERNS] = {"flat", "noisy", "striped", "gradient", "sparse"};
+
+// the sparse pattern's values; 1, 13, 12 and 11 as 4bpp indexes
+static const BYTE sparseValues[SSHGEN_SPARSE_COLORS] = {0x11, 0x4D, 0x8C, 0xFB};
+
+
+// local functions declarations
+static DWORD getNumColors(sshImgType_t imgType);
+static DWORD getMipMapSize(DWORD size, DWORD level);
+static BYTE getValue(sshgenPattern_t pattern, DWORD x, DWORD y, DWORD channel, DWORD *seed);
+static BYTE getAlpha(sshgenPattern_t pattern, DWORD *seed);
+static DWORD nextRandom(DWORD *seed);
+
+
+// functions definitions
+DWORD sshgen_imgDataSize(sshImgType_t imgType, DWORD width, DWORD height){
+    switch(imgType){
+        case SSH_PALETTED_4BPP:     return (width * height + 1) / 2;
+        case SSH_PALETTED_8BPP:     return width * height;
+        case SSH_TRUECOLOR_24BPP:   return width * height * sizeof(sshPixel24_t);
+        default:                    return width * height * sizeof(sshPixel32_t);
+    }
+}
+
+void sshgen_fillImage(sshImgType_t imgType, DWORD width, DWORD height, sshgenPattern_t pattern, BYTE *dst){
+    DWORD numColors = getNumColors(imgType);
+    DWORD seed = 0x12345678 + pattern;
+    DWORD x, y, i = 0;
+    BYTE index;
+
+    for(y = 0; y < height; ++y)
+        for(x = 0; x < width; ++x){
+            switch(imgType){
+                case SSH_PALETTED_4BPP:
+                    // low nibble first
+                    index = getValue(pattern, x, y, 0, &seed) % numColors;
+
+                    if(i & 1)
+                        dst[i / 2] |= index << 4;
+                    else
+                        dst[i / 2] = index;
+                    break;
+
+                case SSH_PALETTED_8BPP:
+                    dst[i] = getValue(pattern, x, y, 0, &seed);
+                    break;
+
+                case SSH_TRUECOLOR_24BPP:
+                    dst[i * 3]     = getValue(pattern, x, y, 0, &seed);
+                    dst[i * 3 + 1] = getValue(pattern, x, y, 1, &seed);
+                    dst[i * 3 + 2] = getValue(pattern, x, y, 2, &seed);
+                    break;
+
+                default:
+                    dst[i * 4]     = getValue(pattern, x, y, 0, &seed);
+                    dst[i * 4 + 1] = getValue(pattern, x, y, 1, &seed);
+                    dst[i * 4 + 2] = getValue(pattern, x, y, 2, &seed);
+                    dst[i * 4 + 3] = getAlpha(pattern, &seed);
+                    break;
+            }
+
+            ++i;
+        }
+}
+
+void sshgen_fillPalette(sshgenPattern_t pattern, DWORD numEntries, sshPixel32_t *dst){
+    DWORD seed = 0x87654321 + pattern;
+    DWORD i;
+
+    for(i = 0; i < numEntries; ++i){
+        dst[i].red = nextRandom(&seed);
+        dst[i].green = nextRandom(&seed);
+        dst[i].blue = nextRandom(&seed);
+        dst[i].alpha = getAlpha(pattern, &seed);
+    }
+}
+
+BYTE *sshgen_make(sshImgType_t imgType, DWORD width, DWORD height, DWORD numMipMaps, sshgenPattern_t pattern, const char *name, DWORD *size){
+    DWORD imgDataSize = 0;      // the image's and its mipmaps'
+    DWORD numEntries = imgType == SSH_PALETTED_4BPP || imgType == SSH_PALETTED_8BPP ? getNumColors(imgType) : 0;
+    DWORD paletteSize = numEntries ? sizeof(sshPaletteHdr_t) + numEntries * sizeof(sshPixel32_t) : 0;
+    DWORD footerSize = sizeof(DWORD) + strlen(name) + SSHGEN_FOOTER_SPACES;
+    DWORD sshSize, offset, level, i;
+    sshMainHdr_t mainHdr;
+    sshResEntry_t resEntry;
+    sshResHdr_t resHdr;
+    sshPaletteHdr_t paletteHdr;
+    BYTE *ssh;
+
+    // the mipmaps add up to less than a third of the image, plus a pixel for each of the levels rounded up to one
+    if(width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF || numMipMaps > SSHGEN_MAX_MIPMAPS
+    || (QWORD)width * height * sizeof(sshPixel32_t) * 4 / 3 + numMipMaps * sizeof(sshPixel32_t) + sizeof(resHdr) > SSHGEN_MAX_HDR_OFFSET)
+        return NULL;
+
+    for(level = 0; level <= numMipMaps; ++level)
+        imgDataSize += sshgen_imgDataSize(imgType, getMipMapSize(width, level), getMipMapSize(height, level));
+
+    sshSize = SSHGEN_RES_OFFSET + sizeof(resHdr) + imgDataSize + paletteSize + footerSize;
+    sshSize = (sshSize + 15) & ~15;
+
+    // the footer's padding is left zeroed
+    if((ssh = calloc(sshSize, 1)) == NULL)
+        return NULL;
+
+    memcpy(&mainHdr.magic, "SHPS", 4);
+    mainHdr.sshSize = sshSize;
+    mainHdr.numResources = 1;
+    memcpy(mainHdr.fileName1, "GIMX", 4);
+
+    for(i = 0; i < 4; ++i)
+        resEntry.fileName2[i] = i < strlen(name) ? name[i] : '_';
+    resEntry.dataOffset = SSHGEN_RES_OFFSET;
+
+    memset(&resHdr, 0, sizeof(resHdr));
+    resHdr.nextHdrOffset_plus_imgType = imgType | (sizeof(resHdr) + imgDataSize) << 8;
+    resHdr.width = width;
+    resHdr.height = height;
+    resHdr.numMipMaps_plus_unk = numMipMaps << 4;
+
+    memcpy(ssh, &mainHdr, sizeof(mainHdr));
+    memcpy(ssh + sizeof(mainHdr), &resEntry, sizeof(resEntry));
+    memcpy(ssh + sizeof(mainHdr) + sizeof(resEntry), "Buy ERTS", 8);
+
+    offset = SSHGEN_RES_OFFSET;
+    memcpy(ssh + offset, &resHdr, sizeof(resHdr));
+    offset += sizeof(resHdr);
+
+    // the mipmaps follow the image, one after the other
+    for(level = 0; level <= numMipMaps; ++level){
+        sshgen_fillImage(imgType, getMipMapSize(width, level), getMipMapSize(height, level), pattern, ssh + offset);
+        offset += sshgen_imgDataSize(imgType, getMipMapSize(width, level), getMipMapSize(height, level));
+    }
+
+    if(numEntries){
+        paletteHdr.nextHdrOffset_plus_unk = 0x21 | paletteSize << 8;
+        paletteHdr.palWidth = numEntries;
+        paletteHdr.palHeight = 1;
+        paletteHdr.palNumEntries = numEntries;
+        paletteHdr.unk2 = 0;
+        paletteHdr.unk3 = 0x2000;
+
+        memcpy(ssh + offset, &paletteHdr, sizeof(paletteHdr));
+        offset += sizeof(paletteHdr);
+
+        sshgen_fillPalette(pattern, numEntries, (sshPixel32_t*)(ssh + offset));
+        offset += numEntries * sizeof(sshPixel32_t);
+    }
+
+    // footer: 0x70, the name, then 12 spaces
+    ssh[offset] = 0x70;
+    offset += sizeof(DWORD);
+    memcpy(ssh + offset, name, strlen(name));
+    memset(ssh + offset + strlen(name), ' ', SSHGEN_FOOTER_SPACES);
+
+    *size = sshSize;
+    return ssh;
+}
+
+bool sshgen_save(sshImgType_t imgType, DWORD width, DWORD height, DWORD numMipMaps, sshgenPattern_t pattern, const char *name, const char *path){
+    BYTE *ssh;
+    DWORD size;
+    FILE *file;
+
+    if((ssh = sshgen_make(imgType, width, height, numMipMaps, pattern, name, &size)) == NULL){
+        fprintf(stderr, "Couldn't generate %s (%ux%u)\n", path, width, height);
+        return false;
+    }
+
+    if((file = fopen(path, "wb")) == NULL){
+        fprintf(stderr, "Couldn't create %s: %s\n", path, strerror(errno));
+        free(ssh);
+        return false;
+    }
+
+    if((fwrite(ssh, 1, size, file) != size) | fclose(file)){
+        fprintf(stderr, "Couldn't write %s\n", path);
+        free(ssh);
+        return false;
+    }
+
+    free(ssh);
+    return true;
+}
+
+
+// local functions definitions
+
+// getNumColors(): the distinct values the image's pixels (or each of their channels) can take
+static DWORD getNumColors(sshImgType_t imgType){
+    return imgType == SSH_PALETTED_4BPP ? 16 : SSH_MAX_PALETTE_ENTRIES;
+}
+
+// getMipMapSize(): a mip level's width or height, as ssh_utils.c works it out
+static DWORD getMipMapSize(DWORD size, DWORD level){
+    size >>= level;
+    return size ? size : 1;
+}
+
+static BYTE getValue(sshgenPattern_t pattern, DWORD x, DWORD y, DWORD channel, DWORD *seed){
+    switch(pattern){
+        case PATTERN_FLAT:      return 3 + channel * 0x40;
+        case PATTERN_NOISY:     return nextRandom(seed);
+        case PATTERN_STRIPED:   return (x / SSHGEN_STRIPE_WIDTH) * 37 + channel * 0x40;
+        case PATTERN_SPARSE:    return sparseValues[(x / 4 + y) % SSHGEN_SPARSE_COLORS] + channel * 0x40;
+        // odd steps along the rows, so that neighbouring pixels differ even in 4bpp images
+        default:                return x * 7 + y * 3 + channel * 0x55;
+    }
+}
+
+static BYTE getAlpha(sshgenPattern_t pattern, DWORD *seed){
+    return pattern == PATTERN_NOISY ? nextRandom(seed) : 0xFF;
+}
+
+// nextRandom(): xorshift32, so that the files are the same on every platform
+static DWORD nextRandom(DWORD *seed){
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+
+    return *seed >> 24;
+}
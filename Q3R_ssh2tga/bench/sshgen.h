@@ -0,0 +1,52 @@
+#ifndef SSHGEN_H
+#define SSHGEN_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Synthetic ssh files for the benchmarks: a single image of any of the four sshImgType_t types,
+** optionally followed by mipmaps, laid out as Q3R's files are (main header, resource entry, "Buy ERTS",
+** image header, image and mipmaps data, palette header and palette for the paletted images, footer,
+** padding to 16 bytes). Each mipmap is filled with the same pattern at its own size, rather than scaled down.
+**
+** The content follows a pattern, picked to hit the kernels' best and worst cases:
+** - flat: a single colour, opaque (one long run for RLE, a full scan for the alpha check);
+** - noisy: random pixels and alpha values (raw packets only, the alpha scan stopping right away);
+** - striped: vertical stripes 8 pixels wide, opaque (short runs);
+** - gradient: each pixel different from its neighbours, opaque (raw packets, all of the palette used);
+** - sparse: 4 colours, scattered across the palette rather than its first entries, opaque
+**   (the shrunk palette's indexes differ from the ssh file's ones; truecolor images fit in a palette).
+*/
+typedef enum sshgenPattern_e{
+    PATTERN_FLAT,
+    PATTERN_NOISY,
+    PATTERN_STRIPED,
+    PATTERN_GRADIENT,
+    PATTERN_SPARSE,
+    NUM_PATTERNS
+}sshgenPattern_t;
+
+extern const char * const sshgen_patternNames[NUM_PATTERNS];
+
+// sshgen_imgDataSize(): the size of a width x height image's pixels (or palette indexes) in a ssh file
+DWORD sshgen_imgDataSize(sshImgType_t imgType, DWORD width, DWORD height);
+
+/* sshgen_fillImage(): write a width x height image's pixels (or palette indexes), as stored in a ssh file, to dst
+** (sshgen_imgDataSize() bytes); the same arguments give the same pixels
+*/
+void sshgen_fillImage(sshImgType_t imgType, DWORD width, DWORD height, sshgenPattern_t pattern, BYTE *dst);
+
+// sshgen_fillPalette(): write numEntries palette entries (RGBA, ssh's channel order) to dst
+void sshgen_fillPalette(sshgenPattern_t pattern, DWORD numEntries, sshPixel32_t *dst);
+
+/* sshgen_make(): build a whole ssh file in a newly allocated buffer, which the caller frees, storing its size in *size;
+** name (without the extension) goes in the footer, and its first 4 characters in the resource entry.
+** NULL if it couldn't be allocated, or if the image (and its numMipMaps mipmaps) is too big for the headers' fields
+*/
+BYTE *sshgen_make(sshImgType_t imgType, DWORD width, DWORD height, DWORD numMipMaps, sshgenPattern_t pattern, const char *name, DWORD *size);
+
+// sshgen_save(): write a ssh file built by sshgen_make() to path; errors are printed to stderr
+bool sshgen_save(sshImgType_t imgType, DWORD width, DWORD height, DWORD numMipMaps, sshgenPattern_t pattern, const char *name, const char *path);
+
+#endif /* SSHGEN_H */
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tga_utils.h"
+#include "tgaread.h"
+
+
+// local functions declarations
+static BYTE *readFile(const char *path, DWORD *size);
+static void getRgba(const BYTE *src, DWORD depth, BYTE *dst);
+
+
+// functions definitions
+BYTE *tgaread_decodeRgba(const char *tgaPath, DWORD *width, DWORD *height){
+    BYTE *tga, *pixels = NULL, *dst;
+    DWORD tgaSize, offset, numPixels, pixelSize, cmapSize, count, i;
+    DWORD cmapLength, cmapDepth, pixelDepth, imgType, descriptor;
+    bool isCMapped, isRle, isRaw = false;
+    const BYTE *cmap, *pixel = NULL;
+
+    if((tga = readFile(tgaPath, &tgaSize)) == NULL)
+        return NULL;
+
+    if(tgaSize < TGA_HEADER_SIZE)
+        goto badFile;
+
+    imgType = tga[2];
+    cmapLength = tga[5] | tga[6] << 8;
+    cmapDepth = tga[7];
+    *width = tga[12] | tga[13] << 8;
+    *height = tga[14] | tga[15] << 8;
+    pixelDepth = tga[16];
+    descriptor = tga[17];
+
+    isCMapped = imgType == IMGTYPE_COLORMAPPED || imgType == IMGTYPE_COLORMAPPED_RLE;
+    isRle = imgType == IMGTYPE_COLORMAPPED_RLE || imgType == IMGTYPE_TRUECOLOR_RLE;
+
+    if(!isCMapped && imgType != IMGTYPE_TRUECOLOR && imgType != IMGTYPE_TRUECOLOR_RLE)
+        goto badFile;
+
+    if(isCMapped ? pixelDepth != 8 || tga[1] != PALETTED || (cmapDepth != 24 && cmapDepth != 32)
+                 : pixelDepth != 24 && pixelDepth != 32)
+        goto badFile;
+
+    pixelSize = pixelDepth / 8;
+    cmapSize = isCMapped ? cmapLength * (cmapDepth / 8) : 0;
+    offset = TGA_HEADER_SIZE + tga[0];
+    cmap = tga + offset;
+    offset += cmapSize;
+    numPixels = *width * *height;
+
+    if(offset > tgaSize || (pixels = malloc(numPixels * sizeof(sshPixel32_t) + 1)) == NULL)
+        goto badFile;
+
+    // each pixel is read either from a raw packet (or unpacked data), or repeated from a RLE packet's one
+    for(i = 0, count = 0; i < numPixels; ++i, --count){
+        if(count == 0 && isRle){
+            if(offset >= tgaSize)
+                goto badFile;
+
+            isRaw = !(tga[offset] & 0x80);
+            count = (tga[offset++] & 0x7F) + 1;
+            pixel = NULL;
+        }
+        else if(count == 0){
+            isRaw = true;
+            count = numPixels;
+        }
+
+        if(isRaw || pixel == NULL){
+            if(offset + pixelSize > tgaSize)
+                goto badFile;
+
+            pixel = tga + offset;
+            offset += pixelSize;
+        }
+
+        dst = pixels + ((descriptor & TOP_LEFT) ? i : (*height - 1 - i / *width) * *width + i % *width) * sizeof(sshPixel32_t);
+
+        if(isCMapped){
+            if(*pixel >= cmapLength)
+                goto badFile;
+
+            getRgba(cmap + *pixel * (cmapDepth / 8), cmapDepth, dst);
+        }
+        else
+            getRgba(pixel, pixelDepth, dst);
+    }
+
+    free(tga);
+    return pixels;
+
+badFile:
+    fprintf(stderr, "%s isn't a tga file as the converter writes them\n", tgaPath);
+    free(tga);
+    free(pixels);
+    return NULL;
+}
+
+
+// local functions definitions
+
+static BYTE *readFile(const char *path, DWORD *size){
+    FILE *file;
+    BYTE *data;
+    long fileSize;
+
+    if((file = fopen(path, "rb")) == NULL){
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if(fileSize < 0 || (data = malloc(fileSize + 1)) == NULL){
+        fprintf(stderr, "Couldn't read %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    if(fread(data, 1, fileSize, file) != (size_t)fileSize){
+        fprintf(stderr, "Couldn't read %s\n", path);
+        fclose(file);
+        free(data);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = fileSize;
+    return data;
+}
+
+// getRgba(): convert a tga pixel (BGR or BGRA) to a ssh one
+static void getRgba(const BYTE *src, DWORD depth, BYTE *dst){
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+    dst[3] = depth == 32 ? src[3] : 0xFF;
+}
@@ -0,0 +1,14 @@
+#ifndef TGAREAD_H
+#define TGAREAD_H
+
+#include "types.h"
+
+/* tgaread_decodeRgba(): decode a tga file as the converter writes them (colour mapped or truecolor,
+** RLE or not, 8 bit indexes with a 24/32 bit palette or 24/32 bit pixels) to RGBA pixels, in ssh's channel order
+** and top-bottom rows, as ssh_decodeRgba() does; the 24 bit ones get an opaque alpha channel.
+** Returns a newly allocated buffer, which the caller frees, or NULL if the file can't be read or decoded
+** (with the reason printed to stderr)
+*/
+BYTE *tgaread_decodeRgba(const char *tgaPath, DWORD *width, DWORD *height);
+
+#endif /* TGAREAD_H */
@@ -8,17 +8,83 @@
 #include "tga_utils.h"
 #include "types.h"
 #include "ssh_utils.h"
+#include "threads.h"
+#include "jobs.h"
+#include "msglog.h"
+#include "atlas.h"
+#include "cache.h"
+
+/* The images are converted by a pool of worker threads (see jobs.h); each conversion's messages are
+** collected in a log and printed when the conversion is committed, so the console output is the same
+** as converting the files one at a time.
+** With -out_atlas the worker threads only decode the images, which are then packed together once all of them are.
+** The files containing more than one image get a job for each image, so that they're converted in parallel too.
+** With -cache the worker threads look each image up in the conversion cache (see cache.h) before converting it.
+*/
+
+#define ATLAS_PADDING   2   // pixels between the images packed in an atlas
+
+// options specified on the command line
+typedef struct options_s{
+    convOptions_t   conv;
+    unsigned        numThreads;
+    DWORD           atlasSize;
+    const char *    atlasName;
+    const char *    image;          // the only image converted from each file (its index or name), if not NULL
+    bool            ps2Alpha;       // rescale the PS2's 0-0x80 alpha values to 0-0xFF
+    bool            cache;          // skip the images converted by a previous run which haven't changed
+}options_t;
+
+// an image to be converted by the worker threads
+typedef struct convJob_s{
+    const char *    sshPath;
+    DWORD           resIndex;
+    bool            multiImage;     // the file has more images, so the messages tell which one this is
+    bool            missing;        // the file has no image options.image refers to
+    msgLog_t        log;
+    size_t          initLogLen;     // messages printed by init_sshHandle(), which precede the "Converting" line
+    bool            initialized;
+    bool            converted;
+    cacheResult_t   cacheResult;    // CACHE_MISS if the image has been converted (or without -cache)
+
+    // the decoded image, for -out_atlas
+    BYTE *          pixels;
+    DWORD           width;
+    DWORD           height;
+}convJob_t;
+
+
+/* global variables(used only inside this module) */
+static options_t options;
+
+/* scratch buffers for the worker threads; a job takes a free one while processing,
+** and since no more than numThreads jobs are processed at once there's always one available
+*/
+static sshScratch_t *   scratchBufs;
+static sshScratch_t **  freeScratchBufs;
+static unsigned         numFreeScratchBufs;
+static mutex_t *        scratchMutex;
+
+static atlas_t          atlas;      // the decoded images, added in the order they were submitted
 
 
 /* local functions declarations */
 static void printUsage(void);
-static outFormat_t checkOption(const char *option, int *firstFileIdx);
+static int parseOptions(int argc, char **argv);
+static bool init_scratchBufs(unsigned numBufs);
+static void free_scratchBufs(unsigned numBufs);
+static void printRleStats(unsigned numBufs);
+static bool saveAtlas(void);
+static DWORD getCacheOptions(void);
+static DWORD countJobs(const char *sshPath);
+static bool submit_file(const char *sshPath);
+static bool submit_convJob(const char *sshPath, DWORD resIndex, bool multiImage, bool missing);
+static bool process_convJob(void *job);
+static bool commit_convJob(void *job);
 
 int main(int argc, char **argv){
     int i, firstFileIdx;
-    outFormat_t outFormat;
-    bool success;
-    sshHandle_t sshHandle;
+    DWORD numJobs;
 
     puts("\tQuake 3 Revolution SSH to TGA image converter by Yagotzirck\n");
 
@@ -27,26 +93,63 @@ int main(int argc, char **argv){
         return 1;
     }
 
-    outFormat = checkOption(argv[1], &firstFileIdx);
+    firstFileIdx = parseOptions(argc, argv);
 
     if(firstFileIdx == argc){
         fputs("You need to specify at least one file after the option!\n", stderr);
         return 1;
     }
 
-    for(i = firstFileIdx; i < argc; ++i){
-        if(!init_sshHandle(&sshHandle, argv[i]))
-            continue;
+    /* the threads the images' conversions don't keep busy compress BC blocks;
+    ** e.g. a single image gets them all, while a file with several images shares them
+    */
+    if(options.conv.outFormat == OUT_DDS_BC){
+        for(numJobs = 0, i = firstFileIdx; i < argc; ++i)
+            numJobs += countJobs(argv[i]);
 
-        printf("Converting %s...", argv[i]);
-        success = ssh_convertAndSave(&sshHandle, outFormat);
-        if(success)
-            puts("done");
+        if(numJobs > 0 && options.numThreads > numJobs)
+            options.conv.bcThreads = options.numThreads / numJobs;
+    }
 
-        free_sshHandleBuffers(&sshHandle);
+    if(!init_scratchBufs(options.numThreads))
+        return 1;
+
+    if(options.cache && !cache_init()){
+        free_scratchBufs(options.numThreads);
+        return 1;
     }
 
+    if(!jobs_init(options.numThreads, process_convJob, commit_convJob)){
+        if(options.cache)
+            cache_free();
+        free_scratchBufs(options.numThreads);
+        return 1;
+    }
+
+    atlas_init(&atlas);
+
+    for(i = firstFileIdx; i < argc; ++i)
+        submit_file(argv[i]);
+
+    jobs_wait();
+    jobs_free();
+
+    if(options.conv.outFormat == OUT_ATLAS)
+        saveAtlas();
+
     puts("\nConversion complete!");
+
+    if(options.conv.outFormat == OUT_SHRINK)
+        printRleStats(options.numThreads);
+
+    if(options.cache){
+        cache_save();
+        cache_free();
+    }
+
+    atlas_free(&atlas);
+
+    free_scratchBufs(options.numThreads);
     return 0;
 }
 
@@ -54,8 +157,8 @@ int main(int argc, char **argv){
 
 static void printUsage(void){
     fputs(
-        "Usage: Q3R_ssh2tga.exe <option> <file1> <file2> ... <fileN>\n"
-        "where <option> is one of the following:\n\n"
+        "Usage: Q3R_ssh2tga.exe [options] <file1> <file2> ... <fileN>\n"
+        "where [options] are one or more of the following:\n\n"
 
         "-out_shrink\n\t"
             "Remove unused palette entries from paletted images, remove alpha\n\t"
@@ -74,53 +177,441 @@ static void printUsage(void){
             "Quake 3 Arena, since it only accepts bottom-top TGA images\n\t"
             "(good job, John Carmack.)\n\n"
 
-        "If no option is specified, -out_shrink will be used by default.\n",
+        "-out_dds\n\t"
+            "Save the images and their mipmaps (if any) as DDS textures,\n\t"
+            "with uncompressed RGBA8 pixels.\n\n"
+
+        "-out_ktx2\n\t"
+            "Same as -out_dds, as KTX2 textures.\n\n"
+
+        "-out_dds_bc\n\t"
+            "Same as -out_dds, with BC1 (DXT1) compressed pixels, or BC3 (DXT5)\n\t"
+            "ones for the images whose alpha channel isn't fully opaque.\n\n"
+
+        "-rle <optimal|greedy>\n\t"
+            "How -out_shrink picks the RLE packets: greedy (the default)\n\t"
+            "takes each run as it comes, optimal finds the smallest packets\n\t"
+            "for the whole image, which takes about twice as long and rarely\n\t"
+            "saves more than a few bytes.\n\n"
+
+        "-bc_quality <fast|best>\n\t"
+            "How hard -out_dds_bc looks for the best colors of each 4x4 block:\n\t"
+            "fast (the default) uses the block's extremes, best tries many\n\t"
+            "more candidates, which is a lot slower.\n\n"
+
+        "-out_atlas\n\t"
+            "Pack all the images into as few texture atlas pages as possible,\n\t"
+            "saved as 32 bit TGA files (<name>_0.tga, <name>_1.tga, ...)\n\t"
+            "along with <name>.txt, which lists each image's page, position\n\t"
+            "and size.\n\n"
+
+        "-atlas_size <pixels>\n\t"
+            "Width and height of the atlas pages (2048 by default); bigger\n\t"
+            "images get a page as big as they need.\n\n"
+
+        "-atlas_name <name>\n\t"
+            "Path and name of the atlas files, without extension\n\t"
+            "(\"atlas\" by default.)\n\n"
+
+        "-image <index|name>\n\t"
+            "Convert only the image with the given index (starting from 0)\n\t"
+            "or name from each file; by default, the files containing more\n\t"
+            "than one image have all of them converted, each saved as\n\t"
+            "<file>_<index>.<ext>.\n\n"
+
+        "-ps2_alpha\n\t"
+            "Rescale the alpha channel of the images whose alpha values are\n\t"
+            "all within 0-0x80 (as on the PS2, where 0x80 is fully opaque)\n\t"
+            "to 0-0xFF; the fully opaque ones then lose the alpha channel\n\t"
+            "with -out_shrink and -out_dds_bc.\n\n"
+
+        "-cache\n\t"
+            "Skip the images which haven't changed since a previous run with\n\t"
+            "-cache converted them with the same options, and hard link the\n\t"
+            "images identical to an already converted one to its file; each\n\t"
+            "folder's converted files are listed in " CACHE_INDEX_NAME ".\n\t"
+            "It can't be used along with -out_atlas.\n\n"
+
+        "-j <threads>\n\t"
+            "Convert up to <threads> images at once\n\t"
+            "(by default, as many as the available CPUs.)\n\n"
+
+        "If no output format is specified, -out_shrink will be used by default.\n",
 
       stderr
     );
 }
 
-static outFormat_t checkOption(const char *option, int *firstFileIdx){
+/* parseOptions(): parse the options preceding the files' list (case insensitive,
+** with either one or two leading hyphens), returning the index of the first file in argv
+*/
+static int parseOptions(int argc, char **argv){
     char option_lowercase[FILENAME_MAX];
 
     const char *optionsStrList[] = {
         "-out_shrink",
         "-out_asis",
-        "-out_truecolor_upsidedown"
+        "-out_truecolor_upsidedown",
+        "-out_dds",
+        "-out_ktx2",
+        "-out_dds_bc",
+        "-out_atlas"
     };
 
-    int i;
+    int i, j;
     const int numOptions = sizeof(optionsStrList) / sizeof(optionsStrList[0]);
 
+    options.conv.outFormat = OUT_SHRINK;
+    options.conv.rleOptimal = false;
+    options.conv.bcQuality = BC_QUALITY_RANGE_FIT;
+    options.conv.bcThreads = 1;
+    options.numThreads = getNumCPUs();
+    options.atlasSize = 2048;
+    options.atlasName = "atlas";
+    options.image = NULL;
+    options.ps2Alpha = false;
+    options.cache = false;
 
-    /* if the 1st character isn't a hyphen then we assume that no argument
-    ** has been specified and that argv[1] is a file passed as a parameter,
-    ** so we'll use the default option OUT_SHRINK as specified in the
-    ** usage message.
+    /* if an argument's 1st character isn't a hyphen then we assume that it's the 1st file
+    ** passed as a parameter, and that there are no more options
     */
-    if(option[0] != '-'){
-        *firstFileIdx = 1;
-        return OUT_SHRINK;
+    for(i = 1; i < argc && argv[i][0] == '-'; ++i){
+        const char *option = argv[i][1] == '-' ? argv[i] + 1 : argv[i];
+
+        // get rid of case sensitivity
+        for(j = 0; option[j] != '\0' && j < sizeof(option_lowercase) - 1; j++)
+            option_lowercase[j] = tolower(option[j]);
+        option_lowercase[j] = '\0';
+
+        if(strcmp(option_lowercase, "-j") == 0 && i + 1 < argc){
+            options.numThreads = strtoul(argv[++i], NULL, 10);
+
+            if(options.numThreads == 0){
+                fprintf(stderr, "Invalid number of threads: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-atlas_size") == 0 && i + 1 < argc){
+            options.atlasSize = strtoul(argv[++i], NULL, 10);
+
+            if(options.atlasSize == 0 || options.atlasSize > 0xFFFF){
+                fprintf(stderr, "Invalid atlas size: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-atlas_name") == 0 && i + 1 < argc){
+            options.atlasName = argv[++i];
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-ps2_alpha") == 0){
+            options.ps2Alpha = true;
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-cache") == 0){
+            options.cache = true;
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-image") == 0 && i + 1 < argc){
+            options.image = argv[++i];
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-rle") == 0 && i + 1 < argc){
+            ++i;
+
+            if(strcmp(argv[i], "optimal") == 0)
+                options.conv.rleOptimal = true;
+            else if(strcmp(argv[i], "greedy") == 0)
+                options.conv.rleOptimal = false;
+            else{
+                fprintf(stderr, "Invalid RLE packing: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            continue;
+        }
+
+        if(strcmp(option_lowercase, "-bc_quality") == 0 && i + 1 < argc){
+            ++i;
+
+            if(strcmp(argv[i], "fast") == 0)
+                options.conv.bcQuality = BC_QUALITY_RANGE_FIT;
+            else if(strcmp(argv[i], "best") == 0)
+                options.conv.bcQuality = BC_QUALITY_CLUSTER_FIT;
+            else{
+                fprintf(stderr, "Invalid BC quality: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+
+            continue;
+        }
+
+        // find which output format has been chosen
+        for(j = 0; j < numOptions; j++)
+            if(strcmp(optionsStrList[j], option_lowercase) == 0)
+                break;
+
+        // no supported option has been found; abort the program
+        if(j == numOptions){
+            fprintf(stderr, "The option %s is unsupported.\n"
+                            "Invoke this exe without any parameters to see a list of available options.\n", argv[i]);
+
+            exit(EXIT_FAILURE);
+        }
+
+        options.conv.outFormat = j;
     }
 
-    /* if the 1st character is a hyphen, then argv[1] is expected to be the option
-    ** and the 1st file passed as a parameter is expected to be at argv[2]
-    */
-    *firstFileIdx = 2;
+    if(options.cache && options.conv.outFormat == OUT_ATLAS){
+        fputs("-cache can't be used along with -out_atlas.\n", stderr);
+        exit(EXIT_FAILURE);
+    }
 
-    // get rid of case sensitivity
-    for(i = 0; option[i] != '\0'; i++)
-        option_lowercase[i] = tolower(option[i]);
-    option_lowercase[i] = '\0';
+    return i;
+}
+
+static bool init_scratchBufs(unsigned numBufs){
+    unsigned i;
+
+    scratchBufs = malloc(numBufs * sizeof(*scratchBufs));
+    freeScratchBufs = malloc(numBufs * sizeof(*freeScratchBufs));
+
+    if(scratchBufs == NULL || freeScratchBufs == NULL || (scratchMutex = mutex_create()) == NULL){
+        fputs("Couldn't allocate the worker threads' data\n", stderr);
+        free(scratchBufs);
+        free(freeScratchBufs);
+        return false;
+    }
+
+    for(i = 0; i < numBufs; ++i){
+        init_sshScratch(&scratchBufs[i]);
+        freeScratchBufs[i] = &scratchBufs[i];
+    }
+
+    numFreeScratchBufs = numBufs;
+    return true;
+}
+
+static void free_scratchBufs(unsigned numBufs){
+    unsigned i;
+
+    for(i = 0; i < numBufs; ++i)
+        free_sshScratch(&scratchBufs[i]);
+
+    mutex_free(scratchMutex);
+    free(scratchBufs);
+    free(freeScratchBufs);
+}
+
+// printRleStats(): print the RLE encoder's throughput, summed up over the worker threads' scratch buffers
+static void printRleStats(unsigned numBufs){
+    unsigned long long rleBytes = 0;
+    double rleSeconds = 0;
+    unsigned i;
+
+    for(i = 0; i < numBufs; ++i){
+        rleBytes += scratchBufs[i].rleBytes;
+        rleSeconds += scratchBufs[i].rleSeconds;
+    }
+
+    if(rleBytes == 0 || rleSeconds <= 0)
+        return;
+
+    printf("RLE encoded %.2f MB in %.3f seconds (%.1f MB/s per thread)\n",
+           rleBytes / 1e6, rleSeconds, rleBytes / 1e6 / rleSeconds);
+}
+
+// saveAtlas(): pack the decoded images and save the atlas
+static bool saveAtlas(void){
+    if(atlas.numImages == 0)
+        return true;
+
+    printf("\nPacking %u images into the atlas...", atlas.numImages);
+    fflush(stdout);
+
+    if(!atlas_pack(&atlas, options.atlasSize, ATLAS_PADDING) || !atlas_save(&atlas, options.atlasName))
+        return false;
+
+    printf("done (%u pages)\n", atlas.numPages);
+    return true;
+}
+
+/* getCacheOptions(): the options the converted files depend on, which the cache tells apart;
+** the others (e.g. the number of threads) don't change a single byte of them.
+** The top byte is the converter's SSH_CONV_VERSION, so that the files an older version made are converted again
+*/
+static DWORD getCacheOptions(void){
+    DWORD cacheOptions = options.conv.outFormat;
+
+    if(options.conv.outFormat == OUT_SHRINK && options.conv.rleOptimal)
+        cacheOptions |= 1 << 8;
+    if(options.conv.outFormat == OUT_DDS_BC)
+        cacheOptions |= options.conv.bcQuality << 9;
+    if(options.ps2Alpha)
+        cacheOptions |= 1 << 12;
+
+    cacheOptions |= (DWORD)SSH_CONV_VERSION << 24;
+
+    return cacheOptions;
+}
+
+// countJobs(): the number of jobs submit_file() submits for the file
+static DWORD countJobs(const char *sshPath){
+    sshResTable_t table;
+    DWORD numJobs;
+
+    if(!ssh_readResTable(sshPath, &table))
+        return 1;
+
+    numJobs = options.image != NULL ? 1 : table.numResources;
+
+    ssh_freeResTable(&table);
+    return numJobs;
+}
+
+// submit_file(): submit a job for each of the file's images to be converted
+static bool submit_file(const char *sshPath){
+    sshResTable_t table;
+    bool success = true;
+    DWORD resIndex;
+
+    // a file whose images can't be listed gets a job anyway, which reports what's wrong with it
+    if(!ssh_readResTable(sshPath, &table))
+        return submit_convJob(sshPath, 0, false, false);
+
+    if(options.image != NULL){
+        if(ssh_findResource(&table, options.image, &resIndex))
+            success = submit_convJob(sshPath, resIndex, table.numResources > 1, false);
+        else
+            success = submit_convJob(sshPath, 0, false, true);
+    }
+    else
+        for(resIndex = 0; resIndex < table.numResources && success; ++resIndex)
+            success = submit_convJob(sshPath, resIndex, table.numResources > 1, false);
+
+    ssh_freeResTable(&table);
+    return success;
+}
+
+static bool submit_convJob(const char *sshPath, DWORD resIndex, bool multiImage, bool missing){
+    convJob_t *job;
+
+    if((job = malloc(sizeof(*job))) == NULL){
+        fprintf(stderr, "Couldn't allocate %u bytes for %s's conversion job\n", (unsigned)sizeof(*job), sshPath);
+        return false;
+    }
+
+    job->sshPath = sshPath;
+    job->resIndex = resIndex;
+    job->multiImage = multiImage;
+    job->missing = missing;
+    job->initLogLen = 0;
+    job->initialized = false;
+    job->converted = false;
+    job->cacheResult = CACHE_MISS;
+    job->pixels = NULL;
+    msgLog_init(&job->log);
+
+    return jobs_submit(job);
+}
+
+// process_convJob(): convert an image on a worker thread
+static bool process_convJob(void *job){
+    convJob_t *convJob = job;
+    sshHandle_t sshHandle;
+    sshScratch_t *scratch;
+    char outPath[FILENAME_MAX];
+    QWORD fileHash;
+
+    if(convJob->missing){
+        msgLog_printf(&convJob->log, "%s has no image %s\n", convJob->sshPath, options.image);
+        convJob->initLogLen = convJob->log.len;
+        return false;
+    }
+
+    // the ssh file is read into the scratch buffers too
+    mutex_lock(scratchMutex);
+    scratch = freeScratchBufs[--numFreeScratchBufs];
+    mutex_unlock(scratchMutex);
+
+    convJob->initialized = init_sshHandle(&sshHandle, convJob->sshPath, convJob->resIndex, options.cache ? &fileHash : NULL, &convJob->log, scratch);
+    convJob->initLogLen = convJob->log.len;
+
+    if(convJob->initialized && options.cache){
+        ssh_getOutPath(&sshHandle, options.conv.outFormat, outPath);
+        convJob->cacheResult = cache_lookup(outPath, fileHash, convJob->resIndex, getCacheOptions());
+        convJob->converted = convJob->cacheResult != CACHE_MISS;
+    }
+
+    if(convJob->initialized && convJob->cacheResult == CACHE_MISS){
+        if(options.ps2Alpha)
+            ssh_normalizePs2Alpha(&sshHandle);
+
+        if(options.conv.outFormat == OUT_ATLAS){
+            convJob->pixels = ssh_decodeRgba(&sshHandle);
+            convJob->width = sshHandle.resHdr.width;
+            convJob->height = sshHandle.resHdr.height;
+            convJob->converted = convJob->pixels != NULL;
+        }
+        else
+            convJob->converted = ssh_convertAndSave(&sshHandle, &options.conv, scratch);
+
+        free_sshHandleBuffers(&sshHandle);
+
+        if(options.cache)
+            cache_update(outPath, fileHash, convJob->resIndex, getCacheOptions(), convJob->converted);
+    }
+
+    mutex_lock(scratchMutex);
+    freeScratchBufs[numFreeScratchBufs++] = scratch;
+    mutex_unlock(scratchMutex);
+
+    return convJob->converted;
+}
+
+// commit_convJob(): print a conversion's messages, in the same order as a serial conversion would
+static bool commit_convJob(void *job){
+    convJob_t *convJob = job;
+    bool success = convJob->converted;
+    char name[FILENAME_MAX];
+
+    // the images of the files containing more than one are named after their index
+    if(convJob->multiImage)
+        snprintf(name, sizeof(name), "%s:%u", convJob->sshPath, convJob->resIndex);
+    else
+        snprintf(name, sizeof(name), "%s", convJob->sshPath);
+
+    msgLog_print(&convJob->log, 0, convJob->initLogLen, stderr);
+
+    if(convJob->initialized){
+        printf(options.conv.outFormat == OUT_ATLAS ? "Decoding %s..." : "Converting %s...", name);
+        fflush(stdout);
+
+        msgLog_print(&convJob->log, convJob->initLogLen, convJob->log.len, stderr);
+
+        if(convJob->cacheResult == CACHE_UNCHANGED)
+            puts("unchanged");
+        else if(convJob->cacheResult == CACHE_LINKED)
+            puts("linked to an identical image");
+        else if(convJob->converted)
+            puts("done");
+    }
 
-    // find which option has been chosen
-    for(i = 0; i < numOptions; i++)
-        if(strcmp(optionsStrList[i], option_lowercase) == 0)
-            return i;
+    // the atlas takes over the decoded image
+    if(convJob->converted && convJob->pixels != NULL)
+        success = atlas_add(&atlas, name, convJob->width, convJob->height, convJob->pixels);
 
-    // no supported option has been found; abort the program
-    fputs(  "The option you specified is unsupported.\n"
-            "Invoke this exe without any parameters to see a list of available options.\n", stderr);
+    msgLog_free(&convJob->log);
+    free(convJob);
 
-    exit(EXIT_FAILURE);
+    return success;
 }
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "atlas.h"
+#include "outfile.h"
+#include "pixconv.h"
+#include "tga_utils.h"
+
+
+// local functions declarations
+static int compareImages(const void *a, const void *b);
+static bool addPage(atlas_t *atlas, DWORD width, DWORD height);
+static bool placeOnPage(atlasPage_t *page, DWORD width, DWORD height, DWORD *x, DWORD *y);
+static bool fitSkyline(const atlasPage_t *page, DWORD node, DWORD width, DWORD height, DWORD *y);
+static void addSkylineLevel(atlasPage_t *page, DWORD node, DWORD x, DWORD y, DWORD width);
+static void removeSkylineNode(atlasPage_t *page, DWORD node);
+static bool savePage(const atlas_t *atlas, DWORD page, const char *prefix);
+
+
+// functions definitions
+void atlas_init(atlas_t *atlas){
+    atlas->images = NULL;
+    atlas->numImages = 0;
+    atlas->maxImages = 0;
+    atlas->pages = NULL;
+    atlas->numPages = 0;
+}
+
+bool atlas_add(atlas_t *atlas, const char *name, DWORD width, DWORD height, BYTE *pixels){
+    atlasImage_t *images, *image;
+    DWORD maxImages;
+    char *nameCopy;
+
+    if(atlas->numImages == atlas->maxImages){
+        maxImages = atlas->maxImages ? atlas->maxImages * 2 : 64;
+
+        if((images = realloc(atlas->images, maxImages * sizeof(*images))) == NULL){
+            fprintf(stderr, "Couldn't allocate the atlas' list of images\n");
+            free(pixels);
+            return false;
+        }
+
+        atlas->images = images;
+        atlas->maxImages = maxImages;
+    }
+
+    if((nameCopy = malloc(strlen(name) + 1)) == NULL){
+        fprintf(stderr, "Couldn't allocate %s's name in the atlas\n", name);
+        free(pixels);
+        return false;
+    }
+    strcpy(nameCopy, name);
+
+    image = &atlas->images[atlas->numImages++];
+    image->name = nameCopy;
+    image->width = width;
+    image->height = height;
+    image->pixels = pixels;
+    image->page = image->x = image->y = 0;
+
+    return true;
+}
+
+bool atlas_pack(atlas_t *atlas, DWORD pageSize, DWORD padding){
+    atlasImage_t **sorted;
+    atlasImage_t *image;
+    atlasPage_t *page;
+    DWORD width, height, x, y, i, p;
+
+    if(atlas->numImages == 0)
+        return true;
+
+    if((sorted = malloc(atlas->numImages * sizeof(*sorted))) == NULL){
+        fprintf(stderr, "Couldn't allocate the atlas' list of images\n");
+        return false;
+    }
+
+    for(i = 0; i < atlas->numImages; ++i)
+        sorted[i] = &atlas->images[i];
+
+    qsort(sorted, atlas->numImages, sizeof(*sorted), compareImages);
+
+    for(i = 0; i < atlas->numImages; ++i){
+        image = sorted[i];
+        width = image->width + padding;
+        height = image->height + padding;
+
+        // first fit: the first page with room for it, or a new one
+        for(p = 0; p < atlas->numPages; ++p)
+            if(placeOnPage(&atlas->pages[p], width, height, &x, &y))
+                break;
+
+        if(p == atlas->numPages){
+            if(!addPage(atlas, width > pageSize ? width : pageSize, height > pageSize ? height : pageSize)){
+                free(sorted);
+                return false;
+            }
+
+            placeOnPage(&atlas->pages[p], width, height, &x, &y);
+        }
+
+        page = &atlas->pages[p];
+        image->page = p;
+        image->x = x + padding;
+        image->y = y + padding;
+
+        if(image->x + image->width > page->usedWidth)
+            page->usedWidth = image->x + image->width;
+        if(image->y + image->height > page->usedHeight)
+            page->usedHeight = image->y + image->height;
+    }
+
+    free(sorted);
+    return true;
+}
+
+bool atlas_save(const atlas_t *atlas, const char *prefix){
+    char path[FILENAME_MAX];
+    FILE *table;
+    const atlasImage_t *image;
+    bool success = true;
+    DWORD i;
+
+    for(i = 0; i < atlas->numPages; ++i)
+        if(!savePage(atlas, i, prefix))
+            success = false;
+
+    snprintf(path, sizeof(path), "%s.txt", prefix);
+
+    if((table = fopen(path, "w")) == NULL){
+        fprintf(stderr, "Couldn't create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // the name goes last, since it may contain spaces
+    fputs("# page x y width height name\n", table);
+
+    for(i = 0; i < atlas->numImages; ++i){
+        image = &atlas->images[i];
+        fprintf(table, "%u %u %u %u %u %s\n", image->page, image->x, image->y, image->width, image->height, image->name);
+    }
+
+    if(ferror(table) | fclose(table)){
+        fprintf(stderr, "Couldn't write %s\n", path);
+        success = false;
+    }
+
+    return success;
+}
+
+void atlas_free(atlas_t *atlas){
+    DWORD i;
+
+    for(i = 0; i < atlas->numImages; ++i){
+        free(atlas->images[i].name);
+        free(atlas->images[i].pixels);
+    }
+
+    for(i = 0; i < atlas->numPages; ++i)
+        free(atlas->pages[i].skyline);
+
+    free(atlas->images);
+    free(atlas->pages);
+    atlas_init(atlas);
+}
+
+
+// local functions definitions
+
+// compareImages(): qsort() comparator putting the tallest (then widest) images first, in the order they were added otherwise
+static int compareImages(const void *a, const void *b){
+    const atlasImage_t *imgA = *(const atlasImage_t * const *)a;
+    const atlasImage_t *imgB = *(const atlasImage_t * const *)b;
+
+    if(imgA->height != imgB->height)
+        return imgA->height > imgB->height ? -1 : 1;
+
+    if(imgA->width != imgB->width)
+        return imgA->width > imgB->width ? -1 : 1;
+
+    return imgA < imgB ? -1 : imgA > imgB;
+}
+
+static bool addPage(atlas_t *atlas, DWORD width, DWORD height){
+    atlasPage_t *pages;
+    atlasPage_t *page;
+
+    if((pages = realloc(atlas->pages, (atlas->numPages + 1) * sizeof(*pages))) == NULL){
+        fprintf(stderr, "Couldn't allocate an atlas page\n");
+        return false;
+    }
+    atlas->pages = pages;
+
+    page = &pages[atlas->numPages];
+
+    // each node is at least a pixel wide, plus the one being inserted by addSkylineLevel()
+    if((page->skyline = malloc((width + 1) * sizeof(*page->skyline))) == NULL){
+        fprintf(stderr, "Couldn't allocate an atlas page\n");
+        return false;
+    }
+
+    page->width = width;
+    page->height = height;
+    page->usedWidth = 0;
+    page->usedHeight = 0;
+    page->skyline[0].x = 0;
+    page->skyline[0].y = 0;
+    page->skyline[0].width = width;
+    page->numNodes = 1;
+
+    ++atlas->numPages;
+    return true;
+}
+
+/* placeOnPage(): find the lowest (then leftmost) position on the skyline where a width x height rectangle fits,
+** and raise the skyline over it; returns false if there's no room for it
+*/
+static bool placeOnPage(atlasPage_t *page, DWORD width, DWORD height, DWORD *x, DWORD *y){
+    DWORD bestNode = page->numNodes, bestY = 0, nodeY, i;
+
+    for(i = 0; i < page->numNodes; ++i)
+        if(fitSkyline(page, i, width, height, &nodeY) && (bestNode == page->numNodes || nodeY < bestY)){
+            bestNode = i;
+            bestY = nodeY;
+        }
+
+    if(bestNode == page->numNodes)
+        return false;
+
+    *x = page->skyline[bestNode].x;
+    *y = bestY;
+    addSkylineLevel(page, bestNode, *x, bestY + height, width);
+
+    return true;
+}
+
+/* fitSkyline(): whether a width x height rectangle fits with its left side at the node's start,
+** storing in *y the height it would sit at (the highest of the nodes under it)
+*/
+static bool fitSkyline(const atlasPage_t *page, DWORD node, DWORD width, DWORD height, DWORD *y){
+    DWORD widthLeft = width;
+
+    if(page->skyline[node].x + width > page->width)
+        return false;
+
+    // the nodes span the whole page, so the loop stops before running out of them
+    *y = 0;
+    while(widthLeft > 0){
+        if(page->skyline[node].y > *y)
+            *y = page->skyline[node].y;
+
+        if(*y + height > page->height)
+            return false;
+
+        if(page->skyline[node].width >= widthLeft)
+            break;
+
+        widthLeft -= page->skyline[node].width;
+        ++node;
+    }
+
+    return true;
+}
+
+// addSkylineLevel(): insert a segment before the node, cutting off the ones it covers and merging those at the same height
+static void addSkylineLevel(atlasPage_t *page, DWORD node, DWORD x, DWORD y, DWORD width){
+    skylineNode_t *skyline = page->skyline;
+    DWORD prevEnd, overlap, i;
+
+    memmove(&skyline[node + 1], &skyline[node], (page->numNodes - node) * sizeof(*skyline));
+    skyline[node].x = x;
+    skyline[node].y = y;
+    skyline[node].width = width;
+    ++page->numNodes;
+
+    for(i = node + 1; i < page->numNodes; ){
+        prevEnd = skyline[i - 1].x + skyline[i - 1].width;
+
+        if(skyline[i].x >= prevEnd)
+            break;
+
+        overlap = prevEnd - skyline[i].x;
+
+        if(skyline[i].width > overlap){
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
+        }
+
+        removeSkylineNode(page, i);
+    }
+
+    for(i = 0; i + 1 < page->numNodes; ){
+        if(skyline[i].y == skyline[i + 1].y){
+            skyline[i].width += skyline[i + 1].width;
+            removeSkylineNode(page, i + 1);
+        }
+        else
+            ++i;
+    }
+}
+
+static void removeSkylineNode(atlasPage_t *page, DWORD node){
+    memmove(&page->skyline[node], &page->skyline[node + 1], (page->numNodes - node - 1) * sizeof(*page->skyline));
+    --page->numNodes;
+}
+
+// savePage(): write a page as <prefix>_<page>.tga, 32 bit top-left, with its images converted to tga's pixel format
+static bool savePage(const atlas_t *atlas, DWORD page, const char *prefix){
+    const atlasPage_t *atlasPage = &atlas->pages[page];
+    DWORD width = atlasPage->usedWidth;
+    DWORD height = atlasPage->usedHeight;
+    const atlasImage_t *image;
+    char path[FILENAME_MAX];
+    BYTE *pixels;
+    DWORD i, row;
+
+    tgaCtx_t tgaCtx;
+    tgaInitStruct_t tgaInitStruct;
+    outFile_t outFile;
+
+    snprintf(path, sizeof(path), "%s_%u.tga", prefix, page);
+
+    if(width > 0xFFFF || height > 0xFFFF){
+        fprintf(stderr, "%s is too big for a tga file (%ux%u)\n", path, width, height);
+        return false;
+    }
+
+    // the padding is left transparent
+    if((pixels = calloc((size_t)width * height, sizeof(tgaPixel32_t))) == NULL){
+        fprintf(stderr, "Couldn't allocate %ux%u pixels for %s\n", width, height, path);
+        return false;
+    }
+
+    for(i = 0; i < atlas->numImages; ++i){
+        image = &atlas->images[i];
+
+        if(image->page != page)
+            continue;
+
+        for(row = 0; row < image->height; ++row)
+            pixconv_convert(PIXCONV_32_TO_32, image->pixels + row * image->width * sizeof(sshPixel32_t),
+                            pixels + ((size_t)(image->y + row) * width + image->x) * sizeof(tgaPixel32_t), image->width);
+    }
+
+    tgaInitStruct.isCMapped = NO_PALETTE;
+    tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
+    tgaInitStruct.CMapLen = 0;
+    tgaInitStruct.CMapDepth = 0;
+    tgaInitStruct.width = width;
+    tgaInitStruct.height = height;
+    tgaInitStruct.PixelDepth = 32;
+    tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | TOP_LEFT;
+
+    if(!outFile_open(&outFile, path)){
+        fprintf(stderr, "Couldn't create %s: %s\n", path, strerror(errno));
+        free(pixels);
+        return false;
+    }
+
+    tga_initHdr(&tgaCtx, &tgaInitStruct);
+    tga_writeHdr(&tgaCtx, &outFile);
+    outFile_queue(&outFile, pixels, (size_t)width * height * sizeof(tgaPixel32_t));
+
+    if(!outFile_close(&outFile)){
+        fprintf(stderr, "Couldn't write %s: %s\n", path, strerror(errno));
+        free(pixels);
+        return false;
+    }
+
+    free(pixels);
+    return true;
+}
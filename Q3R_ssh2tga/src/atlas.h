@@ -0,0 +1,67 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Texture atlas: many decoded images packed into a few big pages, saved as 32 bit tga files
+** (<prefix>_<page>.tga) along with a text table telling where each image went (<prefix>.txt).
+**
+** The images are placed from the tallest to the shortest with a bottom-left skyline packer,
+** with padding pixels (left transparent) between them and the page's top and left edges.
+** Images too big for a page get a page as big as needed, which the others can use too;
+** each page is trimmed to the area actually used when saved.
+*/
+typedef struct atlasImage_s{
+    char *          name;       // listed in the table as it is; a copy owned by the atlas
+    DWORD           width;
+    DWORD           height;
+    BYTE *          pixels;     // RGBA (ssh's channel order), top-bottom; owned by the atlas
+
+    // set by atlas_pack()
+    DWORD           page;
+    DWORD           x;
+    DWORD           y;
+}atlasImage_t;
+
+typedef struct skylineNode_s{
+    DWORD x;
+    DWORD y;
+    DWORD width;
+}skylineNode_t;
+
+typedef struct atlasPage_s{
+    DWORD           width;
+    DWORD           height;
+    DWORD           usedWidth;
+    DWORD           usedHeight;
+
+    // the top of the area filled so far, as a list of horizontal segments from left to right
+    skylineNode_t * skyline;
+    DWORD           numNodes;
+}atlasPage_t;
+
+typedef struct atlas_s{
+    atlasImage_t *  images;
+    DWORD           numImages;
+    DWORD           maxImages;
+
+    atlasPage_t *   pages;
+    DWORD           numPages;
+}atlas_t;
+
+void atlas_init(atlas_t *atlas);
+
+// atlas_add(): add an image, copying its name and taking ownership of its pixels (which are freed if it can't be added)
+bool atlas_add(atlas_t *atlas, const char *name, DWORD width, DWORD height, BYTE *pixels);
+
+// atlas_pack(): place the images on pageSize x pageSize pages, padding (at least 1) pixels apart
+bool atlas_pack(atlas_t *atlas, DWORD pageSize, DWORD padding);
+
+// atlas_save(): write the pages and the table; errors are printed to stderr
+bool atlas_save(const atlas_t *atlas, const char *prefix);
+
+void atlas_free(atlas_t *atlas);
+
+#endif /* ATLAS_H */
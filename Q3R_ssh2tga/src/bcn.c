@@ -0,0 +1,625 @@
+#include <float.h>
+#include <string.h>
+
+#include "bcn.h"
+
+/* as in pixconv.c, the SIMD kernels need GCC/Clang's target attributes and cpu detection builtins;
+** anything else gets the plain C versions
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && \
+    (defined(__i386__) || defined(__x86_64__))
+    #define BCN_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+#define BLOCK_PIXELS    16
+
+// the endpoints' RGB565 grid: levels per channel, and the scales to and from them
+#define GRID_SCALE_5    (31.0f / 255.0f)
+#define GRID_SCALE_6    (63.0f / 255.0f)
+#define GRID_INV_SCALE_5    (255.0f / 31.0f)
+#define GRID_INV_SCALE_6    (255.0f / 63.0f)
+
+/* fitColorIndices: pick the nearest of the 4 palette colors (RGBA, alpha ignored) for each of the block's pixels,
+** returning their 2 bit indices packed as in the color block and storing the sum of the squared errors in *error
+*/
+typedef DWORD (*fitColorIndicesFunc_t)(const BYTE block[BLOCK_PIXELS * 4], const BYTE palette[4][4], DWORD *error);
+
+/* clusterFit: find the endpoints (on the RGB565 grid, as 0-255 values) best fitting the block's pixels,
+** given as RGB0 floats ordered along their principal axis
+*/
+typedef void (*clusterFitFunc_t)(const float points[BLOCK_PIXELS][4], float start[4], float end[4]);
+
+typedef struct bcKernels_s{
+    fitColorIndicesFunc_t   fitColorIndices;
+    clusterFitFunc_t        clusterFit;
+}bcKernels_t;
+
+
+// local functions declarations
+static void getKernels(bcKernels_t *kernels);
+static void loadBlock(const BYTE *rgba, DWORD width, DWORD height, DWORD x, DWORD y, BYTE block[BLOCK_PIXELS * 4]);
+
+static void encodeColorBlock(const bcKernels_t *kernels, bcQuality_t quality, const BYTE block[BLOCK_PIXELS * 4], BYTE *dst);
+static void principalAxis(const float points[BLOCK_PIXELS][4], float axis[3]);
+static WORD toRgb565(const float color[4]);
+static void decodeColorPalette(WORD color0, WORD color1, BYTE palette[4][4]);
+static float snapToGrid(float value, float scale, float invScale);
+
+static void encodeAlphaBlock(bcQuality_t quality, const BYTE block[BLOCK_PIXELS * 4], BYTE *dst);
+static DWORD fitAlphaIndices(const BYTE block[BLOCK_PIXELS * 4], BYTE alpha0, BYTE alpha1, unsigned long long *indices);
+
+static DWORD fitColorIndices_C(const BYTE block[BLOCK_PIXELS * 4], const BYTE palette[4][4], DWORD *error);
+static void clusterFit_C(const float points[BLOCK_PIXELS][4], float start[4], float end[4]);
+
+#ifdef BCN_X86_SIMD
+static DWORD fitColorIndices_SSE2(const BYTE block[BLOCK_PIXELS * 4], const BYTE palette[4][4], DWORD *error);
+static void clusterFit_SSE2(const float points[BLOCK_PIXELS][4], float start[4], float end[4]);
+#endif
+
+
+// functions definitions
+DWORD bc_blockSize(bcFormat_t format){
+    return format == BC_FORMAT_BC1 ? 8 : 16;
+}
+
+void bc_compress(bcFormat_t format, bcQuality_t quality, const BYTE *rgba, DWORD width, DWORD height, BYTE *dst){
+    BYTE block[BLOCK_PIXELS * 4];
+    bcKernels_t kernels;
+    DWORD x, y;
+
+    getKernels(&kernels);
+
+    for(y = 0; y < height; y += 4)
+        for(x = 0; x < width; x += 4){
+            loadBlock(rgba, width, height, x, y, block);
+
+            if(format == BC_FORMAT_BC3){
+                encodeAlphaBlock(quality, block, dst);
+                dst += 8;
+            }
+
+            encodeColorBlock(&kernels, quality, block, dst);
+            dst += 8;
+        }
+}
+
+
+// local functions definitions
+
+static void getKernels(bcKernels_t *kernels){
+    kernels->fitColorIndices = fitColorIndices_C;
+    kernels->clusterFit = clusterFit_C;
+
+#ifdef BCN_X86_SIMD
+    if(__builtin_cpu_supports("sse2")){
+        kernels->fitColorIndices = fitColorIndices_SSE2;
+        kernels->clusterFit = clusterFit_SSE2;
+    }
+#endif
+}
+
+// loadBlock(): copy the 4x4 block at x, y, repeating the last column and row past the image's edges
+static void loadBlock(const BYTE *rgba, DWORD width, DWORD height, DWORD x, DWORD y, BYTE block[BLOCK_PIXELS * 4]){
+    DWORD row, col, srcX, srcY;
+
+    for(row = 0; row < 4; ++row){
+        srcY = y + row < height ? y + row : height - 1;
+
+        for(col = 0; col < 4; ++col){
+            srcX = x + col < width ? x + col : width - 1;
+            memcpy(block + (row * 4 + col) * 4, rgba + (srcY * width + srcX) * 4, 4);
+        }
+    }
+}
+
+/* encodeColorBlock(): range fit the block's endpoints, and cluster fit them too if asked to,
+** keeping whichever gives the smaller error
+*/
+static void encodeColorBlock(const bcKernels_t *kernels, bcQuality_t quality, const BYTE block[BLOCK_PIXELS * 4], BYTE *dst){
+    float points[BLOCK_PIXELS][4];
+    float sorted[BLOCK_PIXELS][4];
+    float projections[BLOCK_PIXELS];
+    float axis[3], start[4], end[4], projection;
+    BYTE palette[4][4];
+    BYTE order[BLOCK_PIXELS];
+    DWORD indices, clusterIndices, error, clusterError;
+    DWORD minIdx = 0, maxIdx = 0, i, j;
+    WORD color0, color1, clusterColor0, clusterColor1, tmp;
+
+    for(i = 0; i < BLOCK_PIXELS; ++i){
+        points[i][0] = block[i * 4];
+        points[i][1] = block[i * 4 + 1];
+        points[i][2] = block[i * 4 + 2];
+        points[i][3] = 0.0f;
+    }
+
+    principalAxis(points, axis);
+
+    for(i = 0; i < BLOCK_PIXELS; ++i){
+        projections[i] = points[i][0] * axis[0] + points[i][1] * axis[1] + points[i][2] * axis[2];
+
+        if(projections[i] < projections[minIdx])
+            minIdx = i;
+        if(projections[i] > projections[maxIdx])
+            maxIdx = i;
+    }
+
+    // range fit: the pixels at either end of the axis
+    color0 = toRgb565(points[maxIdx]);
+    color1 = toRgb565(points[minIdx]);
+    decodeColorPalette(color0, color1, palette);
+    indices = kernels->fitColorIndices(block, palette, &error);
+
+    if(quality == BC_QUALITY_CLUSTER_FIT && error > 0){
+        // sort the pixels along the axis (insertion sort, which is as good as any for 16 items)
+        for(i = 0; i < BLOCK_PIXELS; ++i){
+            projection = projections[i];
+
+            for(j = i; j > 0 && projections[order[j - 1]] > projection; --j)
+                order[j] = order[j - 1];
+            order[j] = i;
+        }
+
+        for(i = 0; i < BLOCK_PIXELS; ++i)
+            memcpy(sorted[i], points[order[i]], sizeof(sorted[i]));
+
+        kernels->clusterFit(sorted, start, end);
+
+        clusterColor0 = toRgb565(start);
+        clusterColor1 = toRgb565(end);
+        decodeColorPalette(clusterColor0, clusterColor1, palette);
+        clusterIndices = kernels->fitColorIndices(block, palette, &clusterError);
+
+        if(clusterError < error){
+            color0 = clusterColor0;
+            color1 = clusterColor1;
+            indices = clusterIndices;
+        }
+    }
+
+    /* color0 <= color1 would mean BC1's 3 colors + transparent mode, so the endpoints are swapped
+    ** (which swaps the palette's entries 0 and 1, and 2 and 3); if they're the same, only the first entry is used
+    */
+    if(color0 < color1){
+        tmp = color0;
+        color0 = color1;
+        color1 = tmp;
+        indices ^= 0x55555555;
+    }
+    else if(color0 == color1)
+        indices = 0;
+
+    dst[0] = color0 & 0xFF;
+    dst[1] = color0 >> 8;
+    dst[2] = color1 & 0xFF;
+    dst[3] = color1 >> 8;
+    dst[4] = indices & 0xFF;
+    dst[5] = (indices >> 8) & 0xFF;
+    dst[6] = (indices >> 16) & 0xFF;
+    dst[7] = indices >> 24;
+}
+
+/* principalAxis(): the direction along which the points vary the most, i.e. the covariance matrix's main eigenvector,
+** found with a few power iterations; it isn't normalized, and it's 0 if all the points are the same
+*/
+static void principalAxis(const float points[BLOCK_PIXELS][4], float axis[3]){
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    float cov[3][3] = {{0.0f}};
+    float d[3], v[3], maxComponent;
+    int i, j, k, iter;
+
+    for(i = 0; i < BLOCK_PIXELS; ++i)
+        for(j = 0; j < 3; ++j)
+            mean[j] += points[i][j];
+
+    for(j = 0; j < 3; ++j)
+        mean[j] /= BLOCK_PIXELS;
+
+    for(i = 0; i < BLOCK_PIXELS; ++i){
+        for(j = 0; j < 3; ++j)
+            d[j] = points[i][j] - mean[j];
+
+        for(j = 0; j < 3; ++j)
+            for(k = 0; k < 3; ++k)
+                cov[j][k] += d[j] * d[k];
+    }
+
+    /* start from the row with the biggest variance: unlike a fixed vector such as (1, 1, 1), it's never
+    ** orthogonal to the main eigenvector when there's a single one (e.g. a red-green ramp)
+    */
+    k = cov[1][1] > cov[0][0] ? 1 : 0;
+    k = cov[2][2] > cov[k][k] ? 2 : k;
+    memcpy(axis, cov[k], sizeof(cov[k]));
+
+    for(iter = 0; iter < 8; ++iter){
+        maxComponent = 0.0f;
+
+        for(j = 0; j < 3; ++j){
+            v[j] = cov[j][0] * axis[0] + cov[j][1] * axis[1] + cov[j][2] * axis[2];
+
+            if(v[j] > maxComponent)
+                maxComponent = v[j];
+            else if(-v[j] > maxComponent)
+                maxComponent = -v[j];
+        }
+
+        if(maxComponent == 0.0f)
+            break;
+
+        for(j = 0; j < 3; ++j)
+            axis[j] = v[j] / maxComponent;
+    }
+}
+
+// toRgb565(): the nearest RGB565 color to a 0-255 one
+static WORD toRgb565(const float color[4]){
+    float r = color[0] < 0.0f ? 0.0f : color[0] > 255.0f ? 255.0f : color[0];
+    float g = color[1] < 0.0f ? 0.0f : color[1] > 255.0f ? 255.0f : color[1];
+    float b = color[2] < 0.0f ? 0.0f : color[2] > 255.0f ? 255.0f : color[2];
+
+    return ((int)(r * GRID_SCALE_5 + 0.5f) << 11) | ((int)(g * GRID_SCALE_6 + 0.5f) << 5) | (int)(b * GRID_SCALE_5 + 0.5f);
+}
+
+// decodeColorPalette(): the 4 colors of a color block with the given endpoints, as the decoder sees them (alpha set to 0)
+static void decodeColorPalette(WORD color0, WORD color1, BYTE palette[4][4]){
+    int i;
+
+    palette[0][0] = ((color0 >> 11) << 3) | (color0 >> 13);
+    palette[0][1] = (((color0 >> 5) & 0x3F) << 2) | ((color0 >> 9) & 0x3);
+    palette[0][2] = ((color0 & 0x1F) << 3) | ((color0 >> 2) & 0x7);
+
+    palette[1][0] = ((color1 >> 11) << 3) | (color1 >> 13);
+    palette[1][1] = (((color1 >> 5) & 0x3F) << 2) | ((color1 >> 9) & 0x3);
+    palette[1][2] = ((color1 & 0x1F) << 3) | ((color1 >> 2) & 0x7);
+
+    for(i = 0; i < 3; ++i){
+        palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+        palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+    }
+
+    for(i = 0; i < 4; ++i)
+        palette[i][3] = 0;
+}
+
+/* snapToGrid(): the nearest 0-255 value a 5 or 6 bit endpoint channel can take
+** (the decoders' bit replication gives the same values as rounding)
+*/
+static float snapToGrid(float value, float scale, float invScale){
+    value = value < 0.0f ? 0.0f : value > 255.0f ? 255.0f : value;
+
+    return (float)(int)((float)(int)(value * scale + 0.5f) * invScale + 0.5f);
+}
+
+/* encodeAlphaBlock(): the alpha block's endpoints are the block's extremes (8 interpolated values);
+** cluster fit tries the extremes besides 0 and 255 too, which the 6 values mode has on their own
+*/
+static void encodeAlphaBlock(bcQuality_t quality, const BYTE block[BLOCK_PIXELS * 4], BYTE *dst){
+    BYTE minAlpha = 255, maxAlpha = 0, minInner = 255, maxInner = 0, alpha, alpha0, alpha1;
+    unsigned long long indices, innerIndices;
+    DWORD error, innerError, i;
+
+    for(i = 0; i < BLOCK_PIXELS; ++i){
+        alpha = block[i * 4 + 3];
+
+        minAlpha = alpha < minAlpha ? alpha : minAlpha;
+        maxAlpha = alpha > maxAlpha ? alpha : maxAlpha;
+
+        if(alpha != 0 && alpha != 255){
+            minInner = alpha < minInner ? alpha : minInner;
+            maxInner = alpha > maxInner ? alpha : maxInner;
+        }
+    }
+
+    alpha0 = maxAlpha;
+    alpha1 = minAlpha;
+    error = fitAlphaIndices(block, alpha0, alpha1, &indices);
+
+    if(quality == BC_QUALITY_CLUSTER_FIT && error > 0 && (minAlpha == 0 || maxAlpha == 255)){
+        // alpha0 <= alpha1 selects the 6 values mode
+        if(minInner > maxInner)
+            minInner = maxInner = 0;
+
+        innerError = fitAlphaIndices(block, minInner, maxInner, &innerIndices);
+
+        if(innerError < error){
+            alpha0 = minInner;
+            alpha1 = maxInner;
+            indices = innerIndices;
+        }
+    }
+
+    dst[0] = alpha0;
+    dst[1] = alpha1;
+
+    for(i = 0; i < 6; ++i)
+        dst[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+/* fitAlphaIndices(): pick the nearest of the alpha block's 8 values for each pixel, storing their 3 bit indices
+** in *indices (48 bits); returns the sum of the squared errors
+*/
+static DWORD fitAlphaIndices(const BYTE block[BLOCK_PIXELS * 4], BYTE alpha0, BYTE alpha1, unsigned long long *indices){
+    int values[8];
+    int diff, bestDiff;
+    DWORD error = 0, best, i, j;
+
+    values[0] = alpha0;
+    values[1] = alpha1;
+
+    if(alpha0 > alpha1)
+        for(i = 1; i < 7; ++i)
+            values[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+    else{
+        for(i = 1; i < 5; ++i)
+            values[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+
+        values[6] = 0;
+        values[7] = 255;
+    }
+
+    *indices = 0;
+
+    for(i = 0; i < BLOCK_PIXELS; ++i){
+        best = 0;
+        bestDiff = 256 * 256;
+
+        for(j = 0; j < 8; ++j){
+            diff = block[i * 4 + 3] - values[j];
+            diff *= diff;
+
+            if(diff < bestDiff){
+                bestDiff = diff;
+                best = j;
+            }
+        }
+
+        *indices |= (unsigned long long)best << (i * 3);
+        error += bestDiff;
+    }
+
+    return error;
+}
+
+
+static DWORD fitColorIndices_C(const BYTE block[BLOCK_PIXELS * 4], const BYTE palette[4][4], DWORD *error){
+    DWORD indices = 0, dist, bestDist, best, i, c;
+    int dr, dg, db;
+
+    *error = 0;
+
+    for(i = 0; i < BLOCK_PIXELS; ++i){
+        best = 0;
+        bestDist = 0xFFFFFFFF;
+
+        for(c = 0; c < 4; ++c){
+            dr = block[i * 4] - palette[c][0];
+            dg = block[i * 4 + 1] - palette[c][1];
+            db = block[i * 4 + 2] - palette[c][2];
+            dist = dr * dr + dg * dg + db * db;
+
+            if(dist < bestDist){
+                bestDist = dist;
+                best = c;
+            }
+        }
+
+        indices |= best << (i * 2);
+        *error += bestDist;
+    }
+
+    return indices;
+}
+
+/* clusterFit_C(): try every split of the ordered points into 4 consecutive clusters (some of them possibly empty),
+** one for each of the palette's colors, solving each split's endpoints by least squares.
+** With the points in cluster 0, 1, 2 and 3 weighted by (alpha, beta) = (1, 0), (2/3, 1/3), (1/3, 2/3) and (0, 1),
+** the endpoints a and b minimizing sum((alpha * a + beta * b - x)^2) are the solution of
+**      a * sum(alpha^2)     + b * sum(alpha * beta) = sum(alpha * x)
+**      a * sum(alpha * beta) + b * sum(beta^2)       = sum(beta * x)
+** which are then snapped to the RGB565 grid before measuring the error
+** (leaving out sum(x^2), which is the same for every split).
+*/
+static void clusterFit_C(const float points[BLOCK_PIXELS][4], float start[4], float end[4]){
+    float sums[BLOCK_PIXELS + 1][3];
+    float count1, count2, alpha2, beta2, alphaBeta, det, factor;
+    float x0, x1, x2, x3, alphaX, betaX, a[3], b[3], error, bestError = FLT_MAX;
+    const float scale[3] = {GRID_SCALE_5, GRID_SCALE_6, GRID_SCALE_5};
+    const float invScale[3] = {GRID_INV_SCALE_5, GRID_INV_SCALE_6, GRID_INV_SCALE_5};
+    int i, j, k, c;
+
+    // sums[i]: sum of the first i points
+    memset(sums[0], 0, sizeof(sums[0]));
+    for(i = 0; i < BLOCK_PIXELS; ++i)
+        for(c = 0; c < 3; ++c)
+            sums[i + 1][c] = sums[i][c] + points[i][c];
+
+    memset(start, 0, 4 * sizeof(float));
+    memset(end, 0, 4 * sizeof(float));
+
+    // the points [0, i) go in cluster 0, [i, j) in cluster 1, [j, k) in cluster 2 and [k, 16) in cluster 3
+    for(i = 0; i <= BLOCK_PIXELS; ++i)
+        for(j = i; j <= BLOCK_PIXELS; ++j)
+            for(k = j; k <= BLOCK_PIXELS; ++k){
+                count1 = (float)(j - i);
+                count2 = (float)(k - j);
+                alpha2 = (float)i + count1 * (4.0f / 9.0f) + count2 * (1.0f / 9.0f);
+                beta2 = (float)(BLOCK_PIXELS - k) + count2 * (4.0f / 9.0f) + count1 * (1.0f / 9.0f);
+                alphaBeta = (count1 + count2) * (2.0f / 9.0f);
+
+                // the endpoints are undetermined when all the points share the same weights
+                det = alpha2 * beta2 - alphaBeta * alphaBeta;
+                if(det < 1e-3f)
+                    continue;
+
+                factor = 1.0f / det;
+                error = 0.0f;
+
+                for(c = 0; c < 3; ++c){
+                    x0 = sums[i][c];
+                    x1 = sums[j][c] - sums[i][c];
+                    x2 = sums[k][c] - sums[j][c];
+                    x3 = sums[BLOCK_PIXELS][c] - sums[k][c];
+
+                    alphaX = x0 + x1 * (2.0f / 3.0f) + x2 * (1.0f / 3.0f);
+                    betaX = x3 + x2 * (2.0f / 3.0f) + x1 * (1.0f / 3.0f);
+
+                    a[c] = snapToGrid((alphaX * beta2 - betaX * alphaBeta) * factor, scale[c], invScale[c]);
+                    b[c] = snapToGrid((betaX * alpha2 - alphaX * alphaBeta) * factor, scale[c], invScale[c]);
+
+                    error += a[c] * a[c] * alpha2 + b[c] * b[c] * beta2 + 2.0f * (a[c] * b[c] * alphaBeta - a[c] * alphaX - b[c] * betaX);
+                }
+
+                if(error < bestError){
+                    bestError = error;
+                    memcpy(start, a, sizeof(a));
+                    memcpy(end, b, sizeof(b));
+                }
+            }
+}
+
+
+#ifdef BCN_X86_SIMD
+
+// colorDist_SSE2(): squared distances between 4 pixels and a color
+__attribute__((target("sse2")))
+static inline __m128i colorDist_SSE2(__m128i pixels, __m128i color){
+    const __m128i zero = _mm_setzero_si128();
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(pixels, color), _mm_subs_epu8(color, pixels));
+    __m128i lo = _mm_unpacklo_epi8(diff, zero);
+    __m128i hi = _mm_unpackhi_epi8(diff, zero);
+
+    // r^2 + g^2 and b^2 + a^2 for each pixel, then added together
+    lo = _mm_madd_epi16(lo, lo);
+    hi = _mm_madd_epi16(hi, hi);
+
+    return _mm_add_epi32(
+        _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0))),
+        _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)))
+    );
+}
+
+// 4 pixels at a time against all of the palette's colors; the ties go to the lowest index, as in the C version
+__attribute__((target("sse2")))
+static DWORD fitColorIndices_SSE2(const BYTE block[BLOCK_PIXELS * 4], const BYTE palette[4][4], DWORD *error){
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i indexShifts = _mm_setr_epi32(1, 4, 16, 64);
+    __m128i colors[4], pixels, dist, best, bestIdx, less, errors = _mm_setzero_si128();
+    DWORD indices = 0, color;
+    int r, c;
+
+    for(c = 0; c < 4; ++c){
+        memcpy(&color, palette[c], sizeof(color));
+        colors[c] = _mm_and_si128(_mm_set1_epi32(color), rgbMask);
+    }
+
+    for(r = 0; r < 4; ++r){
+        pixels = _mm_and_si128(_mm_loadu_si128((const __m128i *)(block + r * 16)), rgbMask);
+
+        best = colorDist_SSE2(pixels, colors[0]);
+        bestIdx = _mm_setzero_si128();
+
+        for(c = 1; c < 4; ++c){
+            dist = colorDist_SSE2(pixels, colors[c]);
+            less = _mm_cmplt_epi32(dist, best);
+
+            best = _mm_or_si128(_mm_and_si128(less, dist), _mm_andnot_si128(less, best));
+            bestIdx = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(c)), _mm_andnot_si128(less, bestIdx));
+        }
+
+        errors = _mm_add_epi32(errors, best);
+
+        // move the 4 indices to bits 0, 2, 4 and 6, then add them up
+        bestIdx = _mm_mullo_epi16(bestIdx, indexShifts);
+        bestIdx = _mm_add_epi32(bestIdx, _mm_srli_si128(bestIdx, 8));
+        bestIdx = _mm_add_epi32(bestIdx, _mm_srli_si128(bestIdx, 4));
+        indices |= (DWORD)_mm_cvtsi128_si32(bestIdx) << (r * 8);
+    }
+
+    errors = _mm_add_epi32(errors, _mm_srli_si128(errors, 8));
+    errors = _mm_add_epi32(errors, _mm_srli_si128(errors, 4));
+    *error = _mm_cvtsi128_si32(errors);
+
+    return indices;
+}
+
+// snapToGrid_SSE2(): as snapToGrid(), for the R, G and B lanes at once
+__attribute__((target("sse2")))
+static inline __m128 snapToGrid_SSE2(__m128 value, __m128 scale, __m128 invScale){
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    value = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), half)));
+
+    return _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, invScale), half)));
+}
+
+// as clusterFit_C(), solving the R, G and B channels' endpoints at once
+__attribute__((target("sse2")))
+static void clusterFit_SSE2(const float points[BLOCK_PIXELS][4], float start[4], float end[4]){
+    const __m128 scale = _mm_setr_ps(GRID_SCALE_5, GRID_SCALE_6, GRID_SCALE_5, 0.0f);
+    const __m128 invScale = _mm_setr_ps(GRID_INV_SCALE_5, GRID_INV_SCALE_6, GRID_INV_SCALE_5, 0.0f);
+    const __m128 twoThirds = _mm_set1_ps(2.0f / 3.0f);
+    const __m128 oneThird = _mm_set1_ps(1.0f / 3.0f);
+    __m128 sums[BLOCK_PIXELS + 1];
+    __m128 x0, x1, x2, x3, alphaX, betaX, a, b, errors, bestA, bestB;
+    __m128 alpha2v, beta2v, alphaBetav, factorv;
+    float count1, count2, alpha2, beta2, alphaBeta, det, error, bestError = FLT_MAX;
+    int i, j, k;
+
+    sums[0] = _mm_setzero_ps();
+    for(i = 0; i < BLOCK_PIXELS; ++i)
+        sums[i + 1] = _mm_add_ps(sums[i], _mm_loadu_ps(points[i]));
+
+    bestA = bestB = _mm_setzero_ps();
+
+    for(i = 0; i <= BLOCK_PIXELS; ++i)
+        for(j = i; j <= BLOCK_PIXELS; ++j)
+            for(k = j; k <= BLOCK_PIXELS; ++k){
+                count1 = (float)(j - i);
+                count2 = (float)(k - j);
+                alpha2 = (float)i + count1 * (4.0f / 9.0f) + count2 * (1.0f / 9.0f);
+                beta2 = (float)(BLOCK_PIXELS - k) + count2 * (4.0f / 9.0f) + count1 * (1.0f / 9.0f);
+                alphaBeta = (count1 + count2) * (2.0f / 9.0f);
+
+                det = alpha2 * beta2 - alphaBeta * alphaBeta;
+                if(det < 1e-3f)
+                    continue;
+
+                alpha2v = _mm_set1_ps(alpha2);
+                beta2v = _mm_set1_ps(beta2);
+                alphaBetav = _mm_set1_ps(alphaBeta);
+                factorv = _mm_set1_ps(1.0f / det);
+
+                x0 = sums[i];
+                x1 = _mm_sub_ps(sums[j], sums[i]);
+                x2 = _mm_sub_ps(sums[k], sums[j]);
+                x3 = _mm_sub_ps(sums[BLOCK_PIXELS], sums[k]);
+
+                alphaX = _mm_add_ps(_mm_add_ps(x0, _mm_mul_ps(x1, twoThirds)), _mm_mul_ps(x2, oneThird));
+                betaX = _mm_add_ps(_mm_add_ps(x3, _mm_mul_ps(x2, twoThirds)), _mm_mul_ps(x1, oneThird));
+
+                a = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(alphaX, beta2v), _mm_mul_ps(betaX, alphaBetav)), factorv);
+                b = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(betaX, alpha2v), _mm_mul_ps(alphaX, alphaBetav)), factorv);
+                a = snapToGrid_SSE2(a, scale, invScale);
+                b = snapToGrid_SSE2(b, scale, invScale);
+
+                // the 4th lane is always 0, as its scale is
+                errors = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_mul_ps(a, a), alpha2v), _mm_mul_ps(_mm_mul_ps(b, b), beta2v)),
+                    _mm_mul_ps(_mm_set1_ps(2.0f), _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(a, b), alphaBetav), _mm_mul_ps(a, alphaX)), _mm_mul_ps(b, betaX)))
+                );
+                error = _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(errors, _mm_shuffle_ps(errors, errors, 1)), _mm_shuffle_ps(errors, errors, 2)));
+
+                if(error < bestError){
+                    bestError = error;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+
+    _mm_storeu_ps(start, bestA);
+    _mm_storeu_ps(end, bestB);
+}
+
+#endif
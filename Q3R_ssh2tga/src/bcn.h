@@ -0,0 +1,39 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include "types.h"
+
+/* BC1/BC3 (DXT1/DXT5) block compression of RGBA8 pixels.
+**
+** Each 4x4 block of pixels becomes a color block (two RGB565 endpoints and a 2 bit index per pixel
+** picking one of the 4 colors interpolated between them), preceded in BC3 by an alpha block
+** (two 8 bit endpoints and a 3 bit index per pixel).
+** The BC1 blocks never use the 3 colors + transparent mode, so BC1 is meant for opaque images only.
+**
+** The endpoints are chosen with either:
+** - range fit: the extremes of the block's pixels along their principal axis; fast;
+** - cluster fit: every way of splitting the pixels, ordered along the principal axis, into 4 clusters
+**   is tried, solving each one's endpoints by least squares and keeping the best; about 30 times slower,
+**   but noticeably better on gradients.
+** The indices are then fitted to the endpoints. The least squares solve and the index fitting use SSE2
+** when available; the output is the same with or without it.
+*/
+typedef enum bcFormat_e{
+    BC_FORMAT_BC1,
+    BC_FORMAT_BC3
+}bcFormat_t;
+
+typedef enum bcQuality_e{
+    BC_QUALITY_RANGE_FIT,
+    BC_QUALITY_CLUSTER_FIT
+}bcQuality_t;
+
+// bc_blockSize(): size in bytes of a compressed 4x4 block
+DWORD bc_blockSize(bcFormat_t format);
+
+/* bc_compress(): compress width x height RGBA pixels into ((width + 3) / 4) x ((height + 3) / 4) blocks in dst,
+** in row order; the blocks past the right and bottom edges are padded by repeating the last column and row
+*/
+void bc_compress(bcFormat_t format, bcQuality_t quality, const BYTE *rgba, DWORD width, DWORD height, BYTE *dst);
+
+#endif /* BCN_H */
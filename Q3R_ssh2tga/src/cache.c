@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "hardlink.h"
+#include "threads.h"
+
+#define CACHE_HEADER        "# Q3R_ssh2tga cache 1: hash index options size name\n"
+#define INITIAL_NUM_SLOTS   1024    // must be a power of 2
+
+// a converted file
+typedef struct cacheEntry_s{
+    QWORD   hash;       // of the ssh file's contents
+    DWORD   resIndex;
+    DWORD   options;
+    QWORD   outSize;    // the file's size once converted
+    DWORD   dir;        // index in dirs[]
+    char *  name;       // the file's name, without its folder
+    DWORD   nameHash;
+    bool    stale;      // replaced by a newer entry for the same file
+}cacheEntry_t;
+
+// a folder the converted files go in
+typedef struct cacheDir_s{
+    char *  path;       // up to the last path separator included, empty for the current folder
+    bool    changed;    // its index needs saving
+}cacheDir_t;
+
+
+// global variables(used only inside this module)
+static cacheEntry_t *   entries;
+static DWORD            numEntries, maxEntries;
+
+static cacheDir_t *     dirs;
+static DWORD            numDirs;
+
+// entries' indexes + 1 (0 if the slot is unused), by file and by contents
+static DWORD *          nameSlots;
+static DWORD *          contentSlots;
+static DWORD            numSlots;
+
+static mutex_t *        cacheMutex;
+
+static DWORD            numUnchanged, numLinked, numConverted;
+
+
+// local functions declarations
+static DWORD findDir(const char *outPath, const char **name);
+static bool loadIndex(DWORD dir);
+static cacheEntry_t *findFile(DWORD dir, const char *name, DWORD nameHash);
+static bool addEntry(DWORD dir, const char *name, QWORD hash, DWORD resIndex, DWORD options, QWORD outSize);
+static bool growSlots(void);
+static void insertSlots(DWORD entry);
+static DWORD hashName(DWORD dir, const char *name);
+static DWORD hashContent(QWORD hash, DWORD resIndex, DWORD options);
+static bool getFileSize(const char *path, QWORD *size);
+static char *dupString(const char *str);
+
+
+bool cache_init(void){
+    entries = NULL;
+    numEntries = maxEntries = 0;
+    dirs = NULL;
+    numDirs = 0;
+    numSlots = INITIAL_NUM_SLOTS;
+    numUnchanged = numLinked = numConverted = 0;
+
+    nameSlots = calloc(numSlots, sizeof(*nameSlots));
+    contentSlots = calloc(numSlots, sizeof(*contentSlots));
+
+    if(nameSlots == NULL || contentSlots == NULL || (cacheMutex = mutex_create()) == NULL){
+        fputs("Couldn't allocate the conversion cache\n", stderr);
+        free(nameSlots);
+        free(contentSlots);
+        return false;
+    }
+
+    return true;
+}
+
+void cache_free(void){
+    DWORD i;
+
+    for(i = 0; i < numEntries; ++i)
+        free(entries[i].name);
+
+    for(i = 0; i < numDirs; ++i)
+        free(dirs[i].path);
+
+    free(entries);
+    free(dirs);
+    free(nameSlots);
+    free(contentSlots);
+    mutex_free(cacheMutex);
+}
+
+/* cache_hash(): processes 8 bytes at a time, finalized with MurmurHash3's fmix64 mixer
+** (the same as the SDT extractor's dedup hash)
+*/
+QWORD cache_hash(const BYTE *data, DWORD size){
+    QWORD h = 0x9E3779B97F4A7C15ULL ^ size;
+    QWORD k;
+    DWORD i;
+
+    for(i = 0; i + 8 <= size; i += 8){
+        memcpy(&k, data + i, sizeof(k));
+        k *= 0x87C37B91114253D5ULL;
+        k = (k << 31) | (k >> 33);
+        h ^= k * 0x4CF5AD432745937FULL;
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+    }
+
+    for(k = 0; i < size; ++i)
+        k = (k << 8) | data[i];
+    h ^= k * 0x87C37B91114253D5ULL;
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+cacheResult_t cache_lookup(const char *outPath, QWORD hash, DWORD resIndex, DWORD options){
+    char linkPath[FILENAME_MAX];
+    cacheResult_t result = CACHE_MISS;
+    cacheEntry_t *entry;
+    const char *name;
+    QWORD outSize;
+    DWORD dir, i;
+
+    mutex_lock(cacheMutex);
+
+    if((dir = findDir(outPath, &name)) == numDirs){
+        mutex_unlock(cacheMutex);
+        return CACHE_MISS;
+    }
+
+    entry = findFile(dir, name, hashName(dir, name));
+
+    if( entry != NULL &&
+        entry->hash == hash &&
+        entry->resIndex == resIndex &&
+        entry->options == options &&
+        getFileSize(outPath, &outSize) && outSize == entry->outSize
+    ){
+        ++numUnchanged;
+        mutex_unlock(cacheMutex);
+        return CACHE_UNCHANGED;
+    }
+
+    // an identical image converted with the same options, whose file is still as it was
+    for(i = hashContent(hash, resIndex, options) & (numSlots - 1); contentSlots[i] != 0; i = (i + 1) & (numSlots - 1)){
+        entry = &entries[contentSlots[i] - 1];
+
+        if(entry->stale || entry->hash != hash || entry->resIndex != resIndex || entry->options != options)
+            continue;
+
+        snprintf(linkPath, sizeof(linkPath), "%s%s", dirs[entry->dir].path, entry->name);
+
+        if(strcmp(linkPath, outPath) == 0 || !getFileSize(linkPath, &outSize) || outSize != entry->outSize)
+            continue;
+
+        if(makeHardLink(linkPath, outPath) && addEntry(dir, name, hash, resIndex, options, outSize)){
+            ++numLinked;
+            result = CACHE_LINKED;
+        }
+        break;
+    }
+
+    mutex_unlock(cacheMutex);
+    return result;
+}
+
+void cache_update(const char *outPath, QWORD hash, DWORD resIndex, DWORD options, bool converted){
+    cacheEntry_t *entry;
+    const char *name;
+    QWORD outSize;
+    DWORD dir;
+
+    mutex_lock(cacheMutex);
+
+    if((dir = findDir(outPath, &name)) < numDirs){
+        if(converted && getFileSize(outPath, &outSize)){
+            if(addEntry(dir, name, hash, resIndex, options, outSize))
+                ++numConverted;
+        }
+        else if((entry = findFile(dir, name, hashName(dir, name))) != NULL){
+            entry->stale = true;
+            dirs[dir].changed = true;
+        }
+    }
+
+    mutex_unlock(cacheMutex);
+}
+
+bool cache_save(void){
+    char path[FILENAME_MAX];
+    const cacheEntry_t *entry;
+    bool success = true;
+    FILE *out_fp;
+    DWORD i, j;
+
+    for(i = 0; i < numDirs; ++i){
+        if(!dirs[i].changed)
+            continue;
+
+        snprintf(path, sizeof(path), "%s%s", dirs[i].path, CACHE_INDEX_NAME);
+
+        if((out_fp = fopen(path, "w")) == NULL){
+            fprintf(stderr, "Couldn't create file %s: %s\n", path, strerror(errno));
+            success = false;
+            continue;
+        }
+
+        fputs(CACHE_HEADER, out_fp);
+
+        // the name goes last, since it may contain spaces
+        for(j = 0; j < numEntries; ++j){
+            entry = &entries[j];
+
+            if(entry->dir == i && !entry->stale)
+                fprintf(out_fp, "%016llX %u %08X %llu %s\n", entry->hash, entry->resIndex, entry->options, entry->outSize, entry->name);
+        }
+
+        if(ferror(out_fp) | fclose(out_fp)){
+            fprintf(stderr, "Couldn't write %s\n", path);
+            success = false;
+        }
+    }
+
+    printf("Cache: %u images unchanged, %u linked to identical ones, %u converted\n", numUnchanged, numLinked, numConverted);
+    return success;
+}
+
+
+// local functions definitions
+
+/* findDir(): the index in dirs[] of outPath's folder, loading its index the first time (numDirs on failure);
+** *name is set to the file's name within it
+*/
+static DWORD findDir(const char *outPath, const char **name){
+    cacheDir_t *newDirs;
+    size_t dirLen;
+    DWORD i;
+
+    for(*name = outPath + strlen(outPath); *name != outPath && (*name)[-1] != '/' && (*name)[-1] != '\\'; --*name)
+        ;
+    dirLen = *name - outPath;
+
+    for(i = 0; i < numDirs; ++i)
+        if(strlen(dirs[i].path) == dirLen && strncmp(dirs[i].path, outPath, dirLen) == 0)
+            return i;
+
+    if((newDirs = realloc(dirs, (numDirs + 1) * sizeof(*dirs))) == NULL)
+        return numDirs;
+    dirs = newDirs;
+
+    if((dirs[numDirs].path = malloc(dirLen + 1)) == NULL)
+        return numDirs;
+
+    memcpy(dirs[numDirs].path, outPath, dirLen);
+    dirs[numDirs].path[dirLen] = '\0';
+    dirs[numDirs].changed = false;
+    ++numDirs;
+
+    // a missing or unreadable index only means that its files get converted again
+    loadIndex(numDirs - 1);
+    return numDirs - 1;
+}
+
+// loadIndex(): add the entries listed in a folder's index file, if it has one made by this version
+static bool loadIndex(DWORD dir){
+    char line[FILENAME_MAX + 64];
+    char path[FILENAME_MAX];
+    FILE *in_fp;
+    QWORD hash, outSize;
+    DWORD resIndex, options;
+    int nameOffset;
+    size_t len;
+
+    snprintf(path, sizeof(path), "%s%s", dirs[dir].path, CACHE_INDEX_NAME);
+
+    if((in_fp = fopen(path, "r")) == NULL)
+        return false;
+
+    if(fgets(line, sizeof(line), in_fp) == NULL || strcmp(line, CACHE_HEADER) != 0){
+        fclose(in_fp);
+        return false;
+    }
+
+    while(fgets(line, sizeof(line), in_fp) != NULL){
+        len = strlen(line);
+        if(len > 0 && line[len - 1] == '\n')
+            line[--len] = '\0';
+
+        nameOffset = 0;
+        if(sscanf(line, "%llx %u %x %llu %n", &hash, &resIndex, &options, &outSize, &nameOffset) != 4 || nameOffset == 0 || line[nameOffset] == '\0')
+            continue;
+
+        if(!addEntry(dir, line + nameOffset, hash, resIndex, options, outSize))
+            break;
+    }
+
+    // loading it doesn't change it
+    dirs[dir].changed = false;
+
+    fclose(in_fp);
+    return true;
+}
+
+// findFile(): the entry of a file in a folder, or NULL if it isn't in the cache
+static cacheEntry_t *findFile(DWORD dir, const char *name, DWORD nameHash){
+    cacheEntry_t *entry;
+    DWORD i;
+
+    for(i = nameHash & (numSlots - 1); nameSlots[i] != 0; i = (i + 1) & (numSlots - 1)){
+        entry = &entries[nameSlots[i] - 1];
+
+        // a forgotten file's slot is kept by its stale entry until a new one takes it over
+        if(entry->nameHash == nameHash && entry->dir == dir && strcmp(entry->name, name) == 0)
+            return entry->stale ? NULL : entry;
+    }
+
+    return NULL;
+}
+
+// addEntry(): add a file's entry, which replaces the one it had (if any)
+static bool addEntry(DWORD dir, const char *name, QWORD hash, DWORD resIndex, DWORD options, QWORD outSize){
+    cacheEntry_t *newEntries, *entry, *oldEntry;
+    DWORD nameHash = hashName(dir, name);
+    DWORD newMax;
+
+    if(numEntries == maxEntries){
+        newMax = maxEntries ? maxEntries * 2 : 256;
+
+        if((newEntries = realloc(entries, newMax * sizeof(*entries))) == NULL)
+            return false;
+
+        entries = newEntries;
+        maxEntries = newMax;
+    }
+
+    // keep the load factor below 50%
+    if((numEntries + 1) * 2 > numSlots && !growSlots())
+        return false;
+
+    entry = &entries[numEntries];
+
+    if((entry->name = dupString(name)) == NULL)
+        return false;
+
+    if((oldEntry = findFile(dir, name, nameHash)) != NULL)
+        oldEntry->stale = true;
+
+    entry->hash = hash;
+    entry->resIndex = resIndex;
+    entry->options = options;
+    entry->outSize = outSize;
+    entry->dir = dir;
+    entry->nameHash = nameHash;
+    entry->stale = false;
+
+    insertSlots(numEntries++);
+    dirs[dir].changed = true;
+    return true;
+}
+
+static bool growSlots(void){
+    DWORD *newNameSlots, *newContentSlots;
+    DWORD i;
+
+    newNameSlots = calloc(numSlots * 2, sizeof(*newNameSlots));
+    newContentSlots = calloc(numSlots * 2, sizeof(*newContentSlots));
+
+    if(newNameSlots == NULL || newContentSlots == NULL){
+        free(newNameSlots);
+        free(newContentSlots);
+        return false;
+    }
+
+    free(nameSlots);
+    free(contentSlots);
+    nameSlots = newNameSlots;
+    contentSlots = newContentSlots;
+    numSlots *= 2;
+
+    for(i = 0; i < numEntries; ++i)
+        insertSlots(i);
+
+    return true;
+}
+
+/* insertSlots(): index an entry by file and by contents; a stale entry stays in the table by contents
+** (the lookups skip it), but its file's slot is taken over by the entry replacing it
+*/
+static void insertSlots(DWORD entry){
+    const cacheEntry_t *newEntry = &entries[entry];
+    const cacheEntry_t *oldEntry;
+    DWORD mask = numSlots - 1;
+    DWORD i;
+
+    for(i = newEntry->nameHash & mask; nameSlots[i] != 0; i = (i + 1) & mask){
+        oldEntry = &entries[nameSlots[i] - 1];
+
+        if(oldEntry->nameHash == newEntry->nameHash && oldEntry->dir == newEntry->dir && strcmp(oldEntry->name, newEntry->name) == 0)
+            break;
+    }
+    nameSlots[i] = entry + 1;
+
+    for(i = hashContent(newEntry->hash, newEntry->resIndex, newEntry->options) & mask; contentSlots[i] != 0; i = (i + 1) & mask)
+        ;
+    contentSlots[i] = entry + 1;
+}
+
+// hashName(): 32-bit FNV-1a hash of a file's folder index and name
+static DWORD hashName(DWORD dir, const char *name){
+    DWORD hash = 0x811C9DC5 ^ dir;
+
+    while(*name != '\0'){
+        hash ^= (BYTE)*name++;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+static DWORD hashContent(QWORD hash, DWORD resIndex, DWORD options){
+    hash ^= (QWORD)resIndex << 32 | options;
+    hash *= 0x9E3779B97F4A7C15ULL;
+    return (DWORD)(hash >> 32);
+}
+
+static bool getFileSize(const char *path, QWORD *size){
+    struct stat fileStat;
+
+    if(stat(path, &fileStat) != 0)
+        return false;
+
+    *size = fileStat.st_size;
+    return true;
+}
+
+static char *dupString(const char *str){
+    char *copy = malloc(strlen(str) + 1);
+
+    if(copy != NULL)
+        strcpy(copy, str);
+
+    return copy;
+}
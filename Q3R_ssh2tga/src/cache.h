@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Conversion cache, for skipping the images which haven't changed since a previous run converted them.
+**
+** Each folder the converted files go in gets an index (CACHE_INDEX_NAME) listing them, each with a hash of the
+** ssh file's contents it was converted from, the image's index in that file and the options the output depends on.
+** An image whose hash, index and options match its output file's entry isn't converted again, as long as the file
+** is still there with the size it had; an image identical to another one in the cache (even under another name)
+** gets its output file hard linked to the other one's instead.
+**
+** The indexes are loaded the first time their folder is looked up, and written back by cache_save() if anything
+** changed. All of the functions but cache_init() and cache_free() can be called from any thread.
+*/
+#define CACHE_INDEX_NAME    "Q3R_ssh2tga_cache.txt"
+
+typedef enum cacheResult_e{
+    CACHE_MISS,         // the image must be converted, then passed to cache_update()
+    CACHE_UNCHANGED,    // the output file is already there
+    CACHE_LINKED        // the output file has been hard linked to an identical image's one
+}cacheResult_t;
+
+bool cache_init(void);
+void cache_free(void);
+
+// cache_hash(): 64-bit hash of a ssh file's contents
+QWORD cache_hash(const BYTE *data, DWORD size);
+
+// cache_lookup(): whether outPath needs converting from the image
+cacheResult_t cache_lookup(const char *outPath, QWORD hash, DWORD resIndex, DWORD options);
+
+// cache_update(): record outPath as converted from the image, or forget it if the conversion failed
+void cache_update(const char *outPath, QWORD hash, DWORD resIndex, DWORD options, bool converted);
+
+// cache_save(): write the indexes which changed and print how many images were skipped; errors are printed to stderr
+bool cache_save(void);
+
+#endif /* CACHE_H */
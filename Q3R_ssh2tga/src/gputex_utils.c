@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "gputex_utils.h"
+#include "types.h"
+
+// DDS header flags (see DDS_HEADER and DDS_PIXELFORMAT in Microsoft's documentation)
+#define DDSD_CAPS           0x1
+#define DDSD_HEIGHT         0x2
+#define DDSD_WIDTH          0x4
+#define DDSD_PITCH          0x8
+#define DDSD_PIXELFORMAT    0x1000
+#define DDSD_MIPMAPCOUNT    0x20000
+#define DDSD_LINEARSIZE     0x80000
+
+#define DDPF_ALPHAPIXELS    0x1
+#define DDPF_FOURCC         0x4
+#define DDPF_RGB            0x40
+
+#define DDSCAPS_COMPLEX     0x8
+#define DDSCAPS_TEXTURE     0x1000
+#define DDSCAPS_MIPMAP      0x400000
+
+#define DDS_HEADER_SIZE     128     // "DDS " magic included
+
+// KTX2 constants (see the KTX 2.0 and Khronos Data Format specifications)
+#define VK_FORMAT_R8G8B8A8_UNORM    37
+
+#define KTX2_HEADER_SIZE        80  // header and index
+#define KTX2_LEVEL_INDEX_SIZE   24
+#define KTX2_DFD_SIZE           92  // total size field and a basic descriptor block with 4 samples
+
+#define KHR_DF_MODEL_RGBSDA         1
+#define KHR_DF_PRIMARIES_BT709      1
+#define KHR_DF_TRANSFER_LINEAR      1
+#define KHR_DF_CHANNEL_ALPHA        15
+
+static const BYTE ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+
+// local functions declarations
+static BYTE *putDword(BYTE *dst, DWORD value);
+static BYTE *putQword(BYTE *dst, DWORD value);
+static DWORD writeDdsHdr(BYTE *dst, gputexFormat_t format, DWORD width, DWORD height, DWORD numLevels);
+static DWORD writeKtx2Hdr(BYTE *dst, DWORD width, DWORD height, DWORD numLevels);
+
+
+// functions definitions
+DWORD gputex_levelSize(gputexFormat_t format, DWORD width, DWORD height, DWORD level){
+    width >>= level;
+    height >>= level;
+    width = width ? width : 1;
+    height = height ? height : 1;
+
+    switch(format){
+        case GPUTEX_DDS_BC1:
+            return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+
+        case GPUTEX_DDS_BC3:
+            return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+
+        default:
+            return width * height * 4;
+    }
+}
+
+void gputex_writeHdr(gputexCtx_t *ctx, outFile_t *file, gputexFormat_t format, DWORD width, DWORD height, DWORD numLevels){
+    DWORD headerSize;
+
+    ctx->format = format;
+
+    if(format == GPUTEX_KTX2)
+        headerSize = writeKtx2Hdr(ctx->headerBytes, width, height, numLevels);
+    else
+        headerSize = writeDdsHdr(ctx->headerBytes, format, width, height, numLevels);
+
+    outFile_queue(file, ctx->headerBytes, headerSize);
+}
+
+DWORD gputex_levelOrder(const gputexCtx_t *ctx, DWORD i, DWORD numLevels){
+    return ctx->format == GPUTEX_KTX2 ? numLevels - 1 - i : i;
+}
+
+
+// local functions definitions
+
+// putDword(), putQword(): store a little endian value, returning the position past it
+static BYTE *putDword(BYTE *dst, DWORD value){
+    dst[0] = value & 0xFF;
+    dst[1] = (value >> 8) & 0xFF;
+    dst[2] = (value >> 16) & 0xFF;
+    dst[3] = value >> 24;
+
+    return dst + 4;
+}
+
+// the 64 bit fields never hold more than 32 bits' worth here
+static BYTE *putQword(BYTE *dst, DWORD value){
+    dst = putDword(dst, value);
+    return putDword(dst, 0);
+}
+
+/* writeDdsHdr(): DDS magic, DDS_HEADER and its DDS_PIXELFORMAT; returns their size.
+** The compressed formats give the main image's size rather than its pitch, and a DXT1/DXT5 fourCC
+*/
+static DWORD writeDdsHdr(BYTE *dst, gputexFormat_t format, DWORD width, DWORD height, DWORD numLevels){
+    bool compressed = format != GPUTEX_DDS;
+    DWORD flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | (compressed ? DDSD_LINEARSIZE : DDSD_PITCH);
+    DWORD caps = DDSCAPS_TEXTURE;
+
+    if(numLevels > 1){
+        flags |= DDSD_MIPMAPCOUNT;
+        caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+
+    memset(dst, 0, DDS_HEADER_SIZE);
+    memcpy(dst, "DDS ", 4);
+
+    putDword(dst + 4, 124);             // dwSize
+    putDword(dst + 8, flags);
+    putDword(dst + 12, height);
+    putDword(dst + 16, width);
+    putDword(dst + 20, compressed ? gputex_levelSize(format, width, height, 0) : width * 4);    // dwPitchOrLinearSize
+    putDword(dst + 28, numLevels);      // dwMipMapCount
+
+    putDword(dst + 76, 32);             // dwSize
+
+    if(compressed){
+        putDword(dst + 80, DDPF_FOURCC);
+        memcpy(dst + 84, format == GPUTEX_DDS_BC1 ? "DXT1" : "DXT5", 4);
+    }
+    else{
+        // pixel format: RGBA8, i.e. red in the lowest byte
+        putDword(dst + 80, DDPF_RGB | DDPF_ALPHAPIXELS);
+        putDword(dst + 88, 32);         // dwRGBBitCount
+        putDword(dst + 92, 0x000000FF);
+        putDword(dst + 96, 0x0000FF00);
+        putDword(dst + 100, 0x00FF0000);
+        putDword(dst + 104, 0xFF000000);
+    }
+
+    putDword(dst + 108, caps);
+
+    return DDS_HEADER_SIZE;
+}
+
+/* writeKtx2Hdr(): KTX2 header, index, level index and data format descriptor (no key/value data);
+** returns their size.
+** The levels' data starts right after them, smallest level first; the pixel size is 4 bytes,
+** so the levels are always 4 bytes aligned as required.
+*/
+static DWORD writeKtx2Hdr(BYTE *dst, DWORD width, DWORD height, DWORD numLevels){
+    DWORD dfdOffset = KTX2_HEADER_SIZE + numLevels * KTX2_LEVEL_INDEX_SIZE;
+    DWORD levelOffset = dfdOffset + KTX2_DFD_SIZE;
+    DWORD level, levelSize, i;
+    BYTE *p;
+
+    memcpy(dst, ktx2Identifier, sizeof(ktx2Identifier));
+    p = dst + sizeof(ktx2Identifier);
+
+    p = putDword(p, VK_FORMAT_R8G8B8A8_UNORM);
+    p = putDword(p, 1);             // typeSize
+    p = putDword(p, width);
+    p = putDword(p, height);
+    p = putDword(p, 0);             // pixelDepth
+    p = putDword(p, 0);             // layerCount
+    p = putDword(p, 1);             // faceCount
+    p = putDword(p, numLevels);
+    p = putDword(p, 0);             // supercompressionScheme
+
+    p = putDword(p, dfdOffset);
+    p = putDword(p, KTX2_DFD_SIZE);
+    p = putDword(p, 0);             // kvdByteOffset
+    p = putDword(p, 0);             // kvdByteLength
+    p = putQword(p, 0);             // sgdByteOffset
+    p = putQword(p, 0);             // sgdByteLength
+
+    // the level index goes from the main image down, while the data goes the other way around
+    for(i = 0; i < numLevels; ++i){
+        level = numLevels - 1 - i;
+        levelSize = gputex_levelSize(GPUTEX_KTX2, width, height, level);
+
+        putQword(dst + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_SIZE,      levelOffset);
+        putQword(dst + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_SIZE + 8,  levelSize);
+        putQword(dst + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_SIZE + 16, levelSize);
+
+        levelOffset += levelSize;
+    }
+
+    // data format descriptor: a basic block describing 4 unsigned normalized 8 bit channels
+    p = dst + dfdOffset;
+    p = putDword(p, KTX2_DFD_SIZE);
+    p = putDword(p, 0);                                 // vendorId, descriptorType
+    p = putDword(p, 2 | ((KTX2_DFD_SIZE - 4) << 16));   // versionNumber, descriptorBlockSize
+    p = putDword(p, KHR_DF_MODEL_RGBSDA | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+    p = putDword(p, 0);                                 // texelBlockDimension: 1x1x1x1
+    p = putDword(p, 4);                                 // bytesPlane0
+    p = putDword(p, 0);                                 // bytesPlane4-7
+
+    for(i = 0; i < 4; ++i){
+        // bitOffset, bitLength - 1, channelType
+        p = putDword(p, (i * 8) | (7 << 16) | ((i == 3 ? KHR_DF_CHANNEL_ALPHA : i) << 24));
+        p = putDword(p, 0);                             // samplePosition
+        p = putDword(p, 0);                             // sampleLower
+        p = putDword(p, 0xFF);                          // sampleUpper
+    }
+
+    return dfdOffset + KTX2_DFD_SIZE;
+}
@@ -0,0 +1,48 @@
+#ifndef GPUTEX_UTILS_H
+#define GPUTEX_UTILS_H
+
+#include "outfile.h"
+#include "types.h"
+
+/* GPU-ready texture containers: DDS and KTX2 files holding an image and its mipmaps,
+** with uncompressed RGBA8 pixels (R8G8B8A8_UNORM, i.e. the channels in ssh's own byte order)
+** and top-bottom rows, so that they can be uploaded as they are.
+** DDS files can hold BC1 or BC3 compressed blocks instead (see bcn.h).
+**
+** The mip levels' data follows the header in the order given by gputex_levelOrder(): DDS stores
+** the main image first, while KTX2 stores the smallest mipmap first.
+*/
+typedef enum gputexFormat_e{
+    GPUTEX_DDS,
+    GPUTEX_KTX2,
+    GPUTEX_DDS_BC1,
+    GPUTEX_DDS_BC3
+}gputexFormat_t;
+
+#define GPUTEX_MAX_LEVELS   16      // the main image plus up to 15 mipmaps, as many as sshResHdr_t can report
+
+// DDS' magic and header, or KTX2's header, level index and data format descriptor
+#define GPUTEX_MAX_HEADER_SIZE  (80 + GPUTEX_MAX_LEVELS * 24 + 92)
+
+/* header of the texture file being written; as for tgaCtx_t, it's queued to the output file
+** rather than written right away, so it must stay untouched until the file is flushed
+*/
+typedef struct gputexCtx_s{
+    gputexFormat_t  format;
+    BYTE            headerBytes[GPUTEX_MAX_HEADER_SIZE];
+}gputexCtx_t;
+
+/* gputex_levelSize(): size in bytes of a mip level's pixels (or blocks of 4x4 pixels, which the compressed levels
+** are padded to); the levels' width and height are halved at each level, rounded down, but never go below 1 pixel
+*/
+DWORD gputex_levelSize(gputexFormat_t format, DWORD width, DWORD height, DWORD level);
+
+/* gputex_writeHdr(): serialize the header of a format texture file for a width x height image with numLevels
+** mip levels (the main image included) and queue it
+*/
+void gputex_writeHdr(gputexCtx_t *ctx, outFile_t *file, gputexFormat_t format, DWORD width, DWORD height, DWORD numLevels);
+
+// gputex_levelOrder(): which mip level's data comes i-th in the file
+DWORD gputex_levelOrder(const gputexCtx_t *ctx, DWORD i, DWORD numLevels);
+
+#endif /* GPUTEX_UTILS_H */
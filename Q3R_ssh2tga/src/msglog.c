@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "msglog.h"
+
+#define MSGLOG_MIN_SIZE 256
+
+
+void msgLog_init(msgLog_t *log){
+    log->text = NULL;
+    log->len = 0;
+    log->size = 0;
+}
+
+void msgLog_printf(msgLog_t *log, const char *format, ...){
+    va_list args;
+    int msgLen;
+    size_t newSize;
+    char *newText;
+
+    va_start(args, format);
+
+    if(log == NULL){
+        vfprintf(stderr, format, args);
+        va_end(args);
+        return;
+    }
+
+    msgLen = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if(msgLen <= 0)
+        return;
+
+    // grow the buffer, leaving room for the null terminator
+    if(log->len + msgLen + 1 > log->size){
+        newSize = log->size ? log->size : MSGLOG_MIN_SIZE;
+        while(log->len + msgLen + 1 > newSize)
+            newSize *= 2;
+
+        // if there's no memory left, print the message right away rather than losing it
+        if((newText = realloc(log->text, newSize)) == NULL){
+            va_start(args, format);
+            vfprintf(stderr, format, args);
+            va_end(args);
+            return;
+        }
+
+        log->text = newText;
+        log->size = newSize;
+    }
+
+    va_start(args, format);
+    vsnprintf(log->text + log->len, msgLen + 1, format, args);
+    va_end(args);
+
+    log->len += msgLen;
+}
+
+void msgLog_print(const msgLog_t *log, size_t start, size_t end, FILE *stream){
+    if(end > start)
+        fwrite(log->text + start, 1, end - start, stream);
+}
+
+void msgLog_free(msgLog_t *log){
+    free(log->text);
+    msgLog_init(log);
+}
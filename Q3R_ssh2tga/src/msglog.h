@@ -0,0 +1,25 @@
+#ifndef MSGLOG_H
+#define MSGLOG_H
+
+#include <stdio.h>
+
+/* Message log: collects the error messages of a conversion running on a worker thread,
+** so that they can be printed along with the conversion's other output once it's done,
+** rather than interleaved with the other threads' messages.
+** Passing a NULL log prints the messages to stderr right away.
+*/
+typedef struct msgLog_s{
+    char *  text;
+    size_t  len;
+    size_t  size;
+}msgLog_t;
+
+void msgLog_init(msgLog_t *log);
+void msgLog_printf(msgLog_t *log, const char *format, ...);
+
+// msgLog_print(): write the log's text from offset start up to offset end to stream
+void msgLog_print(const msgLog_t *log, size_t start, size_t end, FILE *stream);
+
+void msgLog_free(msgLog_t *log);
+
+#endif /* MSGLOG_H */
@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "outfile.h"
+
+#ifndef O_BINARY
+#define O_BINARY    0
+#endif
+
+void outFile_init(outFile_t *file){
+    file->fd = -1;
+    file->error = 0;
+    file->written = 0;
+    file->numPieces = 0;
+}
+
+bool outFile_open(outFile_t *file, const char *path){
+    outFile_init(file);
+
+#ifdef _WIN32
+    file->fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+#endif
+
+    return file->fd != -1;
+}
+
+void outFile_queue(outFile_t *file, const void *data, size_t size){
+    if(size == 0)
+        return;
+
+    if(file->numPieces == OUTFILE_MAX_PIECES)
+        outFile_flush(file);
+
+    file->pieces[file->numPieces].data = data;
+    file->pieces[file->numPieces].size = size;
+    ++file->numPieces;
+}
+
+bool outFile_flush(outFile_t *file){
+    unsigned numPieces = file->numPieces;
+    unsigned i;
+
+#ifdef _WIN32
+    const char *data;
+    size_t size;
+    int written;
+#else
+    struct iovec iov[OUTFILE_MAX_PIECES];
+    struct iovec *nextIov = iov;
+    ssize_t written;
+#endif
+
+    file->numPieces = 0;
+
+    if(file->error != 0)
+        return false;
+
+#ifdef _WIN32
+    for(i = 0; i < numPieces; ++i){
+        data = file->pieces[i].data;
+        size = file->pieces[i].size;
+
+        while(size > 0){
+            if((written = _write(file->fd, data, size > 0x40000000 ? 0x40000000 : (unsigned)size)) <= 0){
+                file->error = written < 0 ? errno : EIO;
+                return false;
+            }
+
+            data += written;
+            size -= written;
+            file->written += written;
+        }
+    }
+#else
+    for(i = 0; i < numPieces; ++i){
+        iov[i].iov_base = (void *)file->pieces[i].data;
+        iov[i].iov_len = file->pieces[i].size;
+    }
+
+    // writev() may write less than asked for, so it's called again for what's left
+    while(numPieces > 0){
+        if((written = writev(file->fd, nextIov, numPieces)) < 0){
+            if(errno == EINTR)
+                continue;
+
+            file->error = errno;
+            return false;
+        }
+
+        file->written += written;
+
+        while(numPieces > 0 && (size_t)written >= nextIov->iov_len){
+            written -= nextIov->iov_len;
+            ++nextIov;
+            --numPieces;
+        }
+
+        if(numPieces > 0){
+            nextIov->iov_base = (char *)nextIov->iov_base + written;
+            nextIov->iov_len -= written;
+        }
+    }
+#endif
+
+    return true;
+}
+
+bool outFile_restart(outFile_t *file){
+    file->numPieces = 0;
+
+    // nothing written yet, e.g. the whole image was still queued
+    if(file->written == 0)
+        return true;
+
+#ifdef _WIN32
+    if(_lseek(file->fd, 0, SEEK_SET) != 0 || _chsize(file->fd, 0) != 0){
+#else
+    if(lseek(file->fd, 0, SEEK_SET) != 0 || ftruncate(file->fd, 0) != 0){
+#endif
+        file->error = errno;
+        return false;
+    }
+
+    file->written = 0;
+    return true;
+}
+
+bool outFile_close(outFile_t *file){
+    int error;
+
+    if(file->fd == -1)
+        return true;
+
+    outFile_flush(file);
+    error = file->error;
+
+#ifdef _WIN32
+    if(_close(file->fd) != 0 && error == 0)
+#else
+    if(close(file->fd) != 0 && error == 0)
+#endif
+        error = errno;
+
+    outFile_init(file);
+
+    if(error != 0){
+        errno = error;
+        return false;
+    }
+
+    return true;
+}
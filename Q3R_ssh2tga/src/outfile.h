@@ -0,0 +1,49 @@
+#ifndef OUTFILE_H
+#define OUTFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Output file with gathered writes: the pieces of data queued with outFile_queue() aren't copied anywhere,
+** and outFile_flush() writes all of them with a single writev() call (on Windows, which has no such thing
+** for ordinary files, with a _write() call for each piece), bypassing stdio's buffering.
+** The queued data must stay untouched until the next flush, so a buffer must be flushed before being reused.
+**
+** Write errors are sticky: after the first one nothing else is written, and outFile_close() reports it.
+*/
+#define OUTFILE_MAX_PIECES  8
+
+typedef struct outFilePiece_s{
+    const void *    data;
+    size_t          size;
+}outFilePiece_t;
+
+typedef struct outFile_s{
+    int             fd;         // -1 if the file isn't open
+    int             error;      // errno of the first failed write, 0 if none
+    size_t          written;    // bytes written so far
+    outFilePiece_t  pieces[OUTFILE_MAX_PIECES];
+    unsigned        numPieces;
+}outFile_t;
+
+// outFile_init(): initialize a closed file, which outFile_close() can be called on safely
+void outFile_init(outFile_t *file);
+
+// outFile_open(): create (or truncate) the file at path; on failure, errno tells why
+bool outFile_open(outFile_t *file, const char *path);
+
+// outFile_queue(): queue size bytes from data for the next flush (flushing first if there's no room for another piece)
+void outFile_queue(outFile_t *file, const void *data, size_t size);
+
+// outFile_flush(): write the queued pieces, returning false on error
+bool outFile_flush(outFile_t *file);
+
+// outFile_restart(): drop the queued pieces and truncate the file, to write it again from scratch
+bool outFile_restart(outFile_t *file);
+
+/* outFile_close(): flush the queued pieces and close the file; returns false (with errno set)
+** if anything couldn't be written
+*/
+bool outFile_close(outFile_t *file);
+
+#endif /* OUTFILE_H */
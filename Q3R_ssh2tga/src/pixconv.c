@@ -0,0 +1,768 @@
+#include <stdio.h>
+
+#include "pixconv.h"
+#include "tga_utils.h"
+
+/* the SIMD kernels need GCC/Clang's target attributes and cpu detection builtins;
+** any other compiler (e.g. tcc) gets the plain C versions
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && \
+    (defined(__i386__) || defined(__x86_64__))
+    #define PIXCONV_X86_SIMD
+    #include <immintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__TINYC__)
+    #define PIXCONV_NEON
+    #include <arm_neon.h>
+#endif
+
+typedef void (*convFunc_t)(const BYTE *src, BYTE *dst, DWORD numPixels);
+typedef void (*unpackFunc_t)(const BYTE *src, BYTE *dst, DWORD numBytes);
+typedef void (*expandFunc_t)(const BYTE *indexes, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+typedef void (*alphaFunc_t)(BYTE *pixels, DWORD numPixels);
+typedef bool (*scanAlphaFunc_t)(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high);
+
+// firstPixel is the index of the first pixel to expand, since rows of odd width start in the middle of a byte
+typedef void (*expand4bppFunc_t)(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+
+// source and destination pixel sizes for each pixConv_t value
+static const BYTE srcPixelSize[] = {sizeof(sshPixel24_t), sizeof(sshPixel32_t), sizeof(sshPixel32_t)};
+static const BYTE dstPixelSize[] = {sizeof(tgaPixel24_t), sizeof(tgaPixel32_t), sizeof(tgaPixel24_t)};
+
+
+// local functions declarations
+static convFunc_t getConvFunc(pixConv_t conv);
+
+static void convert24to24_C(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to32_C(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to24_C(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void unpack4bpp_C(const BYTE *src, BYTE *dst, DWORD numBytes);
+static void expand_C(const BYTE *indexes, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+static void expand4bpp_C(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+static void addAlpha_C(const BYTE *src, BYTE *dst, DWORD numPixels);
+static bool scanAlpha_C(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high);
+static void normalizePs2Alpha_C(BYTE *pixels, DWORD numPixels);
+
+#ifdef PIXCONV_X86_SIMD
+static void convert24to24_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to32_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to24_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert24to24_AVX2(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to32_AVX2(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to24_AVX2(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void unpack4bpp_SSE2(const BYTE *src, BYTE *dst, DWORD numBytes);
+static void unpack4bpp_AVX2(const BYTE *src, BYTE *dst, DWORD numBytes);
+static void expand_AVX2(const BYTE *indexes, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+static void expand4bpp_SSSE3(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+static void addAlpha_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels);
+static bool scanAlpha_SSE2(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high);
+static bool scanAlpha_AVX2(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high);
+static void normalizePs2Alpha_SSE2(BYTE *pixels, DWORD numPixels);
+static void normalizePs2Alpha_AVX2(BYTE *pixels, DWORD numPixels);
+#endif
+
+#ifdef PIXCONV_NEON
+static void convert24to24_NEON(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to32_NEON(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void convert32to24_NEON(const BYTE *src, BYTE *dst, DWORD numPixels);
+static void unpack4bpp_NEON(const BYTE *src, BYTE *dst, DWORD numBytes);
+static void addAlpha_NEON(const BYTE *src, BYTE *dst, DWORD numPixels);
+static bool scanAlpha_NEON(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high);
+static void normalizePs2Alpha_NEON(BYTE *pixels, DWORD numPixels);
+#ifdef __aarch64__
+static void expand4bpp_NEON(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels);
+#endif
+#endif
+
+
+void pixconv_convert(pixConv_t conv, const void *src, void *dst, DWORD numPixels){
+    getConvFunc(conv)(src, dst, numPixels);
+}
+
+void pixconv_convertImage(pixConv_t conv, const void *src, void *dst, DWORD width, DWORD height, bool flip){
+    convFunc_t convFunc = getConvFunc(conv);
+    DWORD srcRowSize = width * srcPixelSize[conv];
+    DWORD dstRowSize = width * dstPixelSize[conv];
+    DWORD y;
+
+    if(!flip){
+        convFunc(src, dst, width * height);
+        return;
+    }
+
+    for(y = 0; y < height; ++y)
+        convFunc((const BYTE *)src + y * srcRowSize, (BYTE *)dst + (height - 1 - y) * dstRowSize, width);
+}
+
+void pixconv_unpack4bpp(const BYTE *src, BYTE *dst, DWORD numBytes){
+    unpackFunc_t unpackFunc = unpack4bpp_C;
+
+#ifdef PIXCONV_X86_SIMD
+    if(__builtin_cpu_supports("avx2"))
+        unpackFunc = unpack4bpp_AVX2;
+    else if(__builtin_cpu_supports("sse2"))
+        unpackFunc = unpack4bpp_SSE2;
+#endif
+
+#ifdef PIXCONV_NEON
+    unpackFunc = unpack4bpp_NEON;
+#endif
+
+    unpackFunc(src, dst, numBytes);
+}
+
+void pixconv_expandImage(const BYTE *indexes, const tgaPixel32_t palette[256], tgaPixel32_t *dst, DWORD width, DWORD height, bool flip){
+    expandFunc_t expandFunc = expand_C;
+    DWORD y;
+
+#ifdef PIXCONV_X86_SIMD
+    if(__builtin_cpu_supports("avx2"))
+        expandFunc = expand_AVX2;
+#endif
+
+    if(!flip){
+        expandFunc(indexes, palette, dst, width * height);
+        return;
+    }
+
+    for(y = 0; y < height; ++y)
+        expandFunc(indexes + y * width, palette, dst + (height - 1 - y) * width, width);
+}
+
+void pixconv_expand4bppImage(const BYTE *src, const tgaPixel32_t palette[16], tgaPixel32_t *dst, DWORD width, DWORD height, bool flip){
+    expand4bppFunc_t expandFunc = expand4bpp_C;
+    DWORD y;
+
+#ifdef PIXCONV_X86_SIMD
+    if(__builtin_cpu_supports("ssse3"))
+        expandFunc = expand4bpp_SSSE3;
+#endif
+
+#if defined(PIXCONV_NEON) && defined(__aarch64__)
+    expandFunc = expand4bpp_NEON;
+#endif
+
+    if(!flip){
+        expandFunc(src, 0, palette, dst, width * height);
+        return;
+    }
+
+    for(y = 0; y < height; ++y)
+        expandFunc(src, y * width, palette, dst + (height - 1 - y) * width, width);
+}
+
+void pixconv_addAlpha(const void *src, void *dst, DWORD numPixels){
+    convFunc_t addAlphaFunc = addAlpha_C;
+
+#ifdef PIXCONV_X86_SIMD
+    if(__builtin_cpu_supports("ssse3"))
+        addAlphaFunc = addAlpha_SSSE3;
+#endif
+
+#ifdef PIXCONV_NEON
+    addAlphaFunc = addAlpha_NEON;
+#endif
+
+    addAlphaFunc(src, dst, numPixels);
+}
+
+bool pixconv_scanAlpha(const void *pixels, DWORD numPixels, BYTE low, BYTE high){
+    scanAlphaFunc_t scanAlphaFunc = scanAlpha_C;
+
+#ifdef PIXCONV_X86_SIMD
+    if(__builtin_cpu_supports("avx2"))
+        scanAlphaFunc = scanAlpha_AVX2;
+    else if(__builtin_cpu_supports("sse2"))
+        scanAlphaFunc = scanAlpha_SSE2;
+#endif
+
+#ifdef PIXCONV_NEON
+    scanAlphaFunc = scanAlpha_NEON;
+#endif
+
+    return scanAlphaFunc(pixels, numPixels, low, high);
+}
+
+void pixconv_normalizePs2Alpha(void *pixels, DWORD numPixels){
+    alphaFunc_t alphaFunc = normalizePs2Alpha_C;
+
+#ifdef PIXCONV_X86_SIMD
+    if(__builtin_cpu_supports("avx2"))
+        alphaFunc = normalizePs2Alpha_AVX2;
+    else if(__builtin_cpu_supports("sse2"))
+        alphaFunc = normalizePs2Alpha_SSE2;
+#endif
+
+#ifdef PIXCONV_NEON
+    alphaFunc = normalizePs2Alpha_NEON;
+#endif
+
+    alphaFunc(pixels, numPixels);
+}
+
+
+// local functions definitions
+
+/* getConvFunc(): the CPU features are checked on each call rather than once in a global,
+** so that converting from several threads at once needs no synchronization
+*/
+static convFunc_t getConvFunc(pixConv_t conv){
+    static const convFunc_t convFuncs_C[] = {convert24to24_C, convert32to32_C, convert32to24_C};
+
+#ifdef PIXCONV_X86_SIMD
+    static const convFunc_t convFuncs_SSSE3[] = {convert24to24_SSSE3, convert32to32_SSSE3, convert32to24_SSSE3};
+    static const convFunc_t convFuncs_AVX2[] = {convert24to24_AVX2, convert32to32_AVX2, convert32to24_AVX2};
+
+    if(__builtin_cpu_supports("avx2"))
+        return convFuncs_AVX2[conv];
+
+    if(__builtin_cpu_supports("ssse3"))
+        return convFuncs_SSSE3[conv];
+#endif
+
+#ifdef PIXCONV_NEON
+    static const convFunc_t convFuncs_NEON[] = {convert24to24_NEON, convert32to32_NEON, convert32to24_NEON};
+
+    return convFuncs_NEON[conv];
+#endif
+
+    return convFuncs_C[conv];
+}
+
+
+static void convert24to24_C(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const sshPixel24_t *ssh24Data = (const sshPixel24_t *)src;
+    tgaPixel24_t *tga24Data = (tgaPixel24_t *)dst;
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i){
+        tga24Data[i].red   =    ssh24Data[i].red;
+        tga24Data[i].green =    ssh24Data[i].green;
+        tga24Data[i].blue  =    ssh24Data[i].blue;
+    }
+}
+
+static void convert32to32_C(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const sshPixel32_t *ssh32Data = (const sshPixel32_t *)src;
+    tgaPixel32_t *tga32Data = (tgaPixel32_t *)dst;
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i){
+        tga32Data[i].red   =    ssh32Data[i].red;
+        tga32Data[i].green =    ssh32Data[i].green;
+        tga32Data[i].blue  =    ssh32Data[i].blue;
+        tga32Data[i].alpha =    ssh32Data[i].alpha;
+    }
+}
+
+static void convert32to24_C(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const sshPixel32_t *ssh32Data = (const sshPixel32_t *)src;
+    tgaPixel24_t *tga24Data = (tgaPixel24_t *)dst;
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i){
+        tga24Data[i].red   =    ssh32Data[i].red;
+        tga24Data[i].green =    ssh32Data[i].green;
+        tga24Data[i].blue  =    ssh32Data[i].blue;
+    }
+}
+
+static void unpack4bpp_C(const BYTE *src, BYTE *dst, DWORD numBytes){
+    DWORD i;
+
+    for(i = 0; i < numBytes; ++i){
+        *dst++ = src[i] & 0xF; // take the low nibble
+        *dst++ = src[i] >>  4; // take the high nibble
+    }
+}
+
+static void expand_C(const BYTE *indexes, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels){
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i)
+        dst[i] = palette[indexes[i]];
+}
+
+static void expand4bpp_C(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels){
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i, ++firstPixel)
+        dst[i] = palette[(src[firstPixel / 2] >> ((firstPixel & 1) * 4)) & 0xF];
+}
+
+static void addAlpha_C(const BYTE *src, BYTE *dst, DWORD numPixels){
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i, src += 3, dst += 4){
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 0xFF;
+    }
+}
+
+static bool scanAlpha_C(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high){
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i, pixels += 4)
+        if(pixels[3] < low || pixels[3] > high)
+            return false;
+
+    return true;
+}
+
+static void normalizePs2Alpha_C(BYTE *pixels, DWORD numPixels){
+    DWORD i;
+
+    for(i = 0; i < numPixels; ++i, pixels += 4)
+        pixels[3] = pixels[3] >= 0x80 ? 0xFF : pixels[3] * 2;
+}
+
+
+#ifdef PIXCONV_X86_SIMD
+/* The 24 bit kernels load and store whole vectors even though they convert a whole number
+** of pixels only (5 pixels out of 16 bytes, or 4 pixels into 12 bytes); the extra bytes
+** written past the converted pixels are rewritten by the next iteration, so the loops stop
+** while there are still enough pixels left for those extra bytes, and never touch anything
+** past the end of either buffer.
+*/
+
+__attribute__((target("ssse3")))
+static void convert24to24_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+
+    // 5 pixels for each 16 bytes load/store
+    for(; numPixels >= 6; numPixels -= 5, src += 15, dst += 15)
+        _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask));
+
+    convert24to24_C(src, dst, numPixels);
+}
+
+__attribute__((target("ssse3")))
+static void convert32to32_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    for(; numPixels >= 4; numPixels -= 4, src += 16, dst += 16)
+        _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask));
+
+    convert32to32_C(src, dst, numPixels);
+}
+
+__attribute__((target("ssse3")))
+static void convert32to24_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    // 4 pixels for each 16 bytes store, of which 12 are valid
+    for(; numPixels >= 6; numPixels -= 4, src += 16, dst += 12)
+        _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask));
+
+    convert32to24_C(src, dst, numPixels);
+}
+
+__attribute__((target("avx2")))
+static void convert24to24_AVX2(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+                                          2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    __m256i v;
+
+    // byte shuffles don't cross 128 bit lanes, so each lane converts 5 pixels
+    for(; numPixels >= 11; numPixels -= 10, src += 30, dst += 30){
+        v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)src)),
+                                    _mm_loadu_si128((const __m128i *)(src + 15)), 1);
+        v = _mm256_shuffle_epi8(v, mask);
+
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(dst + 15), _mm256_extracti128_si256(v, 1));
+    }
+
+    convert24to24_C(src, dst, numPixels);
+}
+
+__attribute__((target("avx2")))
+static void convert32to32_AVX2(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    for(; numPixels >= 8; numPixels -= 8, src += 32, dst += 32)
+        _mm256_storeu_si256((__m256i *)dst, _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), mask));
+
+    convert32to32_C(src, dst, numPixels);
+}
+
+__attribute__((target("avx2")))
+static void convert32to24_AVX2(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    __m256i v;
+
+    // each lane packs 4 pixels in its first 12 bytes, then the lanes are joined: 24 valid bytes out of 32
+    for(; numPixels >= 11; numPixels -= 8, src += 32, dst += 24){
+        v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), mask);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_permutevar8x32_epi32(v, pack));
+    }
+
+    convert32to24_C(src, dst, numPixels);
+}
+
+__attribute__((target("sse2")))
+static void unpack4bpp_SSE2(const BYTE *src, BYTE *dst, DWORD numBytes){
+    const __m128i nibbleMask = _mm_set1_epi8(0xF);
+    __m128i v, lo, hi;
+
+    for(; numBytes >= 16; numBytes -= 16, src += 16, dst += 32){
+        v = _mm_loadu_si128((const __m128i *)src);
+        lo = _mm_and_si128(v, nibbleMask);
+        hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibbleMask);
+
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(lo, hi));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(lo, hi));
+    }
+
+    unpack4bpp_C(src, dst, numBytes);
+}
+
+__attribute__((target("avx2")))
+static void unpack4bpp_AVX2(const BYTE *src, BYTE *dst, DWORD numBytes){
+    const __m256i nibbleMask = _mm256_set1_epi8(0xF);
+    __m256i v, lo, hi, first, second;
+
+    for(; numBytes >= 32; numBytes -= 32, src += 32, dst += 64){
+        v = _mm256_loadu_si256((const __m256i *)src);
+        lo = _mm256_and_si256(v, nibbleMask);
+        hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibbleMask);
+
+        // the unpacks work within each 128 bit lane, so the lanes' halves need to be put back in order
+        first = _mm256_unpacklo_epi8(lo, hi);
+        second = _mm256_unpackhi_epi8(lo, hi);
+
+        _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+
+    unpack4bpp_C(src, dst, numBytes);
+}
+
+// expand_AVX2(): 8 palette lookups at a time with a gather
+__attribute__((target("avx2")))
+static void expand_AVX2(const BYTE *indexes, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels){
+    __m256i idx;
+
+    for(; numPixels >= 8; numPixels -= 8, indexes += 8, dst += 8){
+        idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)indexes));
+        _mm256_storeu_si256((__m256i *)dst, _mm256_i32gather_epi32((const int *)palette, idx, 4));
+    }
+
+    expand_C(indexes, palette, dst, numPixels);
+}
+
+/* expand4bpp_SSSE3(): a 16 entries palette fits in 4 registers, one for each channel,
+** so byte shuffles can look up 16 pixels' channels at once
+*/
+__attribute__((target("ssse3")))
+static void expand4bpp_SSSE3(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels){
+    const __m128i nibbleMask = _mm_set1_epi8(0xF);
+    BYTE planes[4][16];
+    __m128i blue, green, red, alpha;
+    __m128i v, idx, b, g, r, a, bg, ra;
+    unsigned i;
+
+    // start from a byte boundary
+    if((firstPixel & 1) && numPixels){
+        *dst++ = palette[src[firstPixel / 2] >> 4];
+        ++firstPixel;
+        --numPixels;
+    }
+
+    src += firstPixel / 2;
+
+    for(i = 0; i < 16; ++i){
+        planes[0][i] = palette[i].blue;
+        planes[1][i] = palette[i].green;
+        planes[2][i] = palette[i].red;
+        planes[3][i] = palette[i].alpha;
+    }
+
+    blue = _mm_loadu_si128((const __m128i *)planes[0]);
+    green = _mm_loadu_si128((const __m128i *)planes[1]);
+    red = _mm_loadu_si128((const __m128i *)planes[2]);
+    alpha = _mm_loadu_si128((const __m128i *)planes[3]);
+
+    for(; numPixels >= 16; numPixels -= 16, src += 8, dst += 16){
+        v = _mm_loadl_epi64((const __m128i *)src);
+        idx = _mm_unpacklo_epi8(_mm_and_si128(v, nibbleMask), _mm_and_si128(_mm_srli_epi16(v, 4), nibbleMask));
+
+        b = _mm_shuffle_epi8(blue, idx);
+        g = _mm_shuffle_epi8(green, idx);
+        r = _mm_shuffle_epi8(red, idx);
+        a = _mm_shuffle_epi8(alpha, idx);
+
+        // interleave the channels back into BGRA pixels
+        bg = _mm_unpacklo_epi8(b, g);
+        ra = _mm_unpacklo_epi8(r, a);
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(dst + 4), _mm_unpackhi_epi16(bg, ra));
+
+        bg = _mm_unpackhi_epi8(b, g);
+        ra = _mm_unpackhi_epi8(r, a);
+        _mm_storeu_si128((__m128i *)(dst + 8), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(dst + 12), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    expand4bpp_C(src, 0, palette, dst, numPixels);
+}
+
+__attribute__((target("ssse3")))
+static void addAlpha_SSSE3(const BYTE *src, BYTE *dst, DWORD numPixels){
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+    // 4 pixels out of each 16 bytes load, as for the other 24 bit kernels
+    for(; numPixels >= 6; numPixels -= 4, src += 12, dst += 16)
+        _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), mask), alpha));
+
+    addAlpha_C(src, dst, numPixels);
+}
+
+/* scanAlpha_SSE2(): 16 pixels at a time; the color channels are set to 0xFF for the minimum and to 0 for the maximum,
+** so that only the alpha channel counts
+*/
+__attribute__((target("sse2")))
+static bool scanAlpha_SSE2(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high){
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i lowV = _mm_set1_epi8(low);
+    const __m128i highV = _mm_set1_epi8(high);
+    __m128i v0, v1, v2, v3, blockMin, blockMax, inRangeV;
+
+    for(; numPixels >= 16; numPixels -= 16, pixels += 64){
+        v0 = _mm_loadu_si128((const __m128i *)pixels);
+        v1 = _mm_loadu_si128((const __m128i *)(pixels + 16));
+        v2 = _mm_loadu_si128((const __m128i *)(pixels + 32));
+        v3 = _mm_loadu_si128((const __m128i *)(pixels + 48));
+
+        blockMin = _mm_or_si128(_mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3)), colorMask);
+        blockMax = _mm_andnot_si128(colorMask, _mm_max_epu8(_mm_max_epu8(v0, v1), _mm_max_epu8(v2, v3)));
+
+        // unsigned comparisons: blockMin >= low and blockMax <= high
+        inRangeV = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(blockMin, lowV), blockMin),
+                                 _mm_cmpeq_epi8(_mm_min_epu8(blockMax, highV), blockMax));
+
+        if(_mm_movemask_epi8(inRangeV) != 0xFFFF)
+            return false;
+    }
+
+    return scanAlpha_C(pixels, numPixels, low, high);
+}
+
+// scanAlpha_AVX2(): same as scanAlpha_SSE2(), 32 pixels at a time
+__attribute__((target("avx2")))
+static bool scanAlpha_AVX2(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high){
+    const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i lowV = _mm256_set1_epi8(low);
+    const __m256i highV = _mm256_set1_epi8(high);
+    __m256i v0, v1, v2, v3, blockMin, blockMax, inRangeV;
+
+    for(; numPixels >= 32; numPixels -= 32, pixels += 128){
+        v0 = _mm256_loadu_si256((const __m256i *)pixels);
+        v1 = _mm256_loadu_si256((const __m256i *)(pixels + 32));
+        v2 = _mm256_loadu_si256((const __m256i *)(pixels + 64));
+        v3 = _mm256_loadu_si256((const __m256i *)(pixels + 96));
+
+        blockMin = _mm256_or_si256(_mm256_min_epu8(_mm256_min_epu8(v0, v1), _mm256_min_epu8(v2, v3)), colorMask);
+        blockMax = _mm256_andnot_si256(colorMask, _mm256_max_epu8(_mm256_max_epu8(v0, v1), _mm256_max_epu8(v2, v3)));
+
+        inRangeV = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(blockMin, lowV), blockMin),
+                                    _mm256_cmpeq_epi8(_mm256_min_epu8(blockMax, highV), blockMax));
+
+        if((unsigned)_mm256_movemask_epi8(inRangeV) != 0xFFFFFFFF)
+            return false;
+    }
+
+    return scanAlpha_C(pixels, numPixels, low, high);
+}
+
+// normalizePs2Alpha_SSE2(): the doubling is a saturating add of the alpha bytes to themselves
+__attribute__((target("sse2")))
+static void normalizePs2Alpha_SSE2(BYTE *pixels, DWORD numPixels){
+    const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+    __m128i v, alpha;
+
+    for(; numPixels >= 4; numPixels -= 4, pixels += 16){
+        v = _mm_loadu_si128((const __m128i *)pixels);
+        alpha = _mm_and_si128(v, alphaMask);
+        _mm_storeu_si128((__m128i *)pixels, _mm_or_si128(_mm_andnot_si128(alphaMask, v), _mm_adds_epu8(alpha, alpha)));
+    }
+
+    normalizePs2Alpha_C(pixels, numPixels);
+}
+
+__attribute__((target("avx2")))
+static void normalizePs2Alpha_AVX2(BYTE *pixels, DWORD numPixels){
+    const __m256i alphaMask = _mm256_set1_epi32(0xFF000000);
+    __m256i v, alpha;
+
+    for(; numPixels >= 8; numPixels -= 8, pixels += 32){
+        v = _mm256_loadu_si256((const __m256i *)pixels);
+        alpha = _mm256_and_si256(v, alphaMask);
+        _mm256_storeu_si256((__m256i *)pixels, _mm256_or_si256(_mm256_andnot_si256(alphaMask, v), _mm256_adds_epu8(alpha, alpha)));
+    }
+
+    normalizePs2Alpha_C(pixels, numPixels);
+}
+#endif
+
+
+#ifdef PIXCONV_NEON
+// NEON's interleaved loads/stores split the pixels in channels, so swapping red and blue is free
+static void convert24to24_NEON(const BYTE *src, BYTE *dst, DWORD numPixels){
+    uint8x16x3_t px;
+    uint8x16_t tmp;
+
+    for(; numPixels >= 16; numPixels -= 16, src += 48, dst += 48){
+        px = vld3q_u8(src);
+        tmp = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = tmp;
+        vst3q_u8(dst, px);
+    }
+
+    convert24to24_C(src, dst, numPixels);
+}
+
+static void convert32to32_NEON(const BYTE *src, BYTE *dst, DWORD numPixels){
+    uint8x16x4_t px;
+    uint8x16_t tmp;
+
+    for(; numPixels >= 16; numPixels -= 16, src += 64, dst += 64){
+        px = vld4q_u8(src);
+        tmp = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = tmp;
+        vst4q_u8(dst, px);
+    }
+
+    convert32to32_C(src, dst, numPixels);
+}
+
+static void convert32to24_NEON(const BYTE *src, BYTE *dst, DWORD numPixels){
+    uint8x16x4_t px;
+    uint8x16x3_t out;
+
+    for(; numPixels >= 16; numPixels -= 16, src += 64, dst += 48){
+        px = vld4q_u8(src);
+        out.val[0] = px.val[2];
+        out.val[1] = px.val[1];
+        out.val[2] = px.val[0];
+        vst3q_u8(dst, out);
+    }
+
+    convert32to24_C(src, dst, numPixels);
+}
+
+static void unpack4bpp_NEON(const BYTE *src, BYTE *dst, DWORD numBytes){
+    const uint8x16_t nibbleMask = vdupq_n_u8(0xF);
+    uint8x16x2_t idx;
+    uint8x16_t v;
+
+    // the interleaved store puts each byte's low and high nibble next to each other
+    for(; numBytes >= 16; numBytes -= 16, src += 16, dst += 32){
+        v = vld1q_u8(src);
+        idx.val[0] = vandq_u8(v, nibbleMask);
+        idx.val[1] = vshrq_n_u8(v, 4);
+        vst2q_u8(dst, idx);
+    }
+
+    unpack4bpp_C(src, dst, numBytes);
+}
+
+static void addAlpha_NEON(const BYTE *src, BYTE *dst, DWORD numPixels){
+    uint8x16x3_t px;
+    uint8x16x4_t out;
+
+    out.val[3] = vdupq_n_u8(0xFF);
+
+    for(; numPixels >= 16; numPixels -= 16, src += 48, dst += 64){
+        px = vld3q_u8(src);
+        out.val[0] = px.val[0];
+        out.val[1] = px.val[1];
+        out.val[2] = px.val[2];
+        vst4q_u8(dst, out);
+    }
+
+    addAlpha_C(src, dst, numPixels);
+}
+
+// scanAlpha_NEON(): the deinterleaving load puts 16 pixels' alpha values in a register of their own
+static bool scanAlpha_NEON(const BYTE *pixels, DWORD numPixels, BYTE low, BYTE high){
+    const uint8x16_t lowV = vdupq_n_u8(low);
+    const uint8x16_t highV = vdupq_n_u8(high);
+    uint8x16_t alpha;
+    uint64x2_t outside;
+
+    for(; numPixels >= 16; numPixels -= 16, pixels += 64){
+        alpha = vld4q_u8(pixels).val[3];
+
+        outside = vreinterpretq_u64_u8(vorrq_u8(vcltq_u8(alpha, lowV), vcgtq_u8(alpha, highV)));
+
+        if(vgetq_lane_u64(outside, 0) | vgetq_lane_u64(outside, 1))
+            return false;
+    }
+
+    return scanAlpha_C(pixels, numPixels, low, high);
+}
+
+static void normalizePs2Alpha_NEON(BYTE *pixels, DWORD numPixels){
+    uint8x16x4_t px;
+
+    for(; numPixels >= 16; numPixels -= 16, pixels += 64){
+        px = vld4q_u8(pixels);
+        px.val[3] = vqaddq_u8(px.val[3], px.val[3]);
+        vst4q_u8(pixels, px);
+    }
+
+    normalizePs2Alpha_C(pixels, numPixels);
+}
+
+#ifdef __aarch64__
+// expand4bpp_NEON(): same as expand4bpp_SSSE3(), with table lookups on each channel
+static void expand4bpp_NEON(const BYTE *src, DWORD firstPixel, const tgaPixel32_t *palette, tgaPixel32_t *dst, DWORD numPixels){
+    const uint8x16_t nibbleMask = vdupq_n_u8(0xF);
+    BYTE planes[4][16];
+    uint8x16_t blue, green, red, alpha, v, idx;
+    uint8x16x4_t px;
+    unsigned i;
+
+    if((firstPixel & 1) && numPixels){
+        *dst++ = palette[src[firstPixel / 2] >> 4];
+        ++firstPixel;
+        --numPixels;
+    }
+
+    src += firstPixel / 2;
+
+    for(i = 0; i < 16; ++i){
+        planes[0][i] = palette[i].blue;
+        planes[1][i] = palette[i].green;
+        planes[2][i] = palette[i].red;
+        planes[3][i] = palette[i].alpha;
+    }
+
+    blue = vld1q_u8(planes[0]);
+    green = vld1q_u8(planes[1]);
+    red = vld1q_u8(planes[2]);
+    alpha = vld1q_u8(planes[3]);
+
+    for(; numPixels >= 16; numPixels -= 16, src += 8, dst += 16){
+        v = vcombine_u8(vld1_u8(src), vdup_n_u8(0));
+        idx = vzip1q_u8(vandq_u8(v, nibbleMask), vshrq_n_u8(v, 4));
+
+        px.val[0] = vqtbl1q_u8(blue, idx);
+        px.val[1] = vqtbl1q_u8(green, idx);
+        px.val[2] = vqtbl1q_u8(red, idx);
+        px.val[3] = vqtbl1q_u8(alpha, idx);
+        vst4q_u8((BYTE *)dst, px);
+    }
+
+    expand4bpp_C(src, 0, palette, dst, numPixels);
+}
+#endif
+#endif
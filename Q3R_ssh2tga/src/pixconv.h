@@ -0,0 +1,58 @@
+#ifndef PIXCONV_H
+#define PIXCONV_H
+
+#include <stdbool.h>
+
+#include "types.h"
+#include "tga_utils.h"
+
+/* Pixel format conversion from ssh's RGB(A) byte order to tga's BGR(A) one,
+** and from palette indexes to truecolor pixels.
+**
+** The kernels use byte shuffles or gathers (SSE2/SSSE3 or AVX2, picked at runtime, or NEON on ARM)
+** when available, and a plain C loop otherwise; all of them give the same output.
+** Source and destination buffers must not overlap.
+*/
+typedef enum pixConv_e{
+    PIXCONV_24_TO_24,   // RGB  -> BGR
+    PIXCONV_32_TO_32,   // RGBA -> BGRA
+    PIXCONV_32_TO_24    // RGBA -> BGR, dropping the alpha channel
+}pixConv_t;
+
+// pixconv_convert(): convert numPixels pixels from src to dst
+void pixconv_convert(pixConv_t conv, const void *src, void *dst, DWORD numPixels);
+
+/* pixconv_convertImage(): convert a width x height image from src to dst; if flip is true,
+** the rows are also put in bottom-top order along the way
+*/
+void pixconv_convertImage(pixConv_t conv, const void *src, void *dst, DWORD width, DWORD height, bool flip);
+
+/* pixconv_unpack4bpp(): split numBytes bytes of 4bpp data into 2 * numBytes palette indexes,
+** low nibble first
+*/
+void pixconv_unpack4bpp(const BYTE *src, BYTE *dst, DWORD numBytes);
+
+/* pixconv_expandImage(): convert a width x height image of 8bpp palette indexes to 32 bit pixels
+** using a 256 entries palette already in tga's pixel format, flipping the rows if requested
+*/
+void pixconv_expandImage(const BYTE *indexes, const tgaPixel32_t palette[256], tgaPixel32_t *dst, DWORD width, DWORD height, bool flip);
+
+// pixconv_expand4bppImage(): same as pixconv_expandImage(), straight from 4bpp data and a 16 entries palette
+void pixconv_expand4bppImage(const BYTE *src, const tgaPixel32_t palette[16], tgaPixel32_t *dst, DWORD width, DWORD height, bool flip);
+
+/* pixconv_addAlpha(): convert numPixels RGB pixels from src to RGBA ones with an opaque alpha channel in dst,
+** keeping the channels' order (for the formats storing the pixels in ssh's own order)
+*/
+void pixconv_addAlpha(const void *src, void *dst, DWORD numPixels);
+
+/* pixconv_scanAlpha(): whether the alpha values of numPixels 32 bit pixels (in either channel order) are all
+** between low and high; the scan stops at the first block of pixels (16 to 32 of them) with a value outside of it
+*/
+bool pixconv_scanAlpha(const void *pixels, DWORD numPixels, BYTE low, BYTE high);
+
+/* pixconv_normalizePs2Alpha(): rescale the alpha values of numPixels 32 bit pixels (in either channel order)
+** from the PS2's 0-0x80 range to 0-0xFF, in place; each value is doubled, with 0x80 (and above) becoming 0xFF
+*/
+void pixconv_normalizePs2Alpha(void *pixels, DWORD numPixels);
+
+#endif /* PIXCONV_H */
@@ -0,0 +1,443 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "rle.h"
+
+/* the SIMD kernels need GCC/Clang's target attributes and cpu detection builtins;
+** any other compiler (e.g. tcc) gets the plain C search loops
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && \
+    (defined(__i386__) || defined(__x86_64__))
+    #define RLE_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+#define PIXELS_EQUAL(px1,px2,pxSize) (!memcmp((px1), (px2), (pxSize)))
+
+#define RLE_MAX_PACKET_PIXELS   128
+
+// number of neighbouring pixels compared by each equality mask
+#define RLE_BLOCK_PIXELS        32
+
+/* eqMaskFunc_t: bit n of the returned mask is set if pixel n equals pixel n + 1;
+** the kernels read RLE_BLOCK_PIXELS + 2 pixels (the 24 bit ones read 1 byte of the last one)
+*/
+typedef DWORD (*eqMaskFunc_t)(const BYTE *px);
+
+// the image being encoded
+typedef struct rleImage_s{
+    const BYTE *    px;
+    DWORD           numPixels;
+    unsigned        pixelSize;
+    eqMaskFunc_t    eqMask;     // NULL if there's no SIMD kernel for this pixel size
+}rleImage_t;
+
+
+// local functions declarations
+static eqMaskFunc_t getEqMaskFunc(unsigned pixelSize);
+static unsigned bitScan(DWORD mask);
+static DWORD runLength(const rleImage_t *img, DWORD first, DWORD maxLen);
+static bool findRun(const rleImage_t *img, DWORD from, DWORD lastPixel, unsigned minRunLen, DWORD *runStart);
+static DWORD copyPixels(BYTE *dst, const rleImage_t *img, DWORD first, DWORD count, const BYTE remap[]);
+
+#ifdef RLE_X86_SIMD
+static DWORD eqMask8_SSE2(const BYTE *px);
+static DWORD eqMask24_SSSE3(const BYTE *px);
+static DWORD eqMask32_SSE2(const BYTE *px);
+static DWORD eqMask8_AVX2(const BYTE *px);
+static DWORD eqMask24_AVX2(const BYTE *px);
+static DWORD eqMask32_AVX2(const BYTE *px);
+#endif
+
+
+void rle_initStream(rleStream_t *stream, unsigned pixelSize, const BYTE remap[256]){
+    stream->pixelSize = pixelSize;
+    stream->remap = remap;
+    stream->pixelCount = 0;
+}
+
+/* rle_encodeStream(): this gives the same packets as encoding the whole image one pixel at a time would:
+** - a RLE packet takes the run of identical pixels starting at the current one, up to 128 pixels;
+** - a raw packet starts when the current pixel isn't followed by an identical one, and takes the
+**   following pixels too, up to the first one starting a run of minRunLen identical pixels.
+**   The run must end within the 128 pixels following the packet's 1st one;
+**   if the image ends first, its last pixel joins the packet (or gets a packet of its own, if the packet
+**   has a single pixel so far).
+** Either way a packet depends on the 129 pixels starting from its 1st one at most, so unless they're the
+** last ones the pixels are encoded as long as 129 of them are available.
+*/
+DWORD rle_encodeStream(rleStream_t *stream, BYTE *dst, DWORD *encodedSize, const BYTE *src, DWORD numPixels, bool last){
+    rleImage_t img;
+    DWORD i = 0, j = 0;
+    DWORD pixelCount = stream->pixelCount;  // pixels already known to be identical to the current one
+    DWORD rawEnd, lastPixel, runStart;
+
+    // 1 byte pixels need 3 of them in a row to be worth a RLE packet in the middle of raw ones
+    const unsigned minRunLen = stream->pixelSize == 1 ? 3 : 2;
+
+    img.px = src;
+    img.numPixels = numPixels;
+    img.pixelSize = stream->pixelSize;
+    img.eqMask = getEqMaskFunc(stream->pixelSize);
+
+    while(i < numPixels && (last || numPixels - i > RLE_MAX_PACKET_PIXELS)){
+        pixelCount += runLength(&img, i + pixelCount, RLE_MAX_PACKET_PIXELS - 1 - pixelCount);
+
+        if(pixelCount){
+            i += pixelCount;
+            dst[j++] = pixelCount | 0x80;   // this is a RLE packet, so the MSB must be set
+            j += copyPixels(dst + j, &img, i++, 1, stream->remap);
+
+            pixelCount = 0;
+            continue;
+        }
+
+        // find where the raw packet starting at the current pixel ends
+        lastPixel = i + RLE_MAX_PACKET_PIXELS < numPixels - 1 ? i + RLE_MAX_PACKET_PIXELS : numPixels - 1;
+
+        if(findRun(&img, i + 1, lastPixel, minRunLen, &runStart)){
+            // the run's pixels have already been checked; they don't need to be counted again
+            rawEnd = runStart;
+            pixelCount = minRunLen - 1;
+        }
+        else if(i + RLE_MAX_PACKET_PIXELS <= numPixels - 1)
+            rawEnd = i + RLE_MAX_PACKET_PIXELS;
+        else
+            rawEnd = numPixels - 1 > i + 1 ? numPixels : i + 1;
+
+        dst[j++] = rawEnd - i - 1;
+        j += copyPixels(dst + j, &img, i, rawEnd - i, stream->remap);
+        i = rawEnd;
+    }
+
+    stream->pixelCount = pixelCount;
+    *encodedSize = j;
+    return i;
+}
+
+
+void rle_initOptimal(rleOptimal_t *plan, unsigned pixelSize, const BYTE remap[256], BYTE *packets){
+    plan->pixelSize = pixelSize;
+    plan->remap = remap;
+    plan->packets = packets;
+    plan->numPixels = 0;
+
+    plan->costs[0] = 0;
+    plan->queueHead = 0;
+    plan->queueTail = 0;
+    plan->runStart = 0;
+    plan->prevPixel = 0;
+
+    plan->packetLeft = 0;
+    plan->packetIsRaw = false;
+}
+
+void rle_planOptimal(rleOptimal_t *plan, const BYTE *src, DWORD numPixels){
+    const unsigned pixelSize = plan->pixelSize;
+    const DWORD mask = RLE_PLAN_WINDOW - 1;
+    DWORD *costs = plan->costs;
+    DWORD *queue = plan->queue;
+    DWORD head = plan->queueHead, tail = plan->queueTail, runStart = plan->runStart;
+    DWORD prevPixel = plan->prevPixel;
+    DWORD i, p, pixel, first, rleStart, rawStart, rleCost, rawCost;
+    long long key;
+
+    for(i = 0, p = plan->numPixels; i < numPixels; ++i, ++p, src += pixelSize){
+        pixel = pixelSize == 1 ? src[0] : src[0] | src[1] << 8 | src[2] << 16 | (pixelSize == 4 ? (DWORD)src[3] << 24 : 0);
+
+        if(p == 0 || pixel != prevPixel)
+            runStart = p;
+        prevPixel = pixel;
+
+        // the packet ending at pixel p starts between first and p
+        first = p + 1 > RLE_MAX_PACKET_PIXELS ? p + 1 - RLE_MAX_PACKET_PIXELS : 0;
+
+        // p becomes a candidate start, and those too far back or no better than it are dropped
+        key = (long long)costs[p & mask] - (long long)p * pixelSize;
+        while(tail != head && (long long)costs[queue[(tail - 1) & mask] & mask] - (long long)queue[(tail - 1) & mask] * pixelSize >= key)
+            --tail;
+        queue[tail++ & mask] = p;
+
+        while(queue[head & mask] < first)
+            ++head;
+
+        rawStart = queue[head & mask];
+        rawCost = costs[rawStart & mask] + 1 + (p + 1 - rawStart) * pixelSize;
+
+        rleStart = runStart > first ? runStart : first;
+        rleCost = costs[rleStart & mask] + 1 + pixelSize;
+
+        if(rleCost < rawCost){
+            costs[(p + 1) & mask] = rleCost;
+            plan->packets[p] = (p - rleStart) | 0x80;
+        }
+        else{
+            costs[(p + 1) & mask] = rawCost;
+            plan->packets[p] = p - rawStart;
+        }
+    }
+
+    plan->numPixels = p;
+    plan->queueHead = head;
+    plan->queueTail = tail;
+    plan->runStart = runStart;
+    plan->prevPixel = prevPixel;
+}
+
+/* rle_finishPlan(): the packets are walked back from the last one, moving each count byte from the packet's
+** last pixel to its first one; the pixels in between aren't looked at again
+*/
+DWORD rle_finishPlan(rleOptimal_t *plan){
+    DWORD i = plan->numPixels;
+    DWORD encodedSize = plan->costs[i & (RLE_PLAN_WINDOW - 1)];
+    BYTE count;
+
+    while(i > 0){
+        count = plan->packets[i - 1];
+        i -= (count & 0x7F) + 1;
+        plan->packets[i] = count;
+    }
+
+    plan->numPixels = 0;
+    plan->packetLeft = 0;
+    return encodedSize;
+}
+
+DWORD rle_encodeOptimal(rleOptimal_t *plan, BYTE *dst, const BYTE *src, DWORD numPixels){
+    rleImage_t img;
+    DWORD i = 0, j = 0, n;
+    BYTE count;
+
+    img.px = src;
+    img.numPixels = numPixels;
+    img.pixelSize = plan->pixelSize;
+    img.eqMask = NULL;
+
+    while(i < numPixels){
+        if(plan->packetLeft == 0){
+            count = plan->packets[plan->numPixels + i];
+            dst[j++] = count;
+            plan->packetLeft = (count & 0x7F) + 1;
+            plan->packetIsRaw = !(count & 0x80);
+
+            // a RLE packet's pixel is its first one
+            if(!plan->packetIsRaw)
+                j += copyPixels(dst + j, &img, i, 1, plan->remap);
+        }
+
+        n = plan->packetLeft < numPixels - i ? plan->packetLeft : numPixels - i;
+
+        if(plan->packetIsRaw)
+            j += copyPixels(dst + j, &img, i, n, plan->remap);
+
+        plan->packetLeft -= n;
+        i += n;
+    }
+
+    plan->numPixels += numPixels;
+    return j;
+}
+
+
+// local functions definitions
+
+/* getEqMaskFunc(): the CPU features are checked on each call rather than once in a global,
+** so that encoding from several threads at once needs no synchronization
+*/
+static eqMaskFunc_t getEqMaskFunc(unsigned pixelSize){
+#ifdef RLE_X86_SIMD
+    // indexed by pixelSize - 1
+    static const eqMaskFunc_t eqMaskFuncs_SSE[] = {eqMask8_SSE2, NULL, eqMask24_SSSE3, eqMask32_SSE2};
+    static const eqMaskFunc_t eqMaskFuncs_AVX2[] = {eqMask8_AVX2, NULL, eqMask24_AVX2, eqMask32_AVX2};
+
+    if(__builtin_cpu_supports("avx2"))
+        return eqMaskFuncs_AVX2[pixelSize - 1];
+
+    if(pixelSize == 3 ? __builtin_cpu_supports("ssse3") : __builtin_cpu_supports("sse2"))
+        return eqMaskFuncs_SSE[pixelSize - 1];
+#endif
+
+    return NULL;
+}
+
+// bitScan(): index of the lowest set bit; mask must not be 0
+static unsigned bitScan(DWORD mask){
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    return __builtin_ctz(mask);
+#else
+    unsigned n = 0;
+
+    while(!(mask & 1)){
+        mask >>= 1;
+        ++n;
+    }
+
+    return n;
+#endif
+}
+
+// runLength(): number of pixels identical to their previous one from first + 1 onwards, up to maxLen
+static DWORD runLength(const rleImage_t *img, DWORD first, DWORD maxLen){
+    DWORD n = 0, mask;
+
+    while(n < maxLen && first + n + 1 < img->numPixels){
+        if(img->eqMask != NULL && first + n + RLE_BLOCK_PIXELS + 2 <= img->numPixels){
+            mask = ~img->eqMask(img->px + (first + n) * img->pixelSize);
+
+            if(mask){
+                n += bitScan(mask);
+                break;
+            }
+
+            n += RLE_BLOCK_PIXELS;
+        }
+        else if(PIXELS_EQUAL(img->px + (first + n) * img->pixelSize, img->px + (first + n + 1) * img->pixelSize, img->pixelSize))
+            ++n;
+        else
+            break;
+    }
+
+    return n < maxLen ? n : maxLen;
+}
+
+/* findRun(): find the first run of minRunLen (2 or 3) identical pixels starting from the pixel from onwards
+** and ending no later than lastPixel
+*/
+static bool findRun(const rleImage_t *img, DWORD from, DWORD lastPixel, unsigned minRunLen, DWORD *runStart){
+    DWORD r = from, mask;
+    const BYTE *px;
+
+    while(r + minRunLen - 1 <= lastPixel){
+        px = img->px + r * img->pixelSize;
+
+        if(img->eqMask != NULL && r + RLE_BLOCK_PIXELS + 2 <= img->numPixels){
+            mask = img->eqMask(px);
+
+            // a run of 3 needs 2 equalities in a row, so the mask's last bit can't tell
+            if(minRunLen == 3)
+                mask &= mask >> 1;
+
+            if(mask == 0){
+                r += RLE_BLOCK_PIXELS - (minRunLen - 2);
+                continue;
+            }
+
+            r += bitScan(mask);
+        }
+        else if(!PIXELS_EQUAL(px, px + img->pixelSize, img->pixelSize)
+             || (minRunLen == 3 && !PIXELS_EQUAL(px + img->pixelSize, px + 2 * img->pixelSize, img->pixelSize))){
+            ++r;
+            continue;
+        }
+
+        if(r + minRunLen - 1 > lastPixel)
+            break;
+
+        *runStart = r;
+        return true;
+    }
+
+    return false;
+}
+
+// copyPixels(): copy count pixels to dst, remapping them if needed, and return the number of bytes copied
+static DWORD copyPixels(BYTE *dst, const rleImage_t *img, DWORD first, DWORD count, const BYTE remap[]){
+    const BYTE *px = img->px + first * img->pixelSize;
+    DWORD size = count * img->pixelSize;
+    DWORD i;
+
+    if(remap == NULL)
+        memcpy(dst, px, size);
+    else
+        for(i = 0; i < size; ++i)
+            dst[i] = remap[px[i]];
+
+    return size;
+}
+
+
+#ifdef RLE_X86_SIMD
+__attribute__((target("sse2")))
+static DWORD eqMask8_SSE2(const BYTE *px){
+    __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)px), _mm_loadu_si128((const __m128i *)(px + 1)));
+    __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(px + 16)), _mm_loadu_si128((const __m128i *)(px + 17)));
+
+    return (DWORD)_mm_movemask_epi8(lo) | (DWORD)_mm_movemask_epi8(hi) << 16;
+}
+
+/* eqMask24_SSSE3(): each 16 byte load holds 5 pixels; they're spread to 32 bit lanes twice,
+** as pixels 0-3 and 1-4, so that a 32 bit comparison checks 4 pixels against their next one
+*/
+__attribute__((target("ssse3")))
+static DWORD eqMask24_SSSE3(const BYTE *px){
+    const __m128i curr = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i next = _mm_setr_epi8(3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1);
+    DWORD mask = 0;
+    unsigned i;
+    __m128i v;
+
+    for(i = 0; i < RLE_BLOCK_PIXELS; i += 4){
+        v = _mm_loadu_si128((const __m128i *)(px + i * 3));
+        v = _mm_cmpeq_epi32(_mm_shuffle_epi8(v, curr), _mm_shuffle_epi8(v, next));
+        mask |= (DWORD)_mm_movemask_ps(_mm_castsi128_ps(v)) << i;
+    }
+
+    return mask;
+}
+
+__attribute__((target("sse2")))
+static DWORD eqMask32_SSE2(const BYTE *px){
+    DWORD mask = 0;
+    unsigned i;
+    __m128i v;
+
+    for(i = 0; i < RLE_BLOCK_PIXELS; i += 4){
+        v = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(px + i * 4)), _mm_loadu_si128((const __m128i *)(px + i * 4 + 4)));
+        mask |= (DWORD)_mm_movemask_ps(_mm_castsi128_ps(v)) << i;
+    }
+
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static DWORD eqMask8_AVX2(const BYTE *px){
+    __m256i v = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)px), _mm256_loadu_si256((const __m256i *)(px + 1)));
+
+    return (DWORD)_mm256_movemask_epi8(v);
+}
+
+// eqMask24_AVX2(): same as eqMask24_SSSE3(), with 5 pixels loaded in each 128 bit lane
+__attribute__((target("avx2")))
+static DWORD eqMask24_AVX2(const BYTE *px){
+    const __m256i curr = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                          0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i next = _mm256_setr_epi8(3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1,
+                                          3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1);
+    DWORD mask = 0;
+    unsigned i;
+    __m256i v;
+
+    for(i = 0; i < RLE_BLOCK_PIXELS; i += 8){
+        v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(px + i * 3)));
+        v = _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i *)(px + i * 3 + 12)), 1);
+        v = _mm256_cmpeq_epi32(_mm256_shuffle_epi8(v, curr), _mm256_shuffle_epi8(v, next));
+        mask |= (DWORD)_mm256_movemask_ps(_mm256_castsi256_ps(v)) << i;
+    }
+
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static DWORD eqMask32_AVX2(const BYTE *px){
+    DWORD mask = 0;
+    unsigned i;
+    __m256i v;
+
+    for(i = 0; i < RLE_BLOCK_PIXELS; i += 8){
+        v = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(px + i * 4)), _mm256_loadu_si256((const __m256i *)(px + i * 4 + 4)));
+        mask |= (DWORD)_mm256_movemask_ps(_mm256_castsi256_ps(v)) << i;
+    }
+
+    return mask;
+}
+#endif
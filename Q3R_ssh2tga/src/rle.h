@@ -0,0 +1,90 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* TGA RLE encoder.
+**
+** Each packet starts with a count byte: if its MSB is set it's a RLE packet, followed by a single pixel
+** repeated (count & 0x7F) + 1 times, otherwise it's a raw packet followed by count + 1 pixels.
+**
+** The packets are chosen greedily: runs of identical pixels become RLE packets, and a raw packet
+** is broken as soon as a run that's worth encoding starts (2 identical pixels for 24/32 bit images,
+** 3 for 8 bit ones, since a 1 byte pixel isn't worth a count byte of its own).
+**
+** The run boundaries are found 32 pixels at a time from equality masks of neighbouring pixels
+** (SSE2/SSSE3 or AVX2, picked at runtime) and bit scans, and the raw packets are copied in bulk;
+** the output is the same with or without SIMD.
+**
+** The greedy choice isn't always the smallest (e.g. a pair of identical 8 bit pixels between two runs takes a byte less
+** as a RLE packet than as a raw one), though on actual images it's rarely more than a few bytes off;
+** when those bytes matter, there's an optimal encoder too (see rleOptimal_t).
+*/
+
+// the most pixels rle_encodeStream() can leave for the next call
+#define RLE_MAX_PENDING_PIXELS  128
+
+/* the encoder's state; the image can be encoded a piece at a time, as its pixels become available,
+** without holding the whole of it in memory
+*/
+typedef struct rleStream_s{
+    unsigned        pixelSize;  // 1, 3 or 4 bytes
+    const BYTE *    remap;      // if not NULL, the 8 bit pixels are replaced with their entry in it
+    DWORD           pixelCount; // pixels of the next RLE packet already counted by the previous call
+}rleStream_t;
+
+void rle_initStream(rleStream_t *stream, unsigned pixelSize, const BYTE remap[256]);
+
+/* rle_encodeStream(): encode the packets of numPixels pixels from src which don't depend on the pixels
+** coming next (all of them, if last is true) into dst, storing the encoded size in *encodedSize.
+** Returns the number of pixels consumed; the others (no more than RLE_MAX_PENDING_PIXELS) must be passed again, at the start
+** of the next call's pixels. dst must be at least twice as big as the pixels passed.
+*/
+DWORD rle_encodeStream(rleStream_t *stream, BYTE *dst, DWORD *encodedSize, const BYTE *src, DWORD numPixels, bool last);
+
+/* Optimal encoder: the smallest possible packets for the whole image, in two passes over its pixels.
+** rle_planOptimal() is fed all of the pixels, a piece at a time, and picks the packets with a dynamic program;
+** rle_finishPlan() tells their total size, then rle_encodeOptimal() is fed the same pixels again and writes them.
+**
+** With cost[i] being the size of the smallest packets for the first i pixels, the packet ending at each pixel is
+** either a RLE one, costing cost[start] + 1 + pixelSize, or a raw one, costing cost[start] + 1 + (i - start) * pixelSize,
+** with start no more than 128 pixels back. cost[] never decreases, so the best RLE packet starts as far back as possible
+** (at the start of the run of identical pixels, or 128 pixels back); the best raw packet starts where cost[j] - j * pixelSize
+** is the lowest among the last 128 positions, which a monotonic queue keeps track of. Either way it's O(1) per pixel.
+*/
+#define RLE_PLAN_WINDOW 256 // ring buffers' size: a power of 2 above the 129 positions a packet's choice looks at
+
+typedef struct rleOptimal_s{
+    unsigned        pixelSize;  // 1, 3 or 4 bytes
+    const BYTE *    remap;      // as for rleStream_t
+    BYTE *          packets;    // a count byte for each pixel: the one of the packet ending there, then starting there
+    DWORD           numPixels;  // pixels planned (or encoded) so far
+
+    // planning state
+    DWORD           costs[RLE_PLAN_WINDOW];     // cost[i], at i % RLE_PLAN_WINDOW
+    DWORD           queue[RLE_PLAN_WINDOW];     // positions with increasing cost[j] - j * pixelSize
+    DWORD           queueHead;
+    DWORD           queueTail;
+    DWORD           runStart;                   // first pixel of the run of identical pixels the last one is in
+    DWORD           prevPixel;                  // the last pixel's bytes, as a little endian number
+
+    // encoding state
+    DWORD           packetLeft; // pixels of the current packet yet to be written (or skipped, for a RLE packet)
+    bool            packetIsRaw;
+}rleOptimal_t;
+
+// rle_initOptimal(): packets must have room for a byte for each of the image's pixels
+void rle_initOptimal(rleOptimal_t *plan, unsigned pixelSize, const BYTE remap[256], BYTE *packets);
+void rle_planOptimal(rleOptimal_t *plan, const BYTE *src, DWORD numPixels);
+
+// rle_finishPlan(): once all of the pixels have been planned, return the encoded size and get ready to encode them
+DWORD rle_finishPlan(rleOptimal_t *plan);
+
+/* rle_encodeOptimal(): write the packets of the next numPixels pixels to dst, returning their size; a packet can span
+** more than one call. dst must be at least twice as big as the pixels passed
+*/
+DWORD rle_encodeOptimal(rleOptimal_t *plan, BYTE *dst, const BYTE *src, DWORD numPixels);
+
+#endif /* RLE_H */
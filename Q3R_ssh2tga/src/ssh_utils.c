@@ -2,103 +2,278 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <ctype.h>
 #include <errno.h>
 
 #include "ssh_utils.h"
 #include "tga_utils.h"
+#include "gputex_utils.h"
+#include "pixconv.h"
+#include "bcn.h"
+#include "rle.h"
+#include "cache.h"
+#include "threads.h"
 #include "types.h"
 
+/* The pixel data is converted a tile at a time, i.e. a few rows which fit in the cache (about TILE_SIZE bytes
+** once converted), and each tile is written to the output file (RLE encoded, if required) before converting
+** the next one; this way no buffer as big as the whole image is needed besides the ssh data.
+*/
+#define TILE_SIZE   (64 * 1024)
+
+/* BC compression splits each tile's block rows into bands, each compressed by a thread of its own
+** (see compressBands()); the bands are big enough to be worth handing to a thread
+*/
+#define BC_MAX_BANDS        64
+#define BC_MIN_BAND_BLOCKS  256
+
+// hash table slots for the colors of the truecolor images palettized by -out_shrink; 4 for each palette entry
+#define COLORSET_SLOTS  1024
+
+// how the ssh pixels are converted to tga ones
+typedef enum rowConv_e{
+    ROWCONV_INDEXES_8BPP,   // 8bpp palette indexes, copied as they are
+    ROWCONV_INDEXES_4BPP,   // 4bpp palette indexes, unpacked to 8bpp ones
+    ROWCONV_EXPAND_8BPP,    // 8bpp palette indexes, converted to 32 bit pixels
+    ROWCONV_EXPAND_4BPP,    // 4bpp palette indexes, converted to 32 bit pixels
+    ROWCONV_24_TO_24,
+    ROWCONV_32_TO_32,
+    ROWCONV_32_TO_24,
+    ROWCONV_RGBA_24,        // 24 bit pixels converted to RGBA ones, for the formats keeping ssh's channel order
+    ROWCONV_RGBA_32,        // 32 bit pixels copied as they are, as above
+    ROWCONV_PALETTIZE       // 24 or 32 bit pixels replaced with their index in a colorSet_t's palette
+}rowConv_t;
+
+/* the distinct colors of a truecolor image with no more than 256 of them, found by countColors():
+** an open addressing hash table of the pixels (as 32 bit values) with their index in the palette
+*/
+typedef struct colorSet_s{
+    DWORD           colors[COLORSET_SLOTS];
+    short           indexes[COLORSET_SLOTS];    // -1 for the empty slots
+    sshPixel32_t    palette[256];
+    DWORD           numColors;
+    DWORD           numRuns;                    // runs of identical pixels; RLE stores at least a pixel for each
+}colorSet_t;
+
+typedef struct imgConv_s{
+    const BYTE *            sshData;    // the image (or mipmap) to convert
+    DWORD                   width;
+    DWORD                   height;
+
+    rowConv_t               rowConv;
+    DWORD                   pixelSize;  // size of the converted pixels
+    bool                    flip;       // write the rows in bottom-top order
+    const BYTE *            remap;      // if not NULL, the palette indexes are replaced with their entry in it
+    const tgaPixel32_t *    palette;    // tga palette for the paletted images converted to truecolor
+    const colorSet_t *      colors;     // palette for ROWCONV_PALETTIZE
+}imgConv_t;
+
+// a band of a tile's block rows, compressed by compressBand()
+typedef struct bcBand_s{
+    bcFormat_t      format;
+    bcQuality_t     quality;
+    const BYTE *    pixels;
+    DWORD           width;
+    DWORD           height;
+    BYTE *          blocks;
+}bcBand_t;
+
+typedef struct bcCrew_s bcCrew_t;
+
+// a thread compressing one of the bands of each tile
+typedef struct bcWorker_s{
+    bcCrew_t *      crew;
+    DWORD           bandIdx;
+    thread_t *      thread;
+}bcWorker_t;
+
+/* the threads compressing an image's bands, started once for all of its tiles by startCrew();
+** band 0 is compressed by the thread converting the image, so there are BC_MAX_BANDS - 1 workers at most
+*/
+struct bcCrew_s{
+    mutex_t *       mutex;
+    cond_t *        cond;
+    bcBand_t        bands[BC_MAX_BANDS];
+    bcWorker_t      workers[BC_MAX_BANDS - 1];
+    DWORD           numWorkers;
+    DWORD           numBands;   // the current tile's
+    DWORD           tileSeq;    // incremented for each tile handed to the workers
+    DWORD           numDone;    // workers done with the current tile
+    bool            quit;
+};
 
-/************************* local functions' prototypes *************************/
-static bool openTgaFile(sshHandle_t *sshHandle);
 
-static void convertAndSave_shrink(sshHandle_t *sshHandle);
-static void convertAndSave_asIs(sshHandle_t *sshHandle);
-static void convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle);
+/************************* local functions' prototypes *************************/
+static bool readSshFile(sshHandle_t *sshHandle, sshScratch_t *scratch, DWORD *sshSize);
+static DWORD getNumEntries(const sshMainHdr_t *mainHdr, DWORD sshSize);
+static DWORD getNumResources(const BYTE *entries, DWORD numEntries, DWORD sshSize);
+static bool openOutFile(sshHandle_t *sshHandle, outFormat_t outFormat);
+static DWORD getImgDataSize(sshImgType_t imgType, DWORD width, DWORD height);
+static DWORD getMipMapSize(DWORD size, DWORD level);
+static BYTE *getScratchBuf(sshHandle_t *sshHandle, BYTE **buf, DWORD *bufSize, DWORD size);
+
+static bool convertAndSave_shrink(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, const convOptions_t *options, sshScratch_t *scratch);
+static bool convertAndSave_asIs(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, sshScratch_t *scratch);
+static bool convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, sshScratch_t *scratch);
+static bool convertAndSave_gpuTex(sshHandle_t *sshHandle, gputexCtx_t *gputexCtx, gputexFormat_t format, const convOptions_t *options, sshScratch_t *scratch);
+
+static void initImgConv(sshHandle_t *sshHandle, imgConv_t *conv, bool flip);
+static void initRgbaConv(sshHandle_t *sshHandle, imgConv_t *conv);
+static DWORD initTiles(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch, DWORD tileSize, bool rle);
+static void convertRows(sshHandle_t *sshHandle, const imgConv_t *conv, BYTE *dst, DWORD firstRow, DWORD numRows);
+static bool isStraightCopy(const imgConv_t *conv);
+static bool writeImageData(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch);
+static bool writeImageDataRLE(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch, bool sizeOnly, DWORD *encodedSize);
+static bool writeImageDataOptimalRLE(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch, bool sizeOnly, DWORD *encodedSize);
+static bool getShrunkDataSize(sshHandle_t *sshHandle, const imgConv_t *conv, const convOptions_t *options, sshScratch_t *scratch, DWORD *dataSize);
+static bool writeImageDataBC(sshHandle_t *sshHandle, const imgConv_t *conv, bcFormat_t format, const convOptions_t *options, sshScratch_t *scratch);
+static void startCrew(bcCrew_t *crew, DWORD maxWorkers);
+static void stopCrew(bcCrew_t *crew);
+static void compressBands(bcCrew_t *crew, const bcBand_t *tile);
+static void crewWorker(void *worker);
+static void compressBand(const bcBand_t *band);
+static void writeShrunkHdr(tgaCtx_t *tgaCtx, outFile_t *outFile);
+static void findUsedIndexes(sshHandle_t *sshHandle, BYTE used_indexes[256]);
+static bool initPalettized(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, tgaInitStruct_t *tgaInitStruct, imgConv_t *conv, colorSet_t *colors, const convOptions_t *options, sshScratch_t *scratch);
+static bool countColors(sshHandle_t *sshHandle, colorSet_t *colors);
+static void palettizePixels(const colorSet_t *colors, const BYTE *pixels, DWORD pixelSize, BYTE *dst, DWORD numPixels);
+static DWORD getPixelColor(const BYTE *pixel, DWORD pixelSize);
+static DWORD findColorSlot(const colorSet_t *colors, DWORD color);
 
 static bool isFullOpaque(sshHandle_t *sshHandle);
 static void paletteFix(sshHandle_t *sshHandle);
 
 // functions' definitions
-bool init_sshHandle(sshHandle_t *sshHandle, const char *sshPath){
-    FILE    *in_fp;
+bool init_sshHandle(sshHandle_t *sshHandle, const char *sshPath, DWORD resIndex, QWORD *fileHash, msgLog_t *log, sshScratch_t *scratch){
+    BYTE *          sshData;
+    DWORD           sshSize;    // the end of the image's data, which the sizes in its headers are checked against
+    DWORD           offset;
+
+    DWORD           numResources;
+    sshResEntry_t   resEntry;
 
     DWORD           imgDataSize;
     sshImgType_t    imgType;
     DWORD           nextHdrOffset;
 
+    DWORD           numMipMaps, mipMapSize, mipMapsSize, mipMapsEnd, i;
+
     DWORD           paletteDataSize;
     DWORD           paletteNumEntriesRead;
 
-    long            footerBytesToRead;
+    DWORD           footerBytesToRead;
+
+    sshHandle->sshPath = sshPath;
+    sshHandle->log =     log;
 
-    // open the ssh file
-    if((in_fp = fopen(sshPath, "rb")) == NULL){
-        fprintf(stderr, "Couldn't open %s: %s\n", sshPath, strerror(errno));
+    // read the whole ssh file at once
+    if(!readSshFile(sshHandle, scratch, &sshSize))
         return false;
-    }
+
+    sshData = scratch->sshBuf;
+
+    // before anything in the buffer is changed
+    if(fileHash != NULL)
+        *fileHash = cache_hash(sshData, sshSize);
 
     /*************** initialize fields ***************/
 
-    // read main header
-    fread(&(sshHandle->mainHdr), sizeof(sshHandle->mainHdr), 1, in_fp);
+    // main header
+    if(sshSize < sizeof(sshHandle->mainHdr) + sizeof(sshHandle->resEntry)){
+        msgLog_printf(log, "%s isn't a valid SSH file\n", sshPath);
+        return false;
+    }
+    memcpy(&(sshHandle->mainHdr), sshData, sizeof(sshHandle->mainHdr));
     if(sshHandle->mainHdr.magic != SSH_MAGICID){
-        fprintf(stderr, "%s isn't a valid SSH file\n", sshPath);
-        fclose(in_fp);
+        msgLog_printf(log, "%s isn't a valid SSH file\n", sshPath);
         return false;
     }
 
-    if(sshHandle->mainHdr.numResources > 1)
-        fprintf(stderr, "Warning: %s contains more than one image (%u images reported in the header)\n", sshPath, sshHandle->mainHdr.numResources);
+    // the reported size can't be trusted to be within the file
+    if(sshHandle->mainHdr.sshSize < sshSize)
+        sshSize = sshHandle->mainHdr.sshSize;
 
-    /* read the resource entry header, then skip to the resource data header offset specified in this header
-    ** (between resEntry and resHdr there's a "Buy ERTS" string without null-termination, sometimes followed by a series of
-    ** 0x00 values; nothing to care about)
+    numResources = getNumResources(sshData + sizeof(sshHandle->mainHdr), getNumEntries(&sshHandle->mainHdr, sshSize), sshSize);
+    // warned about once per file, rather than for each of its images
+    if(numResources < sshHandle->mainHdr.numResources && resIndex == 0)
+        msgLog_printf(log, "Warning: %s reports %u images in the header, %u found\n", sshPath, sshHandle->mainHdr.numResources, numResources);
+
+    if(resIndex >= numResources){
+        msgLog_printf(log, "%s has no image %u\n", sshPath, resIndex);
+        return false;
+    }
+
+    /* the resource entries follow the main header, one per image, and tell where each resource data header is
+    ** (between the entries and the first resHdr there's a "Buy ERTS" string without null-termination, sometimes
+    ** followed by a series of 0x00 values; nothing to care about)
     */
-    fread(&(sshHandle->resEntry), sizeof(sshHandle->resEntry), 1, in_fp);
-    fseek(in_fp, sshHandle->resEntry.dataOffset, SEEK_SET);
+    memcpy(&(sshHandle->resEntry), sshData + sizeof(sshHandle->mainHdr) + resIndex * sizeof(resEntry), sizeof(sshHandle->resEntry));
+    offset = sshHandle->resEntry.dataOffset;
+
+    // the image's data ends where the next one's starts, so that its palette and footer aren't taken from it
+    for(i = 0; i < numResources; ++i){
+        memcpy(&resEntry, sshData + sizeof(sshHandle->mainHdr) + i * sizeof(resEntry), sizeof(resEntry));
+        if(resEntry.dataOffset > offset && resEntry.dataOffset < sshSize)
+            sshSize = resEntry.dataOffset;
+    }
 
-    // read the resource data header
-    fread(&(sshHandle->resHdr), sizeof(sshHandle->resHdr), 1, in_fp);
+    // resource data header
+    if(offset > sshSize || sshSize - offset < sizeof(sshHandle->resHdr)){
+        msgLog_printf(log, "%s is truncated (no image header)\n", sshPath);
+        return false;
+    }
+    memcpy(&(sshHandle->resHdr), sshData + offset, sizeof(sshHandle->resHdr));
+    offset += sizeof(sshHandle->resHdr);
 
     imgType     = sshHandle->resHdr.nextHdrOffset_plus_imgType & 0xFF;
     nextHdrOffset = (sshHandle->resHdr.nextHdrOffset_plus_imgType >> 8);
 
-    /* calculate image data size;
-    ** also, make sure imgType holds a supported value.
-    */
-    imgDataSize = sshHandle->resHdr.width * sshHandle->resHdr.height;
-
+    // make sure imgType holds a supported value, then calculate image data size
     switch(imgType){
     case SSH_PALETTED_4BPP:
-        imgDataSize = (imgDataSize + 1) / 2;
-        break;
-
     case SSH_PALETTED_8BPP:
-        break;
-
     case SSH_TRUECOLOR_24BPP:
-        imgDataSize *= sizeof(sshPixel24_t);
-        break;
-
     case SSH_TRUECOLOR_32BPP:
-        imgDataSize *= sizeof(sshPixel32_t);
         break;
 
     default:
-        fprintf(stderr,"%s's image type is unknown (%u)\n", sshPath, imgType);
-        fclose(in_fp);
+        msgLog_printf(log, "%s's image type is unknown (%u)\n", sshPath, imgType);
         return false;
     }
 
+    imgDataSize = getImgDataSize(imgType, sshHandle->resHdr.width, sshHandle->resHdr.height);
 
-    // read the image data
-    if((sshHandle->imgData = malloc(imgDataSize)) == NULL){
-        fprintf(stderr, "Couldn't allocate %u bytes for %s's image data\n", imgDataSize, sshPath);
-        fclose(in_fp);
+    // the image data is used where it is in the file buffer
+    if(sshSize - offset < imgDataSize){
+        msgLog_printf(log, "%s is truncated (%u bytes of image data expected, %u found)\n", sshPath, imgDataSize, sshSize - offset);
         return false;
     }
-    fread(sshHandle->imgData, 1, imgDataSize, in_fp);
+    sshHandle->imgData = sshData + offset;
+
+    /* the mipmaps follow the image data, up to the palette header (or the end of the file);
+    ** only those which are actually there (and aren't smaller than a pixel) are kept
+    */
+    numMipMaps = sshHandle->resHdr.numMipMaps_plus_unk >> 4;
+    mipMapsEnd = sshSize - offset;
+    if(nextHdrOffset != 0 && nextHdrOffset - sizeof(sshHandle->resHdr) < mipMapsEnd)
+        mipMapsEnd = nextHdrOffset - sizeof(sshHandle->resHdr);
+
+    mipMapsSize = imgDataSize;
+    for(i = 1; i <= numMipMaps; ++i){
+        if((sshHandle->resHdr.width >> i) == 0 && (sshHandle->resHdr.height >> i) == 0)
+            break;
+
+        mipMapSize = getImgDataSize(imgType, getMipMapSize(sshHandle->resHdr.width, i), getMipMapSize(sshHandle->resHdr.height, i));
+        if(mipMapsSize + mipMapSize > mipMapsEnd)
+            break;
+
+        mipMapsSize += mipMapSize;
+    }
+
+    if(i <= numMipMaps)
+        msgLog_printf(log, "Warning: %s has %u mipmaps out of the %u reported in the header\n", sshPath, i - 1, numMipMaps);
+
+    sshHandle->numMipMaps = i - 1;
 
 
     /* some image headers report zero in the nextHdrOffset field; this means that no header is present at the end
@@ -110,55 +285,80 @@ bool init_sshHandle(sshHandle_t *sshHandle, const char *sshPath){
     */
     if(nextHdrOffset != 0){
         nextHdrOffset -= sizeof(sshHandle->resHdr); // remove the header size from the relative offset
-        fseek(in_fp, nextHdrOffset - imgDataSize, SEEK_CUR);    // skip mipmap data and/or filler bytes (if any)
+        offset += nextHdrOffset;                    // skip mipmap data and/or filler bytes (if any)
     }
+    else
+        offset += imgDataSize;
 
-    // read palette header and palette(if the image is paletted, that is)
+    // palette header and palette (if the image is paletted, that is)
     switch(imgType){
         case SSH_PALETTED_4BPP:
         case SSH_PALETTED_8BPP:
-            fread(&(sshHandle->paletteHdr), sizeof(sshHandle->paletteHdr), 1, in_fp);
+            if(offset > sshSize || sshSize - offset < sizeof(sshHandle->paletteHdr)){
+                msgLog_printf(log, "%s is truncated (no palette header)\n", sshPath);
+                return false;
+            }
+            memcpy(&(sshHandle->paletteHdr), sshData + offset, sizeof(sshHandle->paletteHdr));
+            offset += sizeof(sshHandle->paletteHdr);
 
             paletteDataSize = (sshHandle->paletteHdr.nextHdrOffset_plus_unk >> 8);
 
-            if(paletteDataSize == 0){
-                /* Sometimes there are more palette entries in the file than the reported value
-                ** in palNumEntries, and it's better to read them all (even though the image's
-                ** pixel indexes never go beyond palNumEntries' reported value)
-                */
-                paletteDataSize = sshHandle->mainHdr.sshSize - ftell(in_fp);
-                // we don't want any overflow
-                if(paletteDataSize > sizeof(sshHandle->palette))
-                   paletteDataSize = sizeof(sshHandle->palette);
-            }
+            /* Sometimes there are more palette entries in the file than the reported value
+            ** in palNumEntries, and it's better to read them all (even though the image's
+            ** pixel indexes never go beyond palNumEntries' reported value)
+            */
+            if(paletteDataSize == 0)
+                paletteDataSize = sshSize - offset;
             else    // if it's nonzero, it includes the size of the header which needs to be removed
                 paletteDataSize -= sizeof(sshHandle->paletteHdr);
 
-            paletteNumEntriesRead = paletteDataSize / sizeof(sshHandle->palette[0]);
-            fread(sshHandle->palette, sizeof(sshHandle->palette[0]), paletteNumEntriesRead, in_fp);
+            // we don't want to go past the end of the file or the palette
+            if(paletteDataSize > sshSize - offset)
+                paletteDataSize = sshSize - offset;
+            if(paletteDataSize > SSH_MAX_PALETTE_ENTRIES * sizeof(sshPixel32_t))
+                paletteDataSize = SSH_MAX_PALETTE_ENTRIES * sizeof(sshPixel32_t);
+
+            /* the converters size their palettes (and the tga's colour map) after palNumEntries,
+            ** so it can't go beyond the 256 entries of the buffers; those missing from the file
+            ** are still there, as black ones (see below)
+            */
+            if(sshHandle->paletteHdr.palNumEntries > SSH_MAX_PALETTE_ENTRIES){
+                msgLog_printf(log, "Warning: %s reports %u palette entries, only the first %u are used\n", sshPath, sshHandle->paletteHdr.palNumEntries, SSH_MAX_PALETTE_ENTRIES);
+                sshHandle->paletteHdr.palNumEntries = SSH_MAX_PALETTE_ENTRIES;
+            }
 
+            paletteNumEntriesRead = paletteDataSize / sizeof(sshPixel32_t);
+            sshHandle->palette = (sshPixel32_t *)(sshData + offset);
+            offset += paletteNumEntriesRead * sizeof(sshPixel32_t);
             break;
 
         case SSH_TRUECOLOR_24BPP:
         case SSH_TRUECOLOR_32BPP:
             paletteNumEntriesRead = 0;
+            sshHandle->palette = NULL;
             memset(&(sshHandle->paletteHdr), 0, sizeof(sshHandle->paletteHdr));
             break;
     }
 
-    /* read the footer header at the end of the file;
-    ** reset footer header's fields first, in case we don't read anything
+    /* copy the footer header at the end of the file;
+    ** reset footer header's fields first, in case there's nothing to copy
     ** due to the header's absence
     */
     sshHandle->footerHdr.unk = 0;
     sshHandle->footerHdr.fileName[0] = '\0';
 
     // we don't want any buffer overflow
-    footerBytesToRead = sshHandle->mainHdr.sshSize - ftell(in_fp);
+    footerBytesToRead = (offset < sshSize ? sshSize - offset : 0);
     if(footerBytesToRead > sizeof(sshHandle->footerHdr))
        footerBytesToRead = sizeof(sshHandle->footerHdr);
 
-    fread(&(sshHandle->footerHdr), 1, footerBytesToRead, in_fp);
+    memcpy(&(sshHandle->footerHdr), sshData + offset, footerBytesToRead);
+
+    /* the palette entries missing from the file are black; the file buffer has room for them,
+    ** and what they overwrite (if anything) has already been copied
+    */
+    if(sshHandle->palette != NULL)
+        memset(sshHandle->palette + paletteNumEntriesRead, 0, (SSH_MAX_PALETTE_ENTRIES - paletteNumEntriesRead) * sizeof(sshPixel32_t));
 
 
     /* initialize the other fields in the handle structure not directly tied
@@ -167,132 +367,149 @@ bool init_sshHandle(sshHandle_t *sshHandle, const char *sshPath){
     sshHandle->imgDataSize =            imgDataSize;
     sshHandle->imgType =                imgType;
     sshHandle->paletteNumEntriesRead =  paletteNumEntriesRead;
-    sshHandle->sshPath =                sshPath;
+    sshHandle->resIndex =               resIndex;
+    sshHandle->numResources =           numResources;
+
+    outFile_init(&sshHandle->outFile);  // it will be properly initialized by openOutFile()
+
+    return true;
+}
+
+
+bool ssh_readResTable(const char *sshPath, sshResTable_t *table){
+    FILE *          in_fp;
+    long            fileSize;
+    DWORD           sshSize;
+    DWORD           numEntries;
+    sshMainHdr_t    mainHdr;
+
+    table->numResources = 0;
+    table->entries = NULL;
+
+    if((in_fp = fopen(sshPath, "rb")) == NULL)
+        return false;
+
+    if(fread(&mainHdr, sizeof(mainHdr), 1, in_fp) != 1 || mainHdr.magic != SSH_MAGICID
+    || fseek(in_fp, 0, SEEK_END) != 0 || (fileSize = ftell(in_fp)) < 0
+    || (unsigned long)fileSize > SSH_MAX_FILE_SIZE || (unsigned long)fileSize < sizeof(mainHdr) + sizeof(sshResEntry_t)){
+        fclose(in_fp);
+        return false;
+    }
 
-    sshHandle->tgaImgBuf =              NULL; // it will be properly initialized by ssh_convertAndSave()
-    sshHandle->tgaExtraBuf =            NULL; // same as above(if used)
+    sshSize = mainHdr.sshSize < (DWORD)fileSize ? mainHdr.sshSize : (DWORD)fileSize;
+    numEntries = getNumEntries(&mainHdr, sshSize);
 
-    sshHandle->tga_fp =                 NULL; // it will be properly initialized by openTgaFile()
+    if((table->entries = malloc(numEntries * sizeof(*table->entries))) == NULL
+    || fseek(in_fp, sizeof(mainHdr), SEEK_SET) != 0
+    || fread(table->entries, sizeof(*table->entries), numEntries, in_fp) != numEntries){
+        fclose(in_fp);
+        ssh_freeResTable(table);
+        return false;
+    }
 
     fclose(in_fp);
+
+    // the same number of images init_sshHandle() finds
+    table->numResources = getNumResources((const BYTE *)table->entries, numEntries, sshSize);
     return true;
 }
 
+bool ssh_findResource(const sshResTable_t *table, const char *selector, DWORD *index){
+    size_t len = strlen(selector);
+    char *end;
+    DWORD i;
 
-bool ssh_convertAndSave(sshHandle_t *sshHandle, outFormat_t outFormat){
-    DWORD tgaBufSize = sshHandle->imgDataSize;
+    // a name made of digits only can't be selected, the index is
+    if(isdigit((unsigned char)selector[0])){
+        *index = strtoul(selector, &end, 10);
+        if(*end == '\0')
+            return *index < table->numResources;
+    }
 
-    // allocate/initialize tga's pixel buffer
-    switch(sshHandle->imgType){
-        case SSH_PALETTED_4BPP:
-            /* Unfortunately, TGA doesn't support 4bpp format, so if
-            ** SSH data is 4bpp we must convert it to 8 bpp
-            */
-            tgaBufSize *= 2;
-            if( (sshHandle->tgaImgBuf = malloc(tgaBufSize)) == NULL){
-                fprintf(stderr, "\n\tCouldn't allocate %u bytes for tga's pixel buffer\n", tgaBufSize);
-                return false;
-            }
-        {
-            BYTE *tgaData = sshHandle->tgaImgBuf;
-            BYTE *sshData = sshHandle->imgData;
+    // the names are padded with zeroes, if they're shorter than 4 characters
+    if(len == 0 || len > sizeof(table->entries->fileName2))
+        return false;
 
-            DWORD sshDataSize = sshHandle->imgDataSize;
+    for(i = 0; i < table->numResources; ++i)
+        if(memcmp(table->entries[i].fileName2, selector, len) == 0
+        && (len == sizeof(table->entries->fileName2) || table->entries[i].fileName2[len] == '\0')){
+            *index = i;
+            return true;
+        }
 
-            DWORD i = 0;
-            DWORD j = 0;
+    return false;
+}
 
-            while(i < sshDataSize){
-                tgaData[j++] = sshData[i] & 0xF; // take the low nibble
-                tgaData[j++] = sshData[i] >>  4; // take the high nibble
-                ++i;
-            }
-        }
-            break;
+void ssh_freeResTable(sshResTable_t *table){
+    free(table->entries);
+    table->entries = NULL;
+    table->numResources = 0;
+}
 
-        /* if it's 8bpp there's no need to allocate anything;
-        ** we can use ssh's pixel buffer directly, since it consists of palette indexes.
-        */
-        case SSH_PALETTED_8BPP:
-            sshHandle->tgaImgBuf = sshHandle->imgData;
-            // palette needs to be fixed for 8bpp entries
-            paletteFix(sshHandle);
-            break;
 
-        case SSH_TRUECOLOR_24BPP:
-        case SSH_TRUECOLOR_32BPP:
-            if( (sshHandle->tgaImgBuf = malloc(tgaBufSize)) == NULL){
-                fprintf(stderr, "\n\tCouldn't allocate %u bytes for tga's pixel buffer\n", tgaBufSize);
-                return false;
-            }
-            break;
-    }
+bool ssh_convertAndSave(sshHandle_t *sshHandle, const convOptions_t *options, sshScratch_t *scratch){
+    outFormat_t outFormat = options->outFormat;
+    tgaCtx_t tgaCtx;
+    gputexCtx_t gputexCtx;
+    bool success = false;
+
+    // palette needs to be fixed for 8bpp entries
+    if(sshHandle->imgType == SSH_PALETTED_8BPP)
+        paletteFix(sshHandle);
 
-    // create tga file
-    if(!openTgaFile(sshHandle))
+    // create the output file
+    if(!openOutFile(sshHandle, outFormat))
         return false;
 
     switch(outFormat){
         case OUT_SHRINK:
-            /* RLE encoding can result in bigger data size than the unencoded input data, so it's a good idea
-            ** to make the buffer for the encoded data twice as big as the input data size and check the
-            ** result afterwards
-            */
-            if( (sshHandle->tgaExtraBuf = malloc(tgaBufSize * 2)) == NULL){
-                fprintf(stderr, "\n\tCouldn't allocate %u bytes for tga's shrunk pixel buffer\n", tgaBufSize * 2);
-                return false;
-            }
-            convertAndSave_shrink(sshHandle);
+            success = convertAndSave_shrink(sshHandle, &tgaCtx, options, scratch);
             break;
 
         case OUT_AS_IS:
-            convertAndSave_asIs(sshHandle);
+            success = convertAndSave_asIs(sshHandle, &tgaCtx, scratch);
             break;
 
         case OUT_TRUECOLOR_UPSIDEDOWN:
-            /* if the image is paletted, tgaExtraBuf must be 4 times larger than the
-            ** original image data size, since it will be converted to truecolor 32bpp
-            */
-            if(sshHandle->paletteNumEntriesRead){
-                DWORD tgaExtraBufSize = tgaBufSize * sizeof(tgaPixel32_t);
-
-                if( (sshHandle->tgaExtraBuf = malloc(tgaExtraBufSize)) == NULL){
-                    fprintf(stderr, "\n\tCouldn't allocate %u bytes for tga's truecolor upside-down pixel buffer\n", tgaExtraBufSize);
-                    return false;
-                }
-            }
-            convertAndSave_truecolor_upsideDown(sshHandle);
+            success = convertAndSave_truecolor_upsideDown(sshHandle, &tgaCtx, scratch);
             break;
-    }
 
-    return true;
-}
+        case OUT_DDS:
+            success = convertAndSave_gpuTex(sshHandle, &gputexCtx, GPUTEX_DDS, options, scratch);
+            break;
 
-void free_sshHandleBuffers(sshHandle_t *sshHandle){
-    /* if ssh's image type is paletted 8bpp, tgaImgBuf points to the same buffer
-    ** imgData points to, so we change it to NULL to avoid doing a double-free
-    */
-    if(sshHandle->imgType == SSH_PALETTED_8BPP)
-        sshHandle->tgaImgBuf = NULL;
+        case OUT_KTX2:
+            success = convertAndSave_gpuTex(sshHandle, &gputexCtx, GPUTEX_KTX2, options, scratch);
+            break;
 
-    free(sshHandle->imgData);
-    free(sshHandle->tgaImgBuf);
-    free(sshHandle->tgaExtraBuf);
+        // BC3 is needed only for the alpha channel, as for -out_shrink dropping it
+        case OUT_DDS_BC:
+            success = convertAndSave_gpuTex(sshHandle, &gputexCtx,
+                                            isFullOpaque(sshHandle) ? GPUTEX_DDS_BC1 : GPUTEX_DDS_BC3,
+                                            options, scratch);
+            break;
 
-    if(sshHandle->tga_fp != NULL)
-        fclose(sshHandle->tga_fp);
-}
+        // the images are packed together by atlas.c rather than converted one by one
+        case OUT_ATLAS:
+            break;
+    }
 
+    // what's still queued (the header and palette in tgaCtx or gputexCtx, at least) is written here
+    if(success && !outFile_close(&sshHandle->outFile)){
+        msgLog_printf(sshHandle->log, "\n\tCouldn't write %s's converted file: %s\n", sshHandle->sshPath, strerror(errno));
+        success = false;
+    }
 
+    return success;
+}
 
-/************************* local functions' definitions *************************/
-static bool openTgaFile(sshHandle_t *sshHandle){
-    char    outFilename[FILENAME_MAX];
+void ssh_getOutPath(const sshHandle_t *sshHandle, outFormat_t outFormat, char *outPath){
+    const char *extension = outFormat == OUT_DDS || outFormat == OUT_DDS_BC ? ".dds" : outFormat == OUT_KTX2 ? ".ktx2" : ".tga";
     char *  filenameEndPtr;
-    char *  extPtr; // pointer to file extension that will be replaced to .tga
+    char *  extPtr; // pointer to file extension that will be replaced
 
-    strcpy(outFilename, sshHandle->sshPath);
-    filenameEndPtr = outFilename + strlen(outFilename);
+    strcpy(outPath, sshHandle->sshPath);
+    filenameEndPtr = outPath + strlen(outPath);
     extPtr = filenameEndPtr;
 
     do
@@ -300,241 +517,396 @@ static bool openTgaFile(sshHandle_t *sshHandle){
     while(  *extPtr != '.'  &&
             *extPtr != '\\' &&
             *extPtr != '/'  &&
-             extPtr != outFilename
+             extPtr != outPath
     );
 
-    // if the ssh file has no extension, append the .tga extension at the end of the filename
+    // if the ssh file has no extension, append the new extension at the end of the filename
     if(*extPtr != '.')
         extPtr = filenameEndPtr;
 
-    strcpy(extPtr, ".tga");
+    // the files containing more than one image get a file for each, numbered like them
+    if(sshHandle->numResources > 1)
+        sprintf(extPtr, "_%u%s", sshHandle->resIndex, extension);
+    else
+        strcpy(extPtr, extension);
+}
+
+bool ssh_normalizePs2Alpha(sshHandle_t *sshHandle){
+    BYTE *pixels;
+    DWORD numPixels, i;
+
+    if(sshHandle->palette != NULL){
+        pixels = (BYTE *)sshHandle->palette;
+        numPixels = sshHandle->paletteNumEntriesRead;
+    }
+    else if(sshHandle->imgType == SSH_TRUECOLOR_32BPP){
+        // the mipmaps too, which follow the image's pixels
+        pixels = sshHandle->imgData;
+        numPixels = 0;
+        for(i = 0; i <= sshHandle->numMipMaps; ++i)
+            numPixels += getMipMapSize(sshHandle->resHdr.width, i) * getMipMapSize(sshHandle->resHdr.height, i);
+    }
+    else
+        return false;
+
+    // any alpha value above 0x80 means the image doesn't use the PS2's range
+    if(numPixels == 0 || !pixconv_scanAlpha(pixels, numPixels, 0, 0x80))
+        return false;
+
+    pixconv_normalizePs2Alpha(pixels, numPixels);
+    return true;
+}
+
+BYTE *ssh_decodeRgba(sshHandle_t *sshHandle){
+    DWORD width  = sshHandle->resHdr.width;
+    DWORD height = sshHandle->resHdr.height;
+    imgConv_t conv;
+    BYTE *pixels;
+
+    if(sshHandle->imgType == SSH_PALETTED_8BPP)
+        paletteFix(sshHandle);
+
+    // as for the tile buffer, with room for an extra pixel
+    if((pixels = malloc(((size_t)width * height + 1) * sizeof(sshPixel32_t))) == NULL){
+        msgLog_printf(sshHandle->log, "\n\tCouldn't allocate %ux%u pixels for %s's image\n", width, height, sshHandle->sshPath);
+        return NULL;
+    }
+
+    initRgbaConv(sshHandle, &conv);
+    convertRows(sshHandle, &conv, pixels, 0, height);
+
+    return pixels;
+}
+
+// the ssh data and converted pixels' buffers are the scratch buffers, so there's only the output file to close (if a conversion failed)
+void free_sshHandleBuffers(sshHandle_t *sshHandle){
+    outFile_close(&sshHandle->outFile);
+}
+
+void init_sshScratch(sshScratch_t *scratch){
+    scratch->sshBuf = NULL;
+    scratch->sshBufSize = 0;
+    scratch->tileBuf = NULL;
+    scratch->tileBufSize = 0;
+    scratch->rleBuf = NULL;
+    scratch->rleBufSize = 0;
+    scratch->bcBuf = NULL;
+    scratch->bcBufSize = 0;
+    scratch->planBuf = NULL;
+    scratch->planBufSize = 0;
+    scratch->rleBytes = 0;
+    scratch->rleSeconds = 0;
+}
+
+void free_sshScratch(sshScratch_t *scratch){
+    free(scratch->sshBuf);
+    free(scratch->tileBuf);
+    free(scratch->rleBuf);
+    free(scratch->bcBuf);
+    free(scratch->planBuf);
+    init_sshScratch(scratch);
+}
+
+
+
+/************************* local functions' definitions *************************/
+
+/* readSshFile(): read the whole ssh file into the scratch buffer with a single fread(), storing its size in *sshSize;
+** the buffer has room for a full palette past the end of the file, in case the file's one is incomplete
+*/
+static bool readSshFile(sshHandle_t *sshHandle, sshScratch_t *scratch, DWORD *sshSize){
+    FILE *  in_fp;
+    long    fileSize;
+    DWORD   bufSize;
+
+    if((in_fp = fopen(sshHandle->sshPath, "rb")) == NULL){
+        msgLog_printf(sshHandle->log, "Couldn't open %s: %s\n", sshHandle->sshPath, strerror(errno));
+        return false;
+    }
+
+    // the file is read in one go, so stdio's own buffer would only be an extra copy (and allocation)
+    setvbuf(in_fp, NULL, _IONBF, 0);
+
+    if(fseek(in_fp, 0, SEEK_END) != 0 || (fileSize = ftell(in_fp)) < 0 || fseek(in_fp, 0, SEEK_SET) != 0){
+        msgLog_printf(sshHandle->log, "Couldn't get %s's size: %s\n", sshHandle->sshPath, strerror(errno));
+        fclose(in_fp);
+        return false;
+    }
+
+    if((unsigned long)fileSize > SSH_MAX_FILE_SIZE){
+        msgLog_printf(sshHandle->log, "%s is too big to be a SSH file (%ld bytes)\n", sshHandle->sshPath, fileSize);
+        fclose(in_fp);
+        return false;
+    }
+
+    bufSize = fileSize + SSH_MAX_PALETTE_ENTRIES * sizeof(sshPixel32_t);
+    if(bufSize > scratch->sshBufSize){
+        // the old contents don't matter, so there's no need to realloc()
+        free(scratch->sshBuf);
+        scratch->sshBufSize = 0;
+
+        if((scratch->sshBuf = malloc(bufSize)) == NULL){
+            msgLog_printf(sshHandle->log, "Couldn't allocate %u bytes for %s's data\n", bufSize, sshHandle->sshPath);
+            fclose(in_fp);
+            return false;
+        }
+        scratch->sshBufSize = bufSize;
+    }
 
-    if( (sshHandle->tga_fp = fopen(outFilename, "wb") ) == NULL){
-        fprintf(stderr, "\n\tCouldn't create file %s: %s\n", outFilename, strerror(errno));
+    if(fread(scratch->sshBuf, 1, fileSize, in_fp) != (size_t)fileSize){
+        msgLog_printf(sshHandle->log, "Couldn't read %s\n", sshHandle->sshPath);
+        fclose(in_fp);
         return false;
     }
 
+    fclose(in_fp);
+    *sshSize = fileSize;
     return true;
 }
 
+// openOutFile(): create the output file, named after the ssh file with its extension replaced
+static bool openOutFile(sshHandle_t *sshHandle, outFormat_t outFormat){
+    char    outFilename[FILENAME_MAX];
+
+    ssh_getOutPath(sshHandle, outFormat, outFilename);
 
-static void convertAndSave_shrink(sshHandle_t *sshHandle){
-    unsigned i;
+    // an existing file may be hard linked to another image's (see cache.h), which must be left as it is
+    remove(outFilename);
 
-    /* some aliases to avoid bloating the code too much with long variable names
-    ** which include the structure(s) they belong to
-    */
-    BYTE        *sshData = sshHandle->imgData;
-    BYTE        *tgaData = sshHandle->tgaImgBuf;
-    BYTE        *tgaShrunkData = sshHandle->tgaExtraBuf;
+    if(!outFile_open(&sshHandle->outFile, outFilename)){
+        msgLog_printf(sshHandle->log, "\n\tCouldn't create file %s: %s\n", outFilename, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// getNumEntries(): the number of resource entries reported in the header which are within sshSize bytes (at least one)
+static DWORD getNumEntries(const sshMainHdr_t *mainHdr, DWORD sshSize){
+    DWORD maxEntries = 1;
+
+    if(sshSize > sizeof(*mainHdr) + sizeof(sshResEntry_t))
+        maxEntries = (sshSize - sizeof(*mainHdr)) / sizeof(sshResEntry_t);
+
+    if(mainHdr->numResources == 0)
+        return 1;
+
+    return mainHdr->numResources < maxEntries ? mainHdr->numResources : maxEntries;
+}
+
+/* getNumResources(): the number of images in the file, i.e. its entries up to the first one overlapping
+** the images' data or pointing past the end of the file, as happens if the header's count is bogus;
+** the first entry is always taken, and init_sshHandle() checks it like it checks the image
+*/
+static DWORD getNumResources(const BYTE *entries, DWORD numEntries, DWORD sshSize){
+    sshResEntry_t entry;
+    DWORD firstData, i;
+
+    memcpy(&entry, entries, sizeof(entry));
+    firstData = entry.dataOffset;
+
+    for(i = 1; i < numEntries; ++i){
+        memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+
+        if(entry.dataOffset < firstData)
+            firstData = entry.dataOffset;
+
+        if(entry.dataOffset >= sshSize || sizeof(sshMainHdr_t) + (i + 1) * sizeof(entry) > firstData)
+            break;
+    }
+
+    return i;
+}
+
+// getImgDataSize(): size in bytes of a width x height ssh image's data
+static DWORD getImgDataSize(sshImgType_t imgType, DWORD width, DWORD height){
+    switch(imgType){
+        case SSH_PALETTED_4BPP:
+            return (width * height + 1) / 2;
+
+        case SSH_PALETTED_8BPP:
+            return width * height;
+
+        case SSH_TRUECOLOR_24BPP:
+            return width * height * sizeof(sshPixel24_t);
+
+        case SSH_TRUECOLOR_32BPP:
+            return width * height * sizeof(sshPixel32_t);
+    }
 
-    BYTE        *bufToWrite;
-    DWORD       bufToWrite_size;
+    return 0;
+}
+
+// getMipMapSize(): a mip level's width or height, halved at each level but never less than a pixel
+static DWORD getMipMapSize(DWORD size, DWORD level){
+    size >>= level;
+    return size ? size : 1;
+}
+
+// getScratchBuf(): make sure a scratch buffer is at least size bytes big, returning it
+static BYTE *getScratchBuf(sshHandle_t *sshHandle, BYTE **buf, DWORD *bufSize, DWORD size){
+    BYTE *newBuf;
+
+    if(size <= *bufSize)
+        return *buf;
+
+    // the old contents don't matter, so there's no need to realloc()
+    free(*buf);
+    *bufSize = 0;
+
+    if((*buf = newBuf = malloc(size)) == NULL){
+        msgLog_printf(sshHandle->log, "\n\tCouldn't allocate %u bytes for the converted pixels' buffer\n", size);
+        return NULL;
+    }
 
-    DWORD       sshDataSize = sshHandle->imgDataSize;
-    DWORD       tgaDataSize;
-    int         tgaDataShrunkSize;
+    *bufSize = size;
+    return newBuf;
+}
 
 
+static bool convertAndSave_shrink(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, const convOptions_t *options, sshScratch_t *scratch){
     DWORD width  = sshHandle->resHdr.width;
     DWORD height = sshHandle->resHdr.height;
-    WORD numPalEntries = sshHandle->paletteHdr.palNumEntries;
-    FILE *tga_fp = sshHandle->tga_fp;   // file pointer (previously opened)
 
-    // fields used for truecolor images only
-    DWORD numPixels;
-    sshPixel24_t *ssh24Data;
-    tgaPixel24_t *tga24Data;
-    sshPixel32_t *ssh32Data;
-    tgaPixel32_t *tga32Data;
+    imgConv_t conv;
+    DWORD encodedSize;
+    colorSet_t colors;
+
+    // palette indexes used by the image, which become their indexes in the shrunk palette
+    BYTE used_indexes[256] = {0};
 
     // tga structure to be passed to tga_initHdr()
     tgaInitStruct_t tgaInitStruct;
     tgaInitStruct.width = width;
     tgaInitStruct.height = height;
 
+    initImgConv(sshHandle, &conv, false);
+
 
     switch(sshHandle->imgType){
         case SSH_PALETTED_4BPP:
         case SSH_PALETTED_8BPP:
-            tgaDataSize = width * height;
+            conv.rowConv = sshHandle->imgType == SSH_PALETTED_4BPP ? ROWCONV_INDEXES_4BPP : ROWCONV_INDEXES_8BPP;
+            conv.pixelSize = 1;
+
             tgaInitStruct.PixelDepth = 8;
             tgaInitStruct.isCMapped = PALETTED;
+            tgaInitStruct.imgType = IMGTYPE_COLORMAPPED_RLE;
 
+            findUsedIndexes(sshHandle, used_indexes);
+
+            /* the whole palette buffer is converted, since the indexes aren't checked against palNumEntries
+            ** (the entries missing from the file are zeroed there), so that no used entry is left uninitialized
+            */
             if(isFullOpaque(sshHandle)){
                 tgaInitStruct.CMapDepth = 24;
                 tgaInitStruct.ImageDesc = ATTRIB_BITS_0 | TOP_LEFT;
-                tga_sshToTgaPal24(sshHandle->palette, numPalEntries);
+                tga_sshToTgaPal24(tgaCtx, sshHandle->palette, SSH_MAX_PALETTE_ENTRIES);
+                tgaInitStruct.CMapLen = tga_shrinkPalette24(tgaCtx, used_indexes);
             }
             else{
                 tgaInitStruct.CMapDepth = 32;
                 tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | TOP_LEFT;
-                tga_sshToTgaPal32(sshHandle->palette, numPalEntries);
-            }
-
-            // compress image data
-            tgaDataShrunkSize = tga_shrink8bpp(tgaShrunkData, tgaData, tgaDataSize, tgaInitStruct.CMapDepth, &numPalEntries);
-            tgaInitStruct.CMapLen = numPalEntries;
-
-
-            // if RLE encoding resulted in increased size, save uncompressed data
-            if(tgaDataShrunkSize == -1){
-                bufToWrite = tgaData;
-                bufToWrite_size = tgaDataSize;
-                tgaInitStruct.imgType = IMGTYPE_COLORMAPPED;
-            }
-            // otherwise, save compressed data
-            else{
-                bufToWrite = tgaShrunkData;
-                bufToWrite_size = tgaDataShrunkSize;
-                tgaInitStruct.imgType = IMGTYPE_COLORMAPPED_RLE;
+                tga_sshToTgaPal32(tgaCtx, sshHandle->palette, SSH_MAX_PALETTE_ENTRIES);
+                tgaInitStruct.CMapLen = tga_shrinkPalette32(tgaCtx, used_indexes);
             }
 
+            // the indexes are moved to the shrunk palette's entries while being written
+            conv.remap = used_indexes;
             break;
 
         case SSH_TRUECOLOR_24BPP:
-            tgaDataSize = sshDataSize;
+            conv.rowConv = ROWCONV_24_TO_24;
+            conv.pixelSize = sizeof(tgaPixel24_t);
+
             tgaInitStruct.isCMapped = NO_PALETTE;
+            tgaInitStruct.imgType = IMGTYPE_TRUECOLOR_RLE;
             tgaInitStruct.PixelDepth = 24;
             tgaInitStruct.CMapDepth = 0;
             tgaInitStruct.CMapLen = 0;
             tgaInitStruct.ImageDesc = ATTRIB_BITS_0 | TOP_LEFT;
-
-            // convert image from ssh to tga pixel format
-            numPixels = sshDataSize / sizeof(sshPixel24_t);
-            ssh24Data = sshData;
-            tga24Data = tgaData;
-
-            for(i = 0; i < numPixels; ++i){
-                tga24Data[i].red   =    ssh24Data[i].red;
-                tga24Data[i].green =    ssh24Data[i].green;
-                tga24Data[i].blue  =    ssh24Data[i].blue;
-            }
-
-            // compress image data
-            tgaDataShrunkSize = tga_shrink24bpp(tgaShrunkData, tga24Data, tgaDataSize);
-
-            // if RLE encoding resulted in increased size, save uncompressed data
-            if(tgaDataShrunkSize == -1){
-                bufToWrite = tgaData;
-                bufToWrite_size = tgaDataSize;
-                tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
-            }
-            // otherwise, save compressed data
-            else{
-                bufToWrite = tgaShrunkData;
-                bufToWrite_size = tgaDataShrunkSize;
-                tgaInitStruct.imgType = IMGTYPE_TRUECOLOR_RLE;
-            }
-
             break;
 
-        case SSH_TRUECOLOR_32BPP:
+        // SSH_TRUECOLOR_32BPP, the only type left once init_sshHandle() has checked it
+        default:
             tgaInitStruct.isCMapped = NO_PALETTE;
+            tgaInitStruct.imgType = IMGTYPE_TRUECOLOR_RLE;
             tgaInitStruct.CMapDepth = 0;
             tgaInitStruct.CMapLen = 0;
 
-            // convert image from ssh to tga pixel format
+            // the alpha channel is dropped if it's fully opaque
             if(isFullOpaque(sshHandle)){
-                tgaDataSize = (sshDataSize * sizeof(tgaPixel24_t) ) / sizeof(tgaPixel32_t);
+                conv.rowConv = ROWCONV_32_TO_24;
+                conv.pixelSize = sizeof(tgaPixel24_t);
                 tgaInitStruct.PixelDepth = 24;
                 tgaInitStruct.ImageDesc = ATTRIB_BITS_0 | TOP_LEFT;
-
-                numPixels = sshDataSize / sizeof(sshPixel32_t);
-                ssh32Data = sshData;
-                tga24Data = tgaData;
-
-                for(i = 0; i < numPixels; ++i){
-                    tga24Data[i].red   =    ssh32Data[i].red;
-                    tga24Data[i].green =    ssh32Data[i].green;
-                    tga24Data[i].blue  =    ssh32Data[i].blue;
-                }
-
-                // compress image data
-                tgaDataShrunkSize = tga_shrink24bpp(tgaShrunkData, tga24Data, tgaDataSize);
             }
             else{
-                tgaDataSize = sshDataSize;
+                conv.rowConv = ROWCONV_32_TO_32;
+                conv.pixelSize = sizeof(tgaPixel32_t);
                 tgaInitStruct.PixelDepth = 32;
                 tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | TOP_LEFT;
-                numPixels = sshDataSize / sizeof(sshPixel32_t);
-                ssh32Data = sshData;
-                tga32Data = tgaData;
-
-                for(i = 0; i < numPixels; ++i){
-                    tga32Data[i].red   =    ssh32Data[i].red;
-                    tga32Data[i].green =    ssh32Data[i].green;
-                    tga32Data[i].blue  =    ssh32Data[i].blue;
-                    tga32Data[i].alpha =    ssh32Data[i].alpha;
-                }
-
-                // compress image data
-                tgaDataShrunkSize = tga_shrink32bpp(tgaShrunkData, tga32Data, tgaDataSize);
-            }
-
-            // if RLE encoding resulted in increased size, save uncompressed data
-            if(tgaDataShrunkSize == -1){
-                bufToWrite = tgaData;
-                bufToWrite_size = tgaDataSize;
-                tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
-            }
-            // otherwise, save compressed data
-            else{
-                bufToWrite = tgaShrunkData;
-                bufToWrite_size = tgaDataShrunkSize;
-                tgaInitStruct.imgType = IMGTYPE_TRUECOLOR_RLE;
             }
-
             break;
     }
 
-    // save the tga file
-    tga_initHdr(&tgaInitStruct);
-    tga_writeHdr(tga_fp);
-
-    if(numPalEntries){
-        if(tgaInitStruct.CMapDepth == 24)
-            tga_writeShrunkPalette24(tga_fp);
-        else
-            tga_writeShrunkPalette32(tga_fp);
+    // truecolor images with no more than 256 colors are saved paletted instead, if that makes them smaller
+    if(sshHandle->imgType == SSH_TRUECOLOR_24BPP || sshHandle->imgType == SSH_TRUECOLOR_32BPP){
+        if(!initPalettized(sshHandle, tgaCtx, &tgaInitStruct, &conv, &colors, options, scratch))
+            return false;
     }
 
-    fwrite(bufToWrite, 1, bufToWrite_size, tga_fp);
-}
+    // save the tga file, RLE encoded
+    tga_initHdr(tgaCtx, &tgaInitStruct);
+    writeShrunkHdr(tgaCtx, &sshHandle->outFile);
 
-static void convertAndSave_asIs(sshHandle_t *sshHandle){
-    unsigned i;
-    /* some aliases to avoid bloating the code too much with long variable names
-    ** which include the structure(s) they belong to
+    if(options->rleOptimal){
+        if(!writeImageDataOptimalRLE(sshHandle, &conv, scratch, false, &encodedSize))
+            return false;
+    }
+    else if(!writeImageDataRLE(sshHandle, &conv, scratch, false, &encodedSize))
+        return false;
+
+    /* if RLE encoding resulted in increased size, save uncompressed data instead;
+    ** the file is started over (which for images fitting in a tile just drops the queued data, since none of it has been written yet)
     */
-    BYTE        *sshData = sshHandle->imgData;
-    BYTE        *tgaData = sshHandle->tgaImgBuf;
+    if(encodedSize >= width * height * conv.pixelSize){
+        if(!outFile_restart(&sshHandle->outFile)){
+            msgLog_printf(sshHandle->log, "\n\tCouldn't truncate %s's tga file: %s\n", sshHandle->sshPath, strerror(sshHandle->outFile.error));
+            return false;
+        }
 
-    DWORD       sshDataSize = sshHandle->imgDataSize;
-    DWORD       tgaDataSize;
+        tgaInitStruct.imgType = tgaInitStruct.isCMapped == PALETTED ? IMGTYPE_COLORMAPPED : IMGTYPE_TRUECOLOR;
+        tga_initHdr(tgaCtx, &tgaInitStruct);
+        writeShrunkHdr(tgaCtx, &sshHandle->outFile);
 
+        return writeImageData(sshHandle, &conv, scratch);
+    }
+
+    return true;
+}
+
+static bool convertAndSave_asIs(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, sshScratch_t *scratch){
     DWORD width  = sshHandle->resHdr.width;
     DWORD height = sshHandle->resHdr.height;
     DWORD numPalEntries = sshHandle->paletteHdr.palNumEntries;
-    FILE *tga_fp = sshHandle->tga_fp;   // file pointer (previously opened)
+    outFile_t *outFile = &sshHandle->outFile;   // previously opened
 
-    // fields used for truecolor images only
-    DWORD numPixels;
-    sshPixel24_t *ssh24Data;
-    tgaPixel24_t *tga24Data;
-    sshPixel32_t *ssh32Data;
-    tgaPixel32_t *tga32Data;
+    imgConv_t conv;
 
     // tga structure to be passed to tga_initHdr()
     tgaInitStruct_t tgaInitStruct;
     tgaInitStruct.width = width;
     tgaInitStruct.height = height;
 
+    initImgConv(sshHandle, &conv, false);
+
 
     switch(sshHandle->imgType){
         case SSH_PALETTED_4BPP:
         case SSH_PALETTED_8BPP:
-            tgaDataSize = width * height;
+            conv.rowConv = sshHandle->imgType == SSH_PALETTED_4BPP ? ROWCONV_INDEXES_4BPP : ROWCONV_INDEXES_8BPP;
+            conv.pixelSize = 1;
 
             tgaInitStruct.PixelDepth = 8;
             tgaInitStruct.isCMapped = PALETTED;
@@ -543,12 +915,13 @@ static void convertAndSave_asIs(sshHandle_t *sshHandle){
             tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | TOP_LEFT;
             tgaInitStruct.CMapLen = numPalEntries;
 
-            tga_sshToTgaPal32(sshHandle->palette, numPalEntries);
+            tga_sshToTgaPal32(tgaCtx, sshHandle->palette, numPalEntries);
 
             break;
 
         case SSH_TRUECOLOR_24BPP:
-            tgaDataSize = sshDataSize;
+            conv.rowConv = ROWCONV_24_TO_24;
+            conv.pixelSize = sizeof(tgaPixel24_t);
 
             tgaInitStruct.isCMapped = NO_PALETTE;
             tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
@@ -557,21 +930,11 @@ static void convertAndSave_asIs(sshHandle_t *sshHandle){
             tgaInitStruct.CMapLen = 0;
             tgaInitStruct.ImageDesc = ATTRIB_BITS_0 | TOP_LEFT;
 
-            // convert image from ssh to tga pixel format
-            numPixels = sshDataSize / sizeof(sshPixel24_t);
-            ssh24Data = sshData;
-            tga24Data = tgaData;
-
-            for(i = 0; i < numPixels; ++i){
-                tga24Data[i].red   =    ssh24Data[i].red;
-                tga24Data[i].green =    ssh24Data[i].green;
-                tga24Data[i].blue  =    ssh24Data[i].blue;
-            }
-
-            break;
+            break;
 
         case SSH_TRUECOLOR_32BPP:
-            tgaDataSize = sshDataSize;
+            conv.rowConv = ROWCONV_32_TO_32;
+            conv.pixelSize = sizeof(tgaPixel32_t);
 
             tgaInitStruct.isCMapped = NO_PALETTE;
             tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
@@ -580,59 +943,25 @@ static void convertAndSave_asIs(sshHandle_t *sshHandle){
             tgaInitStruct.PixelDepth = 32;
             tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | TOP_LEFT;
 
-            // convert image from ssh to tga pixel format
-            numPixels = sshDataSize / sizeof(sshPixel32_t);
-            ssh32Data = sshData;
-            tga32Data = tgaData;
-
-            for(i = 0; i < numPixels; ++i){
-                tga32Data[i].red   =    ssh32Data[i].red;
-                tga32Data[i].green =    ssh32Data[i].green;
-                tga32Data[i].blue  =    ssh32Data[i].blue;
-                tga32Data[i].alpha =    ssh32Data[i].alpha;
-            }
-
             break;
     }
 
     // save the tga file
-    tga_initHdr(&tgaInitStruct);
-    tga_writeHdr(tga_fp);
-
-    if(numPalEntries)
-        tga_writePalette32(tga_fp);
+    tga_initHdr(tgaCtx, &tgaInitStruct);
+    tga_writeHdr(tgaCtx, outFile);
 
+    if(tgaInitStruct.isCMapped == PALETTED)
+        tga_writePalette32(tgaCtx, outFile);
 
-    fwrite(tgaData, 1, tgaDataSize, tga_fp);
+    return writeImageData(sshHandle, &conv, scratch);
 }
 
-static void convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle){
-    unsigned i;
-
-    /* some aliases to avoid bloating the code too much with long variable names
-    ** which include the structure(s) they belong to
-    */
-    BYTE    *sshData = sshHandle->imgData;
-    BYTE    *tgaData = sshHandle->tgaImgBuf;
-
-    BYTE    *bufToWrite;
-    DWORD   bufToWrite_size;
-
-    DWORD   sshDataSize = sshHandle->imgDataSize;
-
+static bool convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, sshScratch_t *scratch){
     DWORD width  = sshHandle->resHdr.width;
     DWORD height = sshHandle->resHdr.height;
-    DWORD numPalEntries = sshHandle->paletteHdr.palNumEntries;
-    FILE *tga_fp = sshHandle->tga_fp;   // file pointer (previously opened)
-
-    // fields used for truecolor images only
-    sshPixel24_t *ssh24Data;
-    tgaPixel24_t *tga24Data;
-    sshPixel32_t *ssh32Data;
-    tgaPixel32_t *tga32Data;
+    outFile_t *outFile = &sshHandle->outFile;   // previously opened
 
-    tgaPixel24_t *tgaCurrRow24;
-    tgaPixel32_t *tgaCurrRow32;
+    imgConv_t conv;
 
     // tga structure to be passed to tga_initHdr()
     tgaInitStruct_t tgaInitStruct;
@@ -644,12 +973,17 @@ static void convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle){
     */
     tgaPixel32_t tgaPal[256];
 
+    // all the rows are put in upside-down order
+    initImgConv(sshHandle, &conv, true);
+
 
     switch(sshHandle->imgType){
         case SSH_PALETTED_4BPP:
         case SSH_PALETTED_8BPP:
-            bufToWrite = sshHandle->tgaExtraBuf;
-            bufToWrite_size = width * height * sizeof(tgaPixel32_t);
+            // the indexes are converted to truecolor pixels
+            conv.rowConv = sshHandle->imgType == SSH_PALETTED_4BPP ? ROWCONV_EXPAND_4BPP : ROWCONV_EXPAND_8BPP;
+            conv.pixelSize = sizeof(tgaPixel32_t);
+            conv.palette = tgaPal;
 
             tgaInitStruct.PixelDepth = 32;
             tgaInitStruct.isCMapped = NO_PALETTE;
@@ -658,34 +992,15 @@ static void convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle){
             tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | BOTTOM_LEFT;
             tgaInitStruct.CMapLen = 0;
 
-            // convert palette to tga's pixel format
-            for(i = 0; i < numPalEntries; ++i){
-                tgaPal[i].blue = sshHandle->palette[i].blue;
-                tgaPal[i].green = sshHandle->palette[i].green;
-                tgaPal[i].red = sshHandle->palette[i].red;
-                tgaPal[i].alpha = sshHandle->palette[i].alpha;
-            }
-
-            /* convert indexes to truecolor pixels;
-            ** also, put them in upside-down row order
-            */
-            tga32Data = bufToWrite;
-
-            // let tgaCurrRow32 point to the last row of the dest. buffer
-            tgaCurrRow32 = &tga32Data[width * (height - 1)];
-
-            do{
-                for(int y = 0; y < width; ++y)
-                    tgaCurrRow32[y] = tgaPal[*tgaData++];
-                tgaCurrRow32 -= width;
-            }while(tgaCurrRow32 >= tga32Data);
+            // convert palette to tga's pixel format, all of it as for -out_shrink
+            pixconv_convert(PIXCONV_32_TO_32, sshHandle->palette, tgaPal, SSH_MAX_PALETTE_ENTRIES);
 
             break;
 
 
         case SSH_TRUECOLOR_24BPP:
-            bufToWrite = tgaData;
-            bufToWrite_size = sshDataSize;
+            conv.rowConv = ROWCONV_24_TO_24;
+            conv.pixelSize = sizeof(tgaPixel24_t);
 
             tgaInitStruct.isCMapped = NO_PALETTE;
             tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
@@ -694,98 +1009,790 @@ static void convertAndSave_truecolor_upsideDown(sshHandle_t *sshHandle){
             tgaInitStruct.CMapLen = 0;
             tgaInitStruct.ImageDesc = ATTRIB_BITS_0 | BOTTOM_LEFT;
 
-            /* convert image from ssh to tga pixel format;
-            ** also, put rows in upside-down order
-            */
-            ssh24Data = sshData;
-            tga24Data = tgaData;
+            break;
 
 
-            // let tgaCurrRow24 point to the last row of the dest. buffer
-            tgaCurrRow24 = &tga24Data[width * (height - 1)];
+        case SSH_TRUECOLOR_32BPP:
+            conv.rowConv = ROWCONV_32_TO_32;
+            conv.pixelSize = sizeof(tgaPixel32_t);
 
-            do{
-                for(int y = 0; y < width; ++y){
-                    tgaCurrRow24[y].red = ssh24Data->red;
-                    tgaCurrRow24[y].green = ssh24Data->green;
-                    tgaCurrRow24[y].blue = ssh24Data->blue;
+            tgaInitStruct.isCMapped = NO_PALETTE;
+            tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
+            tgaInitStruct.CMapDepth = 0;
+            tgaInitStruct.CMapLen = 0;
+            tgaInitStruct.PixelDepth = 32;
+            tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | BOTTOM_LEFT;
+
+            break;
+    }
+
+    // save the tga file
+    tga_initHdr(tgaCtx, &tgaInitStruct);
+    tga_writeHdr(tgaCtx, outFile);
 
-                    ++ssh24Data;
-                }
-                tgaCurrRow24 -= width;
-            }while(tgaCurrRow24 >= tga24Data);
+    return writeImageData(sshHandle, &conv, scratch);
+}
 
+
+/* convertAndSave_gpuTex(): save the image and its mipmaps as a DDS or KTX2 file, with RGBA8 pixels
+** (BC1/BC3 compressed ones for GPUTEX_DDS_BC1/GPUTEX_DDS_BC3)
+*/
+static bool convertAndSave_gpuTex(sshHandle_t *sshHandle, gputexCtx_t *gputexCtx, gputexFormat_t format, const convOptions_t *options, sshScratch_t *scratch){
+    DWORD width  = sshHandle->resHdr.width;
+    DWORD height = sshHandle->resHdr.height;
+    DWORD numLevels = sshHandle->numMipMaps + 1;
+
+    imgConv_t conv;
+
+    const BYTE *levelData[GPUTEX_MAX_LEVELS];   // where each mip level starts in the ssh data
+    DWORD level, i;
+
+    initRgbaConv(sshHandle, &conv);
+
+    // the mipmaps are stored one after the other, right after the main image
+    levelData[0] = sshHandle->imgData;
+    for(level = 1; level < numLevels; ++level)
+        levelData[level] = levelData[level - 1] + getImgDataSize(sshHandle->imgType, getMipMapSize(width, level - 1), getMipMapSize(height, level - 1));
+
+    gputex_writeHdr(gputexCtx, &sshHandle->outFile, format, width, height, numLevels);
+
+    for(i = 0; i < numLevels; ++i){
+        level = gputex_levelOrder(gputexCtx, i, numLevels);
+
+        conv.sshData = levelData[level];
+        conv.width = getMipMapSize(width, level);
+        conv.height = getMipMapSize(height, level);
+
+        if(format == GPUTEX_DDS_BC1 || format == GPUTEX_DDS_BC3){
+            if(!writeImageDataBC(sshHandle, &conv, format == GPUTEX_DDS_BC1 ? BC_FORMAT_BC1 : BC_FORMAT_BC3, options, scratch))
+                return false;
+        }
+        else if(!writeImageData(sshHandle, &conv, scratch))
+            return false;
+
+        // the next level reuses the tile (or blocks) buffer
+        if((!isStraightCopy(&conv) || format == GPUTEX_DDS_BC1 || format == GPUTEX_DDS_BC3) && i + 1 < numLevels)
+            outFile_flush(&sshHandle->outFile);
+    }
+
+    return true;
+}
+
+
+// initImgConv(): set up the conversion of the main image, with no remapping
+static void initImgConv(sshHandle_t *sshHandle, imgConv_t *conv, bool flip){
+    conv->sshData = sshHandle->imgData;
+    conv->width = sshHandle->resHdr.width;
+    conv->height = sshHandle->resHdr.height;
+    conv->flip = flip;
+    conv->remap = NULL;
+    conv->palette = NULL;
+    conv->colors = NULL;
+}
+
+/* initRgbaConv(): set up the conversion of the main image to RGBA pixels, i.e. in ssh's channel order;
+** the paletted images are expanded with the ssh palette, which is already in RGBA order
+*/
+static void initRgbaConv(sshHandle_t *sshHandle, imgConv_t *conv){
+    initImgConv(sshHandle, conv, false);
+    conv->pixelSize = 4;
+
+    switch(sshHandle->imgType){
+        case SSH_PALETTED_4BPP:
+            conv->rowConv = ROWCONV_EXPAND_4BPP;
+            conv->palette = (const tgaPixel32_t *)sshHandle->palette;
+            break;
+
+        case SSH_PALETTED_8BPP:
+            conv->rowConv = ROWCONV_EXPAND_8BPP;
+            conv->palette = (const tgaPixel32_t *)sshHandle->palette;
             break;
 
+        case SSH_TRUECOLOR_24BPP:
+            conv->rowConv = ROWCONV_RGBA_24;
+            break;
 
         case SSH_TRUECOLOR_32BPP:
-            bufToWrite = tgaData;
-            bufToWrite_size = sshDataSize;
+            conv->rowConv = ROWCONV_RGBA_32;
+            break;
+    }
+}
 
-            tgaInitStruct.isCMapped = NO_PALETTE;
-            tgaInitStruct.imgType = IMGTYPE_TRUECOLOR;
-            tgaInitStruct.CMapDepth = 0;
-            tgaInitStruct.CMapLen = 0;
+/* initTiles(): make the scratch buffers big enough for converting the image a tile (about tileSize bytes) at a time,
+** returning the number of rows per tile (0 if the buffers couldn't be allocated).
+** When RLE encoding, the tile buffer has room for the pixels left over from the previous tile too,
+** ahead of the tile's own ones
+*/
+static DWORD initTiles(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch, DWORD tileSize, bool rle){
+    DWORD rowSize = conv->width * conv->pixelSize;
+    DWORD rowsPerTile = rowSize != 0 && rowSize < tileSize ? tileSize / rowSize : 1;
+    DWORD tileBufSize;
 
+    /* a multiple of 4 rows per tile makes the 4bpp tiles start on a byte boundary,
+    ** and the tiles hold whole rows of BC blocks
+    */
+    rowsPerTile = (rowsPerTile + 3) & ~3;
 
-            tgaInitStruct.PixelDepth = 32;
-            tgaInitStruct.ImageDesc = ATTRIB_BITS_8 | BOTTOM_LEFT;
+    // unpacking 4bpp indexes may write an extra index past the tile's end
+    tileBufSize = rowsPerTile * rowSize + conv->pixelSize;
+
+    if(rle){
+        tileBufSize += RLE_MAX_PENDING_PIXELS * conv->pixelSize;
+
+        if(getScratchBuf(sshHandle, &scratch->rleBuf, &scratch->rleBufSize, tileBufSize * 2) == NULL)
+            return 0;
+    }
+
+    if(getScratchBuf(sshHandle, &scratch->tileBuf, &scratch->tileBufSize, tileBufSize) == NULL)
+        return 0;
+
+    return rowsPerTile;
+}
+
+/* convertRows(): convert numRows rows starting from firstRow into dst, in bottom-top order if conv->flip is set
+** (palette indexes are never flipped); firstRow must be a multiple of the rows per tile
+*/
+static void convertRows(sshHandle_t *sshHandle, const imgConv_t *conv, BYTE *dst, DWORD firstRow, DWORD numRows){
+    const BYTE *sshData = conv->sshData;
+
+    DWORD width = conv->width;
+    DWORD firstPixel = firstRow * width;
+    DWORD numPixels = numRows * width;
+    DWORD i;
+
+    switch(conv->rowConv){
+        case ROWCONV_INDEXES_8BPP:
+            if(conv->remap == NULL)
+                memcpy(dst, sshData + firstPixel, numPixels);
+            else
+                for(i = 0; i < numPixels; ++i)
+                    dst[i] = conv->remap[sshData[firstPixel + i]];
+            break;
 
-           /* convert image from ssh to tga pixel format;
-            ** also, put rows in upside-down order
+        case ROWCONV_INDEXES_4BPP:
+            /* Unfortunately, TGA doesn't support 4bpp format, so if
+            ** SSH data is 4bpp we must convert it to 8 bpp
             */
-            ssh32Data = sshData;
-            tga32Data = tgaData;
+            pixconv_unpack4bpp(sshData + firstPixel / 2, dst, (numPixels + 1) / 2);
 
-            // let tgaCurrRow32 point to the last row of the dest. buffer
-            tgaCurrRow32 = &tga32Data[width * (height - 1)];
+            if(conv->remap != NULL)
+                for(i = 0; i < numPixels; ++i)
+                    dst[i] = conv->remap[dst[i]];
+            break;
 
-            do{
-                for(int y = 0; y < width; ++y){
-                    tgaCurrRow32[y].red = ssh32Data->red;
-                    tgaCurrRow32[y].green = ssh32Data->green;
-                    tgaCurrRow32[y].blue = ssh32Data->blue;
-                    tgaCurrRow32[y].alpha = ssh32Data->alpha;
+        case ROWCONV_EXPAND_8BPP:
+            pixconv_expandImage(sshData + firstPixel, conv->palette, (tgaPixel32_t *)dst, width, numRows, conv->flip);
+            break;
 
-                    ++ssh32Data;
-                }
-                tgaCurrRow32 -= width;
-            }while(tgaCurrRow32 >= tga32Data);
+        case ROWCONV_EXPAND_4BPP:
+            pixconv_expand4bppImage(sshData + firstPixel / 2, conv->palette, (tgaPixel32_t *)dst, width, numRows, conv->flip);
+            break;
+
+        case ROWCONV_24_TO_24:
+            pixconv_convertImage(PIXCONV_24_TO_24, sshData + firstPixel * sizeof(sshPixel24_t), dst, width, numRows, conv->flip);
+            break;
+
+        case ROWCONV_32_TO_32:
+            pixconv_convertImage(PIXCONV_32_TO_32, sshData + firstPixel * sizeof(sshPixel32_t), dst, width, numRows, conv->flip);
+            break;
 
+        case ROWCONV_32_TO_24:
+            pixconv_convertImage(PIXCONV_32_TO_24, sshData + firstPixel * sizeof(sshPixel32_t), dst, width, numRows, conv->flip);
+            break;
+
+        // these two are never flipped
+        case ROWCONV_RGBA_24:
+            pixconv_addAlpha(sshData + firstPixel * sizeof(sshPixel24_t), dst, numPixels);
+            break;
+
+        case ROWCONV_RGBA_32:
+            memcpy(dst, sshData + firstPixel * sizeof(sshPixel32_t), numPixels * sizeof(sshPixel32_t));
+            break;
+
+        // never flipped either
+        case ROWCONV_PALETTIZE:
+            i = sshHandle->imgType == SSH_TRUECOLOR_24BPP ? sizeof(sshPixel24_t) : sizeof(sshPixel32_t);
+            palettizePixels(conv->colors, sshData + firstPixel * i, i, dst, numPixels);
             break;
     }
+}
 
-    // save the tga file
-    tga_initHdr(&tgaInitStruct);
-    tga_writeHdr(tga_fp);
-    fwrite(bufToWrite, 1, bufToWrite_size, tga_fp);
+/* isStraightCopy(): whether the conversion leaves the ssh data as it is, so that it can be written straight from there
+** (8bpp indexes which don't need remapping, or RGBA pixels)
+*/
+static bool isStraightCopy(const imgConv_t *conv){
+    return (conv->rowConv == ROWCONV_INDEXES_8BPP && conv->remap == NULL) || conv->rowConv == ROWCONV_RGBA_32;
 }
 
+/* writeImageData(): convert the image's pixels and write them to the output file, unencoded;
+** the last tile is left queued, so that images fitting in one tile are written in one go with their header
+*/
+static bool writeImageData(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch){
+    DWORD width  = conv->width;
+    DWORD height = conv->height;
+    DWORD rowsPerTile, numTiles, tile, firstRow, numRows;
+
+    if(isStraightCopy(conv)){
+        outFile_queue(&sshHandle->outFile, conv->sshData, width * height * conv->pixelSize);
+        return true;
+    }
 
-static bool isFullOpaque(sshHandle_t *sshHandle){
-    sshPixel32_t *pixelData;
-    DWORD i, numEntries;
+    if((rowsPerTile = initTiles(sshHandle, conv, scratch, TILE_SIZE, false)) == 0)
+        return false;
 
+    numTiles = (height + rowsPerTile - 1) / rowsPerTile;
 
-    // if the image is paletted, check the palette
-    if(sshHandle->paletteNumEntriesRead){
-        pixelData = sshHandle->palette;
-        numEntries = sshHandle->paletteNumEntriesRead;
+    for(tile = 0; tile < numTiles; ++tile){
+        // flipped images start from the last tile, whose rows get flipped in turn
+        firstRow = (conv->flip ? numTiles - 1 - tile : tile) * rowsPerTile;
+        numRows = height - firstRow < rowsPerTile ? height - firstRow : rowsPerTile;
+
+        // the previous tile must be written before its buffer is reused
+        if(tile > 0)
+            outFile_flush(&sshHandle->outFile);
+
+        convertRows(sshHandle, conv, scratch->tileBuf, firstRow, numRows);
+        outFile_queue(&sshHandle->outFile, scratch->tileBuf, conv->pixelSize * width * numRows);
+    }
+
+    return true;
+}
+
+/* writeImageDataRLE(): convert the image's pixels and write them to the tga file RLE encoded (top-bottom only),
+** storing the encoded size in *encodedSize; as for writeImageData(), the last tile's packets are left queued.
+** With sizeOnly, the packets are just counted: nothing is written, nor added to the encoding stats
+*/
+static bool writeImageDataRLE(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch, bool sizeOnly, DWORD *encodedSize){
+    DWORD width  = conv->width;
+    DWORD height = conv->height;
+    DWORD pixelSize = conv->pixelSize;
+    DWORD rowsPerTile, firstRow, numRows;
+
+    DWORD pendingPixels = 0;    // pixels of the previous tiles the encoder still needs
+    DWORD encodedPixels, packetsSize;
+    const BYTE *pixels;
+
+    rleStream_t rleStream;
+    double rleStart;
+
+    /* 8bpp indexes need no conversion, since the encoder remaps them itself;
+    ** the others (4bpp indexes included) are remapped by convertRows(), so the encoder mustn't do it again
+    */
+    bool fromSshData = conv->rowConv == ROWCONV_INDEXES_8BPP;
+
+    if((rowsPerTile = initTiles(sshHandle, conv, scratch, TILE_SIZE, true)) == 0)
+        return false;
+
+    rle_initStream(&rleStream, pixelSize, fromSshData ? conv->remap : NULL);
+    *encodedSize = 0;
+
+    for(firstRow = 0; firstRow < height; firstRow += rowsPerTile){
+        numRows = height - firstRow < rowsPerTile ? height - firstRow : rowsPerTile;
+
+        if(fromSshData)
+            pixels = conv->sshData + firstRow * width - pendingPixels;
+        else{
+            convertRows(sshHandle, conv, scratch->tileBuf + pendingPixels * pixelSize, firstRow, numRows);
+            pixels = scratch->tileBuf;
+        }
+
+        pendingPixels += numRows * width;
+
+        // the previous tile's packets must be written before their buffer is reused
+        if(firstRow > 0 && !sizeOnly)
+            outFile_flush(&sshHandle->outFile);
+
+        rleStart = getSeconds();
+        encodedPixels = rle_encodeStream(&rleStream, scratch->rleBuf, &packetsSize, pixels, pendingPixels, firstRow + numRows == height);
+
+        if(!sizeOnly){
+            scratch->rleSeconds += getSeconds() - rleStart;
+            scratch->rleBytes += encodedPixels * pixelSize;
+            outFile_queue(&sshHandle->outFile, scratch->rleBuf, packetsSize);
+        }
+        *encodedSize += packetsSize;
+
+        // move the pixels still needed at the beginning of the tile buffer
+        pendingPixels -= encodedPixels;
+
+        if(!fromSshData)
+            memmove(scratch->tileBuf, scratch->tileBuf + encodedPixels * pixelSize, pendingPixels * pixelSize);
     }
 
-    // if it's truecolor, check pixel data
+    return true;
+}
+
+/* writeImageDataOptimalRLE(): same as writeImageDataRLE(), with the smallest possible packets (see rle.h);
+** the pixels are converted twice, once for planning the packets and once for writing them.
+** Nothing is written if the packets turn out no smaller than the pixels, since the caller saves those instead,
+** or with sizeOnly, which stops once the packets are planned (and leaves the encoding stats alone)
+*/
+static bool writeImageDataOptimalRLE(sshHandle_t *sshHandle, const imgConv_t *conv, sshScratch_t *scratch, bool sizeOnly, DWORD *encodedSize){
+    DWORD width  = conv->width;
+    DWORD height = conv->height;
+    DWORD pixelSize = conv->pixelSize;
+    DWORD rowsPerTile, firstRow, numRows, packetsSize;
+    const BYTE *pixels;
+
+    rleOptimal_t plan;
+    double rleStart;
+
+    // as in writeImageDataRLE(), only the 8bpp indexes are remapped by the encoder
+    bool fromSshData = conv->rowConv == ROWCONV_INDEXES_8BPP;
+
+    if((rowsPerTile = initTiles(sshHandle, conv, scratch, TILE_SIZE, true)) == 0)
+        return false;
+
+    if(getScratchBuf(sshHandle, &scratch->planBuf, &scratch->planBufSize, width * height) == NULL)
+        return false;
+
+    rle_initOptimal(&plan, pixelSize, fromSshData ? conv->remap : NULL, scratch->planBuf);
+
+    for(firstRow = 0; firstRow < height; firstRow += rowsPerTile){
+        numRows = height - firstRow < rowsPerTile ? height - firstRow : rowsPerTile;
+
+        if(fromSshData)
+            pixels = conv->sshData + firstRow * width;
+        else{
+            convertRows(sshHandle, conv, scratch->tileBuf, firstRow, numRows);
+            pixels = scratch->tileBuf;
+        }
+
+        rleStart = getSeconds();
+        rle_planOptimal(&plan, pixels, numRows * width);
+        if(!sizeOnly)
+            scratch->rleSeconds += getSeconds() - rleStart;
+    }
+
+    *encodedSize = rle_finishPlan(&plan);
+    if(sizeOnly)
+        return true;
+
+    scratch->rleBytes += width * height * pixelSize;
+
+    if(*encodedSize >= width * height * pixelSize)
+        return true;
+
+    for(firstRow = 0; firstRow < height; firstRow += rowsPerTile){
+        numRows = height - firstRow < rowsPerTile ? height - firstRow : rowsPerTile;
+
+        if(fromSshData)
+            pixels = conv->sshData + firstRow * width;
+        else{
+            convertRows(sshHandle, conv, scratch->tileBuf, firstRow, numRows);
+            pixels = scratch->tileBuf;
+        }
+
+        // the previous tile's packets must be written before their buffer is reused
+        if(firstRow > 0)
+            outFile_flush(&sshHandle->outFile);
+
+        rleStart = getSeconds();
+        packetsSize = rle_encodeOptimal(&plan, scratch->rleBuf, pixels, numRows * width);
+        scratch->rleSeconds += getSeconds() - rleStart;
+
+        outFile_queue(&sshHandle->outFile, scratch->rleBuf, packetsSize);
+    }
+
+    return true;
+}
+
+/* getShrunkDataSize(): the size the image's pixels take in a -out_shrink tga file, with the given conversion:
+** the RLE packets, or the pixels themselves if the packets aren't smaller
+*/
+static bool getShrunkDataSize(sshHandle_t *sshHandle, const imgConv_t *conv, const convOptions_t *options, sshScratch_t *scratch, DWORD *dataSize){
+    DWORD pixelsSize = conv->width * conv->height * conv->pixelSize;
+
+    if(options->rleOptimal){
+        if(!writeImageDataOptimalRLE(sshHandle, conv, scratch, true, dataSize))
+            return false;
+    }
+    else if(!writeImageDataRLE(sshHandle, conv, scratch, true, dataSize))
+        return false;
+
+    if(*dataSize > pixelsSize)
+        *dataSize = pixelsSize;
+
+    return true;
+}
+
+/* writeImageDataBC(): convert the image's pixels to RGBA and write them BC compressed; as for writeImageData(),
+** the last tile's blocks are left queued.
+** The tiles are as many times bigger as the threads compressing them, which get a band of each tile's block rows
+*/
+static bool writeImageDataBC(sshHandle_t *sshHandle, const imgConv_t *conv, bcFormat_t format, const convOptions_t *options, sshScratch_t *scratch){
+    DWORD width  = conv->width;
+    DWORD height = conv->height;
+    DWORD blockRowSize = (width + 3) / 4 * bc_blockSize(format);
+    DWORD rowsPerTile, firstRow, maxBands;
+    bcBand_t tile;
+    bcCrew_t crew;
+
+    if((rowsPerTile = initTiles(sshHandle, conv, scratch, TILE_SIZE * options->bcThreads, false)) == 0)
+        return false;
+
+    if(getScratchBuf(sshHandle, &scratch->bcBuf, &scratch->bcBufSize, rowsPerTile / 4 * blockRowSize) == NULL)
+        return false;
+
+    // no more workers than the biggest tile has bands for
+    maxBands = ((rowsPerTile < height ? rowsPerTile : height) + 3) / 4 * ((width + 3) / 4) / BC_MIN_BAND_BLOCKS;
+    maxBands = maxBands < options->bcThreads ? maxBands : options->bcThreads;
+    startCrew(&crew, maxBands > 1 ? maxBands - 1 : 0);
+
+    tile.format = format;
+    tile.quality = options->bcQuality;
+    tile.width = width;
+    tile.blocks = scratch->bcBuf;
+
+    for(firstRow = 0; firstRow < height; firstRow += rowsPerTile){
+        tile.height = height - firstRow < rowsPerTile ? height - firstRow : rowsPerTile;
+
+        // the previous tile's blocks must be written before their buffer is reused
+        if(firstRow > 0)
+            outFile_flush(&sshHandle->outFile);
+
+        // RGBA pixels are compressed straight from the ssh data
+        if(isStraightCopy(conv))
+            tile.pixels = conv->sshData + firstRow * width * conv->pixelSize;
+        else{
+            convertRows(sshHandle, conv, scratch->tileBuf, firstRow, tile.height);
+            tile.pixels = scratch->tileBuf;
+        }
+
+        compressBands(&crew, &tile);
+        outFile_queue(&sshHandle->outFile, scratch->bcBuf, (tile.height + 3) / 4 * blockRowSize);
+    }
+
+    stopCrew(&crew);
+    return true;
+}
+
+/* startCrew(): start up to maxWorkers threads compressing the bands of each tile handed to compressBands();
+** the crew may end up with fewer of them (none, even) if they can't be created, compressBands() copes with that
+*/
+static void startCrew(bcCrew_t *crew, DWORD maxWorkers){
+    DWORD i;
+
+    crew->numWorkers = 0;
+    crew->numBands = 0;
+    crew->tileSeq = 0;
+    crew->numDone = 0;
+    crew->quit = false;
+
+    maxWorkers = maxWorkers < BC_MAX_BANDS - 1 ? maxWorkers : BC_MAX_BANDS - 1;
+    if(maxWorkers == 0)
+        return;
+
+    crew->mutex = mutex_create();
+    crew->cond = cond_create();
+
+    if(crew->mutex == NULL || crew->cond == NULL){
+        mutex_free(crew->mutex);
+        cond_free(crew->cond);
+        return;
+    }
+
+    for(i = 0; i < maxWorkers; ++i){
+        crew->workers[i].crew = crew;
+        crew->workers[i].bandIdx = i + 1;
+
+        if((crew->workers[i].thread = thread_create(crewWorker, &crew->workers[i])) == NULL)
+            break;
+    }
+
+    if((crew->numWorkers = i) == 0){
+        mutex_free(crew->mutex);
+        cond_free(crew->cond);
+    }
+}
+
+// stopCrew(): let the workers exit and wait for them
+static void stopCrew(bcCrew_t *crew){
+    DWORD i;
+
+    if(crew->numWorkers == 0)
+        return;
+
+    mutex_lock(crew->mutex);
+    crew->quit = true;
+    cond_broadcast(crew->cond);
+    mutex_unlock(crew->mutex);
+
+    for(i = 0; i < crew->numWorkers; ++i)
+        thread_join(crew->workers[i].thread);
+
+    mutex_free(crew->mutex);
+    cond_free(crew->cond);
+}
+
+/* compressBands(): compress a tile split into bands of block rows, one for the calling thread and one for each
+** of the crew's workers (with no less than BC_MIN_BAND_BLOCKS blocks each); the workers left without a band
+** just report they're done
+*/
+static void compressBands(bcCrew_t *crew, const bcBand_t *tile){
+    DWORD blocksPerRow = (tile->width + 3) / 4;
+    DWORD numBlockRows = (tile->height + 3) / 4;
+    DWORD numBands = numBlockRows * blocksPerRow / BC_MIN_BAND_BLOCKS;
+    DWORD blockRowsPerBand, firstBlockRow, i;
+
+    numBands = numBands < crew->numWorkers + 1 ? numBands : crew->numWorkers + 1;
+
+    if(numBands <= 1){
+        compressBand(tile);
+        return;
+    }
+
+    blockRowsPerBand = (numBlockRows + numBands - 1) / numBands;
+
+    for(i = 0; i < numBands && i * blockRowsPerBand < numBlockRows; ++i){
+        firstBlockRow = i * blockRowsPerBand;
+
+        crew->bands[i] = *tile;
+        crew->bands[i].pixels = tile->pixels + firstBlockRow * 4 * tile->width * 4;
+        crew->bands[i].height = tile->height - firstBlockRow * 4 < blockRowsPerBand * 4 ? tile->height - firstBlockRow * 4 : blockRowsPerBand * 4;
+        crew->bands[i].blocks = tile->blocks + firstBlockRow * blocksPerRow * bc_blockSize(tile->format);
+    }
+
+    mutex_lock(crew->mutex);
+    crew->numBands = i;
+    crew->numDone = 0;
+    ++crew->tileSeq;
+    cond_broadcast(crew->cond);
+    mutex_unlock(crew->mutex);
+
+    compressBand(&crew->bands[0]);
+
+    mutex_lock(crew->mutex);
+    while(crew->numDone < crew->numWorkers)
+        cond_wait(crew->cond, crew->mutex);
+    mutex_unlock(crew->mutex);
+}
+
+// crewWorker(): the thread function of a bcWorker_t, compressing its band of each tile until the crew is stopped
+static void crewWorker(void *worker){
+    bcWorker_t *w = worker;
+    bcCrew_t *crew = w->crew;
+    DWORD tileSeq = 0;
+    bool hasBand;
+
+    for(;;){
+        mutex_lock(crew->mutex);
+        while(crew->tileSeq == tileSeq && !crew->quit)
+            cond_wait(crew->cond, crew->mutex);
+
+        if(crew->quit){
+            mutex_unlock(crew->mutex);
+            return;
+        }
+
+        tileSeq = crew->tileSeq;
+        hasBand = w->bandIdx < crew->numBands;
+        mutex_unlock(crew->mutex);
+
+        if(hasBand)
+            compressBand(&crew->bands[w->bandIdx]);
+
+        mutex_lock(crew->mutex);
+        ++crew->numDone;
+        cond_broadcast(crew->cond);
+        mutex_unlock(crew->mutex);
+    }
+}
+
+// compressBand(): compress a bcBand_t
+static void compressBand(const bcBand_t *band){
+    bc_compress(band->format, band->quality, band->pixels, band->width, band->height, band->blocks);
+}
+
+// writeShrunkHdr(): write the tga header, followed by the shrunk palette if the image is paletted
+static void writeShrunkHdr(tgaCtx_t *tgaCtx, outFile_t *outFile){
+    tga_writeHdr(tgaCtx, outFile);
+
+    if(tgaCtx->tga_header.ColorMapType == PALETTED){
+        if(tgaCtx->tga_header.CMapDepth == 24)
+            tga_writeShrunkPalette24(tgaCtx, outFile);
+        else
+            tga_writeShrunkPalette32(tgaCtx, outFile);
+    }
+}
+
+// findUsedIndexes(): set the entries of the palette indexes found in the image to 1
+static void findUsedIndexes(sshHandle_t *sshHandle, BYTE used_indexes[256]){
+    const BYTE *sshData = sshHandle->imgData;
+    DWORD numPixels = sshHandle->resHdr.width * sshHandle->resHdr.height;
+    DWORD i;
+
+    if(sshHandle->imgType == SSH_PALETTED_8BPP){
+        for(i = 0; i < numPixels; ++i)
+            used_indexes[sshData[i]] = 1;
+
+        return;
+    }
+
+    // 4bpp images have 2 indexes per byte, low nibble first
+    for(i = 0; i < numPixels / 2; ++i){
+        used_indexes[sshData[i] & 0xF] = 1;
+        used_indexes[sshData[i] >>  4] = 1;
+    }
+
+    // with an odd number of pixels, the last byte's high nibble is just padding
+    if(numPixels & 1)
+        used_indexes[sshData[i] & 0xF] = 1;
+}
+
+
+/* initPalettized(): switch a truecolor image's conversion, as set up by the caller, to a paletted one, as long as it has
+** no more than 256 colors and that makes the file smaller; the palette has the same depth as the truecolor pixels.
+** The sizes compared are the RLE encoded ones, since the paletted image's smaller pixels can make for more packets
+** (its short runs go in raw packets instead); returns false if the pixels couldn't be encoded, with the image left truecolor
+*/
+static bool initPalettized(sshHandle_t *sshHandle, tgaCtx_t *tgaCtx, tgaInitStruct_t *tgaInitStruct, imgConv_t *conv, colorSet_t *colors, const convOptions_t *options, sshScratch_t *scratch){
+    DWORD numPixels = conv->width * conv->height;
+    DWORD pixelSize = conv->pixelSize;
+    DWORD truecolorSize, palettedSize;
+    imgConv_t palConv;
+    BYTE used_indexes[256] = {0};
+
+    if(!countColors(sshHandle, colors))
+        return true;
+
+    palConv = *conv;
+    palConv.rowConv = ROWCONV_PALETTIZE;
+    palConv.pixelSize = 1;
+    palConv.colors = colors;
+
+    if(!getShrunkDataSize(sshHandle, &palConv, options, scratch, &palettedSize))
+        return false;
+    palettedSize += colors->numColors * pixelSize;
+
+    /* the truecolor pixels can't take less than a pixel for each run and a count byte for each 128 pixels
+    ** (or than the unencoded pixels), so they're only encoded when that isn't enough to tell
+    */
+    truecolorSize = colors->numRuns * pixelSize + (numPixels + 127) / 128;
+    if(truecolorSize > numPixels * pixelSize)
+        truecolorSize = numPixels * pixelSize;
+
+    if(palettedSize >= truecolorSize && !getShrunkDataSize(sshHandle, conv, options, scratch, &truecolorSize))
+        return false;
+
+    if(palettedSize >= truecolorSize)
+        return true;
+
+    *conv = palConv;
+
+    tgaInitStruct->PixelDepth = 8;
+    tgaInitStruct->isCMapped = PALETTED;
+    tgaInitStruct->imgType = IMGTYPE_COLORMAPPED_RLE;
+
+    // every entry is used, so the shrunk palette is the same and the indexes need no remapping
+    memset(used_indexes, 1, colors->numColors);
+
+    if(pixelSize == sizeof(tgaPixel24_t)){
+        tgaInitStruct->CMapDepth = 24;
+        tgaInitStruct->ImageDesc = ATTRIB_BITS_0 | TOP_LEFT;
+        tga_sshToTgaPal24(tgaCtx, colors->palette, colors->numColors);
+        tgaInitStruct->CMapLen = tga_shrinkPalette24(tgaCtx, used_indexes);
+    }
     else{
-        pixelData = sshHandle->imgData;
-        numEntries = sshHandle->imgDataSize;
+        tgaInitStruct->CMapDepth = 32;
+        tgaInitStruct->ImageDesc = ATTRIB_BITS_8 | TOP_LEFT;
+        tga_sshToTgaPal32(tgaCtx, colors->palette, colors->numColors);
+        tgaInitStruct->CMapLen = tga_shrinkPalette32(tgaCtx, used_indexes);
     }
 
-    for(i = 0; i < numEntries; ++i)
-        if(pixelData[i].alpha != 0xFF)
-           return false;
+    return true;
+}
+
+/* countColors(): put the truecolor image's distinct colors in a color set and its palette, in the order they're found;
+** it gives up (returning false) as soon as there are more than 256 of them, so noisy images cost little
+*/
+static bool countColors(sshHandle_t *sshHandle, colorSet_t *colors){
+    DWORD pixelSize = sshHandle->imgType == SSH_TRUECOLOR_24BPP ? sizeof(sshPixel24_t) : sizeof(sshPixel32_t);
+    DWORD numPixels = sshHandle->resHdr.width * sshHandle->resHdr.height;
+    const BYTE *pixel = sshHandle->imgData;
+    sshPixel32_t *entry;
+    DWORD color, prevColor = 0, slot, i;
+
+    memset(colors->indexes, -1, sizeof(colors->indexes));
+    colors->numColors = 0;
+    colors->numRuns = 0;
+
+    for(i = 0; i < numPixels; ++i, pixel += pixelSize){
+        color = getPixelColor(pixel, pixelSize);
+
+        // runs of the same color are common, and need no lookup
+        if(i > 0 && color == prevColor)
+            continue;
+        prevColor = color;
+        ++colors->numRuns;
+
+        slot = findColorSlot(colors, color);
+        if(colors->indexes[slot] >= 0)
+            continue;
+
+        if(colors->numColors == 256)
+            return false;
+
+        colors->colors[slot] = color;
+        colors->indexes[slot] = colors->numColors;
+
+        entry = &colors->palette[colors->numColors++];
+        entry->red = pixel[0];
+        entry->green = pixel[1];
+        entry->blue = pixel[2];
+        entry->alpha = pixelSize == sizeof(sshPixel32_t) ? pixel[3] : 0xFF;
+    }
 
     return true;
 }
 
+// palettizePixels(): replace the pixels with their index in the color set's palette, looking up the runs of the same color once
+static void palettizePixels(const colorSet_t *colors, const BYTE *pixels, DWORD pixelSize, BYTE *dst, DWORD numPixels){
+    DWORD color, prevColor = 0, i;
+    BYTE index = 0;
+
+    for(i = 0; i < numPixels; ++i, pixels += pixelSize){
+        color = getPixelColor(pixels, pixelSize);
+
+        if(i == 0 || color != prevColor){
+            index = colors->indexes[findColorSlot(colors, color)];
+            prevColor = color;
+        }
+
+        dst[i] = index;
+    }
+}
+
+// getPixelColor(): a 24 or 32 bit ssh pixel as a 32 bit value, with the 24 bit ones being opaque
+static DWORD getPixelColor(const BYTE *pixel, DWORD pixelSize){
+    DWORD alpha = pixelSize == sizeof(sshPixel32_t) ? pixel[3] : 0xFF;
+
+    return pixel[0] | (pixel[1] << 8) | (pixel[2] << 16) | (alpha << 24);
+}
+
+// findColorSlot(): the slot holding the color, or the empty one where it would go (linear probing; the table is never full)
+static DWORD findColorSlot(const colorSet_t *colors, DWORD color){
+    DWORD slot = (color * 0x9E3779B1u) >> 22;   // Fibonacci hashing, to the top 10 bits
+
+    while(colors->indexes[slot] >= 0 && colors->colors[slot] != color)
+        slot = (slot + 1) % COLORSET_SLOTS;
+
+    return slot;
+}
+
+// isFullOpaque(): whether the palette's entries (or the truecolor pixels) all have a 0xFF alpha
+static bool isFullOpaque(sshHandle_t *sshHandle){
+    // if the image is paletted, check the palette
+    if(sshHandle->palette != NULL)
+        return pixconv_scanAlpha(sshHandle->palette, sshHandle->paletteNumEntriesRead, 0xFF, 0xFF);
+
+    if(sshHandle->imgType == SSH_TRUECOLOR_24BPP)
+        return true;
+
+    // if it's 32 bit truecolor, check pixel data
+    return pixconv_scanAlpha(sshHandle->imgData, (DWORD)sshHandle->resHdr.width * sshHandle->resHdr.height, 0xFF, 0xFF);
+}
+
 
 /* The palette for 8bpp entries must be adjusted as shown below;
 ** If I were to take a guess about the reason why it's organized like that,
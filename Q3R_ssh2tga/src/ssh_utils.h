@@ -3,11 +3,62 @@
 
 #include <stdbool.h>
 
+#include "bcn.h"
 #include "types.h"
 
+/* the converted files' version, which the cache keys them with along with the options (see getCacheOptions());
+** to be bumped whenever a change to the conversions alters a single byte of their output
+*/
+#define SSH_CONV_VERSION    1
+
+// how the images are converted
+typedef struct convOptions_s{
+    outFormat_t outFormat;
+    bool        rleOptimal;     // for OUT_SHRINK: the smallest RLE packets rather than greedily picked ones (slower)
+    bcQuality_t bcQuality;      // for OUT_DDS_BC
+    unsigned    bcThreads;      // threads compressing each image's BC blocks (the one converting it included)
+}convOptions_t;
+
+// the images in a ssh file, as listed by ssh_readResTable()
+typedef struct sshResTable_s{
+    DWORD           numResources;
+    sshResEntry_t * entries;
+}sshResTable_t;
+
 // functions' prototypes
-bool init_sshHandle(sshHandle_t *sshHandle, const char *sshPath);
-bool ssh_convertAndSave(sshHandle_t *sshHandle, outFormat_t outFormat);
+
+/* init_sshHandle(): read a ssh file and parse its resIndex-th image (0 for the first one); when converted,
+** the images of the files containing more than one are saved as <name>_<resIndex>.<ext>.
+** If fileHash isn't NULL it's set to the whole file's cache_hash() (see cache.h)
+*/
+bool init_sshHandle(sshHandle_t *sshHandle, const char *sshPath, DWORD resIndex, QWORD *fileHash, msgLog_t *log, sshScratch_t *scratch);
+bool ssh_convertAndSave(sshHandle_t *sshHandle, const convOptions_t *options, sshScratch_t *scratch);
+
+// ssh_getOutPath(): the path ssh_convertAndSave() saves the image to, in outPath (FILENAME_MAX bytes)
+void ssh_getOutPath(const sshHandle_t *sshHandle, outFormat_t outFormat, char *outPath);
+
+/* ssh_normalizePs2Alpha(): rescale the alpha channel of the palette (or of the 32 bit pixels and their mipmaps)
+** from 0-0x80, where the PS2 has 0x80 as fully opaque, to 0-0xFF, so that the outputs dropping a fully opaque
+** alpha channel can tell it is; the images with alpha values above 0x80 are left as they are (returning false)
+*/
+bool ssh_normalizePs2Alpha(sshHandle_t *sshHandle);
+
+/* ssh_decodeRgba(): convert the main image to RGBA pixels (ssh's channel order, top-bottom rows) into a newly allocated
+** buffer, which the caller frees; NULL if it couldn't be allocated
+*/
+BYTE *ssh_decodeRgba(sshHandle_t *sshHandle);
 void free_sshHandleBuffers(sshHandle_t *sshHandle);
 
+/* ssh_readResTable(): read just the file's resource entries, one per image, so that the images can be
+** converted separately; false if the file can't be read or isn't a ssh file (which init_sshHandle() reports)
+*/
+bool ssh_readResTable(const char *sshPath, sshResTable_t *table);
+
+// ssh_findResource(): the index of the image selected by its index or its (up to 4 characters) name
+bool ssh_findResource(const sshResTable_t *table, const char *selector, DWORD *index);
+void ssh_freeResTable(sshResTable_t *table);
+
+void init_sshScratch(sshScratch_t *scratch);
+void free_sshScratch(sshScratch_t *scratch);
+
 #endif // SSH_UTILS_H
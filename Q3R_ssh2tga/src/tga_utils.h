@@ -1,8 +1,7 @@
 #ifndef TGA_UTILS_H
 #define TGA_UTILS_H
 
-#include <stdio.h>
-
+#include "outfile.h"
 #include "types.h"
 
 enum tgaImageDescriptor{
@@ -32,6 +31,37 @@ typedef struct tgaPixel32_s{
     BYTE blue, green, red, alpha;
 }tgaPixel32_t;
 
+typedef struct _TgaHeader
+{
+  BYTE IDLength;        /* 00h  Size of Image ID field */
+  BYTE ColorMapType;    /* 01h  Color map type */
+  BYTE ImageType;       /* 02h  Image type code */
+  WORD CMapStart;       /* 03h  Color map origin */
+  WORD CMapLength;      /* 05h  Color map length */
+  BYTE CMapDepth;       /* 07h  Depth of color map entries */
+  WORD XOffset;         /* 08h  X origin of image */
+  WORD YOffset;         /* 0Ah  Y origin of image */
+  WORD Width;           /* 0Ch  Width of image */
+  WORD Height;          /* 0Eh  Height of image */
+  BYTE PixelDepth;      /* 10h  Image pixel size */
+  BYTE ImageDescriptor; /* 11h  Image descriptor byte */
+} TGAHEAD;
+
+#define TGA_HEADER_SIZE 18  // TGAHEAD's size in the file, without the padding
+
+/* header and palettes of the tga file being written; each conversion has its own,
+** so that several images can be converted at the same time.
+** They're queued to the output file rather than written right away (see outfile.h),
+** so they must stay untouched until the file is flushed.
+*/
+typedef struct tgaCtx_s{
+    TGAHEAD tga_header;
+    BYTE    tga_headerBytes[TGA_HEADER_SIZE];   // tga_header as written to the file
+
+    struct tgaPixel24_s tga_palette24[256], tga_shrunk_palette24[256];
+    struct tgaPixel32_s tga_palette32[256], tga_shrunk_palette32[256];
+}tgaCtx_t;
+
 typedef struct tgaInitStruct_s{
     enum tgaColorMap isCMapped;
     enum tgaImageType imgType;
@@ -46,17 +76,16 @@ typedef struct tgaInitStruct_s{
 
 
 /* function prototypes */
-void tga_sshToTgaPal24(const sshPixel32_t *ssh_palette, DWORD numPalEntries);
-void tga_sshToTgaPal32(const sshPixel32_t *ssh_palette, DWORD numPalEntries);
-void tga_initHdr(tgaInitStruct_t *tgaInitStruct);
-void tga_writeHdr(FILE *stream);
-void tga_writePalette24(FILE *stream);
-void tga_writeShrunkPalette24(FILE *stream);
-void tga_writePalette32(FILE *stream);
-void tga_writeShrunkPalette32(FILE *stream);
-int tga_shrink8bpp(BYTE imgDest[], BYTE imgBuf[], DWORD size, DWORD CMapDepth, WORD *CMapLen);
-int tga_shrink24bpp(BYTE imgDest[], const tgaPixel24_t imgBuf[], DWORD size);
-int tga_shrink32bpp(BYTE imgDest[], const tgaPixel32_t imgBuf[], DWORD size);
+void tga_sshToTgaPal24(tgaCtx_t *ctx, const sshPixel32_t *ssh_palette, DWORD numPalEntries);
+void tga_sshToTgaPal32(tgaCtx_t *ctx, const sshPixel32_t *ssh_palette, DWORD numPalEntries);
+void tga_initHdr(tgaCtx_t *ctx, tgaInitStruct_t *tgaInitStruct);
+void tga_writeHdr(tgaCtx_t *ctx, outFile_t *file);
+void tga_writePalette24(tgaCtx_t *ctx, outFile_t *file);
+void tga_writeShrunkPalette24(tgaCtx_t *ctx, outFile_t *file);
+void tga_writePalette32(tgaCtx_t *ctx, outFile_t *file);
+void tga_writeShrunkPalette32(tgaCtx_t *ctx, outFile_t *file);
+WORD tga_shrinkPalette24(tgaCtx_t *ctx, BYTE used_indexes[256]);
+WORD tga_shrinkPalette32(tgaCtx_t *ctx, BYTE used_indexes[256]);
 
 
 #endif /* TGA_UTILS_H */
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0600     // condition variables need Vista or later
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "threads.h"
+
+#ifdef _WIN32
+
+struct thread_s{
+    HANDLE          handle;
+    threadFunc_t    func;
+    void *          arg;
+};
+
+struct mutex_s{
+    CRITICAL_SECTION cs;
+};
+
+struct cond_s{
+    CONDITION_VARIABLE cv;
+};
+
+static DWORD WINAPI threadStart(LPVOID param){
+    thread_t *thread = param;
+
+    thread->func(thread->arg);
+    return 0;
+}
+
+thread_t *thread_create(threadFunc_t func, void *arg){
+    thread_t *thread;
+
+    if((thread = malloc(sizeof(*thread))) == NULL)
+        return NULL;
+
+    thread->func = func;
+    thread->arg = arg;
+
+    if((thread->handle = CreateThread(NULL, 0, threadStart, thread, 0, NULL)) == NULL){
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void thread_join(thread_t *thread){
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+mutex_t *mutex_create(void){
+    mutex_t *mutex;
+
+    if((mutex = malloc(sizeof(*mutex))) != NULL)
+        InitializeCriticalSection(&mutex->cs);
+
+    return mutex;
+}
+
+void mutex_free(mutex_t *mutex){
+    if(mutex != NULL)
+        DeleteCriticalSection(&mutex->cs);
+
+    free(mutex);
+}
+
+void mutex_lock(mutex_t *mutex){
+    EnterCriticalSection(&mutex->cs);
+}
+
+void mutex_unlock(mutex_t *mutex){
+    LeaveCriticalSection(&mutex->cs);
+}
+
+cond_t *cond_create(void){
+    cond_t *cond;
+
+    if((cond = malloc(sizeof(*cond))) != NULL)
+        InitializeConditionVariable(&cond->cv);
+
+    return cond;
+}
+
+void cond_free(cond_t *cond){
+    free(cond);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex){
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+
+void cond_broadcast(cond_t *cond){
+    WakeAllConditionVariable(&cond->cv);
+}
+
+unsigned getNumCPUs(void){
+    SYSTEM_INFO sysInfo;
+
+    GetSystemInfo(&sysInfo);
+    return sysInfo.dwNumberOfProcessors > 0 ? sysInfo.dwNumberOfProcessors : 1;
+}
+
+double getSeconds(void){
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / frequency.QuadPart;
+}
+
+#else
+
+struct thread_s{
+    pthread_t       handle;
+    threadFunc_t    func;
+    void *          arg;
+};
+
+struct mutex_s{
+    pthread_mutex_t mutex;
+};
+
+struct cond_s{
+    pthread_cond_t  cond;
+};
+
+static void *threadStart(void *param){
+    thread_t *thread = param;
+
+    thread->func(thread->arg);
+    return NULL;
+}
+
+thread_t *thread_create(threadFunc_t func, void *arg){
+    thread_t *thread;
+
+    if((thread = malloc(sizeof(*thread))) == NULL)
+        return NULL;
+
+    thread->func = func;
+    thread->arg = arg;
+
+    if(pthread_create(&thread->handle, NULL, threadStart, thread) != 0){
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void thread_join(thread_t *thread){
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+mutex_t *mutex_create(void){
+    mutex_t *mutex;
+
+    if((mutex = malloc(sizeof(*mutex))) != NULL && pthread_mutex_init(&mutex->mutex, NULL) != 0){
+        free(mutex);
+        return NULL;
+    }
+
+    return mutex;
+}
+
+void mutex_free(mutex_t *mutex){
+    if(mutex != NULL)
+        pthread_mutex_destroy(&mutex->mutex);
+
+    free(mutex);
+}
+
+void mutex_lock(mutex_t *mutex){
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void mutex_unlock(mutex_t *mutex){
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+cond_t *cond_create(void){
+    cond_t *cond;
+
+    if((cond = malloc(sizeof(*cond))) != NULL && pthread_cond_init(&cond->cond, NULL) != 0){
+        free(cond);
+        return NULL;
+    }
+
+    return cond;
+}
+
+void cond_free(cond_t *cond){
+    if(cond != NULL)
+        pthread_cond_destroy(&cond->cond);
+
+    free(cond);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex){
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+void cond_broadcast(cond_t *cond){
+    pthread_cond_broadcast(&cond->cond);
+}
+
+unsigned getNumCPUs(void){
+    long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return numCPUs > 0 ? numCPUs : 1;
+}
+
+double getSeconds(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
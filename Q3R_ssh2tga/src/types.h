@@ -1,16 +1,27 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include "msglog.h"
+#include "outfile.h"
+
 #define SSH_MAGICID     0x53504853
 
+#define SSH_MAX_PALETTE_ENTRIES 256
+#define SSH_MAX_FILE_SIZE       0x7FFFFFFF  // the sizes in the headers are 32 bit anyway
+
 typedef unsigned char   BYTE;
 typedef unsigned short  WORD;
 typedef unsigned int    DWORD;
+typedef unsigned long long QWORD;
 
 typedef enum outFormat_e{
     OUT_SHRINK,
     OUT_AS_IS,
-    OUT_TRUECOLOR_UPSIDEDOWN
+    OUT_TRUECOLOR_UPSIDEDOWN,
+    OUT_DDS,
+    OUT_KTX2,
+    OUT_DDS_BC,
+    OUT_ATLAS
 }outFormat_t;
 
 
@@ -73,12 +84,12 @@ uint32      Size of colour table INCLUDING the 16-byte header
 typedef struct sshMainHdr_s{
     DWORD magic;            // "SHPS" (no null-termination character), or 0x53504853 (little endian)
     DWORD sshSize;          // total size
-    DWORD numResources;     // seems to be always 1, so we can assume that each Q3R .ssh file contains just one image
+    DWORD numResources;     // always 1 in Q3R's .ssh files, but other games pack several images in a file
     char fileName1[4];      // always "GIMX" (no null-termination character), apparently
 }sshMainHdr_t;
 
 typedef struct sshResEntry_s{
-    char fileName2[4];      // the first 4 characters of the same .ssh filename
+    char fileName2[4];      // the image's name; the first 4 characters of the same .ssh filename in Q3R
     DWORD dataOffset;
 }sshResEntry_t;
 
@@ -109,10 +120,10 @@ typedef struct sshResHdr_s{
     WORD  unk2;     // as above
     BYTE  unk3;     // as above
 
-    /* I'm putting this field here for documentation purposes only; I'm not interested in extracting
-    ** mipmap subimages, since it doesn't make any sense in my opinion (they're just lower resolution
-    ** versions of the main image.)
-    ** For those interested in extracting them for whatever reason, it works like this:
+    /* The tga outputs ignore the mipmap subimages, since they're just lower resolution versions
+    ** of the main image; the DDS and KTX2 outputs keep them, so that they can be uploaded to the GPU
+    ** along with the main image rather than being generated again.
+    ** It works like this:
     **
     ** The mipmap images' data is located immediately after the main image data; each mipmap's data
     ** is placed one after the other, with width and height being half the size of the
@@ -134,8 +145,8 @@ typedef struct sshResHdr_s{
             BYTE lastHdrByte_unk:   4;  // low nibble, seems to be always zero
             BYTE numMipMaps:        4;  // number of mipmaps after the main image, high nibble
         };
-        /* we'll use this field to extract the data represented in the bitfield struct above
-        ** (actually I'm completely ignoring this, as already stated.)
+        /* we'll use this field to extract the data represented in the bitfield struct above;
+        ** init_sshHandle() reads numMipMaps from it, to find the mipmaps the DDS and KTX2 outputs keep
         */
         BYTE numMipMaps_plus_unk;
     };
@@ -192,14 +203,17 @@ typedef struct sshFooterHdr_s{
 /* structure representing the .ssh file;
 ** each field/structure is placed in the same order as it appears
 ** inside the file.
+** The whole file is read into a scratch buffer (see sshScratch_t), and the image data and palette
+** point into it rather than being copied; the headers are small enough to be copied, so their fields
+** can be accessed regardless of their alignment in the file.
 */
 typedef struct sshHandle_s{
     sshMainHdr_t    mainHdr;
     sshResEntry_t   resEntry;
     sshResHdr_t     resHdr;
-    BYTE*           imgData;            // this needs to be malloc'd
+    BYTE*           imgData;            // inside the file buffer
     sshPaletteHdr_t paletteHdr;         // obviously this is ignored/absent for truecolor images
-    sshPixel32_t    palette[256];       // as above, also not necessarily 256 entries big
+    sshPixel32_t *  palette;            // as above (NULL); inside the file buffer, with room for 256 entries even if the file has less
     sshFooterHdr_t  footerHdr;
 
     /* some fields that are not present in the .ssh file, but which will make data computation
@@ -207,16 +221,36 @@ typedef struct sshHandle_s{
     */
     DWORD           imgDataSize;
     sshImgType_t    imgType;
+    DWORD           numMipMaps;             // the mipmaps actually present after the image data (see sshResHdr_t)
 
     DWORD           paletteNumEntriesRead;  // doesn't always match the number of entries reported in the palette header
+    DWORD           resIndex;               // which of the file's images this is
+    DWORD           numResources;           // how many images the file has room for (see sshMainHdr_t)
     const char *    sshPath;
+    msgLog_t *      log;                    // where error messages go (see msglog.h)
 
-    // tga-related buffers
-    FILE *          tga_fp;
-
-    BYTE *          tgaImgBuf;
-    BYTE *          tgaExtraBuf; // used for either RLE-encoded data, or paletted images converted to truecolor
+    outFile_t       outFile;            // the converted image's file
 
 }sshHandle_t;
 
+/* ssh and tga buffers reused across conversions rather than allocated for each image;
+** each thread converting images needs its own.
+*/
+typedef struct sshScratch_s{
+    BYTE *  sshBuf;         // the whole ssh file
+    DWORD   sshBufSize;
+    BYTE *  tileBuf;        // a tile of converted pixels
+    DWORD   tileBufSize;
+    BYTE *  rleBuf;         // a tile's RLE packets
+    DWORD   rleBufSize;
+    BYTE *  bcBuf;          // a tile's BC blocks
+    DWORD   bcBufSize;
+    BYTE *  planBuf;        // the optimal RLE packets' count bytes, one per pixel
+    DWORD   planBufSize;
+
+    // RLE encoding statistics of the images converted with these buffers
+    unsigned long long  rleBytes;
+    double              rleSeconds;
+}sshScratch_t;
+
 #endif // TYPES_H